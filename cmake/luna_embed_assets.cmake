@@ -0,0 +1,50 @@
+#
+#       _
+#   ___/_)
+#  (, /      ,_   _
+#    /   (_(_/ (_(_(_
+#  CX________________
+#                    )
+#
+#  Luna
+#  A web application and API framework in modern C++
+#
+#  Copyright © 2016–2018 D.E. Goodman-Wilson
+#
+
+# luna_embed_assets(<target> <name> <directory>)
+#
+# Compile every file under directory into target, as luna::embedded::<name>, declared in the generated header
+# <name>.h. Serve it with router::serve_embedded(). Files named like another file with .gz or .br on the end are served
+# in its place to clients that accept gzip or brotli. The assets are compiled again whenever one of them changes; run
+# CMake again after adding or removing files.
+function(luna_embed_assets TARGET NAME DIRECTORY)
+    get_filename_component(DIRECTORY ${DIRECTORY} ABSOLUTE)
+    set(OUTPUT_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/luna_embedded)
+    set(SOURCE ${OUTPUT_DIRECTORY}/${NAME}.cpp)
+    set(HEADER ${OUTPUT_DIRECTORY}/${NAME}.h)
+
+    # built along with luna, or installed next to it
+    if (TARGET luna_embed_assets)
+        set(TOOL $<TARGET_FILE:luna_embed_assets>)
+        set(TOOL_DEPENDENCY luna_embed_assets)
+    else ()
+        find_program(LUNA_EMBED_ASSETS_TOOL luna_embed_assets HINTS ${CONAN_BIN_DIRS})
+        if (NOT LUNA_EMBED_ASSETS_TOOL)
+            message(FATAL_ERROR "luna_embed_assets: can't find the luna_embed_assets tool")
+        endif ()
+        set(TOOL ${LUNA_EMBED_ASSETS_TOOL})
+        set(TOOL_DEPENDENCY ${LUNA_EMBED_ASSETS_TOOL})
+    endif ()
+
+    file(GLOB_RECURSE FILES LIST_DIRECTORIES false ${DIRECTORY}/*)
+    file(MAKE_DIRECTORY ${OUTPUT_DIRECTORY})
+    add_custom_command(
+            OUTPUT ${SOURCE} ${HEADER}
+            COMMAND ${TOOL} ${NAME} ${DIRECTORY} ${SOURCE} ${HEADER}
+            DEPENDS ${TOOL_DEPENDENCY} ${FILES}
+            COMMENT "Embedding ${DIRECTORY} as luna::embedded::${NAME}"
+            VERBATIM)
+    target_sources(${TARGET} PRIVATE ${SOURCE} ${HEADER})
+    target_include_directories(${TARGET} PRIVATE ${OUTPUT_DIRECTORY})
+endfunction()
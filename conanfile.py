@@ -28,7 +28,7 @@ class LunaConan(ConanFile):
                "build_luna_coverage": [True, False],
                "build_luna_examples": [True, False]}
     default_options = "shared=False", "build_luna_tests=False", "build_luna_coverage=False", "build_luna_examples=False"
-    requires = "libmicrohttpd/0.9.51@DEGoodmanWilson/stable", "libmime/[~= 0.1]@DEGoodmanWilson/stable", "base64/[~= 1.0]@DEGoodmanWilson/stable"
+    requires = "libmicrohttpd/0.9.51@DEGoodmanWilson/stable", "base64/[~= 1.0]@DEGoodmanWilson/stable"
     generators = "cmake"
     exports = ["*"] #TODO this isn't correct, we can improve this.
     description = "A web application and API framework in modern C++"
@@ -71,6 +71,8 @@ class LunaConan(ConanFile):
         self.copy(pattern="*.h", dst="include/luna", src="luna")
         self.copy(pattern="*.hpp", dst="include/luna", src="luna")
         self.copy(pattern="*.dll", dst="bin", src="bin", keep_path=False)
+        self.copy(pattern="luna_embed_assets*", dst="bin", src="bin", keep_path=False)
+        self.copy(pattern="*.cmake", dst="cmake", src="cmake")
         self.copy(pattern="*.lib", dst="lib", src="lib", keep_path=False)
         self.copy(pattern="*.a", dst="lib", src="lib", keep_path=False)
         self.copy(pattern="*.so*", dst="lib", src="lib", keep_path=False)
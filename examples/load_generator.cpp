@@ -0,0 +1,118 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+// A tiny load generator for comparing transports. It starts a server on the loopback interface using the transport
+// named on the command line, then hammers it with keep-alive connections for a few seconds and reports throughput.
+//
+//   load_generator [microhttpd|native] [connections] [seconds]
+
+#include <luna/luna.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace luna;
+
+static const uint16_t port = 8080;
+
+static void hammer(const std::atomic<bool> &done, std::atomic<uint64_t> &completed, std::atomic<uint64_t> &errors)
+{
+    const std::string request{"GET /endpoint HTTP/1.1\r\nHost: localhost\r\n\r\n"};
+    char buffer[4096];
+
+    while (!done)
+    {
+        auto fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+        {
+            ++errors;
+            close(fd);
+            continue;
+        }
+
+        // The endpoint's response fits in one read, so one read per request is enough to keep the connection in step
+        while (!done)
+        {
+            if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size()) ||
+                recv(fd, buffer, sizeof(buffer), 0) <= 0)
+            {
+                ++errors;
+                break;
+            }
+            ++completed;
+        }
+        close(fd);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string transport_name{argc > 1 ? argv[1] : "native"};
+    unsigned int connections = argc > 2 ? std::stoul(argv[2]) : 64;
+    unsigned int seconds = argc > 3 ? std::stoul(argv[3]) : 5;
+
+    auto kind = (transport_name == "microhttpd") ? server::transport_kind::MICROHTTPD : server::transport_kind::NATIVE;
+
+    server server{server::transport{kind},
+                  server::use_epoll_if_available{true},
+                  server::thread_pool_size{std::max(1U, std::thread::hardware_concurrency())}};
+    auto api{server.create_router("/")};
+    api->handle_request(request_method::GET, "/endpoint",
+                        [](auto request) -> response
+                        {
+                            return {"application/json", "{\"made_it\": true}"};
+                        });
+
+    if (!server.start_async(port))
+    {
+        std::cerr << "Could not start the " << transport_name << " server" << std::endl;
+        return 1;
+    }
+
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> completed{0};
+    std::atomic<uint64_t> errors{0};
+    std::vector<std::thread> clients;
+    for (unsigned int i = 0; i < connections; ++i)
+    {
+        clients.emplace_back(hammer, std::cref(done), std::ref(completed), std::ref(errors));
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds{seconds});
+    done = true;
+    for (auto &client : clients)
+    {
+        client.join();
+    }
+    server.stop();
+
+    std::cout << transport_name << ": " << connections << " connections, " << completed / seconds << " requests/s, "
+              << errors << " errors" << std::endl;
+}
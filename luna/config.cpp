@@ -14,6 +14,9 @@
 
 #include "luna/config.h"
 #include "luna/types.h"
+#include "luna/private/async_logger.h"
+#include <atomic>
+#include <memory>
 #include <sstream>
 #include <regex>
 
@@ -63,16 +66,95 @@ void reset_error_logger()
 }
 
 
+// Request threads take their own reference before pushing, so enabling or disabling async logging while requests are in
+// flight can't destroy the logger out from under them.
+std::shared_ptr<async_logger> async_logger_ = nullptr;
+
+std::atomic<log_level> log_level_{log_level::DEBUG};
+
+void set_log_level(log_level level)
+{
+    log_level_ = level;
+}
+
+log_level get_log_level()
+{
+    return log_level_;
+}
+
+bool error_log_enabled(log_level level)
+{
+    return error_logger_ && (level <= log_level_.load(std::memory_order_relaxed));
+}
+
 void access_log(const request &request, const response &response)
 {
-    if(access_logger_)
+    if(!access_logger_)
+        return;
+
+    if(auto logger = std::atomic_load(&async_logger_))
+        logger->push(request, response);
+    else
+        access_logger_(request, response);
+}
+
+void access_log(request &&request, response &&response)
+{
+    if(!access_logger_)
+        return;
+
+    if(auto logger = std::atomic_load(&async_logger_))
+        logger->push(std::move(request), std::move(response));
+    else
         access_logger_(request, response);
 }
 
 void error_log(luna::log_level level, const std::string &message)
 {
-    if(error_logger_)
+    if(!error_log_enabled(level))
+        return;
+
+    if(auto logger = std::atomic_load(&async_logger_))
+        logger->push(level, message);
+    else
         error_logger_(level, message);
 }
 
+void enable_async_logging(size_t queue_size)
+{
+    // the background thread looks the loggers up when it writes each record, so they can still be swapped out later
+    std::shared_ptr<async_logger> logger{new async_logger{queue_size,
+                                                          [](const request &request, const response &response)
+                                                          {
+                                                              if(access_logger_)
+                                                                  access_logger_(request, response);
+                                                          },
+                                                          [](log_level level, const std::string &message)
+                                                          {
+                                                              if(error_logger_)
+                                                                  error_logger_(level, message);
+                                                          }}};
+    if(auto previous = std::atomic_exchange(&async_logger_, logger))
+        previous->flush();
+}
+
+void disable_async_logging()
+{
+    // The background thread is joined, draining the queue, once the last request thread lets go of it
+    if(auto previous = std::atomic_exchange(&async_logger_, std::shared_ptr<async_logger>{}))
+        previous->flush();
+}
+
+void flush_logs()
+{
+    if(auto logger = std::atomic_load(&async_logger_))
+        logger->flush();
+}
+
+uint64_t dropped_log_records()
+{
+    auto logger = std::atomic_load(&async_logger_);
+    return logger ? logger->dropped() : 0;
+}
+
 } //namespace luna
@@ -31,6 +31,12 @@ enum class log_level
 };
 
 
+// Log messages less severe than LUNA_MAX_LOG_LEVEL are removed at compile time when logged through the LUNA_LOG_*
+// macros below. Set it to the numeric value of a log_level, for example -DLUNA_MAX_LOG_LEVEL=3 to drop DEBUG messages.
+#ifndef LUNA_MAX_LOG_LEVEL
+#define LUNA_MAX_LOG_LEVEL 4
+#endif
+
 using access_logger_cb = std::function<void(const request &request, const response &response)>;
 using error_logger_cb = std::function<void(log_level level, const std::string &string)>;
 
@@ -41,8 +47,60 @@ void set_error_logger(error_logger_cb logger);
 void reset_error_logger();
 
 void access_log(const request& request, const response &response);
+void access_log(request &&request, response &&response);
 void error_log(log_level level, const std::string &string);
 
+// Messages less severe than the runtime log level are discarded. Defaults to log_level::DEBUG, i.e. log everything.
+void set_log_level(log_level level);
+log_level get_log_level();
+
+// true if a message at this level would actually reach an error logger
+bool error_log_enabled(log_level level);
+
+// Hand log records off to a background thread instead of calling the loggers on the request thread. Records are queued
+// in a bounded ring of queue_size entries; when it is full, new records are dropped and counted instead of blocking.
+void enable_async_logging(size_t queue_size = 8192);
+void disable_async_logging(); // flushes any queued records first
+void flush_logs();
+uint64_t dropped_log_records();
+
 } //namespace luna
 
 std::string to_string(luna::log_level value);
+
+// Logging macros that only build the message if it is going to be written. The message expression is not evaluated at
+// all when the level is filtered out at runtime, and the whole statement is compiled out above LUNA_MAX_LOG_LEVEL.
+#define LUNA_LOG_(level, message) \
+do \
+{ \
+    if (::luna::error_log_enabled(level)) \
+    { \
+        ::luna::error_log(level, message); \
+    } \
+} while (0)
+
+#define LUNA_LOG_FATAL(message) LUNA_LOG_(::luna::log_level::FATAL, message)
+
+#if LUNA_MAX_LOG_LEVEL >= 1
+#define LUNA_LOG_ERROR(message) LUNA_LOG_(::luna::log_level::ERROR, message)
+#else
+#define LUNA_LOG_ERROR(message) do {} while (0)
+#endif
+
+#if LUNA_MAX_LOG_LEVEL >= 2
+#define LUNA_LOG_WARNING(message) LUNA_LOG_(::luna::log_level::WARNING, message)
+#else
+#define LUNA_LOG_WARNING(message) do {} while (0)
+#endif
+
+#if LUNA_MAX_LOG_LEVEL >= 3
+#define LUNA_LOG_INFO(message) LUNA_LOG_(::luna::log_level::INFO, message)
+#else
+#define LUNA_LOG_INFO(message) do {} while (0)
+#endif
+
+#if LUNA_MAX_LOG_LEVEL >= 4
+#define LUNA_LOG_DEBUG(message) LUNA_LOG_(::luna::log_level::DEBUG, message)
+#else
+#define LUNA_LOG_DEBUG(message) do {} while (0)
+#endif
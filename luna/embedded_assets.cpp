@@ -0,0 +1,37 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "embedded_assets.h"
+
+namespace luna
+{
+
+const embedded_asset *embedded_assets::find(const std::string &path) const
+{
+    if (count == 0)
+    {
+        return nullptr;
+    }
+
+    // a negative displacement is the slot itself, for buckets of one; otherwise it seeds the hash that finds the slot
+    auto displacement = displacements[embedded_assets_hash(path.data(), path.size(), 0) % count];
+    auto slot = displacement < 0 ? static_cast<size_t>(-displacement - 1) :
+                embedded_assets_hash(path.data(), path.size(), static_cast<uint32_t>(displacement)) % count;
+
+    // any path at all hashes to some slot, so make sure it's the right one
+    const auto &asset = assets[slot];
+    return path.compare(asset.path) == 0 ? &asset : nullptr;
+}
+
+} //namespace luna
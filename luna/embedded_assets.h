@@ -0,0 +1,68 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace luna
+{
+
+// A file compiled into the binary by the luna_embed_assets() CMake function
+struct embedded_asset
+{
+    const char *path; // relative to the directory that was embedded; a directory's index file is also there as the directory
+    const unsigned char *data;
+    size_t size;
+    const char *mime_type;
+    const char *etag;
+
+    // precompressed variants, from .gz and .br files next to the original; null if there weren't any
+    const unsigned char *gzip;
+    size_t gzip_size;
+    const unsigned char *brotli;
+    size_t brotli_size;
+};
+
+// A directory compiled into the binary, with a perfect hash table over its paths, so that finding an asset takes one
+// hash and one comparison. Serve it with router::serve_embedded().
+struct embedded_assets
+{
+    const embedded_asset *assets; // in the order of the table, so that an asset's slot is its index
+    const int32_t *displacements;
+    size_t count;
+
+    // path is relative to the directory that was embedded; null if there's no such asset
+    const embedded_asset *find(const std::string &path) const;
+};
+
+// The hash behind the table, with a seed for each bucket. The same function builds the table at compile time.
+constexpr uint32_t embedded_assets_hash(const char *key, size_t length, uint32_t seed)
+{
+    uint32_t hash{seed == 0 ? 0x811c9dc5u : seed};
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash = (hash ^ static_cast<unsigned char>(key[i])) * 0x01000193u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+} //namespace luna
@@ -16,5 +16,6 @@
 
 #include <luna/types.h>
 #include <luna/config.h>
+#include <luna/embedded_assets.h>
 #include <luna/router.h>
 #include <luna/server.h>
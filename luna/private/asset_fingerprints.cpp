@@ -0,0 +1,436 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/asset_fingerprints.h"
+#include "luna/config.h"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+namespace luna
+{
+
+// hex digits of the content hash that go into a fingerprinted name
+static const size_t fingerprint_length_{16};
+
+static int64_t modified_ns_(const struct stat &st)
+{
+#if defined(__APPLE__)
+    return static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+// Just enough JSON for a manifest: the string members of one object. Anything else is skipped over.
+class manifest_parser
+{
+public:
+    explicit manifest_parser(const std::string &json) : json_{json}, at_{0}
+    {}
+
+    bool parse(std::unordered_map<std::string, std::string> &members)
+    {
+        skip_space_();
+        if (!consume_('{'))
+        {
+            return false;
+        }
+        skip_space_();
+        if (consume_('}'))
+        {
+            return true;
+        }
+        for (;;)
+        {
+            std::string key;
+            skip_space_();
+            if (!string_(key))
+            {
+                return false;
+            }
+            skip_space_();
+            if (!consume_(':'))
+            {
+                return false;
+            }
+            skip_space_();
+            if (peek_() == '"')
+            {
+                std::string value;
+                if (!string_(value))
+                {
+                    return false;
+                }
+                members[key] = value;
+            }
+            else if (!skip_value_())
+            {
+                return false;
+            }
+            skip_space_();
+            if (consume_('}'))
+            {
+                return true;
+            }
+            if (!consume_(','))
+            {
+                return false;
+            }
+        }
+    }
+
+private:
+    char peek_() const
+    { return at_ < json_.size() ? json_[at_] : '\0'; }
+
+    bool consume_(char c)
+    {
+        if (peek_() != c)
+        {
+            return false;
+        }
+        ++at_;
+        return true;
+    }
+
+    void skip_space_()
+    {
+        while (at_ < json_.size() && std::isspace(static_cast<unsigned char>(json_[at_])))
+        {
+            ++at_;
+        }
+    }
+
+    bool string_(std::string &out)
+    {
+        if (!consume_('"'))
+        {
+            return false;
+        }
+        while (at_ < json_.size())
+        {
+            auto c = json_[at_++];
+            if (c == '"')
+            {
+                return true;
+            }
+            if (c != '\\')
+            {
+                out.push_back(c);
+                continue;
+            }
+            if (at_ >= json_.size())
+            {
+                return false;
+            }
+            c = json_[at_++];
+            switch (c)
+            {
+                case 'b':
+                    out.push_back('\b');
+                    break;
+                case 'f':
+                    out.push_back('\f');
+                    break;
+                case 'n':
+                    out.push_back('\n');
+                    break;
+                case 'r':
+                    out.push_back('\r');
+                    break;
+                case 't':
+                    out.push_back('\t');
+                    break;
+                case 'u':
+                {
+                    if (at_ + 4 > json_.size())
+                    {
+                        return false;
+                    }
+                    auto code = std::strtoul(json_.substr(at_, 4).c_str(), nullptr, 16);
+                    at_ += 4;
+                    // as UTF-8; paths outside the basic multilingual plane are beyond what a manifest needs
+                    if (code < 0x80)
+                    {
+                        out.push_back(static_cast<char>(code));
+                    }
+                    else if (code < 0x800)
+                    {
+                        out.push_back(static_cast<char>(0xc0 | (code >> 6)));
+                        out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+                    }
+                    else
+                    {
+                        out.push_back(static_cast<char>(0xe0 | (code >> 12)));
+                        out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+                        out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+                    }
+                    break;
+                }
+                default: // ", \ and /
+                    out.push_back(c);
+            }
+        }
+        return false;
+    }
+
+    bool skip_value_()
+    {
+        auto c = peek_();
+        if (c == '"')
+        {
+            std::string ignored;
+            return string_(ignored);
+        }
+        if (c == '{' || c == '[')
+        {
+            auto close = c == '{' ? '}' : ']';
+            ++at_;
+            skip_space_();
+            if (consume_(close))
+            {
+                return true;
+            }
+            for (;;)
+            {
+                skip_space_();
+                if (c == '{')
+                {
+                    std::string ignored;
+                    if (!string_(ignored))
+                    {
+                        return false;
+                    }
+                    skip_space_();
+                    if (!consume_(':'))
+                    {
+                        return false;
+                    }
+                    skip_space_();
+                }
+                if (!skip_value_())
+                {
+                    return false;
+                }
+                skip_space_();
+                if (consume_(close))
+                {
+                    return true;
+                }
+                if (!consume_(','))
+                {
+                    return false;
+                }
+            }
+        }
+        // a number, true, false or null
+        auto start = at_;
+        while (at_ < json_.size() && (std::isalnum(static_cast<unsigned char>(json_[at_])) || json_[at_] == '-' ||
+                                      json_[at_] == '+' || json_[at_] == '.'))
+        {
+            ++at_;
+        }
+        return at_ > start;
+    }
+
+    const std::string &json_;
+    size_t at_;
+};
+
+asset_fingerprints::asset_fingerprints(std::string root, std::string manifest) :
+        root_{std::move(root)},
+        manifest_{std::move(manifest)}
+{
+    if (!manifest_.empty())
+    {
+        reload();
+    }
+}
+
+void asset_fingerprints::reload()
+{
+    auto mapping = read_manifest_();
+    std::lock_guard<std::mutex> guard{lock_};
+    if (mapping)
+    {
+        mapping_ = std::move(mapping);
+    }
+    else if (!mapping_)
+    {
+        mapping_ = std::make_shared<const asset_fingerprints::mapping>(); // nothing is fingerprinted
+    }
+}
+
+std::shared_ptr<const asset_fingerprints::mapping> asset_fingerprints::read_manifest_() const
+{
+    std::ifstream in{manifest_};
+    std::ostringstream json;
+    json << in.rdbuf();
+    std::unordered_map<std::string, std::string> members;
+    if (!in || !manifest_parser{json.str()}.parse(members))
+    {
+        LUNA_LOG_ERROR("Can't read the asset manifest " + manifest_);
+        return nullptr;
+    }
+
+    auto mapping = std::make_shared<asset_fingerprints::mapping>();
+    for (const auto &member : members)
+    {
+        auto fingerprinted = find_under_root_(member.second);
+        if (fingerprinted.empty())
+        {
+            LUNA_LOG_WARNING("The asset manifest names " + member.second + ", which isn't under " + root_);
+            continue;
+        }
+        auto name = member.first;
+        name.erase(0, name.find_first_not_of('/'));
+        mapping->names[name] = fingerprinted;
+        mapping->fingerprinted.emplace(fingerprinted);
+    }
+    LUNA_LOG_DEBUG("Read " + std::to_string(mapping->names.size()) + " fingerprinted assets from " + manifest_);
+    return mapping;
+}
+
+std::string asset_fingerprints::find_under_root_(std::string path) const
+{
+    // published somewhere else entirely, perhaps, or with a public path in front: drop whatever comes before the
+    // file, until what's left is under the root
+    auto scheme = path.find("://");
+    if (scheme != std::string::npos)
+    {
+        auto host_end = path.find('/', scheme + 3);
+        path.erase(0, host_end == std::string::npos ? path.size() : host_end);
+    }
+    path.erase(0, path.find_first_not_of('/'));
+
+    while (!path.empty())
+    {
+        struct stat st;
+        if (stat((root_ + "/" + path).c_str(), &st) == 0 && S_ISREG(st.st_mode))
+        {
+            return path;
+        }
+        auto slash = path.find('/');
+        if (slash == std::string::npos)
+        {
+            break;
+        }
+        path.erase(0, slash + 1);
+    }
+    return {};
+}
+
+std::string asset_fingerprints::fingerprinted(const std::string &name)
+{
+    std::unique_lock<std::mutex> lock{lock_};
+    if (mapping_)
+    {
+        auto found = mapping_->names.find(name);
+        return found == mapping_->names.end() ? std::string{} : found->second;
+    }
+    lock.unlock();
+
+    auto path = root_ + "/" + name;
+    struct stat st;
+    if (name.empty() || stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return {};
+    }
+    auto same_file = [&st](const hashed &was)
+    {
+        return was.size == static_cast<uint64_t>(st.st_size) && was.modified == modified_ns_(st) &&
+               was.inode == static_cast<uint64_t>(st.st_ino);
+    };
+
+    lock.lock();
+    auto known = hashes_.find(name);
+    if (known != hashes_.end() && same_file(known->second))
+    {
+        return known->second.fingerprinted;
+    }
+    lock.unlock();
+
+    // FNV-1a, which is plenty to tell one version of a file from the next
+    std::ifstream in{path, std::ios::binary};
+    uint64_t hash{0xcbf29ce484222325ull};
+    char buffer[16 * 1024];
+    while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0)
+    {
+        for (std::streamsize i = 0; i < in.gcount(); ++i)
+        {
+            hash = (hash ^ static_cast<unsigned char>(buffer[i])) * 0x100000001b3ull;
+        }
+    }
+    char hex[fingerprint_length_ + 1];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+
+    // app.js becomes app.<hash>.js, and README becomes README.<hash>
+    auto fingerprinted = name;
+    auto slash = name.rfind('/');
+    auto dot = name.rfind('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash) ||
+        dot == (slash == std::string::npos ? 0 : slash + 1))
+    {
+        dot = name.size();
+    }
+    fingerprinted.insert(dot, std::string{"."} + hex);
+
+    lock.lock();
+    hashes_[name] = hashed{static_cast<uint64_t>(st.st_size), modified_ns_(st), static_cast<uint64_t>(st.st_ino),
+                           fingerprinted};
+    return fingerprinted;
+}
+
+OPT_NS::optional<std::string> asset_fingerprints::resolve(const std::string &path)
+{
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        if (mapping_)
+        {
+            if (mapping_->fingerprinted.count(path))
+            {
+                return path;
+            }
+            return OPT_NS::nullopt;
+        }
+    }
+
+    // take the fingerprint out of the name, and see whether it's still the fingerprint of that file
+    auto slash = path.rfind('/');
+    auto start = slash == std::string::npos ? 0 : slash + 1;
+    for (auto dot = path.find('.', start); dot != std::string::npos; dot = path.find('.', dot + 1))
+    {
+        auto end = dot + 1 + fingerprint_length_;
+        if (end > path.size() || (end < path.size() && path[end] != '.'))
+        {
+            continue;
+        }
+        if (path.find_first_not_of("0123456789abcdef", dot + 1) < end)
+        {
+            continue;
+        }
+        auto name = path.substr(0, dot) + path.substr(end);
+        if (fingerprinted(name) == path)
+        {
+            return name;
+        }
+    }
+    return OPT_NS::nullopt;
+}
+
+} //namespace luna
@@ -0,0 +1,82 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include <luna/optional.hpp>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace luna
+{
+
+// Which files in a tree served by router::serve_files have fingerprinted names, that change whenever their contents do,
+// so that they can be cached forever. Either a manifest says, mapping each asset's name to its fingerprinted name as
+// webpack's manifest.json does, or the files are fingerprinted here, by hashing their contents: app.js is then also
+// app.<hash>.js, for as long as its contents hash to that.
+//
+// All paths are relative to the root of the tree.
+class asset_fingerprints
+{
+public:
+    // With an empty manifest, fingerprint files by their contents
+    asset_fingerprints(std::string root, std::string manifest);
+
+    // Read the manifest again, after it has changed
+    void reload();
+
+    const std::string &manifest() const
+    { return manifest_; }
+
+    // The fingerprinted path for name, or empty if it hasn't one
+    std::string fingerprinted(const std::string &name);
+
+    // If path is a fingerprinted path, the file to serve for it
+    OPT_NS::optional<std::string> resolve(const std::string &path);
+
+private:
+    struct mapping
+    {
+        std::unordered_map<std::string, std::string> names; // name to fingerprinted path
+        std::unordered_set<std::string> fingerprinted; // and back again, such as it's needed
+    };
+
+    // a file's fingerprint, and which version of the file it's the fingerprint of
+    struct hashed
+    {
+        uint64_t size;
+        int64_t modified; // ns since the epoch
+        uint64_t inode;
+        std::string fingerprinted;
+    };
+
+    std::shared_ptr<const mapping> read_manifest_() const;
+
+    // the path to a file under the root with contents, given a path from the manifest that may begin with where it's
+    // published
+    std::string find_under_root_(std::string path) const;
+
+    std::string root_;
+    std::string manifest_;
+
+    std::mutex lock_;
+    std::shared_ptr<const mapping> mapping_; // from the manifest
+    std::unordered_map<std::string, hashed> hashes_; // otherwise
+};
+
+} //namespace luna
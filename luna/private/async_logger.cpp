@@ -0,0 +1,264 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/async_logger.h"
+#include <chrono>
+
+namespace luna
+{
+
+// How many records the consumer hands to the loggers before looking at the ring again
+static const size_t batch_size_ = 256;
+
+// Upper bound on how long a record can sit in the ring before the consumer notices it, should a wakeup be missed
+static const std::chrono::milliseconds idle_wait_{50};
+
+static size_t round_up_to_power_of_two_(size_t value)
+{
+    size_t size = 2;
+    while (size < value)
+    {
+        size <<= 1;
+    }
+    return size;
+}
+
+async_logger::async_logger(size_t queue_size, access_logger_cb access_logger, error_logger_cb error_logger) :
+        access_logger_{std::move(access_logger)},
+        error_logger_{std::move(error_logger)},
+        ring_(round_up_to_power_of_two_(queue_size)),
+        mask_{ring_.size() - 1},
+        enqueue_pos_{0},
+        dequeue_pos_{0},
+        written_{0},
+        dropped_{0},
+        dropped_reported_{0},
+        stopping_{false},
+        consumer_sleeping_{false}
+{
+    for (size_t i = 0; i < ring_.size(); ++i)
+    {
+        ring_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    consumer_ = std::thread{&async_logger::run_, this};
+}
+
+async_logger::~async_logger()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stopping_ = true;
+    }
+    wake_cv_.notify_one();
+
+    if (consumer_.joinable())
+    {
+        consumer_.join(); // the consumer drains whatever is left in the ring before exiting
+    }
+}
+
+bool async_logger::push(const request &request, const response &response)
+{
+    // Copy what a log line can use, but not the bodies, which can be large and would sit in the ring until written
+    record rec;
+    rec.access.reset(new access_record);
+    auto &logged_request = rec.access->request;
+    logged_request.start = request.start;
+    logged_request.end = request.end;
+    logged_request.ip_address = request.ip_address;
+    logged_request.method = request.method;
+    logged_request.path = request.path;
+    logged_request.http_version = request.http_version;
+    logged_request.matches = request.matches;
+    logged_request.params = request.params;
+    logged_request.headers = request.headers;
+    auto &logged_response = rec.access->response;
+    logged_response.status_code = response.status_code;
+    logged_response.headers = response.headers;
+    logged_response.content_type = response.content_type;
+    logged_response.file = response.file;
+    return push_(std::move(rec));
+}
+
+bool async_logger::push(request &&request, response &&response)
+{
+    // moving the bodies along would be free, but they'd be held in the ring until written
+    request.body = std::string{};
+    response.content = std::string{};
+    record rec;
+    rec.access.reset(new access_record{std::move(request), std::move(response)});
+    return push_(std::move(rec));
+}
+
+bool async_logger::push(log_level level, const std::string &message)
+{
+    record rec;
+    rec.level = level;
+    rec.message = message;
+    return push_(std::move(rec));
+}
+
+void async_logger::flush()
+{
+    auto target = enqueue_pos_.load(std::memory_order_acquire);
+
+    std::unique_lock<std::mutex> lock{mutex_};
+    wake_cv_.notify_one();
+    written_cv_.wait(lock, [this, target]
+    {
+        return written_.load(std::memory_order_acquire) >= target;
+    });
+}
+
+uint64_t async_logger::dropped() const
+{
+    return dropped_.load(std::memory_order_relaxed);
+}
+
+bool async_logger::push_(record &&rec)
+{
+    // Bounded MPMC ring after Dmitry Vyukov. Each cell carries a sequence number that tells producers whether the
+    // cell is free for the current lap, so claiming a slot is a single CAS and the consumer never takes a lock.
+    cell *target;
+    auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        target = &ring_[pos & mask_];
+        auto seq = target->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0)
+        {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // ring is full, drop the record rather than stall the request thread
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+
+    target->data = std::move(rec);
+    target->sequence.store(pos + 1, std::memory_order_release);
+
+    if (consumer_sleeping_.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        wake_cv_.notify_one();
+    }
+
+    return true;
+}
+
+bool async_logger::pop_(record &rec)
+{
+    auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+    auto &source = ring_[pos & mask_];
+    auto seq = source.sequence.load(std::memory_order_acquire);
+    if (seq != pos + 1)
+    {
+        return false; // empty, or a producer has claimed the cell but not finished writing it yet
+    }
+
+    rec = std::move(source.data);
+    source.sequence.store(pos + mask_ + 1, std::memory_order_release);
+    dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+    return true;
+}
+
+void async_logger::run_()
+{
+    std::vector<record> batch;
+    batch.reserve(batch_size_);
+
+    for (;;)
+    {
+        record rec;
+        while (batch.size() < batch_size_ && pop_(rec))
+        {
+            batch.emplace_back(std::move(rec));
+        }
+
+        if (batch.empty())
+        {
+            std::unique_lock<std::mutex> lock{mutex_};
+            if (stopping_ && written_.load() == enqueue_pos_.load())
+            {
+                return;
+            }
+
+            consumer_sleeping_.store(true, std::memory_order_release);
+            auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+            if (ring_[pos & mask_].sequence.load(std::memory_order_acquire) != pos + 1)
+            {
+                wake_cv_.wait_for(lock, idle_wait_);
+            }
+            consumer_sleeping_.store(false, std::memory_order_release);
+            continue;
+        }
+
+        for (auto &entry : batch)
+        {
+            write_(entry);
+        }
+
+        written_.fetch_add(batch.size(), std::memory_order_release);
+        batch.clear();
+
+        auto dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != dropped_reported_ && error_logger_)
+        {
+            error_logger_(log_level::WARNING,
+                          "Log queue overflowed, " + std::to_string(dropped - dropped_reported_) + " log records dropped");
+            dropped_reported_ = dropped;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            written_cv_.notify_all();
+        }
+    }
+}
+
+void async_logger::write_(record &rec)
+{
+    // a misbehaving logger must not take the logging thread down with it
+    try
+    {
+        if (rec.access)
+        {
+            if (access_logger_)
+            {
+                access_logger_(rec.access->request, rec.access->response);
+            }
+        }
+        else if (error_logger_)
+        {
+            error_logger_(rec.level, rec.message);
+        }
+    }
+    catch (...)
+    {
+    }
+}
+
+} //namespace luna
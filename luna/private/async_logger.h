@@ -0,0 +1,108 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include <luna/config.h>
+#include <luna/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace luna
+{
+
+// A background logging pipeline. Request threads push compact log records into a bounded, lock-free
+// multi-producer/single-consumer ring, and a single background thread drains the ring in batches and hands each record
+// to the user-supplied access and error loggers. When the ring is full, new records are dropped and counted rather than
+// making the request thread wait; the drop count is reported through the error logger once space frees up again.
+class async_logger
+{
+public:
+    async_logger(size_t queue_size, access_logger_cb access_logger, error_logger_cb error_logger);
+
+    ~async_logger();
+
+    async_logger(const async_logger &) = delete;
+    async_logger &operator=(const async_logger &) = delete;
+
+    bool push(const request &request, const response &response);
+
+    bool push(request &&request, response &&response);
+
+    bool push(log_level level, const std::string &message);
+
+    // Blocks until every record pushed before this call has been handed to the loggers
+    void flush();
+
+    uint64_t dropped() const;
+
+private:
+    struct access_record
+    {
+        luna::request request;
+        luna::response response;
+    };
+
+    // One slot in the ring. Error records only need the level and message; access records carry the finished request
+    // and response, moved in rather than copied whenever the caller is done with them, and always without the request
+    // body or response content.
+    struct record
+    {
+        std::unique_ptr<access_record> access;
+        log_level level;
+        std::string message;
+    };
+
+    struct cell
+    {
+        std::atomic<size_t> sequence;
+        record data;
+    };
+
+    bool push_(record &&rec);
+
+    bool pop_(record &rec);
+
+    void run_();
+
+    void write_(record &rec);
+
+    access_logger_cb access_logger_;
+    error_logger_cb error_logger_;
+
+    std::vector<cell> ring_;
+    size_t mask_;
+
+    // producers and the consumer live on separate cache lines
+    alignas(64) std::atomic<size_t> enqueue_pos_;
+    alignas(64) std::atomic<size_t> dequeue_pos_;
+    std::atomic<size_t> written_;
+
+    std::atomic<uint64_t> dropped_;
+    uint64_t dropped_reported_;
+
+    std::atomic<bool> stopping_;
+    std::atomic<bool> consumer_sleeping_;
+    std::mutex mutex_;
+    std::condition_variable wake_cv_;
+    std::condition_variable written_cv_;
+
+    std::thread consumer_;
+};
+
+} //namespace luna
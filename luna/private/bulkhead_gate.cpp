@@ -0,0 +1,222 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/bulkhead_gate.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+namespace luna
+{
+
+// Who is inside the bulkhead, and who is waiting to get in
+class bulkhead_gate::slots
+{
+public:
+    slots(unsigned int max_concurrent, unsigned int max_queued, std::chrono::milliseconds max_wait) :
+            max_concurrent_{max_concurrent}, max_queued_{max_queued}, max_wait_{max_wait}, in_flight_{0}
+    {}
+
+    bool enter(clock::time_point deadline)
+    {
+        std::unique_lock<std::mutex> lock{lock_};
+
+        // nobody jumps the queue, even when a slot has just come free
+        if (in_flight_ < max_concurrent_ && waiters_.empty())
+        {
+            ++in_flight_;
+            return true;
+        }
+
+        if (max_wait_.count() <= 0 || waiters_.size() >= max_queued_)
+        {
+            return false;
+        }
+
+        auto until = clock::now() + max_wait_;
+        if (deadline < until)
+        {
+            until = deadline;
+        }
+
+        waiter self;
+        waiters_.push_back(&self);
+        self.granted_changed.wait_until(lock, until, [&self]
+        { return self.granted; });
+
+        if (!self.granted)
+        {
+            waiters_.erase(std::find(waiters_.begin(), waiters_.end(), &self));
+            return false;
+        }
+
+        // leave() handed us its slot, and already counted it
+        return true;
+    }
+
+    void leave()
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        if (waiters_.empty())
+        {
+            --in_flight_;
+            return;
+        }
+
+        // pass the slot straight to whoever has waited longest
+        auto next = waiters_.front();
+        waiters_.pop_front();
+        next->granted = true;
+        next->granted_changed.notify_one();
+    }
+
+    unsigned int in_flight()
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        return in_flight_;
+    }
+
+    size_t queued()
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        return waiters_.size();
+    }
+
+private:
+    struct waiter
+    {
+        std::condition_variable granted_changed;
+        bool granted{false};
+    };
+
+    const unsigned int max_concurrent_;
+    const unsigned int max_queued_;
+    const std::chrono::milliseconds max_wait_;
+
+    std::mutex lock_;
+    unsigned int in_flight_;
+    std::deque<waiter *> waiters_; // first come, first served
+};
+
+bulkhead_gate::bulkhead_gate(const router::bulkhead &config) :
+        slots_{std::make_shared<slots>(std::max(1U, config.max_concurrent), config.max_queued, config.max_wait)},
+        rejection_{503, {{"Retry-After", std::to_string(config.retry_after.count())}}, "text/plain",
+                   "Service Unavailable"}
+{
+    if (config.own_threads)
+    {
+        threads_.reset(new handler_pool{std::max(1U, config.max_concurrent)});
+    }
+}
+
+bulkhead_gate::~bulkhead_gate() = default;
+
+bulkhead_gate::permit &bulkhead_gate::permit::operator=(permit &&other) noexcept
+{
+    if (this != &other)
+    {
+        if (slots_)
+        {
+            slots_->leave();
+        }
+        slots_ = std::move(other.slots_);
+    }
+    return *this;
+}
+
+bulkhead_gate::permit::~permit()
+{
+    if (slots_)
+    {
+        slots_->leave();
+    }
+}
+
+bulkhead_gate::permit bulkhead_gate::enter(clock::time_point deadline)
+{
+    return slots_->enter(deadline) ? permit{slots_} : permit{};
+}
+
+unsigned int bulkhead_gate::in_flight()
+{
+    return slots_->in_flight();
+}
+
+size_t bulkhead_gate::queued()
+{
+    return slots_->queued();
+}
+
+OPT_NS::optional<response> bulkhead_gate::run(const router::endpoint_handler_cb &callback,
+                                              const request &request,
+                                              std::vector<permit> permits)
+{
+    // shared with the task, which may outlive this call
+    struct outcome
+    {
+        std::mutex lock;
+        std::condition_variable done_changed;
+        bool done{false};
+        OPT_NS::optional<luna::response> answer;
+        std::exception_ptr error;
+    };
+    auto result = std::make_shared<outcome>();
+    auto held = std::make_shared<std::vector<permit>>(std::move(permits));
+
+    threads_->post([result, held, callback, request]
+                   {
+                       OPT_NS::optional<response> response;
+                       std::exception_ptr error;
+                       try
+                       {
+                           response = callback(request);
+                       }
+                       catch (...)
+                       {
+                           error = std::current_exception();
+                       }
+                       held->clear(); // let the next request in as soon as possible
+
+                       std::lock_guard<std::mutex> guard{result->lock};
+                       result->answer = std::move(response);
+                       result->error = error;
+                       result->done = true;
+                       result->done_changed.notify_one();
+                   });
+
+    auto done = [&result]
+    { return result->done; };
+    auto token = request.cancellation;
+    std::unique_lock<std::mutex> lock{result->lock};
+    if (token.deadline() == clock::time_point::max())
+    {
+        result->done_changed.wait(lock, done);
+    }
+    else if (!result->done_changed.wait_until(lock, token.deadline(), done))
+    {
+        token.cancel(); // the handler's copy of the request shares the token, so it can tell it's wasting its time
+        return OPT_NS::nullopt;
+    }
+
+    if (result->error)
+    {
+        std::rethrow_exception(result->error);
+    }
+    return std::move(result->answer);
+}
+
+} //namespace luna
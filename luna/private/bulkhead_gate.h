@@ -0,0 +1,93 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include "luna/router.h"
+#include "luna/private/handler_pool.h"
+#include <memory>
+#include <vector>
+
+namespace luna
+{
+
+// Enforces a router::bulkhead: at most max_concurrent requests inside at once, and a queue of its own, served in the
+// order requests arrived, for the ones waiting to get in. With own_threads, handlers run on the bulkhead's threads.
+class bulkhead_gate
+{
+public:
+    using clock = cancellation_token::clock;
+
+    explicit bulkhead_gate(const router::bulkhead &config);
+
+    ~bulkhead_gate();
+
+    class slots;
+
+    // A slot inside the bulkhead, given back when the permit is destroyed. A permit keeps track of its slots on its
+    // own, so it may outlive the gate it came from.
+    class permit
+    {
+    public:
+        permit() = default;
+
+        explicit permit(std::shared_ptr<slots> slots) : slots_{std::move(slots)}
+        {}
+
+        permit(permit &&other) noexcept = default;
+
+        permit &operator=(permit &&other) noexcept;
+
+        permit(const permit &) = delete;
+
+        permit &operator=(const permit &) = delete;
+
+        ~permit();
+
+        explicit operator bool() const
+        { return slots_ != nullptr; }
+
+    private:
+        std::shared_ptr<slots> slots_;
+    };
+
+    // Wait for a slot, for no longer than the bulkhead's max_wait and never past deadline. An empty permit means the
+    // request should be turned away with rejection().
+    permit enter(clock::time_point deadline);
+
+    bool has_threads() const
+    { return threads_ != nullptr; }
+
+    // Run callback on one of the bulkhead's threads, holding on to permits until it returns, and wait for the answer
+    // until the request's deadline. Past the deadline the request is cancelled and nullopt returned straight away,
+    // while the handler carries on with its own copy of the request. Exceptions from the handler are rethrown here.
+    OPT_NS::optional<response> run(const router::endpoint_handler_cb &callback,
+                                   const request &request,
+                                   std::vector<permit> permits);
+
+    const response &rejection() const
+    { return rejection_; }
+
+    unsigned int in_flight();
+
+    size_t queued();
+
+private:
+    std::shared_ptr<slots> slots_;
+    response rejection_;
+
+    std::unique_ptr<handler_pool> threads_; // only with own_threads
+};
+
+} //namespace luna
@@ -18,7 +18,7 @@ namespace luna
 {
 
 cacheable_response::cacheable_response(struct MHD_Response *mhd_response, luna::status_code status_code)
-        : mhd_response{mhd_response}, status_code{status_code}, cached{false}
+        : mhd_response{mhd_response}, status_code{status_code}, cached{false}, watched{false}
 {
 }
 
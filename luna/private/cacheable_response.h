@@ -18,6 +18,8 @@
 #include <microhttpd.h>
 #include <unordered_map>
 #include <chrono>
+#include <memory>
+#include <string>
 
 namespace luna
 {
@@ -29,6 +31,11 @@ struct cacheable_response
 
     bool cached;
     std::chrono::system_clock::time_point time_cached;
+    bool watched; // changes to the file are reported, so it needn't expire from the fd cache
+
+    // The buffer mhd_response was made from, for responses MHD doesn't copy the body of. Whoever queues the response
+    // must keep this alive until the request is complete.
+    std::shared_ptr<const std::string> content;
 
     cacheable_response(struct MHD_Response *mhd_response, luna::status_code status_code);
 
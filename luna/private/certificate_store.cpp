@@ -0,0 +1,189 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/certificate_store.h"
+
+#if defined(LUNA_HAVE_KTLS)
+
+#include <gnutls/x509.h>
+#include <cctype>
+
+namespace luna
+{
+
+static std::string lowercase_(std::string name)
+{
+    for (auto &c : name)
+    {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    // a fully-qualified name is the same name
+    if (!name.empty() && name.back() == '.')
+    {
+        name.pop_back();
+    }
+    return name;
+}
+
+// The DNS names the first certificate in a PEM chain is for
+static bool names_(const std::string &cert, std::vector<std::string> &names, std::string &error)
+{
+    gnutls_x509_crt_t crt;
+    auto result = gnutls_x509_crt_init(&crt);
+    if (result == GNUTLS_E_SUCCESS)
+    {
+        gnutls_datum_t datum{const_cast<unsigned char *>(reinterpret_cast<const unsigned char *>(cert.data())),
+                             static_cast<unsigned int>(cert.size())};
+        result = gnutls_x509_crt_import(crt, &datum, GNUTLS_X509_FMT_PEM);
+        if (result < 0)
+        {
+            gnutls_x509_crt_deinit(crt);
+        }
+    }
+    if (result < 0)
+    {
+        error = std::string{"can't read the certificate: "} + gnutls_strerror(result);
+        return false;
+    }
+
+    char name[256];
+    for (unsigned int i = 0;; ++i)
+    {
+        size_t size = sizeof(name);
+        result = gnutls_x509_crt_get_subject_alt_name(crt, i, name, &size, nullptr);
+        if (result == GNUTLS_E_REQUESTED_DATA_NOT_AVAILABLE)
+        {
+            break;
+        }
+        if (result == GNUTLS_SAN_DNSNAME)
+        {
+            names.emplace_back(lowercase_({name, size}));
+        }
+    }
+    if (names.empty())
+    {
+        size_t size = sizeof(name);
+        if (gnutls_x509_crt_get_dn_by_oid(crt, GNUTLS_OID_X520_COMMON_NAME, 0, 0, name, &size) == GNUTLS_E_SUCCESS)
+        {
+            names.emplace_back(lowercase_({name, size}));
+        }
+    }
+    gnutls_x509_crt_deinit(crt);
+    return true;
+}
+
+certificate_store::certificate::~certificate()
+{
+    if (credentials_)
+    {
+        gnutls_certificate_free_credentials(credentials_);
+    }
+}
+
+bool certificate_store::load(const std::vector<server::https_certificate> &certificates, std::string &error)
+{
+    if (certificates.empty())
+    {
+        error = "there are no certificates";
+        return false;
+    }
+
+    auto loaded = std::make_shared<table>();
+    for (const auto &https_certificate : certificates)
+    {
+        auto entry = std::make_shared<certificate>();
+        auto result = gnutls_certificate_allocate_credentials(&entry->credentials_);
+        if (result == GNUTLS_E_SUCCESS)
+        {
+            const auto &cert = https_certificate.cert;
+            const auto &key = https_certificate.key;
+            gnutls_datum_t cert_datum{const_cast<unsigned char *>(reinterpret_cast<const unsigned char *>(cert.data())),
+                                      static_cast<unsigned int>(cert.size())};
+            gnutls_datum_t key_datum{const_cast<unsigned char *>(reinterpret_cast<const unsigned char *>(key.data())),
+                                     static_cast<unsigned int>(key.size())};
+            result = gnutls_certificate_set_x509_key_mem2(entry->credentials_, &cert_datum, &key_datum,
+                                                          GNUTLS_X509_FMT_PEM,
+                                                          https_certificate.key_password.empty()
+                                                          ? nullptr : https_certificate.key_password.c_str(), 0);
+        }
+        if (result < 0)
+        {
+            error = std::string{"can't load the certificate and key: "} + gnutls_strerror(result);
+            return false;
+        }
+        if (!names_(https_certificate.cert, entry->names_, error))
+        {
+            return false;
+        }
+
+        // where two certificates are for the same name, the first one wins
+        for (const auto &name : entry->names_)
+        {
+            if (name.compare(0, 2, "*.") == 0)
+            {
+                loaded->wildcards.emplace(name.substr(2), entry);
+            }
+            else
+            {
+                loaded->names.emplace(name, entry);
+            }
+        }
+        if (!loaded->fallback)
+        {
+            loaded->fallback = entry;
+        }
+    }
+
+    std::lock_guard<std::mutex> guard{lock_};
+    table_ = std::move(loaded);
+    return true;
+}
+
+std::shared_ptr<const certificate_store::certificate> certificate_store::find(const std::string &server_name) const
+{
+    std::shared_ptr<const table> current;
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        current = table_;
+    }
+    if (!current)
+    {
+        return nullptr;
+    }
+    if (server_name.empty())
+    {
+        return current->fallback;
+    }
+
+    auto name = lowercase_(server_name);
+    auto found = current->names.find(name);
+    if (found != current->names.end())
+    {
+        return found->second;
+    }
+    auto dot = name.find('.');
+    if (dot != std::string::npos)
+    {
+        found = current->wildcards.find(name.substr(dot + 1));
+        if (found != current->wildcards.end())
+        {
+            return found->second;
+        }
+    }
+    return current->fallback;
+}
+
+} //namespace luna
+
+#endif // LUNA_HAVE_KTLS
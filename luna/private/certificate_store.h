@@ -0,0 +1,78 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include "luna/server.h"
+
+#if defined(LUNA_HAVE_KTLS)
+
+#include <gnutls/gnutls.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace luna
+{
+
+// The certificates an HTTPS server chooses between by the name each client asks for (SNI). They're loaded up front, and
+// indexed by the DNS names in their subject alternative names (or by their common name, if they have none): exact names
+// in one hash table, and wildcards (*.example.com, which stand for exactly one more label) by the domain they're under
+// in another. The first certificate is for clients that ask for no name, or for one that none of them match.
+//
+// load() replaces them all at once, and handshakes already under way keep the certificate they found.
+class certificate_store
+{
+public:
+    class certificate
+    {
+    public:
+        ~certificate();
+
+        gnutls_certificate_credentials_t credentials() const
+        { return credentials_; }
+
+        const std::vector<std::string> &names() const
+        { return names_; }
+
+    private:
+        friend class certificate_store;
+
+        gnutls_certificate_credentials_t credentials_{nullptr};
+        std::vector<std::string> names_;
+    };
+
+    // False, with the reason in error and the certificates as they were, if any of them won't load
+    bool load(const std::vector<server::https_certificate> &certificates, std::string &error);
+
+    // Null until something's been loaded
+    std::shared_ptr<const certificate> find(const std::string &server_name) const;
+
+private:
+    struct table
+    {
+        std::unordered_map<std::string, std::shared_ptr<const certificate>> names;
+        std::unordered_map<std::string, std::shared_ptr<const certificate>> wildcards; // by the domain after "*."
+        std::shared_ptr<const certificate> fallback;
+    };
+
+    mutable std::mutex lock_;
+    std::shared_ptr<const table> table_;
+};
+
+} //namespace luna
+
+#endif // LUNA_HAVE_KTLS
@@ -0,0 +1,169 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/concurrency_limiter.h"
+#include <algorithm>
+#include <cmath>
+
+namespace luna
+{
+
+// how many samples the long-run latency is averaged over
+static const double long_window_ = 600.0;
+
+// how much slower than usual requests may get before the limit starts to shrink
+static const double tolerance_ = 1.5;
+
+// how far each sample moves the limit towards where the gradient says it should be
+static const double smoothing_ = 0.2;
+
+// the share of the limit each priority may use before it is turned away
+static double headroom_(router::priority_level priority)
+{
+    switch (priority)
+    {
+        case router::priority_level::LOW:
+            return 0.75;
+        case router::priority_level::NORMAL:
+            return 1.0;
+        case router::priority_level::HIGH:
+            return 1.25;
+        case router::priority_level::CRITICAL:
+        default:
+            return 0.0; // never turned away
+    }
+}
+
+concurrency_limiter::permit::permit(permit &&other) noexcept :
+        limiter_{other.limiter_}, admitted_{other.admitted_}, start_{other.start_}
+{
+    other.limiter_ = nullptr;
+    other.admitted_ = false;
+}
+
+concurrency_limiter::permit &concurrency_limiter::permit::operator=(permit &&other) noexcept
+{
+    if (this != &other)
+    {
+        if (limiter_ && admitted_)
+        {
+            limiter_->release_(clock::duration{0}, false);
+        }
+        limiter_ = other.limiter_;
+        admitted_ = other.admitted_;
+        start_ = other.start_;
+        other.limiter_ = nullptr;
+        other.admitted_ = false;
+    }
+    return *this;
+}
+
+concurrency_limiter::permit::~permit()
+{
+    if (limiter_ && admitted_)
+    {
+        limiter_->release_(clock::duration{0}, false);
+    }
+}
+
+void concurrency_limiter::permit::release()
+{
+    if (limiter_ && admitted_)
+    {
+        limiter_->release_(clock::now() - start_, true);
+    }
+    limiter_ = nullptr;
+}
+
+concurrency_limiter::concurrency_limiter(unsigned int initial_limit, unsigned int min_limit, unsigned int max_limit) :
+        in_flight_{0},
+        limit_{initial_limit},
+        min_limit_{std::max(1U, min_limit)},
+        max_limit_{std::max(min_limit, max_limit)},
+        estimated_limit_{static_cast<double>(initial_limit)},
+        long_latency_{0.0},
+        samples_{0}
+{}
+
+concurrency_limiter::permit concurrency_limiter::try_acquire(router::priority_level priority)
+{
+    auto allowed = static_cast<unsigned int>(limit_ * headroom_(priority));
+    auto current = in_flight_.load();
+    do
+    {
+        if (priority != router::priority_level::CRITICAL && current >= std::max(1U, allowed))
+        {
+            return permit{this, false};
+        }
+    }
+    while (!in_flight_.compare_exchange_weak(current, current + 1));
+
+    return permit{this, true};
+}
+
+bool concurrency_limiter::priority_matters() const
+{
+    return in_flight_ >= static_cast<unsigned int>(limit_ * headroom_(router::priority_level::LOW));
+}
+
+void concurrency_limiter::release_(clock::duration latency, bool sample)
+{
+    auto in_flight = in_flight_--;
+    if (!sample)
+    {
+        return;
+    }
+
+    // A server that's nowhere near its limit says nothing about whether the limit is too low
+    if (in_flight * 2 < limit_)
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock{lock_, std::try_to_lock};
+    if (lock)
+    {
+        update_(std::chrono::duration<double>(latency).count());
+    }
+}
+
+void concurrency_limiter::update_(double latency)
+{
+    if (latency <= 0.0)
+    {
+        return;
+    }
+
+    // a plain average while warming up, then an exponential one
+    ++samples_;
+    auto weight = 1.0 / std::min(static_cast<double>(samples_), long_window_);
+    long_latency_ += (latency - long_latency_) * weight;
+
+    // If requests have been much faster than the long-run average for a while, the average is stale: pull it down
+    // faster than the window alone would, or the limit could grow without bound
+    if (long_latency_ / latency > 2.0)
+    {
+        long_latency_ *= 0.95;
+    }
+
+    auto gradient = std::max(0.5, std::min(1.0, tolerance_ * long_latency_ / latency));
+    auto target = estimated_limit_ * gradient + std::sqrt(estimated_limit_);
+    estimated_limit_ = estimated_limit_ * (1.0 - smoothing_) + target * smoothing_;
+    estimated_limit_ = std::max(static_cast<double>(min_limit_),
+                                std::min(static_cast<double>(max_limit_), estimated_limit_));
+
+    limit_ = static_cast<unsigned int>(estimated_limit_);
+}
+
+} //namespace luna
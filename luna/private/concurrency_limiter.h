@@ -0,0 +1,101 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include "luna/router.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+namespace luna
+{
+
+// Decides how many requests may be in flight at once, and adapts that limit to how long they're taking, so that a
+// server past saturation turns excess work away immediately instead of letting every request queue up behind it.
+//
+// The limit follows the gradient between the long-run latency and the latest sample: while requests take about as long
+// as they usually do, the limit grows by roughly its own square root; once they start taking longer (because they're
+// queueing for CPU, a database, or a lock), it shrinks in proportion. Lower priority requests are turned away first.
+class concurrency_limiter
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    concurrency_limiter(unsigned int initial_limit, unsigned int min_limit, unsigned int max_limit);
+
+    // Permission for one request to run. Releasing it records how long the request took; a permit that is simply
+    // destroyed (because the request was abandoned) gives back its slot without a latency sample.
+    class permit
+    {
+    public:
+        permit() : limiter_{nullptr}, admitted_{false}
+        {}
+
+        permit(concurrency_limiter *limiter, bool admitted) :
+                limiter_{limiter}, admitted_{admitted}, start_{clock::now()}
+        {}
+
+        permit(permit &&other) noexcept;
+
+        permit &operator=(permit &&other) noexcept;
+
+        permit(const permit &) = delete;
+
+        permit &operator=(const permit &) = delete;
+
+        ~permit();
+
+        explicit operator bool() const
+        { return admitted_; }
+
+        void release();
+
+    private:
+        concurrency_limiter *limiter_; // null when there's no limit to count against
+        bool admitted_;
+        clock::time_point start_;
+    };
+
+    permit try_acquire(router::priority_level priority);
+
+    // Below this many requests in flight, everything is admitted whatever its priority, so there's no need to find out
+    // what the priority is
+    bool priority_matters() const;
+
+    unsigned int limit() const
+    { return limit_; }
+
+    unsigned int in_flight() const
+    { return in_flight_; }
+
+private:
+    void release_(clock::duration latency, bool sample);
+
+    void update_(double latency);
+
+    std::atomic<unsigned int> in_flight_;
+    std::atomic<unsigned int> limit_;
+
+    unsigned int min_limit_;
+    unsigned int max_limit_;
+
+    // only touched while holding lock_; a sample that finds it held is simply skipped
+    std::mutex lock_;
+    double estimated_limit_;
+    double long_latency_;
+    size_t samples_;
+};
+
+} //namespace luna
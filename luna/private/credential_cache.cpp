@@ -0,0 +1,187 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/credential_cache.h"
+#include <random>
+
+namespace luna
+{
+
+static inline uint64_t rotl_(uint64_t x, int b)
+{
+    return (x << b) | (x >> (64 - b));
+}
+
+static inline void sipround_(uint64_t &v0, uint64_t &v1, uint64_t &v2, uint64_t &v3)
+{
+    v0 += v1;
+    v1 = rotl_(v1, 13);
+    v1 ^= v0;
+    v0 = rotl_(v0, 32);
+    v2 += v3;
+    v3 = rotl_(v3, 16);
+    v3 ^= v2;
+    v0 += v3;
+    v3 = rotl_(v3, 21);
+    v3 ^= v0;
+    v2 += v1;
+    v1 = rotl_(v1, 17);
+    v1 ^= v2;
+    v2 = rotl_(v2, 32);
+}
+
+uint64_t siphash_2_4(uint64_t k0, uint64_t k1, const void *data, size_t length)
+{
+    auto in = static_cast<const uint8_t *>(data);
+
+    uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+    uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+    auto end = in + (length - (length % 8));
+    for (; in != end; in += 8)
+    {
+        uint64_t m = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            m |= static_cast<uint64_t>(in[i]) << (8 * i);
+        }
+        v3 ^= m;
+        sipround_(v0, v1, v2, v3);
+        sipround_(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    uint64_t b = static_cast<uint64_t>(length) << 56;
+    for (size_t i = 0; i < length % 8; ++i)
+    {
+        b |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    v3 ^= b;
+    sipround_(v0, v1, v2, v3);
+    sipround_(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    sipround_(v0, v1, v2, v3);
+    sipround_(v0, v1, v2, v3);
+    sipround_(v0, v1, v2, v3);
+    sipround_(v0, v1, v2, v3);
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+bool constant_time_equals(const void *a, const void *b, size_t length)
+{
+    auto x = static_cast<const volatile uint8_t *>(a);
+    auto y = static_cast<const volatile uint8_t *>(b);
+    uint8_t diff = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        diff |= x[i] ^ y[i];
+    }
+    return diff == 0;
+}
+
+credential_cache::credential_cache(std::chrono::milliseconds ttl, size_t max_entries) :
+        ttl_{ttl},
+        max_entries_{max_entries},
+        generation_{0}
+{
+    std::random_device random;
+    for (auto &key : keys_)
+    {
+        key = (static_cast<uint64_t>(random()) << 32) ^ random();
+    }
+}
+
+bool credential_cache::contains(const std::string &credentials)
+{
+    auto index = index_(credentials);
+    auto check = tag_(credentials);
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto found = entries_.find(index);
+    if (found == entries_.end())
+    {
+        return false;
+    }
+
+    if (std::chrono::steady_clock::now() >= found->second.expires)
+    {
+        entries_.erase(found);
+        return false;
+    }
+
+    return constant_time_equals(check.data(), found->second.check.data(), sizeof(tag));
+}
+
+void credential_cache::insert(const std::string &credentials)
+{
+    if (max_entries_ == 0)
+    {
+        return;
+    }
+
+    auto index = index_(credentials);
+    auto check = tag_(credentials);
+    auto expires = std::chrono::steady_clock::now() + ttl_;
+
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    // make room, skipping over order entries whose cache entry was since replaced or expired
+    while (entries_.size() >= max_entries_ && !order_.empty())
+    {
+        auto oldest = order_.front();
+        order_.pop_front();
+        auto found = entries_.find(oldest.first);
+        if (found != entries_.end() && found->second.generation == oldest.second)
+        {
+            entries_.erase(found);
+        }
+    }
+
+    auto generation = ++generation_;
+    entries_[index] = entry{check, expires, generation};
+    order_.emplace_back(index, generation);
+
+    // entries removed on expiry leave their order records behind; don't let those pile up
+    if (order_.size() > 2 * max_entries_)
+    {
+        std::deque<std::pair<uint64_t, uint64_t>> live;
+        for (const auto &o : order_)
+        {
+            auto found = entries_.find(o.first);
+            if (found != entries_.end() && found->second.generation == o.second)
+            {
+                live.push_back(o);
+            }
+        }
+        order_.swap(live);
+    }
+}
+
+uint64_t credential_cache::index_(const std::string &credentials) const
+{
+    return siphash_2_4(keys_[0], keys_[1], credentials.data(), credentials.length());
+}
+
+credential_cache::tag credential_cache::tag_(const std::string &credentials) const
+{
+    return {siphash_2_4(keys_[2], keys_[3], credentials.data(), credentials.length()),
+            siphash_2_4(keys_[4], keys_[5], credentials.data(), credentials.length())};
+}
+
+} //namespace luna
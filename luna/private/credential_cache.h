@@ -0,0 +1,74 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace luna
+{
+
+// A bounded cache of credentials that have already been verified, so that an expensive password check (bcrypt, argon2,
+// a round trip to an identity provider...) only has to run once per client per TTL rather than on every request.
+//
+// Credentials are never stored. Entries are indexed by one keyed hash of the credential string and checked against a
+// second, independently keyed 128-bit tag, using a constant-time comparison. The keys are random per cache, so the
+// hashes are useless outside this process.
+class credential_cache
+{
+public:
+    credential_cache(std::chrono::milliseconds ttl, size_t max_entries);
+
+    // true if these exact credentials were verified less than one TTL ago
+    bool contains(const std::string &credentials);
+
+    void insert(const std::string &credentials);
+
+private:
+    using tag = std::array<uint64_t, 2>;
+
+    struct entry
+    {
+        tag check;
+        std::chrono::steady_clock::time_point expires;
+        uint64_t generation;
+    };
+
+    uint64_t index_(const std::string &credentials) const;
+
+    tag tag_(const std::string &credentials) const;
+
+    std::chrono::milliseconds ttl_;
+    size_t max_entries_;
+
+    std::array<uint64_t, 6> keys_;
+
+    std::mutex mutex_;
+    std::unordered_map<uint64_t, entry> entries_;
+    // insertion order, for evicting the oldest entry once the cache is full
+    std::deque<std::pair<uint64_t, uint64_t>> order_;
+    uint64_t generation_;
+};
+
+// Compares two equal-length byte ranges without bailing out at the first difference
+bool constant_time_equals(const void *a, const void *b, size_t length);
+
+uint64_t siphash_2_4(uint64_t k0, uint64_t k1, const void *data, size_t length);
+
+} //namespace luna
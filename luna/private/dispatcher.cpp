@@ -0,0 +1,277 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/dispatcher.h"
+#include "luna/private/shared_memory_store.h"
+#include <cerrno>
+#include <cstdlib>
+#include <future>
+
+namespace luna
+{
+
+std::shared_ptr<router> dispatcher::create_router(std::string route_base)
+{
+    std::shared_ptr<router> r{new router{route_base}};
+    std::lock_guard<std::mutex> lock{lock_};
+    r->set_response_cache_(response_cache_);
+    r->set_renderer_(response_renderer_);
+    routers_.emplace_back(r);
+    return r;
+}
+
+concurrency_limiter::permit dispatcher::admit(request_method method, const std::string &path)
+{
+    if (!limiter_)
+    {
+        return concurrency_limiter::permit{nullptr, true};
+    }
+
+    // Finding the endpoint costs a few regex matches, so only do it once the priority could make a difference
+    auto priority = router::priority_level::NORMAL;
+    if (limiter_->priority_matters())
+    {
+        std::unique_lock<std::mutex> ulock{lock_};
+        auto routers = routers_;
+        ulock.unlock();
+
+        for (auto &router : routers)
+        {
+            auto endpoint_priority = router->priority_for(method, path);
+            if (endpoint_priority)
+            {
+                priority = *endpoint_priority;
+                break;
+            }
+        }
+    }
+
+    auto permit = limiter_->try_acquire(priority);
+    if (!permit)
+    {
+        LUNA_LOG_DEBUG("Shedding request for " + path + "; concurrency limit is " + std::to_string(limiter_->limit()));
+    }
+    return permit;
+}
+
+response dispatcher::dispatch(request &request)
+{
+    // shared, because the leader may still be inside set_value() when we wake up and go
+    auto ready = std::make_shared<std::promise<luna::response>>();
+    auto waiting = ready->get_future();
+    auto response = dispatch(request, [ready](const luna::response &response)
+    {
+        ready->set_value(response);
+    });
+    if (response)
+    {
+        return std::move(*response);
+    }
+    return waiting.get();
+}
+
+OPT_NS::optional<response> dispatcher::dispatch(request &request, singleflight::ready_cb on_ready)
+{
+    start_deadline_(request);
+
+    // Handlers run outside the lock, on a snapshot of the routers, so requests on different threads don't queue
+    // up behind one another.
+    std::unique_lock<std::mutex> ulock{lock_};
+    auto routers = routers_;
+    ulock.unlock();
+
+    std::string key;
+    for (auto &router : routers)
+    {
+        auto router_key = router->coalesce_key_for(request);
+        if (router_key)
+        {
+            key = std::move(*router_key);
+            break;
+        }
+    }
+
+    if (key.empty())
+    {
+        return route_(request, routers);
+    }
+
+    // on_ready may hand the request on as soon as it's called, which can be before join() has even returned, so a
+    // request that waits mustn't be touched afterwards
+    if (!flights_.join(key, request.cancellation.deadline(), std::move(on_ready)))
+    {
+        LUNA_LOG_DEBUG("Waiting for an identical request to finish");
+        return OPT_NS::nullopt;
+    }
+
+    luna::response response;
+    try
+    {
+        response = route_(request, routers);
+    }
+    catch (...)
+    {
+        flights_.land(key, {500, "text/plain", "Internal error"});
+        throw;
+    }
+    flights_.land(key, response);
+    return response;
+}
+
+response dispatcher::route_(request &request, const std::vector<std::shared_ptr<router>> &routers)
+{
+    //iterate through the handlers. Could stand being parallelized, I suppose?
+    OPT_NS::optional<response> response;
+
+    for (auto &router : routers)
+    {
+        response = router->process_request(request);
+        if (response)
+        {
+            break;
+        }
+    }
+
+    if (!response)
+    {
+        // if there was no response generated by a request handler, make us a 404.
+        response = luna::response{404, "text/html; charset=utf-8", "<html><h1>404 Not Found</h1></html>"};
+
+        if (not_found_handler_)
+        {
+            not_found_handler_(request, *response);
+        }
+    }
+
+    // TODO this is the point where we will want to include middlewares in the future.
+
+    return std::move(*response);
+}
+
+void dispatcher::set_not_found_handler(server::not_found_handler_cb handler)
+{
+    // At the moment, there are multiple places where we might generate a 404:
+    //  Here, when no router responds to a request
+    //  In the response renderer, when a file isn't found.
+    // So for now, set this handler in both places.
+    // TODO also, we should do something similar for 500 errors, to generate traces and such
+    not_found_handler_ = handler;
+    response_renderer_->set_option(handler);
+}
+
+void dispatcher::set_option(server::request_deadline value)
+{
+    request_deadline_ = value;
+}
+
+void dispatcher::set_option(const server::request_deadline_header &value)
+{
+    request_deadline_header_ = value;
+}
+
+void dispatcher::set_option(const server::adaptive_concurrency_limit &value)
+{
+    limiter_.reset(new concurrency_limiter{value.initial_limit, value.min_limit, value.max_limit});
+    shed_response_.headers["Retry-After"] = std::to_string(value.retry_after.count());
+}
+
+void dispatcher::set_option(const server::response_cache &value)
+{
+    auto read = value.read;
+    auto write = value.write;
+    if (!value.shared_memory_path.empty())
+    {
+        auto store = std::make_shared<shared_memory_store>(value.shared_memory_path, value.shared_memory_size);
+        if (*store)
+        {
+            read = [store](const std::string &key)
+            {
+                return store->read(key);
+            };
+            write = [store](const std::string &key, std::shared_ptr<std::string> value)
+            {
+                store->write(key, *value);
+            };
+        }
+        else
+        {
+            LUNA_LOG_WARNING("Caching responses in this process only");
+        }
+    }
+
+    std::unique_ptr<persistent_store> persistent;
+    if (!value.persistent_path.empty())
+    {
+        persistent.reset(new persistent_store{value.persistent_path, value.persistent_size});
+    }
+
+    std::lock_guard<std::mutex> lock{lock_};
+    response_cache_ = std::make_shared<tiered_response_cache>(value.max_size, std::move(read), std::move(write),
+                                                              std::move(persistent));
+    for (auto &router : routers_)
+    {
+        router->set_response_cache_(response_cache_);
+    }
+}
+
+void dispatcher::start()
+{
+    flights_.open();
+
+    std::lock_guard<std::mutex> lock{lock_};
+    if (response_cache_)
+    {
+        response_cache_->load();
+    }
+}
+
+void dispatcher::stop()
+{
+    flights_.close(shed_response_);
+}
+
+std::shared_ptr<tiered_response_cache> dispatcher::response_cache()
+{
+    std::lock_guard<std::mutex> lock{lock_};
+    return response_cache_;
+}
+
+void dispatcher::start_deadline_(request &request)
+{
+    // the clock starts when the request arrived, not now; time spent reading the body counts
+    auto arrived = cancellation_token::to_clock(request.start);
+
+    if (request_deadline_.count() > 0)
+    {
+        request.cancellation.set_deadline(arrived + request_deadline_);
+    }
+
+    if (!request_deadline_header_.empty())
+    {
+        auto header = request.headers.find(request_deadline_header_);
+        if (header != request.headers.end())
+        {
+            char *end;
+            errno = 0;
+            auto budget = std::strtol(header->second.c_str(), &end, 10);
+            // anything longer than a day is as good as no limit, and might overflow the clock
+            if (!errno && end != header->second.c_str() && !*end && budget >= 0 && budget < 86400000)
+            {
+                request.cancellation.limit_deadline(arrived + std::chrono::milliseconds{budget});
+            }
+        }
+    }
+}
+
+} //namespace luna
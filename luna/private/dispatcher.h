@@ -0,0 +1,108 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include "luna/router.h"
+#include "luna/server.h"
+#include "luna/private/concurrency_limiter.h"
+#include "luna/private/response_renderer.h"
+#include "luna/private/singleflight.h"
+#include "luna/private/tiered_response_cache.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace luna
+{
+
+// Everything that happens to a request between the network and the wire that doesn't care which network engine is in
+// use: finding a router to handle it, falling back to a 404, and rendering the result. Transport engines own the
+// sockets, build luna::request objects, and hand them here.
+class dispatcher
+{
+public:
+    dispatcher() = default;
+
+    dispatcher(const dispatcher &) = delete;
+    dispatcher &operator=(const dispatcher &) = delete;
+
+    std::shared_ptr<router> create_router(std::string route_base);
+
+    // Admission control, before anything else is done with a request. A permit that converts to false means the request
+    // should be answered with shed_response() and nothing more. Hold on to the permit until the handler is done.
+    concurrency_limiter::permit admit(request_method method, const std::string &path);
+
+    // 503 Service Unavailable, with Retry-After. The same every time, so transports can prepare it ahead of time.
+    const response &shed_response() const
+    { return shed_response_; }
+
+    // Run the request through the routers; produces a 404 if none of them will handle it
+    response dispatch(request &request);
+
+    // Like dispatch(), except that a request that can share the response of an identical one already being handled
+    // (see router::coalesce) returns nullopt straight away, and on_ready is called with the response once it's ready,
+    // on whichever thread produced it, or with a 503 once the request's deadline passes. Transports that can put a
+    // connection aside use this, so that waiting requests don't hold on to a thread.
+    OPT_NS::optional<response> dispatch(request &request, singleflight::ready_cb on_ready);
+
+    response_renderer &renderer()
+    { return *response_renderer_; }
+
+    void set_not_found_handler(server::not_found_handler_cb handler);
+
+    void set_option(server::request_deadline value);
+
+    void set_option(const server::request_deadline_header &value);
+
+    void set_option(const server::adaptive_concurrency_limit &value);
+
+    void set_option(const server::response_cache &value);
+
+    // The server is up; anything that was waiting for that can begin
+    void start();
+
+    // The server is going down. Requests waiting on an identical one's response are answered with shed_response()
+    // now, rather than left with a transport that's going away, and until start(), requests don't wait on each other.
+    void stop();
+
+    // null without the response_cache option
+    std::shared_ptr<tiered_response_cache> response_cache();
+
+private:
+    void start_deadline_(request &request);
+
+    response route_(request &request, const std::vector<std::shared_ptr<router>> &routers);
+
+    std::mutex lock_;
+    std::vector<std::shared_ptr<router>> routers_;
+    // shared with the routers, which tell it about changes to the files they serve
+    std::shared_ptr<response_renderer> response_renderer_{std::make_shared<response_renderer>()};
+
+    // custom 404 renderer
+    server::not_found_handler_cb not_found_handler_;
+
+    std::chrono::milliseconds request_deadline_{0};
+    std::string request_deadline_header_;
+
+    singleflight flights_;
+
+    // shared with every router
+    std::shared_ptr<tiered_response_cache> response_cache_;
+
+    std::unique_ptr<concurrency_limiter> limiter_;
+    response shed_response_{503, {{"Retry-After", "1"}}, "text/plain", "Service Unavailable"};
+};
+
+} //namespace luna
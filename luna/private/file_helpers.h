@@ -13,21 +13,13 @@
 //
 
 #include <string>
-#include <unordered_map>
+#include <vector>
 
 #pragma once
 
 namespace luna
 {
 
-static const std::unordered_map <std::string, std::string> mime_types
-        {
-                {"html", "text/html"},
-                {"htm", "text/html"},
-                {"css", "text/css"},
-                {"js",  "text/javascript"},
-        };
-
 static const std::vector <std::string> index_filenames
         {
                 "index.html",
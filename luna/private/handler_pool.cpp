@@ -0,0 +1,72 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/handler_pool.h"
+#include <algorithm>
+
+namespace luna
+{
+
+handler_pool::handler_pool(unsigned int size) :
+        stopping_{false}
+{
+    for (unsigned int i = 0; i < std::max(1U, size); ++i)
+    {
+        threads_.emplace_back(&handler_pool::work_, this);
+    }
+}
+
+handler_pool::~handler_pool()
+{
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        stopping_ = true;
+    }
+    tasks_changed_.notify_all();
+    for (auto &thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+void handler_pool::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        tasks_.emplace_back(std::move(task));
+    }
+    tasks_changed_.notify_one();
+}
+
+void handler_pool::work_()
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock{lock_};
+            tasks_changed_.wait(lock, [this]
+            { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty())
+            {
+                return; // stopping, and nothing left to do
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+} //namespace luna
@@ -0,0 +1,52 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace luna
+{
+
+// A fixed set of threads that run tasks in the order they were posted. Request handlers run here when whoever received
+// the request has better things to do with its own thread than wait for them.
+class handler_pool
+{
+public:
+    explicit handler_pool(unsigned int size);
+
+    // Runs whatever is still queued, then joins the threads
+    ~handler_pool();
+
+    handler_pool(const handler_pool &) = delete;
+    handler_pool &operator=(const handler_pool &) = delete;
+
+    void post(std::function<void()> task);
+
+private:
+    void work_();
+
+    std::vector<std::thread> threads_;
+    std::mutex lock_;
+    std::condition_variable tasks_changed_;
+    std::deque<std::function<void()>> tasks_;
+    bool stopping_;
+};
+
+} //namespace luna
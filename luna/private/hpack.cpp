@@ -0,0 +1,586 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/hpack.h"
+#include <array>
+
+namespace luna
+{
+
+// RFC 7541 §4.1: every entry costs its name and value plus this much
+static const size_t entry_overhead_ = 32;
+
+static const size_t default_table_size_ = 4096;
+
+// RFC 7541 Appendix A
+static const std::array<hpack_field, 61> static_table_{{
+        {":authority", ""},
+        {":method", "GET"},
+        {":method", "POST"},
+        {":path", "/"},
+        {":path", "/index.html"},
+        {":scheme", "http"},
+        {":scheme", "https"},
+        {":status", "200"},
+        {":status", "204"},
+        {":status", "206"},
+        {":status", "304"},
+        {":status", "400"},
+        {":status", "404"},
+        {":status", "500"},
+        {"accept-charset", ""},
+        {"accept-encoding", "gzip, deflate"},
+        {"accept-language", ""},
+        {"accept-ranges", ""},
+        {"accept", ""},
+        {"access-control-allow-origin", ""},
+        {"age", ""},
+        {"allow", ""},
+        {"authorization", ""},
+        {"cache-control", ""},
+        {"content-disposition", ""},
+        {"content-encoding", ""},
+        {"content-language", ""},
+        {"content-length", ""},
+        {"content-location", ""},
+        {"content-range", ""},
+        {"content-type", ""},
+        {"cookie", ""},
+        {"date", ""},
+        {"etag", ""},
+        {"expect", ""},
+        {"expires", ""},
+        {"from", ""},
+        {"host", ""},
+        {"if-match", ""},
+        {"if-modified-since", ""},
+        {"if-none-match", ""},
+        {"if-range", ""},
+        {"if-unmodified-since", ""},
+        {"last-modified", ""},
+        {"link", ""},
+        {"location", ""},
+        {"max-forwards", ""},
+        {"proxy-authenticate", ""},
+        {"proxy-authorization", ""},
+        {"range", ""},
+        {"referer", ""},
+        {"refresh", ""},
+        {"retry-after", ""},
+        {"server", ""},
+        {"set-cookie", ""},
+        {"strict-transport-security", ""},
+        {"transfer-encoding", ""},
+        {"user-agent", ""},
+        {"vary", ""},
+        {"via", ""},
+        {"www-authenticate", ""},
+}};
+
+struct huffman_code
+{
+    uint32_t code;
+    uint8_t bits;
+};
+
+// RFC 7541 Appendix B; the last entry is EOS
+static const huffman_code huffman_codes_[257] = {
+        {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+        {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+        {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+        {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+        {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+        {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+        {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10},
+        {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+        {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+        {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+        {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+        {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+        {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7},
+        {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+        {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+        {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+        {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+        {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+        {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+        {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+        {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+        {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+        {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+        {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+        {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+        {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+        {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+        {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+        {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+        {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+        {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+        {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+        {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+        {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+        {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+        {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+        {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+        {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+        {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+        {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+        {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+        {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+        {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+};
+
+// A binary trie over the codes above, built the first time anything is decoded
+struct huffman_trie
+{
+    std::vector<std::array<int16_t, 2>> next;
+    std::vector<int16_t> symbol;
+
+    huffman_trie() : next(1, {{0, 0}}), symbol(1, -1)
+    {
+        for (int16_t sym = 0; sym < 257; ++sym)
+        {
+            size_t node = 0;
+            for (int bit = huffman_codes_[sym].bits - 1; bit >= 0; --bit)
+            {
+                auto b = (huffman_codes_[sym].code >> bit) & 1;
+                if (!next[node][b])
+                {
+                    next[node][b] = static_cast<int16_t>(next.size());
+                    next.push_back({{0, 0}});
+                    symbol.push_back(-1);
+                }
+                node = static_cast<size_t>(next[node][b]);
+            }
+            symbol[node] = sym;
+        }
+    }
+};
+
+void huffman_encode(const std::string &in, std::string &out)
+{
+    uint64_t bits = 0;
+    unsigned int count = 0;
+    for (unsigned char c : in)
+    {
+        bits = (bits << huffman_codes_[c].bits) | huffman_codes_[c].code;
+        count += huffman_codes_[c].bits;
+        while (count >= 8)
+        {
+            count -= 8;
+            out.push_back(static_cast<char>(bits >> count));
+        }
+    }
+    if (count)
+    {
+        // pad with the most significant bits of EOS, which are all ones
+        out.push_back(static_cast<char>((bits << (8 - count)) | (0xff >> count)));
+    }
+}
+
+size_t huffman_encoded_length(const std::string &in)
+{
+    size_t bits = 0;
+    for (unsigned char c : in)
+    {
+        bits += huffman_codes_[c].bits;
+    }
+    return (bits + 7) / 8;
+}
+
+bool huffman_decode(const uint8_t *data, size_t length, std::string &out)
+{
+    static const huffman_trie trie;
+
+    size_t node = 0;
+    unsigned int pending_bits = 0; // since the last complete symbol
+    bool pending_all_ones = true;
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        for (int bit = 7; bit >= 0; --bit)
+        {
+            auto b = (data[i] >> bit) & 1;
+            node = static_cast<size_t>(trie.next[node][b]);
+            if (!node)
+            {
+                return false;
+            }
+
+            auto sym = trie.symbol[node];
+            if (sym < 0)
+            {
+                ++pending_bits;
+                pending_all_ones = pending_all_ones && b;
+                continue;
+            }
+            if (sym == 256)
+            {
+                return false; // EOS must not appear in the string itself
+            }
+            out.push_back(static_cast<char>(sym));
+            node = 0;
+            pending_bits = 0;
+            pending_all_ones = true;
+        }
+    }
+
+    // whatever is left over must be padding: fewer than eight bits of EOS
+    return pending_bits < 8 && pending_all_ones;
+}
+
+static void encode_integer_(uint64_t value, unsigned int prefix_bits, uint8_t first_byte, std::string &out)
+{
+    auto max_prefix = (1U << prefix_bits) - 1;
+    if (value < max_prefix)
+    {
+        out.push_back(static_cast<char>(first_byte | value));
+        return;
+    }
+
+    out.push_back(static_cast<char>(first_byte | max_prefix));
+    value -= max_prefix;
+    while (value >= 128)
+    {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static bool decode_integer_(const uint8_t *&p, const uint8_t *end, unsigned int prefix_bits, uint64_t &value)
+{
+    if (p == end)
+    {
+        return false;
+    }
+
+    auto max_prefix = (1U << prefix_bits) - 1;
+    value = *p++ & max_prefix;
+    if (value < max_prefix)
+    {
+        return true;
+    }
+
+    for (unsigned int shift = 0; p < end; shift += 7)
+    {
+        if (shift > 28)
+        {
+            return false; // nothing we'd accept needs more than 32 bits
+        }
+        auto byte = *p++;
+        value += static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void encode_string_(const std::string &value, std::string &out)
+{
+    auto huffman_length = huffman_encoded_length(value);
+    if (huffman_length < value.size())
+    {
+        encode_integer_(huffman_length, 7, 0x80, out);
+        huffman_encode(value, out);
+    }
+    else
+    {
+        encode_integer_(value.size(), 7, 0x00, out);
+        out.append(value);
+    }
+}
+
+static bool decode_string_(const uint8_t *&p, const uint8_t *end, std::string &out)
+{
+    if (p == end)
+    {
+        return false;
+    }
+
+    bool huffman = (*p & 0x80) != 0;
+    uint64_t length;
+    if (!decode_integer_(p, end, 7, length) || length > static_cast<uint64_t>(end - p))
+    {
+        return false;
+    }
+
+    out.clear();
+    if (huffman)
+    {
+        if (!huffman_decode(p, length, out))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        out.assign(reinterpret_cast<const char *>(p), length);
+    }
+    p += length;
+    return true;
+}
+
+
+//////// hpack_table
+
+hpack_table::hpack_table(size_t max_size) : size_{0}, max_size_{max_size}
+{}
+
+const hpack_field *hpack_table::get(size_t index) const
+{
+    if (index == 0)
+    {
+        return nullptr;
+    }
+    if (index <= static_table_.size())
+    {
+        return &static_table_[index - 1];
+    }
+    index -= static_table_.size() + 1;
+    return (index < entries_.size()) ? &entries_[index] : nullptr;
+}
+
+void hpack_table::insert(hpack_field field)
+{
+    auto size = field.name.size() + field.value.size() + entry_overhead_;
+    if (size > max_size_)
+    {
+        // RFC 7541 §4.4: an entry too big for the table empties it, and isn't added
+        entries_.clear();
+        size_ = 0;
+        return;
+    }
+
+    evict_(size);
+    entries_.emplace_front(std::move(field));
+    size_ += size;
+}
+
+void hpack_table::set_max_size(size_t max_size)
+{
+    max_size_ = max_size;
+    evict_(0);
+}
+
+size_t hpack_table::find(const std::string &name, const std::string &value, size_t &name_index) const
+{
+    name_index = 0;
+    for (size_t i = 0; i < static_table_.size(); ++i)
+    {
+        if (static_table_[i].name == name)
+        {
+            if (static_table_[i].value == value)
+            {
+                return i + 1;
+            }
+            if (!name_index)
+            {
+                name_index = i + 1;
+            }
+        }
+    }
+    for (size_t i = 0; i < entries_.size(); ++i)
+    {
+        if (entries_[i].name == name)
+        {
+            if (entries_[i].value == value)
+            {
+                return static_table_.size() + i + 1;
+            }
+            if (!name_index)
+            {
+                name_index = static_table_.size() + i + 1;
+            }
+        }
+    }
+    return 0;
+}
+
+void hpack_table::evict_(size_t room_for)
+{
+    while (!entries_.empty() && size_ + room_for > max_size_)
+    {
+        size_ -= entries_.back().name.size() + entries_.back().value.size() + entry_overhead_;
+        entries_.pop_back();
+    }
+}
+
+
+//////// hpack_decoder
+
+hpack_decoder::hpack_decoder(size_t max_table_size, size_t max_list_size) :
+        table_{max_table_size},
+        max_table_size_{max_table_size},
+        max_list_size_{max_list_size},
+        too_large_{false}
+{}
+
+bool hpack_decoder::decode(const uint8_t *data, size_t length, std::vector<hpack_field> &fields)
+{
+    auto p = data;
+    auto end = data + length;
+    bool fields_seen = false;
+    size_t list_size = 0;
+    too_large_ = false;
+
+    // A small block can name the same big table entry over and over, so it's what the fields come to that's limited.
+    // Past the limit, the rest of the block is still decoded, as the table has to stay in step with the peer's.
+    auto add = [&](hpack_field field)
+    {
+        fields_seen = true;
+        if (too_large_)
+        {
+            return;
+        }
+        list_size += field.name.size() + field.value.size() + 32;
+        if (list_size > max_list_size_)
+        {
+            too_large_ = true;
+            fields.clear();
+            return;
+        }
+        fields.push_back(std::move(field));
+    };
+
+    while (p < end)
+    {
+        auto byte = *p;
+        uint64_t index;
+
+        if (byte & 0x80)
+        {
+            // indexed header field
+            if (!decode_integer_(p, end, 7, index))
+            {
+                return false;
+            }
+            auto field = table_.get(index);
+            if (!field)
+            {
+                return false;
+            }
+            add(*field);
+            continue;
+        }
+
+        if ((byte & 0xe0) == 0x20)
+        {
+            // dynamic table size update, only allowed before the first field (RFC 7541 §4.2)
+            if (fields_seen || !decode_integer_(p, end, 5, index) || index > max_table_size_)
+            {
+                return false;
+            }
+            table_.set_max_size(index);
+            continue;
+        }
+
+        // a literal, with incremental indexing (01), without (0000), or never indexed (0001)
+        bool add_to_table = (byte & 0xc0) == 0x40;
+        if (!decode_integer_(p, end, add_to_table ? 6 : 4, index))
+        {
+            return false;
+        }
+
+        hpack_field field;
+        if (index)
+        {
+            auto named = table_.get(index);
+            if (!named)
+            {
+                return false;
+            }
+            field.name = named->name;
+        }
+        else if (!decode_string_(p, end, field.name))
+        {
+            return false;
+        }
+        if (!decode_string_(p, end, field.value))
+        {
+            return false;
+        }
+
+        if (add_to_table)
+        {
+            table_.insert(field);
+        }
+        add(std::move(field));
+    }
+
+    return true;
+}
+
+
+//////// hpack_encoder
+
+hpack_encoder::hpack_encoder() : table_{default_table_size_}, size_update_pending_{false}
+{}
+
+void hpack_encoder::set_max_table_size(size_t max_size)
+{
+    auto size = (max_size < default_table_size_) ? max_size : default_table_size_;
+    if (size != table_.max_size())
+    {
+        table_.set_max_size(size);
+        size_update_pending_ = true;
+    }
+}
+
+void hpack_encoder::begin(std::string &out)
+{
+    if (size_update_pending_)
+    {
+        encode_integer_(table_.max_size(), 5, 0x20, out);
+        size_update_pending_ = false;
+    }
+}
+
+void hpack_encoder::encode(const std::string &name, const std::string &value, std::string &out)
+{
+    size_t name_index;
+    auto index = table_.find(name, value, name_index);
+    if (index)
+    {
+        encode_integer_(index, 7, 0x80, out);
+        return;
+    }
+
+    // Values that change with every response would only churn the table, so those are sent without indexing.
+    // Everything else (server, content-type, most custom headers) is added, so a chatty client only pays for it once.
+    bool volatile_value = (name == "date" || name == "content-length" || name == "etag" || name == "last-modified" ||
+                           name == "set-cookie" || name == "location" || value.size() > table_.max_size() / 4);
+    if (volatile_value)
+    {
+        encode_integer_(name_index, 4, 0x00, out);
+    }
+    else
+    {
+        encode_integer_(name_index, 6, 0x40, out);
+    }
+    if (!name_index)
+    {
+        encode_string_(name, out);
+    }
+    encode_string_(value, out);
+
+    if (!volatile_value)
+    {
+        table_.insert({name, value});
+    }
+}
+
+} //namespace luna
@@ -0,0 +1,112 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace luna
+{
+
+// HPACK (RFC 7541) header compression, for HTTP/2
+
+struct hpack_field
+{
+    std::string name;
+    std::string value;
+};
+
+// The dynamic table both ends keep in step with each other
+class hpack_table
+{
+public:
+    explicit hpack_table(size_t max_size);
+
+    // 1-based, across the static table and then the dynamic one
+    const hpack_field *get(size_t index) const;
+
+    void insert(hpack_field field);
+
+    void set_max_size(size_t max_size);
+
+    size_t max_size() const
+    { return max_size_; }
+
+    // Look for name (and value) among the static and dynamic entries. Returns the index of an exact match if there
+    // is one, and the index of some entry with the same name (or 0) in name_index.
+    size_t find(const std::string &name, const std::string &value, size_t &name_index) const;
+
+private:
+    void evict_(size_t room_for);
+
+    std::deque<hpack_field> entries_;
+    size_t size_;
+    size_t max_size_;
+};
+
+class hpack_decoder
+{
+public:
+    // max_list_size is what we advertised in SETTINGS_MAX_HEADER_LIST_SIZE
+    explicit hpack_decoder(size_t max_table_size = 4096, size_t max_list_size = SIZE_MAX);
+
+    // Decode a complete header block. false means the block was malformed, which leaves the table out of step with
+    // the peer's and is fatal to the connection.
+    bool decode(const uint8_t *data, size_t length, std::vector<hpack_field> &fields);
+
+    // Whether the last block decoded came to more than max_list_size, counting each field as its name and value plus
+    // 32 bytes (RFC 7540 §6.5.2). Its fields were dropped, but the table was kept in step all the same.
+    bool too_large() const
+    { return too_large_; }
+
+private:
+    hpack_table table_;
+
+    // the most the peer may ask the table to grow to: what we advertised in SETTINGS_HEADER_TABLE_SIZE
+    size_t max_table_size_;
+
+    size_t max_list_size_;
+    bool too_large_;
+};
+
+class hpack_encoder
+{
+public:
+    hpack_encoder();
+
+    // The peer's SETTINGS_HEADER_TABLE_SIZE. We never use more than the default, even if we're allowed to.
+    void set_max_table_size(size_t max_size);
+
+    // Start a new header block in out
+    void begin(std::string &out);
+
+    void encode(const std::string &name, const std::string &value, std::string &out);
+
+private:
+    hpack_table table_;
+    bool size_update_pending_;
+};
+
+// Huffman coding from RFC 7541 Appendix B
+void huffman_encode(const std::string &in, std::string &out);
+
+size_t huffman_encoded_length(const std::string &in);
+
+bool huffman_decode(const uint8_t *data, size_t length, std::string &out);
+
+} //namespace luna
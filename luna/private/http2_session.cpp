@@ -0,0 +1,816 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/http2_session.h"
+#include <base64/base64.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+
+namespace luna
+{
+
+const std::string http2_session::preface{"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", 24};
+
+const size_t http2_session::output_budget = 64 * 1024;
+
+// RFC 7540 §11.2
+enum frame_type : uint8_t
+{
+    DATA = 0x0,
+    HEADERS = 0x1,
+    PRIORITY = 0x2,
+    RST_STREAM = 0x3,
+    SETTINGS = 0x4,
+    PUSH_PROMISE = 0x5,
+    PING = 0x6,
+    GOAWAY = 0x7,
+    WINDOW_UPDATE = 0x8,
+    CONTINUATION = 0x9,
+};
+
+enum frame_flag : uint8_t
+{
+    END_STREAM = 0x1,
+    ACK = 0x1,
+    END_HEADERS = 0x4,
+    PADDED = 0x8,
+    PRIORITY_FLAG = 0x20,
+};
+
+// RFC 7540 §11.4
+enum error_code : uint32_t
+{
+    NO_ERROR = 0x0,
+    PROTOCOL_ERROR = 0x1,
+    INTERNAL_ERROR = 0x2,
+    FLOW_CONTROL_ERROR = 0x3,
+    STREAM_CLOSED = 0x5,
+    FRAME_SIZE_ERROR = 0x6,
+    REFUSED_STREAM = 0x7,
+    COMPRESSION_ERROR = 0x9,
+    ENHANCE_YOUR_CALM = 0xb,
+};
+
+// RFC 7540 §11.3
+enum setting : uint16_t
+{
+    HEADER_TABLE_SIZE = 0x1,
+    ENABLE_PUSH = 0x2,
+    MAX_CONCURRENT_STREAMS = 0x3,
+    INITIAL_WINDOW_SIZE = 0x4,
+    MAX_FRAME_SIZE = 0x5,
+    MAX_HEADER_LIST_SIZE = 0x6,
+};
+
+static const size_t frame_header_size_ = 9;
+static const size_t default_frame_size_ = 16384;
+static const int64_t default_window_size_ = 65535;
+static const int64_t max_window_size_ = 0x7fffffff;
+static const uint32_t max_concurrent_streams_ = 100;
+
+static uint32_t read_u32_(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static void write_u32_(std::string &out, uint32_t value)
+{
+    out.push_back(static_cast<char>(value >> 24));
+    out.push_back(static_cast<char>(value >> 16));
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+// headers that only mean something to a single HTTP/1.1 hop (RFC 7540 §8.1.2.2), and the framing we add ourselves
+static bool connection_specific_(const std::string &name)
+{
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade" || name == "content-length";
+}
+
+http2_session::stream::~stream()
+{
+    if (file >= 0)
+    {
+        close(file);
+    }
+}
+
+http2_session::http2_session(handler handler, size_t max_header_block_size, size_t max_body_size) :
+        handler_{std::move(handler)},
+        max_header_block_size_{max_header_block_size},
+        max_body_size_{max_body_size},
+        buffered_{0},
+        withheld_{0},
+        decoder_{4096, max_header_block_size},
+        last_stream_id_{0},
+        continuation_stream_{0},
+        continuation_ends_stream_{false},
+        preface_received_{false},
+        goaway_sent_{false},
+        goaway_received_{false},
+        send_window_{default_window_size_},
+        initial_window_size_{default_window_size_},
+        max_frame_size_{default_frame_size_}
+{
+    // our connection preface. The defaults suit us, apart from having limits on concurrent streams and on headers.
+    std::string settings;
+    settings.push_back(0);
+    settings.push_back(static_cast<char>(MAX_CONCURRENT_STREAMS));
+    write_u32_(settings, max_concurrent_streams_);
+    settings.push_back(0);
+    settings.push_back(static_cast<char>(MAX_HEADER_LIST_SIZE));
+    write_u32_(settings, static_cast<uint32_t>(std::min<size_t>(max_header_block_size, UINT32_MAX)));
+    write_frame_(SETTINGS, 0, 0, settings.data(), settings.size());
+}
+
+bool http2_session::start_upgraded(const std::string &http2_settings, http2_request &&request)
+{
+    // HTTP2-Settings is a SETTINGS payload in unpadded base64url (RFC 7540 §3.2.1)
+    std::string encoded{http2_settings};
+    std::replace(encoded.begin(), encoded.end(), '-', '+');
+    std::replace(encoded.begin(), encoded.end(), '_', '/');
+    encoded.append((4 - encoded.size() % 4) % 4, '=');
+    auto payload = base64_decode(encoded);
+    if (payload.size() % 6 || !apply_settings_(reinterpret_cast<const uint8_t *>(payload.data()), payload.size()))
+    {
+        return false;
+    }
+
+    // the 101 response stands in for an acknowledgement of those settings
+    last_stream_id_ = 1;
+    auto &upgraded = streams_[1];
+    upgraded.remote_closed = true;
+    upgraded.send_window = initial_window_size_;
+
+    handle_(1, std::move(request));
+    return true;
+}
+
+bool http2_session::wants_close() const
+{
+    return goaway_sent_ || (goaway_received_ && streams_.empty());
+}
+
+size_t http2_session::receive(const char *data, size_t length)
+{
+    auto p = reinterpret_cast<const uint8_t *>(data);
+    auto end = p + length;
+
+    if (goaway_sent_)
+    {
+        return length; // nothing more the client says matters
+    }
+
+    if (!preface_received_)
+    {
+        if (length < preface.size())
+        {
+            return 0;
+        }
+        if (preface.compare(0, preface.size(), data, preface.size()) != 0)
+        {
+            connection_error_(PROTOCOL_ERROR);
+            return length;
+        }
+        preface_received_ = true;
+        p += preface.size();
+    }
+
+    while (static_cast<size_t>(end - p) >= frame_header_size_ && !goaway_sent_)
+    {
+        size_t frame_length = (static_cast<size_t>(p[0]) << 16) | (static_cast<size_t>(p[1]) << 8) | p[2];
+        if (frame_length > default_frame_size_) // we never raise SETTINGS_MAX_FRAME_SIZE
+        {
+            connection_error_(FRAME_SIZE_ERROR);
+            break;
+        }
+        if (static_cast<size_t>(end - p) < frame_header_size_ + frame_length)
+        {
+            break;
+        }
+
+        auto type = p[3];
+        auto flags = p[4];
+        auto stream_id = read_u32_(p + 5) & 0x7fffffff;
+        on_frame_(type, flags, stream_id, p + frame_header_size_, frame_length);
+        p += frame_header_size_ + frame_length;
+    }
+
+    return goaway_sent_ ? length : static_cast<size_t>(p - reinterpret_cast<const uint8_t *>(data));
+}
+
+void http2_session::on_frame_(uint8_t type, uint8_t flags, uint32_t stream_id, const uint8_t *payload, size_t length)
+{
+    // a header block has to arrive in one piece (RFC 7540 §6.10)
+    if (continuation_stream_ && (type != CONTINUATION || stream_id != continuation_stream_))
+    {
+        connection_error_(PROTOCOL_ERROR);
+        return;
+    }
+
+    switch (type)
+    {
+        case DATA:
+            on_data_(flags, stream_id, payload, length);
+            break;
+        case HEADERS:
+            on_headers_(flags, stream_id, payload, length);
+            break;
+        case CONTINUATION:
+            on_continuation_(flags, stream_id, payload, length);
+            break;
+        case SETTINGS:
+            on_settings_(flags, stream_id, payload, length);
+            break;
+        case WINDOW_UPDATE:
+            on_window_update_(stream_id, payload, length);
+            break;
+        case PING:
+            if (stream_id || length != 8)
+            {
+                connection_error_(stream_id ? PROTOCOL_ERROR : FRAME_SIZE_ERROR);
+            }
+            else if (!(flags & ACK))
+            {
+                write_frame_(PING, ACK, 0, reinterpret_cast<const char *>(payload), length);
+            }
+            break;
+        case RST_STREAM:
+            if (!stream_id || length != 4)
+            {
+                connection_error_(stream_id ? FRAME_SIZE_ERROR : PROTOCOL_ERROR);
+            }
+            else
+            {
+                auto found = streams_.find(stream_id);
+                if (found != streams_.end())
+                {
+                    auto unanswered = found->second.remote_closed && !found->second.responding;
+                    release_body_(found->second.body.size());
+                    streams_.erase(found);
+                    if (unanswered && reset_handler_)
+                    {
+                        reset_handler_(stream_id);
+                    }
+                }
+            }
+            break;
+        case GOAWAY:
+            goaway_received_ = true;
+            break;
+        case PUSH_PROMISE:
+            connection_error_(PROTOCOL_ERROR); // clients can't push
+            break;
+        case PRIORITY:
+        default:
+            break; // we don't prioritize, and unknown frame types are to be ignored
+    }
+}
+
+void http2_session::on_data_(uint8_t flags, uint32_t stream_id, const uint8_t *payload, size_t length)
+{
+    auto found = streams_.find(stream_id);
+    if (!stream_id || (found == streams_.end() && stream_id > last_stream_id_))
+    {
+        connection_error_(PROTOCOL_ERROR);
+        return;
+    }
+
+    // The whole frame counts against the windows, padding included. The stream's share is given straight back, as
+    // each stream's body is limited anyway, but the connection's is held back while the streams hold too much between
+    // them, until their bodies have been handed on.
+    auto frame_length = length;
+    withheld_ += frame_length;
+
+    if (found == streams_.end() || found->second.remote_closed)
+    {
+        release_body_(0);
+        reset_stream_(stream_id, STREAM_CLOSED);
+        return;
+    }
+
+    size_t padding = 0;
+    if (flags & PADDED)
+    {
+        if (length < 1 || payload[0] >= length)
+        {
+            connection_error_(PROTOCOL_ERROR);
+            return;
+        }
+        padding = payload[0];
+        ++payload;
+        --length;
+    }
+
+    auto &stream = found->second;
+    if (stream.body.size() + (length - padding) > max_body_size_)
+    {
+        release_body_(stream.body.size());
+        respond(stream_id, {413, {}, {}});
+        streams_.erase(stream_id);
+        reset_stream_(stream_id, NO_ERROR); // we've answered, so the rest of the body isn't wanted
+        return;
+    }
+    stream.body.append(reinterpret_cast<const char *>(payload), length - padding);
+    buffered_ += length - padding;
+    if (frame_length && !(flags & END_STREAM))
+    {
+        std::string increment;
+        write_u32_(increment, static_cast<uint32_t>(frame_length));
+        write_frame_(WINDOW_UPDATE, 0, stream_id, increment.data(), increment.size());
+    }
+    release_body_(0);
+    if (flags & END_STREAM)
+    {
+        stream.remote_closed = true;
+        dispatch_(stream_id, stream);
+    }
+}
+
+void http2_session::on_headers_(uint8_t flags, uint32_t stream_id, const uint8_t *payload, size_t length)
+{
+    if (!stream_id || !(stream_id & 1))
+    {
+        connection_error_(PROTOCOL_ERROR);
+        return;
+    }
+
+    size_t padding = 0;
+    if (flags & PADDED)
+    {
+        if (length < 1)
+        {
+            connection_error_(PROTOCOL_ERROR);
+            return;
+        }
+        padding = payload[0];
+        ++payload;
+        --length;
+    }
+    if (flags & PRIORITY_FLAG)
+    {
+        if (length < 5)
+        {
+            connection_error_(PROTOCOL_ERROR);
+            return;
+        }
+        payload += 5;
+        length -= 5;
+    }
+    if (padding > length)
+    {
+        connection_error_(PROTOCOL_ERROR);
+        return;
+    }
+
+    auto found = streams_.find(stream_id);
+    if (found != streams_.end())
+    {
+        // trailers, which have to end the stream
+        if (found->second.remote_closed || !(flags & END_STREAM))
+        {
+            connection_error_(found->second.remote_closed ? STREAM_CLOSED : PROTOCOL_ERROR);
+            return;
+        }
+    }
+    else if (stream_id <= last_stream_id_)
+    {
+        connection_error_(STREAM_CLOSED);
+        return;
+    }
+    else
+    {
+        last_stream_id_ = stream_id;
+        auto &stream = streams_[stream_id];
+        stream.send_window = initial_window_size_;
+        // The header block still has to be decoded to keep our table in step, even if we won't serve the request
+        stream.refused = (streams_.size() > max_concurrent_streams_) || goaway_received_;
+    }
+
+    header_block_.assign(reinterpret_cast<const char *>(payload), length - padding);
+    if (header_block_.size() > max_header_block_size_)
+    {
+        connection_error_(ENHANCE_YOUR_CALM);
+        return;
+    }
+    continuation_ends_stream_ = (flags & END_STREAM) != 0;
+    if (flags & END_HEADERS)
+    {
+        end_headers_(stream_id);
+    }
+    else
+    {
+        continuation_stream_ = stream_id;
+    }
+}
+
+void http2_session::on_continuation_(uint8_t flags, uint32_t stream_id, const uint8_t *payload, size_t length)
+{
+    if (!continuation_stream_)
+    {
+        connection_error_(PROTOCOL_ERROR);
+        return;
+    }
+
+    header_block_.append(reinterpret_cast<const char *>(payload), length);
+    if (header_block_.size() > max_header_block_size_)
+    {
+        connection_error_(ENHANCE_YOUR_CALM);
+        return;
+    }
+
+    if (flags & END_HEADERS)
+    {
+        continuation_stream_ = 0;
+        end_headers_(stream_id);
+    }
+}
+
+void http2_session::end_headers_(uint32_t stream_id)
+{
+    std::vector<hpack_field> fields;
+    auto ok = decoder_.decode(reinterpret_cast<const uint8_t *>(header_block_.data()), header_block_.size(), fields);
+    header_block_.clear();
+    if (!ok)
+    {
+        connection_error_(COMPRESSION_ERROR);
+        return;
+    }
+
+    auto &stream = streams_[stream_id];
+    if (stream.refused)
+    {
+        streams_.erase(stream_id);
+        reset_stream_(stream_id, REFUSED_STREAM);
+        return;
+    }
+    if (decoder_.too_large() && stream.fields.empty())
+    {
+        respond(stream_id, {431, {}, {}}); // Request Header Fields Too Large
+        streams_.erase(stream_id);
+        if (!continuation_ends_stream_)
+        {
+            reset_stream_(stream_id, NO_ERROR);
+        }
+        return;
+    } // trailers that are too large are dropped along with the rest
+
+    if (stream.fields.empty())
+    {
+        stream.fields = std::move(fields);
+    } // otherwise these were trailers, which we don't pass on
+
+    if (continuation_ends_stream_)
+    {
+        stream.remote_closed = true;
+        dispatch_(stream_id, stream);
+    }
+}
+
+void http2_session::on_settings_(uint8_t flags, uint32_t stream_id, const uint8_t *payload, size_t length)
+{
+    if (stream_id)
+    {
+        connection_error_(PROTOCOL_ERROR);
+        return;
+    }
+    if (flags & ACK)
+    {
+        if (length)
+        {
+            connection_error_(FRAME_SIZE_ERROR);
+        }
+        return;
+    }
+    if (length % 6)
+    {
+        connection_error_(FRAME_SIZE_ERROR);
+        return;
+    }
+
+    if (apply_settings_(payload, length))
+    {
+        write_frame_(SETTINGS, ACK, 0, nullptr, 0);
+        flush(); // the windows may have grown
+    }
+}
+
+bool http2_session::apply_settings_(const uint8_t *payload, size_t length)
+{
+    for (size_t i = 0; i + 6 <= length; i += 6)
+    {
+        auto id = static_cast<uint16_t>((payload[i] << 8) | payload[i + 1]);
+        auto value = read_u32_(payload + i + 2);
+        switch (id)
+        {
+            case HEADER_TABLE_SIZE:
+                encoder_.set_max_table_size(value);
+                break;
+            case ENABLE_PUSH:
+                if (value > 1)
+                {
+                    connection_error_(PROTOCOL_ERROR);
+                    return false;
+                }
+                break;
+            case INITIAL_WINDOW_SIZE:
+                if (value > max_window_size_)
+                {
+                    connection_error_(FLOW_CONTROL_ERROR);
+                    return false;
+                }
+                // the change applies to every open stream's window (RFC 7540 §6.9.2)
+                for (auto &entry : streams_)
+                {
+                    entry.second.send_window += static_cast<int64_t>(value) - initial_window_size_;
+                }
+                initial_window_size_ = value;
+                break;
+            case MAX_FRAME_SIZE:
+                if (value < default_frame_size_ || value > 0xffffff)
+                {
+                    connection_error_(PROTOCOL_ERROR);
+                    return false;
+                }
+                max_frame_size_ = value;
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+void http2_session::on_window_update_(uint32_t stream_id, const uint8_t *payload, size_t length)
+{
+    if (length != 4)
+    {
+        connection_error_(FRAME_SIZE_ERROR);
+        return;
+    }
+
+    auto increment = read_u32_(payload) & 0x7fffffff;
+    if (!stream_id)
+    {
+        send_window_ += increment;
+        if (!increment || send_window_ > max_window_size_)
+        {
+            connection_error_(increment ? FLOW_CONTROL_ERROR : PROTOCOL_ERROR);
+            return;
+        }
+    }
+    else
+    {
+        auto found = streams_.find(stream_id);
+        if (found == streams_.end())
+        {
+            return; // a stream we've finished with; the update crossed our last frame on the wire
+        }
+        found->second.send_window += increment;
+        if (!increment || found->second.send_window > max_window_size_)
+        {
+            streams_.erase(found);
+            reset_stream_(stream_id, increment ? FLOW_CONTROL_ERROR : PROTOCOL_ERROR);
+            return;
+        }
+    }
+
+    flush();
+}
+
+void http2_session::dispatch_(uint32_t stream_id, stream &stream)
+{
+    release_body_(stream.body.size()); // from here on, it's either handed on or dropped
+
+    http2_request request;
+    std::string authority;
+    for (auto &field : stream.fields)
+    {
+        if (field.name.empty())
+        {
+            continue;
+        }
+        if (field.name[0] == ':')
+        {
+            if (field.name == ":method")
+            {
+                request.method = std::move(field.value);
+            }
+            else if (field.name == ":path")
+            {
+                request.target = std::move(field.value);
+            }
+            else if (field.name == ":authority")
+            {
+                authority = std::move(field.value);
+            }
+            continue;
+        }
+
+        auto existing = request.headers.find(field.name);
+        if (existing == request.headers.end())
+        {
+            request.headers.emplace(std::move(field.name), std::move(field.value));
+        }
+        else
+        {
+            // cookies may be split across fields to help compression (RFC 7540 §8.1.2.5)
+            existing->second.append(field.name == "cookie" ? "; " : ", ");
+            existing->second.append(field.value);
+        }
+    }
+    stream.fields.clear();
+
+    if (request.method.empty() || request.target.empty())
+    {
+        streams_.erase(stream_id);
+        reset_stream_(stream_id, PROTOCOL_ERROR);
+        return;
+    }
+    if (!authority.empty() && !request.headers.count("host"))
+    {
+        request.headers.emplace("host", authority);
+    }
+    request.body = std::move(stream.body);
+
+    handle_(stream_id, std::move(request));
+}
+
+void http2_session::handle_(uint32_t stream_id, http2_request &&request)
+{
+    auto response = handler_(stream_id, std::move(request));
+    if (response)
+    {
+        respond(stream_id, std::move(*response));
+    }
+}
+
+void http2_session::release_body_(size_t size)
+{
+    buffered_ -= size;
+    if (withheld_ && buffered_ < max_body_size_)
+    {
+        std::string increment;
+        write_u32_(increment, static_cast<uint32_t>(withheld_));
+        write_frame_(WINDOW_UPDATE, 0, 0, increment.data(), increment.size());
+        withheld_ = 0;
+    }
+}
+
+void http2_session::respond(uint32_t stream_id, http2_response &&response)
+{
+    auto found = streams_.find(stream_id);
+    if (found == streams_.end() || goaway_sent_)
+    {
+        if (response.file >= 0)
+        {
+            close(response.file);
+        }
+        return;
+    }
+    auto &stream = found->second;
+    stream.file = response.file; // closed along with the stream from here on
+    stream.pending_size = (stream.file >= 0) ? response.file_size : response.body.size();
+
+    std::string block;
+    encoder_.begin(block);
+    encoder_.encode(":status", std::to_string(response.status), block);
+    for (auto &header : response.headers)
+    {
+        std::transform(header.first.begin(), header.first.end(), header.first.begin(), ::tolower);
+        if (!connection_specific_(header.first))
+        {
+            encoder_.encode(header.first, header.second, block);
+        }
+    }
+    if (stream.pending_size)
+    {
+        encoder_.encode("content-length", std::to_string(stream.pending_size), block);
+    }
+
+    // the header block goes out in one HEADERS frame and as many CONTINUATIONs as it takes
+    size_t offset = 0;
+    do
+    {
+        auto size = std::min(block.size() - offset, max_frame_size_);
+        uint8_t flags = (offset + size == block.size()) ? END_HEADERS : 0;
+        if (offset == 0 && !stream.pending_size)
+        {
+            flags |= END_STREAM;
+        }
+        write_frame_(offset ? CONTINUATION : HEADERS, flags, stream_id, block.data() + offset, size);
+        offset += size;
+    }
+    while (offset < block.size());
+
+    if (!stream.pending_size)
+    {
+        streams_.erase(stream_id);
+        return;
+    }
+
+    if (stream.file < 0)
+    {
+        stream.pending = std::move(response.body);
+    }
+    stream.responding = true;
+    flush();
+}
+
+void http2_session::flush()
+{
+    for (auto it = streams_.begin(); it != streams_.end() && send_window_ > 0 && output_.size() < output_budget;)
+    {
+        auto &stream = it->second;
+        if (!stream.responding)
+        {
+            ++it;
+            continue;
+        }
+
+        auto failed = false;
+        while (stream.pending_sent < stream.pending_size && send_window_ > 0 && stream.send_window > 0 &&
+               output_.size() < output_budget)
+        {
+            auto size = std::min({stream.pending_size - stream.pending_sent, max_frame_size_,
+                                  static_cast<size_t>(send_window_), static_cast<size_t>(stream.send_window)});
+            const char *data = stream.pending.data() + stream.pending_sent;
+            if (stream.file >= 0)
+            {
+                file_chunk_.resize(size);
+                auto offset = static_cast<off_t>(stream.pending_sent);
+                if (pread(stream.file, &file_chunk_[0], size, offset) != static_cast<ssize_t>(size))
+                {
+                    failed = true; // it can't be read, or it's shrunk since we said how long it was
+                    break;
+                }
+                data = file_chunk_.data();
+            }
+            auto last = (stream.pending_sent + size == stream.pending_size);
+            write_frame_(DATA, last ? END_STREAM : 0, it->first, data, size);
+            stream.pending_sent += size;
+            send_window_ -= size;
+            stream.send_window -= size;
+        }
+
+        if (failed)
+        {
+            reset_stream_(it->first, INTERNAL_ERROR);
+            it = streams_.erase(it);
+        }
+        else if (stream.pending_sent == stream.pending_size)
+        {
+            it = streams_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void http2_session::write_frame_(uint8_t type, uint8_t flags, uint32_t stream_id, const char *payload, size_t length)
+{
+    output_.push_back(static_cast<char>(length >> 16));
+    output_.push_back(static_cast<char>(length >> 8));
+    output_.push_back(static_cast<char>(length));
+    output_.push_back(static_cast<char>(type));
+    output_.push_back(static_cast<char>(flags));
+    write_u32_(output_, stream_id);
+    if (length)
+    {
+        output_.append(payload, length);
+    }
+}
+
+void http2_session::reset_stream_(uint32_t stream_id, uint32_t error_code)
+{
+    std::string payload;
+    write_u32_(payload, error_code);
+    write_frame_(RST_STREAM, 0, stream_id, payload.data(), payload.size());
+}
+
+void http2_session::connection_error_(uint32_t error_code)
+{
+    std::string payload;
+    write_u32_(payload, last_stream_id_);
+    write_u32_(payload, error_code);
+    write_frame_(GOAWAY, 0, 0, payload.data(), payload.size());
+    goaway_sent_ = true;
+}
+
+} //namespace luna
@@ -0,0 +1,181 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include "luna/types.h"
+#include "luna/optional.hpp"
+#include "luna/private/hpack.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace luna
+{
+
+struct http2_request
+{
+    std::string method;
+    std::string target;
+    request_headers headers;
+    std::string body;
+};
+
+struct http2_response
+{
+    status_code status;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+
+    // Or, in place of body, an open file whose first file_size bytes are read a frame at a time as flow control lets
+    // them go out. The session closes it.
+    int file{-1};
+    size_t file_size{0};
+};
+
+// The server side of one HTTP/2 connection (RFC 7540), as a state machine over bytes: feed it what arrives from the
+// client, and send whatever it leaves in output(). Each request is handed to the handler as soon as its stream is
+// complete. The handler can answer straight away, or return nullopt and answer later with respond(); either way the
+// response is queued subject to the client's flow control windows. No more than about output_budget bytes of response
+// data are queued in output() at a time; call flush() for more once it's been sent.
+//
+// This knows nothing about sockets, so it works the same over any transport; the native transport uses it for h2c.
+class http2_session
+{
+public:
+    using handler = std::function<OPT_NS::optional<http2_response>(uint32_t stream_id, http2_request &&request)>;
+    using reset_handler = std::function<void(uint32_t stream_id)>;
+
+    // max_header_block_size limits both the compressed header blocks a client may send and the header lists they
+    // decode to. Request bodies larger than max_body_size are answered with 413, and no more than that much of all the
+    // streams' bodies together is held before the client is made to wait.
+    http2_session(handler handler, size_t max_header_block_size, size_t max_body_size);
+
+    // The connection was upgraded from HTTP/1.1, so the request that asked for the upgrade becomes stream 1.
+    // http2_settings is the HTTP2-Settings header from that request. false if it couldn't be decoded.
+    bool start_upgraded(const std::string &http2_settings, http2_request &&request);
+
+    // Process as much of data as makes up complete frames, and return how much that was. The rest should be offered
+    // again with more data appended.
+    size_t receive(const char *data, size_t length);
+
+    // Called when the client resets a stream whose request the handler has been given but not yet answered, so that
+    // whatever is working on the answer can give up.
+    void on_reset(reset_handler handler)
+    { reset_handler_ = std::move(handler); }
+
+    // Answer a request the handler put off. Does nothing if the client has reset the stream meanwhile.
+    void respond(uint32_t stream_id, http2_response &&response);
+
+    // Queue as much more response data as flow control and output_budget allow
+    void flush();
+
+    // Frames waiting to be sent. Whoever sends them should clear out what's been sent.
+    std::string &output()
+    { return output_; }
+
+    // Once output() has been sent, the connection should be closed
+    bool wants_close() const;
+
+    // the client connection preface, which begins every HTTP/2 connection
+    static const std::string preface;
+
+    static const size_t output_budget;
+
+private:
+    struct stream
+    {
+        stream() = default;
+        stream(const stream &) = delete;
+        stream &operator=(const stream &) = delete;
+        ~stream();
+
+        std::vector<hpack_field> fields;
+        std::string body;
+        bool remote_closed{false};
+        bool refused{false};
+
+        int64_t send_window;
+        std::string pending; // response data not yet sent, or
+        int file{-1};        // the file it's read from
+        size_t pending_size{0};
+        size_t pending_sent{0};
+        bool responding{false};
+    };
+
+    void on_frame_(uint8_t type, uint8_t flags, uint32_t stream_id, const uint8_t *payload, size_t length);
+
+    void on_data_(uint8_t flags, uint32_t stream_id, const uint8_t *payload, size_t length);
+
+    void on_headers_(uint8_t flags, uint32_t stream_id, const uint8_t *payload, size_t length);
+
+    void on_continuation_(uint8_t flags, uint32_t stream_id, const uint8_t *payload, size_t length);
+
+    void on_settings_(uint8_t flags, uint32_t stream_id, const uint8_t *payload, size_t length);
+
+    void on_window_update_(uint32_t stream_id, const uint8_t *payload, size_t length);
+
+    void end_headers_(uint32_t stream_id);
+
+    bool apply_settings_(const uint8_t *payload, size_t length);
+
+    void dispatch_(uint32_t stream_id, stream &stream);
+
+    void handle_(uint32_t stream_id, http2_request &&request);
+
+    void release_body_(size_t size);
+
+    void write_frame_(uint8_t type, uint8_t flags, uint32_t stream_id, const char *payload, size_t length);
+
+    void reset_stream_(uint32_t stream_id, uint32_t error_code);
+
+    void connection_error_(uint32_t error_code);
+
+    handler handler_;
+    reset_handler reset_handler_;
+    size_t max_header_block_size_;
+    size_t max_body_size_;
+
+    // request bodies received but not yet handed to the handler, and the connection window we've held back meanwhile
+    size_t buffered_;
+    size_t withheld_;
+
+    hpack_decoder decoder_;
+    hpack_encoder encoder_;
+
+    std::map<uint32_t, stream> streams_;
+    uint32_t last_stream_id_;
+
+    // a header block in progress, split across HEADERS and CONTINUATION frames
+    std::string header_block_;
+    uint32_t continuation_stream_;
+    bool continuation_ends_stream_;
+
+    bool preface_received_;
+    bool goaway_sent_;
+    bool goaway_received_;
+
+    // what the client has told us about itself
+    int64_t send_window_;
+    int64_t initial_window_size_;
+    size_t max_frame_size_;
+
+    std::string output_;
+    std::string file_chunk_; // read from a file on its way to output_
+};
+
+} //namespace luna
@@ -0,0 +1,498 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/http_parser.h"
+#include <strings.h>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace luna
+{
+
+// more than this many header fields in one request is somebody probing us, not a browser
+static const size_t max_headers_ = 128;
+
+static inline bool is_control_(unsigned char c, bool allow_tab)
+{
+    return (c < 0x20 && !(allow_tab && c == '\t')) || c == 0x7f;
+}
+
+// Find the first byte in [p, end) that is either stop or a control character. Everything the parser needs to find is
+// a delimiter at the end of a run of ordinary bytes, and any control character inside such a run makes the request
+// invalid, so a single scan does both jobs.
+static const char *scan_(const char *p, const char *end, char stop, bool allow_tab)
+{
+#if defined(__SSE2__)
+    const auto stops = _mm_set1_epi8(stop);
+    const auto control_ceiling = _mm_set1_epi8(0x1f);
+    const auto del = _mm_set1_epi8(0x7f);
+    const auto tab = _mm_set1_epi8('\t');
+
+    while (end - p >= 16)
+    {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        // unsigned block <= 0x1f, without a signed compare mistaking obs-text (>= 0x80) for control characters
+        auto control = _mm_cmpeq_epi8(_mm_min_epu8(block, control_ceiling), block);
+        if (allow_tab)
+        {
+            control = _mm_andnot_si128(_mm_cmpeq_epi8(block, tab), control);
+        }
+        auto hits = _mm_or_si128(_mm_or_si128(control, _mm_cmpeq_epi8(block, del)), _mm_cmpeq_epi8(block, stops));
+        auto mask = _mm_movemask_epi8(hits);
+        if (mask)
+        {
+            return p + __builtin_ctz(static_cast<unsigned int>(mask));
+        }
+        p += 16;
+    }
+#endif
+
+    for (; p < end; ++p)
+    {
+        if (*p == stop || is_control_(static_cast<unsigned char>(*p), allow_tab))
+        {
+            return p;
+        }
+    }
+    return end;
+}
+
+// Consume the line ending at p, if there is one
+static parse_status end_of_line_(const char *&p, const char *end)
+{
+    if (p == end)
+    {
+        return parse_status::INCOMPLETE;
+    }
+    if (*p == '\n') // tolerate a bare LF
+    {
+        ++p;
+        return parse_status::COMPLETE;
+    }
+    if (*p != '\r')
+    {
+        return parse_status::INVALID;
+    }
+    if (p + 1 == end)
+    {
+        return parse_status::INCOMPLETE;
+    }
+    if (p[1] != '\n')
+    {
+        return parse_status::INVALID;
+    }
+    p += 2;
+    return parse_status::COMPLETE;
+}
+
+static bool parse_size_(const http_slice &value, size_t &out)
+{
+    if (value.length == 0)
+    {
+        return false;
+    }
+
+    size_t result = 0;
+    for (size_t i = 0; i < value.length; ++i)
+    {
+        auto c = value.data[i];
+        if (c < '0' || c > '9')
+        {
+            return false;
+        }
+        auto digit = static_cast<size_t>(c - '0');
+        if (result > (std::numeric_limits<size_t>::max() - digit) / 10)
+        {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    out = result;
+    return true;
+}
+
+// Call f on each comma-separated token in value, with surrounding whitespace removed
+template<typename F>
+static void for_each_token_(const http_slice &value, F &&f)
+{
+    auto p = value.data;
+    auto end = value.data + value.length;
+    while (p < end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+        {
+            ++p;
+        }
+        auto start = p;
+        while (p < end && *p != ',')
+        {
+            ++p;
+        }
+        auto stop = p;
+        while (stop > start && (stop[-1] == ' ' || stop[-1] == '\t'))
+        {
+            --stop;
+        }
+        if (stop > start)
+        {
+            f(http_slice{start, static_cast<size_t>(stop - start)});
+        }
+    }
+}
+
+bool http_slice::equals_nocase(const char *other, size_t other_length) const
+{
+    return length == other_length && strncasecmp(data, other, length) == 0;
+}
+
+#define SLICE_IS(slice, literal) (slice).equals_nocase(literal, sizeof(literal) - 1)
+
+parse_status parse_request_head(const char *buf, size_t length, http_request_head &head, size_t &consumed)
+{
+    auto p = buf;
+    auto end = buf + length;
+
+    head.headers.clear();
+    head.content_length = 0;
+    head.chunked = false;
+    head.expect_continue = false;
+
+    // RFC 7230 §3.5: ignore empty lines before the request line
+    while (p < end && (*p == '\r' || *p == '\n'))
+    {
+        ++p;
+    }
+
+    // request line
+    auto q = scan_(p, end, ' ', false);
+    if (q == end)
+    {
+        return parse_status::INCOMPLETE;
+    }
+    if (*q != ' ' || q == p)
+    {
+        return parse_status::INVALID;
+    }
+    head.method = {p, static_cast<size_t>(q - p)};
+    p = q + 1;
+
+    q = scan_(p, end, ' ', false);
+    if (q == end)
+    {
+        return parse_status::INCOMPLETE;
+    }
+    if (*q != ' ' || q == p)
+    {
+        return parse_status::INVALID;
+    }
+    head.target = {p, static_cast<size_t>(q - p)};
+    p = q + 1;
+
+    q = scan_(p, end, '\r', false);
+    head.version = {p, static_cast<size_t>(q - p)};
+    p = q;
+    auto status = end_of_line_(p, end);
+    if (status != parse_status::COMPLETE)
+    {
+        return status;
+    }
+    if (head.version.length != 8 || std::strncmp(head.version.data, "HTTP/1.", 7) != 0 ||
+        (head.version.data[7] != '0' && head.version.data[7] != '1'))
+    {
+        return parse_status::INVALID;
+    }
+    head.keep_alive = (head.version.data[7] == '1');
+
+    // header fields
+    for (;;)
+    {
+        if (p == end)
+        {
+            return parse_status::INCOMPLETE;
+        }
+        if (*p == '\r' || *p == '\n')
+        {
+            status = end_of_line_(p, end);
+            if (status != parse_status::COMPLETE)
+            {
+                return status;
+            }
+            break;
+        }
+
+        q = scan_(p, end, ':', false);
+        if (q == end)
+        {
+            return parse_status::INCOMPLETE;
+        }
+        // no empty names, and no whitespace between the name and the colon (RFC 7230 §3.2.4)
+        if (*q != ':' || q == p || q[-1] == ' ')
+        {
+            return parse_status::INVALID;
+        }
+        http_slice name{p, static_cast<size_t>(q - p)};
+        p = q + 1;
+
+        while (p < end && (*p == ' ' || *p == '\t'))
+        {
+            ++p;
+        }
+        q = scan_(p, end, '\r', true);
+        auto value_end = q;
+        while (value_end > p && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+        {
+            --value_end;
+        }
+        http_slice value{p, static_cast<size_t>(value_end - p)};
+        p = q;
+        status = end_of_line_(p, end);
+        if (status != parse_status::COMPLETE)
+        {
+            return status;
+        }
+
+        if (head.headers.size() == max_headers_)
+        {
+            return parse_status::INVALID;
+        }
+        head.headers.push_back({name, value});
+    }
+
+    // pull out the headers that decide how the rest of the message is framed
+    bool have_content_length = false;
+    for (const auto &header : head.headers)
+    {
+        if (SLICE_IS(header.name, "Content-Length"))
+        {
+            size_t content_length;
+            if (!parse_size_(header.value, content_length) ||
+                (have_content_length && content_length != head.content_length))
+            {
+                return parse_status::INVALID;
+            }
+            head.content_length = content_length;
+            have_content_length = true;
+        }
+        else if (SLICE_IS(header.name, "Transfer-Encoding"))
+        {
+            head.chunked = false;
+            for_each_token_(header.value, [&head](const http_slice &token)
+            {
+                head.chunked = SLICE_IS(token, "chunked"); // only meaningful as the final coding
+            });
+            if (!head.chunked)
+            {
+                return parse_status::INVALID; // we can't find the end of a body in any other coding
+            }
+        }
+        else if (SLICE_IS(header.name, "Connection"))
+        {
+            for_each_token_(header.value, [&head](const http_slice &token)
+            {
+                if (SLICE_IS(token, "close"))
+                {
+                    head.keep_alive = false;
+                }
+                else if (SLICE_IS(token, "keep-alive"))
+                {
+                    head.keep_alive = true;
+                }
+            });
+        }
+        else if (SLICE_IS(header.name, "Expect"))
+        {
+            head.expect_continue = SLICE_IS(header.value, "100-continue");
+        }
+    }
+
+    // a message with both is how request smuggling starts (RFC 7230 §3.3.3)
+    if (head.chunked && have_content_length)
+    {
+        return parse_status::INVALID;
+    }
+
+    consumed = static_cast<size_t>(p - buf);
+    return parse_status::COMPLETE;
+}
+
+static int hex_value_(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+parse_status parse_chunked_body(const char *buf, size_t length, size_t max_size, std::string &body, size_t &consumed)
+{
+    auto p = buf;
+    auto end = buf + length;
+
+    consumed = 0;
+
+    for (;;)
+    {
+        // chunk size, in hex
+        size_t size = 0;
+        size_t digits = 0;
+        for (; p < end && hex_value_(*p) >= 0; ++p, ++digits)
+        {
+            if (digits == sizeof(size_t) * 2 - 1)
+            {
+                return parse_status::INVALID; // far larger than anything we could hold anyway
+            }
+            size = (size << 4) | static_cast<size_t>(hex_value_(*p));
+        }
+        if (p == end)
+        {
+            return parse_status::INCOMPLETE;
+        }
+        if (digits == 0)
+        {
+            return parse_status::INVALID;
+        }
+
+        // skip any chunk extensions
+        auto q = scan_(p, end, '\r', true);
+        p = q;
+        auto status = end_of_line_(p, end);
+        if (status != parse_status::COMPLETE)
+        {
+            return status;
+        }
+
+        if (size == 0)
+        {
+            break;
+        }
+
+        // turn the body away as soon as it's declared too big, rather than once it has all arrived
+        if (size > max_size - body.size())
+        {
+            return parse_status::TOO_LARGE;
+        }
+
+        if (static_cast<size_t>(end - p) < size)
+        {
+            return parse_status::INCOMPLETE;
+        }
+        auto data = p;
+        p += size;
+
+        status = end_of_line_(p, end);
+        if (status != parse_status::COMPLETE)
+        {
+            return status;
+        }
+
+        body.append(data, size);
+        consumed = static_cast<size_t>(p - buf);
+    }
+
+    // trailer fields, up to an empty line
+    for (;;)
+    {
+        if (p == end)
+        {
+            return parse_status::INCOMPLETE;
+        }
+        if (*p == '\r' || *p == '\n')
+        {
+            auto status = end_of_line_(p, end);
+            if (status != parse_status::COMPLETE)
+            {
+                return status;
+            }
+            break;
+        }
+        auto q = scan_(p, end, '\r', true);
+        p = q;
+        auto status = end_of_line_(p, end);
+        if (status != parse_status::COMPLETE)
+        {
+            return status;
+        }
+    }
+
+    consumed = static_cast<size_t>(p - buf);
+    return parse_status::COMPLETE;
+}
+
+void url_decode(const char *data, size_t length, std::string &out, bool plus_is_space)
+{
+    out.clear();
+    out.reserve(length);
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        auto c = data[i];
+        if (c == '%' && i + 2 < length)
+        {
+            auto hi = hex_value_(data[i + 1]);
+            auto lo = hex_value_(data[i + 2]);
+            if (hi >= 0 && lo >= 0)
+            {
+                out.push_back(static_cast<char>((hi << 4) | lo));
+                i += 2;
+                continue;
+            }
+        }
+        out.push_back((plus_is_space && c == '+') ? ' ' : c);
+    }
+}
+
+void parse_query_string(const char *data, size_t length, query_params &params)
+{
+    auto p = data;
+    auto end = data + length;
+    std::string key, value;
+
+    while (p < end)
+    {
+        auto pair_end = p;
+        while (pair_end < end && *pair_end != '&')
+        {
+            ++pair_end;
+        }
+
+        auto equals = p;
+        while (equals < pair_end && *equals != '=')
+        {
+            ++equals;
+        }
+
+        if (pair_end > p)
+        {
+            url_decode(p, static_cast<size_t>(equals - p), key, true);
+            if (equals < pair_end)
+            {
+                url_decode(equals + 1, static_cast<size_t>(pair_end - equals - 1), value, true);
+            }
+            else
+            {
+                value.clear();
+            }
+            params[key] = value;
+        }
+
+        p = (pair_end < end) ? pair_end + 1 : end;
+    }
+}
+
+} //namespace luna
@@ -0,0 +1,83 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include "luna/types.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace luna
+{
+
+// A view into the connection's receive buffer. Only valid until the buffer is next modified.
+struct http_slice
+{
+    const char *data{nullptr};
+    size_t length{0};
+
+    std::string str() const
+    { return {data, length}; }
+
+    bool equals_nocase(const char *other, size_t other_length) const;
+};
+
+struct http_request_head
+{
+    struct header
+    {
+        http_slice name;
+        http_slice value;
+    };
+
+    http_slice method;
+    http_slice target;
+    http_slice version;
+
+    // cleared, not freed, between requests, so a connection stops allocating once it has seen its largest request
+    std::vector<header> headers;
+
+    // the framing-relevant headers, pulled out while we're looking at them anyway
+    size_t content_length{0};
+    bool chunked{false};
+    bool keep_alive{true};
+    bool expect_continue{false};
+};
+
+enum class parse_status
+{
+    COMPLETE,
+    INCOMPLETE,
+    INVALID,
+    TOO_LARGE,
+};
+
+// Parse an HTTP/1.x request line and header block out of buf. On COMPLETE, consumed is the size of the head,
+// including the blank line that ends it. Delimiters and control characters are located 16 bytes at a time where SSE2
+// is available, so validating the head costs no more than finding the ends of its lines.
+parse_status parse_request_head(const char *buf, size_t length, http_request_head &head, size_t &consumed);
+
+// Decode a chunked message body, appending each complete chunk to body. consumed covers the chunks decoded so far, so
+// that the caller can discard them and offer only what follows once more has arrived. On COMPLETE, it also covers the
+// last chunk and any trailer fields (which are discarded). TOO_LARGE as soon as a chunk would take body past max_size.
+parse_status parse_chunked_body(const char *buf, size_t length, size_t max_size, std::string &body, size_t &consumed);
+
+// Percent-decode, optionally turning '+' into ' ' as forms do. Malformed escapes are passed through untouched.
+void url_decode(const char *data, size_t length, std::string &out, bool plus_is_space);
+
+// Split an application/x-www-form-urlencoded string (a query string, or a form body) into params
+void parse_query_string(const char *data, size_t length, query_params &params);
+
+} //namespace luna
@@ -0,0 +1,578 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/kernel_tls.h"
+#include <atomic>
+
+#if defined(LUNA_HAVE_KTLS)
+
+#include "luna/private/certificate_store.h"
+#include "luna/private/tls_session_cache.h"
+#include <gnutls/gnutls.h>
+#include <gnutls/socket.h>
+#include <linux/tls.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+// older C libraries don't have these yet
+#if !defined(SOL_TLS)
+#define SOL_TLS 282
+#endif
+#if !defined(TCP_ULP)
+#define TCP_ULP 31
+#endif
+
+#endif // LUNA_HAVE_KTLS
+
+namespace luna
+{
+
+#if defined(LUNA_HAVE_KTLS)
+
+// the ciphers the kernel can take over, and nothing else
+static const char *default_priorities_{
+        "NORMAL:-VERS-TLS1.1:-VERS-TLS1.0:-CIPHER-ALL:+AES-128-GCM:+AES-256-GCM:+CHACHA20-POLY1305"};
+
+// offered with ALPN. Not h2: HTTP/2 frames file bodies in user space, so only HTTP/1.1 keeps them zero-copy, and
+// browsers would always pick h2 if it were offered. A client that starts with the HTTP/2 preface anyway is still
+// served HTTP/2, since the transport looks for it regardless.
+static const gnutls_datum_t alpn_protocols_[] = {
+        {const_cast<unsigned char *>(reinterpret_cast<const unsigned char *>("http/1.1")), 8},
+};
+
+struct kernel_tls::impl
+{
+    certificate_store certificates;
+    gnutls_priority_t priorities{nullptr};
+
+    std::unique_ptr<tls_session_cache> sessions;
+    gnutls_datum_t ticket_key{nullptr, 0}; // GnuTLS derives the rotating keys from this
+    std::chrono::seconds lifetime{0};
+
+    std::atomic<uint64_t> full_handshakes{0};
+    std::atomic<uint64_t> resumed_handshakes{0};
+
+    ~impl()
+    {
+        if (ticket_key.data)
+        {
+            gnutls_memset(ticket_key.data, 0, ticket_key.size);
+            gnutls_free(ticket_key.data);
+        }
+        if (priorities)
+        {
+            gnutls_priority_deinit(priorities);
+        }
+    }
+};
+
+struct kernel_tls::session::impl
+{
+    gnutls_session_t session{nullptr};
+    int fd;
+    kernel_tls::impl *tls;
+    std::shared_ptr<const certificate_store::certificate> certificate; // kept until the session's done with it
+
+    ~impl()
+    {
+        if (session)
+        {
+            gnutls_deinit(session);
+        }
+    }
+};
+
+// The tls module is loaded the first time a socket asks for it, and only a connected TCP socket can ask
+static bool probe_(std::string &why_not)
+{
+    auto listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    auto client = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int server{-1};
+    bool ok{false};
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    if (listener < 0 || client < 0 ||
+        bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listener, 1) != 0 ||
+        getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &length) != 0 ||
+        connect(client, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        (server = accept(listener, nullptr, nullptr)) < 0)
+    {
+        why_not = std::string{"can't open a connection to try it: "} + std::strerror(errno);
+    }
+    else if (setsockopt(server, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0)
+    {
+        why_not = std::string{"the kernel's tls module isn't available ("} + std::strerror(errno) + ")";
+    }
+    else
+    {
+        ok = true;
+    }
+
+    for (auto fd : {listener, client, server})
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+    return ok;
+}
+
+bool kernel_tls::available(std::string &why_not)
+{
+    static std::string reason;
+    static const bool available{probe_(reason)};
+    why_not = reason;
+    return available;
+}
+
+kernel_tls::kernel_tls() : impl_{new impl}
+{}
+
+kernel_tls::~kernel_tls() = default;
+
+bool kernel_tls::configure(const std::string &cert,
+                           const std::string &key,
+                           const std::string &password,
+                           const std::string &priorities,
+                           std::string &error)
+{
+    return configure({server::https_certificate{cert, key, password}}, priorities, error);
+}
+
+bool kernel_tls::configure(const std::vector<server::https_certificate> &certificates,
+                           const std::string &priorities,
+                           std::string &error)
+{
+    if (!reload(certificates, error))
+    {
+        return false;
+    }
+
+    const char *bad_priority{nullptr};
+    auto result = gnutls_priority_init(&impl_->priorities, priorities.empty() ? default_priorities_ : priorities.c_str(),
+                                  &bad_priority);
+    if (result < 0)
+    {
+        error = std::string{"bad TLS priorities"} + (bad_priority ? std::string{" at "} + bad_priority : "") + ": " +
+                gnutls_strerror(result);
+        return false;
+    }
+
+    return true;
+}
+
+bool kernel_tls::reload(const std::vector<server::https_certificate> &certificates, std::string &error)
+{
+    return impl_->certificates.load(certificates, error);
+}
+
+static std::string string_from_(const gnutls_datum_t &datum)
+{
+    return {reinterpret_cast<const char *>(datum.data), datum.size};
+}
+
+static int store_session_(void *sessions, gnutls_datum_t id, gnutls_datum_t session)
+{
+    static_cast<tls_session_cache *>(sessions)->store(string_from_(id), string_from_(session));
+    return 0;
+}
+
+static gnutls_datum_t retrieve_session_(void *sessions, gnutls_datum_t id)
+{
+    gnutls_datum_t session{nullptr, 0};
+    auto found = static_cast<tls_session_cache *>(sessions)->fetch(string_from_(id));
+    if (found)
+    {
+        // GnuTLS frees it
+        session.data = static_cast<unsigned char *>(gnutls_malloc(found->size()));
+        if (session.data)
+        {
+            std::memcpy(session.data, found->data(), found->size());
+            session.size = static_cast<unsigned int>(found->size());
+        }
+    }
+    return session;
+}
+
+static int remove_session_(void *sessions, gnutls_datum_t id)
+{
+    return static_cast<tls_session_cache *>(sessions)->remove(string_from_(id)) ? 0 : -1;
+}
+
+bool kernel_tls::enable_resumption(size_t cache_size, bool tickets, std::chrono::seconds lifetime, std::string &error)
+{
+    impl_->lifetime = lifetime;
+    if (cache_size > 0)
+    {
+        impl_->sessions.reset(new tls_session_cache{cache_size, lifetime});
+    }
+    if (tickets && !impl_->ticket_key.data)
+    {
+        auto result = gnutls_session_ticket_key_generate(&impl_->ticket_key);
+        if (result < 0)
+        {
+            error = std::string{"can't make a session ticket key: "} + gnutls_strerror(result);
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t kernel_tls::full_handshakes() const
+{
+    return impl_->full_handshakes;
+}
+
+uint64_t kernel_tls::resumed_handshakes() const
+{
+    return impl_->resumed_handshakes;
+}
+
+kernel_tls::session::session(const kernel_tls &tls, int fd) : impl_{new impl}
+{
+    impl_->fd = fd;
+    impl_->tls = tls.impl_.get();
+    impl_->certificate = impl_->tls->certificates.find("");
+    if (!impl_->certificate)
+    {
+        error_ = "there are no certificates";
+        return;
+    }
+    auto result = gnutls_init(&impl_->session, GNUTLS_SERVER | GNUTLS_NONBLOCK);
+    if (result == GNUTLS_E_SUCCESS)
+    {
+        result = gnutls_priority_set(impl_->session, tls.impl_->priorities);
+    }
+    if (result == GNUTLS_E_SUCCESS)
+    {
+        result = gnutls_credentials_set(impl_->session, GNUTLS_CRD_CERTIFICATE, impl_->certificate->credentials());
+    }
+    if (result == GNUTLS_E_SUCCESS)
+    {
+        result = gnutls_alpn_set_protocols(impl_->session, alpn_protocols_, 1, 0);
+    }
+    if (result == GNUTLS_E_SUCCESS && tls.impl_->ticket_key.data)
+    {
+        result = gnutls_session_ticket_enable_server(impl_->session, &tls.impl_->ticket_key);
+    }
+    if (result < 0)
+    {
+        error_ = gnutls_strerror(result);
+        return;
+    }
+    gnutls_certificate_server_set_request(impl_->session, GNUTLS_CERT_IGNORE);
+    gnutls_session_set_ptr(impl_->session, impl_.get());
+    // once the client has said which name it wants, switch to the certificate for that name
+    gnutls_handshake_set_post_client_hello_function(impl_->session, [](gnutls_session_t session) -> int
+    {
+        auto impl = static_cast<kernel_tls::session::impl *>(gnutls_session_get_ptr(session));
+        char name[256];
+        size_t size = sizeof(name);
+        unsigned int type;
+        std::string server_name;
+        if (gnutls_server_name_get(session, name, &size, &type, 0) == GNUTLS_E_SUCCESS && type == GNUTLS_NAME_DNS)
+        {
+            server_name.assign(name, size);
+        }
+
+        auto certificate = impl->tls->certificates.find(server_name);
+        if (certificate != impl->certificate)
+        {
+            auto result = gnutls_credentials_set(session, GNUTLS_CRD_CERTIFICATE, certificate->credentials());
+            if (result < 0)
+            {
+                return result;
+            }
+            impl->certificate = std::move(certificate);
+        }
+        return 0;
+    });
+    if (tls.impl_->lifetime.count() > 0)
+    {
+        // also how often GnuTLS moves on to a new ticket key; tickets made with the one before are still accepted
+        gnutls_db_set_cache_expiration(impl_->session, static_cast<int>(tls.impl_->lifetime.count()));
+    }
+    if (tls.impl_->sessions)
+    {
+        gnutls_db_set_ptr(impl_->session, tls.impl_->sessions.get());
+        gnutls_db_set_store_function(impl_->session, store_session_);
+        gnutls_db_set_retrieve_function(impl_->session, retrieve_session_);
+        gnutls_db_set_remove_function(impl_->session, remove_session_);
+    }
+    gnutls_handshake_set_timeout(impl_->session, 0); // the transport's connection_timeout covers it
+    gnutls_transport_set_int(impl_->session, fd);
+}
+
+kernel_tls::session::~session() = default;
+
+kernel_tls::session::progress kernel_tls::session::handshake()
+{
+    if (!error_.empty())
+    {
+        return progress::FAILED;
+    }
+
+    for (;;)
+    {
+        auto result = gnutls_handshake(impl_->session);
+        if (result == GNUTLS_E_SUCCESS)
+        {
+            ++(gnutls_session_is_resumed(impl_->session) ? impl_->tls->resumed_handshakes
+                                                         : impl_->tls->full_handshakes);
+            return progress::DONE;
+        }
+        if (result == GNUTLS_E_AGAIN || result == GNUTLS_E_INTERRUPTED)
+        {
+            return gnutls_record_get_direction(impl_->session) ? progress::WANT_WRITE : progress::WANT_READ;
+        }
+        if (gnutls_error_is_fatal(result))
+        {
+            error_ = gnutls_strerror(result);
+            return progress::FAILED;
+        }
+        // a warning alert; carry on
+    }
+}
+
+// The key material for one direction, in the form the kernel takes it for AES-GCM
+template<typename info_type>
+static bool gcm_info_(info_type &info,
+                      unsigned short version,
+                      unsigned short cipher,
+                      const gnutls_datum_t &iv,
+                      const gnutls_datum_t &key,
+                      const unsigned char *sequence)
+{
+    auto iv_size = sizeof(info.salt) + (version == TLS_1_3_VERSION ? sizeof(info.iv) : 0);
+    if (iv.size < iv_size || key.size != sizeof(info.key))
+    {
+        return false;
+    }
+    info.info.version = version;
+    info.info.cipher_type = cipher;
+    std::memcpy(info.salt, iv.data, sizeof(info.salt));
+    // TLS 1.3 nonces come entirely from the IV; TLS 1.2 sends part of each one with the record, and GnuTLS sends the
+    // sequence number for that part
+    std::memcpy(info.iv, version == TLS_1_3_VERSION ? iv.data + sizeof(info.salt) : sequence, sizeof(info.iv));
+    std::memcpy(info.key, key.data, sizeof(info.key));
+    std::memcpy(info.rec_seq, sequence, sizeof(info.rec_seq));
+    return true;
+}
+
+static bool offload_direction_(gnutls_session_t session, int fd, bool receiving, std::string &error)
+{
+    gnutls_datum_t mac_key, iv, key;
+    unsigned char sequence[8];
+    auto result = gnutls_record_get_state(session, receiving ? 1 : 0, &mac_key, &iv, &key, sequence);
+    if (result < 0)
+    {
+        error = gnutls_strerror(result);
+        return false;
+    }
+
+    unsigned short version;
+    switch (gnutls_protocol_get_version(session))
+    {
+        case GNUTLS_TLS1_2:
+            version = TLS_1_2_VERSION;
+            break;
+        case GNUTLS_TLS1_3:
+            version = TLS_1_3_VERSION;
+            break;
+        default:
+            error = std::string{"the kernel can't take over "} +
+                    gnutls_protocol_get_name(gnutls_protocol_get_version(session));
+            return false;
+    }
+
+    auto option = receiving ? TLS_RX : TLS_TX;
+    auto cipher = gnutls_cipher_get(session);
+    bool ok{false};
+    bool set{false};
+    switch (cipher)
+    {
+        case GNUTLS_CIPHER_AES_128_GCM:
+        {
+            tls12_crypto_info_aes_gcm_128 info;
+            std::memset(&info, 0, sizeof(info));
+            set = gcm_info_(info, version, TLS_CIPHER_AES_GCM_128, iv, key, sequence);
+            ok = set && setsockopt(fd, SOL_TLS, option, &info, sizeof(info)) == 0;
+            gnutls_memset(&info, 0, sizeof(info));
+            break;
+        }
+        case GNUTLS_CIPHER_AES_256_GCM:
+        {
+            tls12_crypto_info_aes_gcm_256 info;
+            std::memset(&info, 0, sizeof(info));
+            set = gcm_info_(info, version, TLS_CIPHER_AES_GCM_256, iv, key, sequence);
+            ok = set && setsockopt(fd, SOL_TLS, option, &info, sizeof(info)) == 0;
+            gnutls_memset(&info, 0, sizeof(info));
+            break;
+        }
+#if defined(TLS_CIPHER_CHACHA20_POLY1305)
+        case GNUTLS_CIPHER_CHACHA20_POLY1305:
+        {
+            tls12_crypto_info_chacha20_poly1305 info;
+            std::memset(&info, 0, sizeof(info));
+            set = iv.size == sizeof(info.iv) && key.size == sizeof(info.key);
+            if (set)
+            {
+                info.info.version = version;
+                info.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+                std::memcpy(info.iv, iv.data, sizeof(info.iv));
+                std::memcpy(info.key, key.data, sizeof(info.key));
+                std::memcpy(info.rec_seq, sequence, sizeof(info.rec_seq));
+            }
+            ok = set && setsockopt(fd, SOL_TLS, option, &info, sizeof(info)) == 0;
+            gnutls_memset(&info, 0, sizeof(info));
+            break;
+        }
+#endif
+        default:
+            break;
+    }
+
+    if (!set)
+    {
+        error = std::string{"the kernel can't take over "} + gnutls_cipher_get_name(cipher);
+    }
+    else if (!ok)
+    {
+        error = std::string{"the kernel wouldn't take over "} + gnutls_cipher_get_name(cipher) + ": " +
+                std::strerror(errno);
+    }
+    return ok;
+}
+
+bool kernel_tls::session::offload(std::vector<char> &in, size_t &in_used)
+{
+    auto session = impl_->session;
+
+    // Application data can arrive with the client's last handshake flight, and GnuTLS may have read it already
+    while (gnutls_record_check_pending(session) > 0)
+    {
+        auto pending = gnutls_record_check_pending(session);
+        if (in.size() - in_used < pending)
+        {
+            in.resize(in_used + pending);
+        }
+        auto received = gnutls_record_recv(session, in.data() + in_used, in.size() - in_used);
+        if (received <= 0)
+        {
+            break;
+        }
+        in_used += static_cast<size_t>(received);
+    }
+
+    // GnuTLS may have done this itself, if it's configured to
+    if (gnutls_transport_is_ktls_enabled(session) == GNUTLS_KTLS_DUPLEX)
+    {
+        return true;
+    }
+
+    if (setsockopt(impl_->fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0)
+    {
+        error_ = std::string{"the kernel's tls module isn't available ("} + std::strerror(errno) + ")";
+        return false;
+    }
+    return offload_direction_(session, impl_->fd, false, error_) &&
+           offload_direction_(session, impl_->fd, true, error_);
+}
+
+#else
+
+struct kernel_tls::impl
+{
+};
+
+struct kernel_tls::session::impl
+{
+};
+
+bool kernel_tls::available(std::string &why_not)
+{
+    why_not = "this build of Luna doesn't have GnuTLS and the kernel's TLS headers";
+    return false;
+}
+
+kernel_tls::kernel_tls() : impl_{new impl}
+{}
+
+kernel_tls::~kernel_tls() = default;
+
+bool kernel_tls::configure(const std::string &, const std::string &, const std::string &, const std::string &,
+                           std::string &error)
+{
+    available(error);
+    return false;
+}
+
+bool kernel_tls::configure(const std::vector<server::https_certificate> &, const std::string &, std::string &error)
+{
+    available(error);
+    return false;
+}
+
+bool kernel_tls::reload(const std::vector<server::https_certificate> &, std::string &error)
+{
+    available(error);
+    return false;
+}
+
+bool kernel_tls::enable_resumption(size_t, bool, std::chrono::seconds, std::string &error)
+{
+    available(error);
+    return false;
+}
+
+uint64_t kernel_tls::full_handshakes() const
+{
+    return 0;
+}
+
+uint64_t kernel_tls::resumed_handshakes() const
+{
+    return 0;
+}
+
+kernel_tls::session::session(const kernel_tls &, int) : impl_{new impl}
+{
+    available(error_);
+}
+
+kernel_tls::session::~session() = default;
+
+kernel_tls::session::progress kernel_tls::session::handshake()
+{
+    return progress::FAILED;
+}
+
+bool kernel_tls::session::offload(std::vector<char> &, size_t &)
+{
+    return false;
+}
+
+#endif // LUNA_HAVE_KTLS
+
+} //namespace luna
@@ -0,0 +1,115 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include "luna/server.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace luna
+{
+
+// HTTPS for the native transport. GnuTLS does the handshake, and then the session's keys are handed to the kernel
+// (kTLS), which encrypts and decrypts records itself from then on. To the transport, the connection is an ordinary
+// socket again: what it receives is plaintext, and files can still be spliced into it.
+//
+// Needs Linux's tls module and a cipher it can take over (AES-GCM, or ChaCha20-Poly1305 from Linux 5.11), and a build
+// of Luna with GnuTLS and the kernel's TLS headers (LUNA_HAVE_KTLS).
+class kernel_tls
+{
+public:
+    kernel_tls();
+
+    ~kernel_tls();
+
+    kernel_tls(const kernel_tls &) = delete;
+    kernel_tls &operator=(const kernel_tls &) = delete;
+
+    // Whether connections can be handed to the kernel here at all, and if not, why not
+    static bool available(std::string &why_not);
+
+    // The server's certificate and key, in PEM (the key decrypted with password, unless that's empty), and GnuTLS
+    // cipher priorities, or empty for the ones the kernel can take over. False, with the reason in error, if they
+    // won't do.
+    bool configure(const std::string &cert,
+                   const std::string &key,
+                   const std::string &password,
+                   const std::string &priorities,
+                   std::string &error);
+
+    // Or several certificates, chosen between by the name the client asks for (SNI); see certificate_store
+    bool configure(const std::vector<server::https_certificate> &certificates,
+                   const std::string &priorities,
+                   std::string &error);
+
+    // Replace the certificates while serving. Handshakes that have already begun finish with the ones they started
+    // with; if any of the new ones won't load, nothing changes.
+    bool reload(const std::vector<server::https_certificate> &certificates, std::string &error);
+
+    // Let clients resume earlier sessions for up to lifetime instead of doing a full handshake again: by session ID,
+    // from an in-memory cache of up to cache_size sessions (0 for none), and with session tickets, whose keys are
+    // rotated every lifetime. Sessions started before this are unaffected.
+    bool enable_resumption(size_t cache_size, bool tickets, std::chrono::seconds lifetime, std::string &error);
+
+    // How many handshakes have finished so far: full ones, and ones that resumed an earlier session
+    uint64_t full_handshakes() const;
+
+    uint64_t resumed_handshakes() const;
+
+    // One connection's handshake, on a non-blocking socket
+    class session
+    {
+    public:
+        enum class progress
+        {
+            DONE,
+            WANT_READ,
+            WANT_WRITE,
+            FAILED,
+        };
+
+        session(const kernel_tls &tls, int fd);
+
+        ~session();
+
+        session(const session &) = delete;
+        session &operator=(const session &) = delete;
+
+        // Take the handshake as far as it will go without blocking
+        progress handshake();
+
+        // Once the handshake is done, give the connection to the kernel. Anything the client sent along with the end
+        // of the handshake that has already been decrypted is appended to in.
+        bool offload(std::vector<char> &in, size_t &in_used);
+
+        const std::string &error() const
+        { return error_; }
+
+    private:
+        struct impl;
+        std::unique_ptr<impl> impl_;
+        std::string error_;
+    };
+
+private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+} //namespace luna
@@ -0,0 +1,72 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/loopback_engine.h"
+#include <fstream>
+#include <sstream>
+
+namespace luna
+{
+
+loopback_engine::loopback_engine(dispatcher &dispatcher) :
+        transport_engine{dispatcher},
+        running_{false}
+{}
+
+bool loopback_engine::start(uint16_t port)
+{
+    running_ = true;
+    return true;
+}
+
+void loopback_engine::stop()
+{
+    running_ = false;
+}
+
+bool loopback_engine::is_running()
+{
+    return running_;
+}
+
+response loopback_engine::inject(request request)
+{
+    request.start = std::chrono::system_clock::now();
+
+    auto permit = dispatcher_.admit(request.method, request.path);
+    if (!permit)
+    {
+        return dispatcher_.shed_response();
+    }
+
+    auto response = dispatcher_.dispatch(request);
+    permit.release();
+    dispatcher_.renderer().finalize(request, response);
+
+    // there is no wire to stream a file onto, so hand back its contents instead
+    if (!response.file.empty())
+    {
+        std::ifstream file{response.file, std::ios::in | std::ios::binary};
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        response.content = contents.str();
+    }
+
+    request.end = std::chrono::system_clock::now();
+    access_log(request, response);
+
+    return response;
+}
+
+} //namespace luna
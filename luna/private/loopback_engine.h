@@ -0,0 +1,42 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include "luna/private/transport_engine.h"
+#include <atomic>
+
+namespace luna
+{
+
+// An in-process transport with no sockets at all: requests are injected directly, and come back as finished response
+// objects. Useful for tests and for benchmarking routing and rendering without the network in the way.
+class loopback_engine : public transport_engine
+{
+public:
+    explicit loopback_engine(dispatcher &dispatcher);
+
+    bool start(uint16_t port) override;
+
+    void stop() override;
+
+    bool is_running() override;
+
+    response inject(request request);
+
+private:
+    std::atomic<bool> running_;
+};
+
+} //namespace luna
@@ -0,0 +1,738 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <arpa/inet.h>
+#include "luna/private/microhttpd_engine.h"
+#include <mutex>
+
+namespace luna
+{
+
+
+const server::accept_policy_cb default_accept_policy_callback_ = [](const struct sockaddr *addr,
+                                                                    socklen_t len) -> bool
+{
+    return true;
+};
+
+microhttpd_engine::microhttpd_engine(dispatcher &dispatcher) :
+        transport_engine{dispatcher},
+        debug_output_{false},
+        ssl_mem_key_set_{false},
+        ssl_mem_cert_set_{false},
+        use_thread_per_connection_{false},
+        use_epoll_if_available_{false},
+        suspendable_{false},
+        daemon_{nullptr},
+        shed_response_{nullptr},
+        accept_policy_callback_{default_accept_policy_callback_}
+{ }
+
+bool microhttpd_engine::start(uint16_t port)
+{
+    MHD_OptionItem options[options_.size() + 1];
+    uint16_t idx = 0;
+    for (const auto &opt : options_)
+    {
+        options[idx++] = opt; //copy it in, whee.
+    }
+    options[idx] = {MHD_OPTION_END, 0, nullptr};
+
+    unsigned int flags = MHD_NO_FLAG;
+
+    if (debug_output_)
+    {
+        LUNA_LOG_DEBUG("Enabling debug output");
+        flags |= MHD_USE_DEBUG;
+    }
+
+    if (ssl_mem_cert_set_ && ssl_mem_key_set_)
+    {
+        LUNA_LOG_DEBUG("Enabling SSL");
+        flags |= MHD_USE_SSL;
+    }
+    else if (ssl_mem_cert_set_ || ssl_mem_key_set_)
+    {
+        LUNA_LOG_FATAL("Please provide both server::https_mem_key AND server::https_mem_cert");
+        return false;
+    }
+
+    if (use_thread_per_connection_)
+    {
+        LUNA_LOG_DEBUG("Will use one thread per connection");
+        flags |= MHD_USE_THREAD_PER_CONNECTION | MHD_USE_POLL;
+    }
+    else if (use_epoll_if_available_)
+    {
+#if defined(__linux__)
+        LUNA_LOG_DEBUG("Will use epoll");
+        flags |= MHD_USE_EPOLL_INTERNALLY;
+#else
+        LUNA_LOG_DEBUG("Will use poll");
+        flags |= MHD_USE_POLL_INTERNALLY;
+#endif
+    }
+    else
+    {
+        LUNA_LOG_DEBUG("No threading options set, will use select");
+        flags |= MHD_USE_SELECT_INTERNALLY;
+    }
+
+    suspendable_ = !use_thread_per_connection_;
+    if (suspendable_)
+    {
+        flags |= MHD_USE_SUSPEND_RESUME;
+    }
+
+    if (!shed_response_)
+    {
+        const auto &shed = dispatcher_.shed_response();
+        shed_response_ = MHD_create_response_from_buffer(shed.content.size(),
+                                                         const_cast<char *>(shed.content.data()),
+                                                         MHD_RESPMEM_PERSISTENT);
+        MHD_add_response_header(shed_response_, MHD_HTTP_HEADER_CONTENT_TYPE, shed.content_type.c_str());
+        for (const auto &header : shed.headers)
+        {
+            MHD_add_response_header(shed_response_, header.first.c_str(), header.second.c_str());
+        }
+    }
+
+    daemon_ = MHD_start_daemon(flags,
+                               port,
+                               access_policy_callback_shim_, this,
+                               access_handler_callback_shim_, this,
+                               MHD_OPTION_NOTIFY_COMPLETED, request_completed_callback_shim_, this,
+                               MHD_OPTION_EXTERNAL_LOGGER, logger_callback_shim_, nullptr,
+                               MHD_OPTION_URI_LOG_CALLBACK, uri_logger_callback_shim_, nullptr,
+                               MHD_OPTION_ARRAY, options,
+                               MHD_OPTION_END);
+
+    return (daemon_ != nullptr);
+}
+
+void microhttpd_engine::stop()
+{
+    if (daemon_)
+    {
+        MHD_stop_daemon(daemon_);
+        daemon_ = nullptr;
+    }
+    if (shed_response_)
+    {
+        MHD_destroy_response(shed_response_);
+        shed_response_ = nullptr;
+    }
+}
+
+bool microhttpd_engine::is_running()
+{
+    return (daemon_ != nullptr);
+}
+
+
+//////// option setters
+
+void microhttpd_engine::set_option(server::debug_output value)
+{
+    debug_output_ = static_cast<bool>(value);
+}
+
+void microhttpd_engine::set_option(server::use_thread_per_connection value)
+{
+    use_thread_per_connection_ = static_cast<bool>(value);
+    if (use_epoll_if_available_)
+    {
+        LUNA_LOG_ERROR(
+                "Cannot combine use_thread_per_connection with use_epoll_if_available. Disabling use_epoll_if_available");
+        use_epoll_if_available_ = false; //not compatible!
+    }
+}
+
+void microhttpd_engine::set_option(server::use_epoll_if_available value)
+{
+    use_epoll_if_available_ = static_cast<bool>(value);
+    if (use_thread_per_connection_)
+    {
+        LUNA_LOG_ERROR(
+                "Cannot combine use_thread_per_connection with use_epoll_if_available. Disabling use_thread_per_connection");
+        use_thread_per_connection_ = false; //not compatible!
+    }
+}
+
+void microhttpd_engine::set_option(server::accept_policy_cb value)
+{
+    accept_policy_callback_ = value;
+}
+
+void microhttpd_engine::set_option(server::connection_memory_limit value)
+{
+    //this is a narrowing cast, so ugly! What to do, though?
+    options_.push_back({MHD_OPTION_CONNECTION_MEMORY_LIMIT, static_cast<intptr_t>(value), NULL});
+}
+
+void microhttpd_engine::set_option(server::connection_limit value)
+{
+    options_.push_back({MHD_OPTION_CONNECTION_LIMIT, static_cast<intptr_t>(value), NULL});
+}
+
+void microhttpd_engine::set_option(server::connection_timeout value)
+{
+    options_.push_back({MHD_OPTION_CONNECTION_TIMEOUT, static_cast<intptr_t>(value), NULL});
+}
+
+//void microhttpd_engine::set_option(server::notify_completed value)
+//{
+//    //TODO
+//}
+
+void microhttpd_engine::set_option(server::per_ip_connection_limit value)
+{
+    options_.push_back({MHD_OPTION_PER_IP_CONNECTION_LIMIT, static_cast<intptr_t>(value), NULL});
+}
+
+void microhttpd_engine::set_option(const server::sockaddr_ptr value)
+{
+    //why are we casting away the constness? Because MHD isn'T going to modify this, and I want the caller
+    // to be assured of this fact.
+    options_.push_back({MHD_OPTION_SOCK_ADDR, 0, const_cast<sockaddr *>(value)});
+}
+
+//void microhttpd_engine::set_option(uri_log_callback value)
+//{
+//    options_.push_back({MHD_OPTION_URI_LOG_CALLBACK, value, NULL});
+//}
+
+void microhttpd_engine::set_option(const server::https_mem_key &value)
+{
+    // we must make a durable copy of these strings before tossing around char pointers to their internals
+    https_mem_key_.emplace_back(value);
+    options_.push_back({MHD_OPTION_HTTPS_MEM_KEY, 0,
+                               const_cast<char *>(https_mem_key_.back().c_str())});
+    ssl_mem_key_set_ = true;
+}
+
+void microhttpd_engine::set_option(const server::https_mem_cert &value)
+{
+    https_mem_cert_.emplace_back(value);
+    options_.push_back({MHD_OPTION_HTTPS_MEM_CERT, 0,
+                               const_cast<char *>(https_mem_cert_.back().c_str())});
+    ssl_mem_cert_set_ = true;
+}
+
+//void microhttpd_engine::set_option(https_cred_type value)
+//{
+//    //TODO
+//}
+
+void microhttpd_engine::set_option(const server::https_priorities &value)
+{
+    https_priorities_.emplace_back(value);
+    options_.push_back({MHD_OPTION_HTTPS_PRIORITIES, 0,
+                               const_cast<char *>(https_priorities_.back().c_str())});
+}
+
+void microhttpd_engine::set_option(server::listen_socket value)
+{
+    options_.push_back({MHD_OPTION_LISTEN_SOCKET, static_cast<intptr_t>(value), NULL});
+}
+
+void microhttpd_engine::set_option(server::thread_pool_size value)
+{
+    options_.push_back({MHD_OPTION_THREAD_POOL_SIZE, static_cast<intptr_t>(value), NULL});
+}
+
+void microhttpd_engine::set_option(server::unescaper_cb value)
+{
+    unescaper_callback_ = value;
+    options_.push_back({MHD_OPTION_UNESCAPE_CALLBACK, (intptr_t) &(unescaper_callback_shim_), this});
+}
+
+//void microhttpd_engine::set_option(digest_auth_random value)
+//{
+//    //TODO
+//}
+
+void microhttpd_engine::set_option(server::nonce_nc_size value)
+{
+    options_.push_back({MHD_OPTION_NONCE_NC_SIZE, static_cast<intptr_t>(value), NULL});
+}
+
+void microhttpd_engine::set_option(server::thread_stack_size value)
+{
+    options_.push_back({MHD_OPTION_THREAD_STACK_SIZE, static_cast<intptr_t>(value), NULL});
+}
+
+void microhttpd_engine::set_option(const server::https_mem_trust &value)
+{
+    https_mem_trust_.emplace_back(value);
+    options_.push_back({MHD_OPTION_HTTPS_MEM_TRUST, 0,
+                               const_cast<char *>(https_mem_trust_.back().c_str())});
+}
+
+void microhttpd_engine::set_option(server::connection_memory_increment value)
+{
+    options_.push_back({MHD_OPTION_CONNECTION_MEMORY_INCREMENT, static_cast<intptr_t>(value), NULL});
+}
+
+//void microhttpd_engine::set_option(https_cert_callback value)
+//{
+//    //TODO
+//}
+
+//void microhttpd_engine::set_option(tcp_fastopen_queue_size value)
+//{
+//    options_.push_back({MHD_OPTION_TCP_FASTOPEN_QUEUE_SIZE, value, NULL});
+//}
+
+void microhttpd_engine::set_option(const server::https_mem_dhparams &value)
+{
+    https_mem_dhparams_.emplace_back(value);
+    options_.push_back({MHD_OPTION_HTTPS_MEM_DHPARAMS, 0,
+                               const_cast<char *>(https_mem_dhparams_.back().c_str())});
+}
+
+//void microhttpd_engine::set_option(listening_address_reuse value)
+//{
+//    options_.push_back({MHD_OPTION_LISTENING_ADDRESS_REUSE, value, NULL});
+//}
+
+void microhttpd_engine::set_option(const server::https_key_password &value)
+{
+    https_key_password_.emplace_back(value);
+    options_.push_back({MHD_OPTION_HTTPS_KEY_PASSWORD, 0,
+                               const_cast<char *>(https_key_password_.back().c_str())});
+}
+
+//void microhttpd_engine::set_option(notify_connection value)
+//{
+//    //TODO
+//}
+
+
+//////// private methods setters
+
+struct connection_info_struct
+{
+    request_method connectiontype;
+    query_params post_params;
+    std::string body;
+    MHD_PostProcessor *postprocessor;
+    cancellation_token cancellation; // tripped if the connection dies before the response is sent
+    concurrency_limiter::permit permit;
+
+    // for a request that's waiting on an identical one for its response, with its connection suspended
+    std::mutex coalesced_lock;
+    bool suspended{false};
+    OPT_NS::optional<request> waiting_request;
+    OPT_NS::optional<response> coalesced_response;
+
+    // what was queued, held until the request is complete: its body may be a buffer MHD doesn't have a copy of
+    std::shared_ptr<cacheable_response> queued;
+
+    connection_info_struct(request_method method,
+                           struct MHD_Connection *connection,
+                           size_t buffer_size,
+                           MHD_PostDataIterator iter) :
+            connectiontype{method}, postprocessor{nullptr}
+    {
+        postprocessor = MHD_create_post_processor(connection, buffer_size, iter, this);
+    }
+
+    ~connection_info_struct()
+    {
+        if (postprocessor)
+        {
+            MHD_destroy_post_processor(postprocessor);
+        }
+    }
+};
+
+request_method method_str_to_enum_(const char *method_str)
+{
+    if (!std::strcmp(method_str, "GET"))
+    {
+        return request_method::GET;
+    }
+
+    if (!std::strcmp(method_str, "PUT"))
+    {
+        return request_method::PUT;
+    }
+
+    if (!std::strcmp(method_str, "POST"))
+    {
+        return request_method::POST;
+    }
+
+    if (!std::strcmp(method_str, "PATCH"))
+    {
+        return request_method::PATCH;
+    }
+
+    if (!std::strcmp(method_str, "DELETE"))
+    {
+        return request_method::DELETE;
+    }
+
+    if (!std::strcmp(method_str, "OPTIONS"))
+    {
+        return request_method::OPTIONS;
+    }
+
+    return request_method::UNKNOWN;
+}
+
+//TODO I hate this.
+request_method method_str_to_enum_(const std::string &method_str)
+{
+    return method_str_to_enum_(method_str.c_str());
+}
+
+std::string addr_to_str_(const struct sockaddr *addr)
+{
+    if (addr)
+    {
+        char str[INET_ADDRSTRLEN];
+
+        switch (addr->sa_family)
+        {
+            case AF_INET:
+                inet_ntop(addr->sa_family,
+                          &(reinterpret_cast<const sockaddr_in *>(addr)->sin_addr),
+                          str,
+                          INET_ADDRSTRLEN);
+                break;
+            case AF_INET6:
+                inet_ntop(addr->sa_family,
+                          &(reinterpret_cast<const sockaddr_in6 *>(addr)->sin6_addr),
+                          str,
+                          INET_ADDRSTRLEN);
+                break;
+            default:
+                return "";
+        }
+        return std::string{str};
+    }
+    return "";
+}
+
+MHD_ValueKind method_to_value_kind_enum_(request_method method)
+{
+    if (method == request_method::GET)
+    {
+        return MHD_GET_ARGUMENT_KIND;
+    }
+
+    return MHD_POSTDATA_KIND;
+}
+
+
+int parse_kv_(void *cls, enum MHD_ValueKind kind, const char *key, const char *value)
+{
+    switch (kind)
+    {
+        case MHD_HEADER_KIND:
+        case MHD_RESPONSE_HEADER_KIND:
+        {
+            auto kv = static_cast<case_insensitive_map *>(cls);
+            (*kv)[key] = value ? value : "";
+        }
+            break;
+        default:
+        {
+            auto kv = static_cast<case_sensitive_map *>(cls);
+            (*kv)[key] = value ? value : "";
+        }
+    }
+    return MHD_YES;
+}
+
+int microhttpd_engine::access_handler_callback_(struct MHD_Connection *connection,
+                                                  const char *url,
+                                                  const char *method_char,
+                                                  const char *version,
+                                                  const char *upload_data,
+                                                  size_t *upload_data_size,
+                                                  void **con_cls)
+{
+    auto start = std::chrono::system_clock::now();
+
+    std::string http_version{version};
+
+    request_method method = method_str_to_enum_(method_char);
+
+    std::string url_str{url};
+
+    if (!*con_cls)
+    {
+        // Under overload, turn the request away before spending anything on it, not even reading its body
+        auto permit = dispatcher_.admit(method, url_str);
+        if (!permit)
+        {
+            return MHD_queue_response(connection, dispatcher_.shed_response().status_code, shed_response_);
+        }
+
+        connection_info_struct *con_info = new(std::nothrow) connection_info_struct(method,
+                                                                                    connection,
+                                                                                    65535,
+                                                                                    iterate_postdata_shim_);
+        if (!con_info) return MHD_NO; //TODO what does this mean?
+
+        con_info->permit = std::move(permit);
+        *con_cls = con_info;
+
+        return MHD_YES;
+    }
+
+    //POST data handling. This is a tortured flow, and not really MHD' high point.
+    auto con_info = static_cast<connection_info_struct *>(*con_cls);
+
+    // back from suspension, with the response we were waiting for
+    if (con_info->waiting_request)
+    {
+        std::unique_lock<std::mutex> ulock{con_info->coalesced_lock};
+        auto request = std::move(*con_info->waiting_request);
+        auto response = std::move(*con_info->coalesced_response);
+        con_info->waiting_request = OPT_NS::nullopt;
+        ulock.unlock();
+        return respond_(connection, con_info, std::move(request), std::move(response));
+    }
+
+    //parse the query params:
+    luna::headers header;
+
+    MHD_get_connection_values(connection, MHD_HEADER_KIND, &parse_kv_, &header);
+
+    //find the route, and hit the right callback
+    query_params query_params;
+
+    //Query params handling
+    MHD_get_connection_values(connection, method_to_value_kind_enum_(method), &parse_kv_, &query_params);
+
+    if (*upload_data_size != 0)
+    {
+        //TODO note that we just drop BINARY data on the floor at present!! See iterate_postdata_shim_()
+        if (MHD_post_process(con_info->postprocessor, upload_data, *upload_data_size) == MHD_NO)
+        {
+            //MHD couldn't parse it, maybe we can.
+            con_info->body.append(upload_data, *upload_data_size);
+        }
+
+        *upload_data_size = 0; //flags that we processed everything. This is a funny place to put it.
+        return MHD_YES;
+    }
+
+    if (!con_info->post_params.empty())//we're done getting postdata, and we have some query params to handle, do something with it
+    {
+        //if we have post_params, then MHD has ignored the query params. So just overwrite it.
+        std::swap(query_params, con_info->post_params);
+    }
+
+    // construct request object
+    auto ip_address = addr_to_str_(MHD_get_connection_info(connection,
+                                                           MHD_CONNECTION_INFO_CLIENT_ADDRESS)->client_addr);
+
+    luna::request request{};
+    request.start = start;
+    request.end = start;
+    request.ip_address = ip_address;
+    request.method = method;
+    request.path = url_str;
+    request.http_version = http_version;
+    request.params = std::move(query_params);
+    request.headers = std::move(header);
+    request.body = con_info->body;
+    request.cancellation = con_info->cancellation;
+
+    LUNA_LOG_DEBUG(std::string{"Received request for "} + method_char + " " + url_str);
+
+
+
+    if (!suspendable_)
+    {
+        auto response = dispatcher_.dispatch(request);
+        con_info->permit.release();
+        return respond_(connection, con_info, std::move(request), std::move(response));
+    }
+
+    auto response = dispatcher_.dispatch(request, [connection, con_info](const luna::response &response)
+    {
+        std::lock_guard<std::mutex> guard{con_info->coalesced_lock};
+        con_info->coalesced_response = response;
+        if (con_info->suspended)
+        {
+            MHD_resume_connection(connection); // and we'll be called again, to send it
+        }
+    });
+
+    if (!response)
+    {
+        // An identical request is already being handled. Put the connection aside until its response is ready,
+        // unless it already is.
+        con_info->permit = concurrency_limiter::permit{}; // not running anything, so not counted against the limit
+        std::unique_lock<std::mutex> ulock{con_info->coalesced_lock};
+        if (!con_info->coalesced_response)
+        {
+            con_info->waiting_request = std::move(request);
+            con_info->suspended = true;
+            MHD_suspend_connection(connection);
+            return MHD_YES;
+        }
+        response = std::move(con_info->coalesced_response);
+    }
+    con_info->permit.release();
+
+    return respond_(connection, con_info, std::move(request), std::move(*response));
+}
+
+int microhttpd_engine::respond_(struct MHD_Connection *connection,
+                                connection_info_struct *con_info,
+                                request &&request,
+                                response &&response)
+{
+    auto response_mhd = dispatcher_.renderer().render(request, response);
+    auto retval = MHD_queue_response(connection, response_mhd->status_code, response_mhd->mhd_response);
+    con_info->queued = std::move(response_mhd);
+
+    request.end = std::chrono::system_clock::now();
+
+    // log it
+    access_log(std::move(request), std::move(response)); // we're done with these, so the logger can take them
+
+    return retval;
+}
+
+/////////// callback shims
+
+int microhttpd_engine::access_handler_callback_shim_(void *cls,
+                                                       struct MHD_Connection *connection,
+                                                       const char *url,
+                                                       const char *method,
+                                                       const char *version,
+                                                       const char *upload_data,
+                                                       size_t *upload_data_size,
+                                                       void **con_cls)
+{
+    if (!cls) return MHD_NO;
+
+    return static_cast<microhttpd_engine *>(cls)->access_handler_callback_(connection,
+                                                                     url,
+                                                                     method,
+                                                                     version,
+                                                                     upload_data,
+                                                                     upload_data_size,
+                                                                     con_cls);
+}
+
+
+int microhttpd_engine::access_policy_callback_shim_(void *cls, const struct sockaddr *addr, socklen_t addrlen)
+{
+    if (!cls) return MHD_NO;
+
+    return static_cast<microhttpd_engine *>(cls)->accept_policy_callback_(addr, addrlen);
+}
+
+
+void microhttpd_engine::request_completed_callback_shim_(void *cls, struct MHD_Connection *connection,
+                                                           void **con_cls,
+                                                           enum MHD_RequestTerminationCode toe)
+{
+    auto con_info = static_cast<connection_info_struct *>(*con_cls);
+
+    if (con_info)
+    {
+        // The client aborted, timed out, or the connection broke: let anything still working on this request know
+        // that there's nobody left to answer
+        if (toe != MHD_REQUEST_TERMINATED_COMPLETED_OK)
+        {
+            con_info->cancellation.cancel();
+        }
+
+        delete con_info;
+        *con_cls = NULL;
+    }
+}
+
+void *microhttpd_engine::uri_logger_callback_shim_(void *cls, const char *uri, struct MHD_Connection *con)
+{
+//    LUNA_LOG_DEBUG(uri); //TODO and stuff about the connection too!
+    return nullptr;
+}
+
+int microhttpd_engine::iterate_postdata_shim_(void *cls,
+                                                enum MHD_ValueKind kind,
+                                                const char *key,
+                                                const char *filename,
+                                                const char *content_type,
+                                                const char *transfer_encoding,
+                                                const char *data,
+                                                uint64_t off,
+                                                size_t size)
+{
+    auto con_info = static_cast<connection_info_struct *>(cls);
+    //TODO this is where we would process binary data. This needs to be implemented
+    //TODO unsure how to differentiate between binary (multi-part) post data, and query params, so I am going to wing it
+    //  ANnoyingly, when query params are sent here, content_type is nil. As is transfer_encoding. So.
+
+
+    if (key) //TODO this is a hack, I don't even know if this is a reliable way to detect query params
+    {
+        auto con_info = static_cast<connection_info_struct *>(cls);
+        parse_kv_(&con_info->post_params, kind, key, data);
+        return MHD_YES;
+    }
+
+    return MHD_YES;
+}
+
+void microhttpd_engine::logger_callback_shim_(void *cls, const char *fm, va_list ap)
+{
+    if (!error_log_enabled(log_level::DEBUG))
+    {
+        return; // don't bother formatting a message nobody will read
+    }
+
+    //not at all happy with this.
+    char message[4096];
+    std::vsnprintf(message, sizeof(message), fm, ap);
+    LUNA_LOG_DEBUG(message);
+}
+
+size_t microhttpd_engine::unescaper_callback_shim_(void *cls, struct MHD_Connection *c, char *s)
+{
+    auto this_ptr = static_cast<microhttpd_engine *>(cls);
+    if (this_ptr && this_ptr->unescaper_callback_)
+    {
+        auto result = this_ptr->unescaper_callback_(s);
+        auto old_len = strlen(s);
+        memcpy(s, result.c_str(), old_len);
+        return (old_len > result.length()) ? result.length() : old_len;
+    }
+
+    return strlen(s); //no change
+}
+
+//void microhttpd_engine::notify_connection_callback_shim_(void *cls,
+//                                                           struct MHD_Connection *connection,
+//                                                           void **socket_context,
+//                                                           enum MHD_ConnectionNotificationCode toe)
+//{
+//    auto this_ptr = static_cast<microhttpd_engine *>(cls);
+//    if (this_ptr && this_ptr->notify_connection_callback_)
+//    {
+//        return this_ptr->notify_connection_callback_(connection, socket_context, toe);
+//    }
+//}
+
+} //namespace luna
@@ -0,0 +1,181 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include "luna/private/transport_engine.h"
+#include "luna/server.h"
+#include <microhttpd.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace luna
+{
+
+struct connection_info_struct;
+
+// The default transport, built on libmicrohttpd
+class microhttpd_engine : public transport_engine
+{
+public:
+    explicit microhttpd_engine(dispatcher &dispatcher);
+
+    bool start(uint16_t port) override;
+
+    void stop() override;
+
+    bool is_running() override;
+
+    // option setters
+    void set_option(server::debug_output value);
+
+    void set_option(server::use_thread_per_connection value);
+
+    void set_option(server::use_epoll_if_available value);
+
+    void set_option(server::accept_policy_cb handler);
+
+    //MHD options
+    void set_option(server::connection_memory_limit value);
+
+    void set_option(server::connection_limit value);
+
+    void set_option(server::connection_timeout value);
+
+    void set_option(server::per_ip_connection_limit value);
+
+    void set_option(const server::sockaddr_ptr value);
+
+    void set_option(const server::https_mem_key &value);
+
+    void set_option(const server::https_mem_cert &value);
+
+    void set_option(const server::https_priorities &value);
+
+    void set_option(server::listen_socket value);
+
+    void set_option(server::thread_pool_size value);
+
+    void set_option(server::unescaper_cb value);
+
+    void set_option(server::nonce_nc_size value);
+
+    void set_option(server::thread_stack_size value);
+
+    void set_option(const server::https_mem_trust &value);
+
+    void set_option(server::connection_memory_increment value);
+
+    void set_option(const server::https_mem_dhparams &value);
+
+    void set_option(const server::https_key_password &value);
+
+private:
+    bool debug_output_;
+
+    bool ssl_mem_key_set_;
+    bool ssl_mem_cert_set_;
+
+    bool use_thread_per_connection_;
+
+    bool use_epoll_if_available_;
+
+    // whether connections can be put aside while they wait for another request's response. Not with a thread per
+    // connection, where waiting only holds up the connection's own thread anyway.
+    bool suspendable_;
+
+    // string copies of options
+    std::vector<std::string> https_mem_key_;
+    std::vector<std::string> https_mem_cert_;
+    std::vector<std::string> https_priorities_;
+    std::vector<std::string> https_mem_trust_;
+    std::vector<std::string> https_mem_dhparams_;
+    std::vector<std::string> https_key_password_;
+
+    //options
+    std::vector<MHD_OptionItem> options_;
+
+    struct MHD_Daemon *daemon_;
+
+    // prepared once, and queued as is for every request that's turned away under load
+    struct MHD_Response *shed_response_;
+
+    ///// internal use-only callbacks
+
+    int access_handler_callback_(struct MHD_Connection *connection,
+                                 const char *url,
+                                 const char *method,
+                                 const char *version,
+                                 const char *upload_data,
+                                 size_t *upload_data_size,
+                                 void **con_cls);
+
+    int respond_(struct MHD_Connection *connection,
+                 connection_info_struct *con_info,
+                 request &&request,
+                 response &&response);
+
+
+    ////// external-use callbacks that can be set with options
+    server::accept_policy_cb accept_policy_callback_; //has a default value
+
+    server::unescaper_cb unescaper_callback_;
+
+    ///// callback shims
+
+    static int access_policy_callback_shim_(void *cls,
+                                            const struct sockaddr *addr,
+                                            socklen_t addrlen);
+
+    static int access_handler_callback_shim_(void *cls,
+                                             struct MHD_Connection *connection,
+                                             const char *url,
+                                             const char *method,
+                                             const char *version,
+                                             const char *upload_data,
+                                             size_t *upload_data_size,
+                                             void **con_cls);
+
+    static void request_completed_callback_shim_(void *cls,
+                                                 struct MHD_Connection *connection,
+                                                 void **con_cls,
+                                                 enum MHD_RequestTerminationCode toe);
+
+    static void *uri_logger_callback_shim_(void *cls, const char *uri, struct MHD_Connection *con);
+
+    static void logger_callback_shim_(void *cls, const char *fm, va_list ap);
+
+    static size_t unescaper_callback_shim_(void *cls, struct MHD_Connection *c, char *s);
+
+    static int iterate_postdata_shim_(void *cls,
+                                      enum MHD_ValueKind kind,
+                                      const char *key,
+                                      const char *filename,
+                                      const char *content_type,
+                                      const char *transfer_encoding,
+                                      const char *data,
+                                      uint64_t off,
+                                      size_t size);
+
+    //TODO MHD_OPTION_HTTPS_CERT_CALLBACK callback_shim_
+
+    //TODO I don't know what to do with this one yet.
+//    static void notify_connection_callback_shim_(void *cls,
+//                                                 struct MHD_Connection *connection,
+//                                                 void **socket_context,
+//                                                 enum MHD_ConnectionNotificationCode toe);
+};
+
+} //namespace luna
@@ -0,0 +1,316 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/mime_registry.h"
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+
+namespace luna
+{
+
+namespace
+{
+
+struct mime_entry
+{
+    const char *extension; // in lower case
+    const char *type;
+};
+
+constexpr mime_entry builtin_types_[] = {
+        // text
+        {"html", "text/html; charset=utf-8"},
+        {"htm", "text/html; charset=utf-8"},
+        {"xhtml", "application/xhtml+xml"},
+        {"css", "text/css; charset=utf-8"},
+        {"txt", "text/plain"}, // as libmime had it, and as unknown extensions are served
+        {"text", "text/plain"},
+        {"log", "text/plain"},
+        {"md", "text/markdown; charset=utf-8"},
+        {"markdown", "text/markdown; charset=utf-8"},
+        {"csv", "text/csv; charset=utf-8"},
+        {"tsv", "text/tab-separated-values; charset=utf-8"},
+        {"ics", "text/calendar; charset=utf-8"},
+        {"vcf", "text/vcard; charset=utf-8"},
+        {"vtt", "text/vtt; charset=utf-8"},
+        {"appcache", "text/cache-manifest; charset=utf-8"},
+        {"xml", "application/xml"},
+        {"xsl", "application/xml"},
+        {"rss", "application/rss+xml"},
+        {"atom", "application/atom+xml"},
+        {"srt", "application/x-subrip"},
+
+        // scripts and data
+        {"js", "application/javascript; charset=utf-8"},
+        {"mjs", "application/javascript; charset=utf-8"},
+        {"cjs", "application/javascript; charset=utf-8"},
+        {"json", "application/json; charset=utf-8"},
+        {"map", "application/json; charset=utf-8"},
+        {"jsonld", "application/ld+json"},
+        {"geojson", "application/geo+json"},
+        {"webmanifest", "application/manifest+json"},
+        {"yaml", "application/yaml"},
+        {"yml", "application/yaml"},
+        {"toml", "application/toml"},
+        {"wasm", "application/wasm"},
+        {"pbf", "application/x-protobuf"},
+        {"sh", "application/x-sh"},
+
+        // images
+        {"png", "image/png"},
+        {"apng", "image/apng"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"jpe", "image/jpeg"},
+        {"gif", "image/gif"},
+        {"webp", "image/webp"},
+        {"avif", "image/avif"},
+        {"jxl", "image/jxl"},
+        {"heic", "image/heic"},
+        {"svg", "image/svg+xml"},
+        {"svgz", "image/svg+xml"},
+        {"ico", "image/x-icon"},
+        {"cur", "image/x-icon"},
+        {"bmp", "image/bmp"},
+        {"tif", "image/tiff"},
+        {"tiff", "image/tiff"},
+        {"psd", "image/vnd.adobe.photoshop"},
+
+        // fonts
+        {"woff", "font/woff"},
+        {"woff2", "font/woff2"},
+        {"ttf", "font/ttf"},
+        {"otf", "font/otf"},
+        {"eot", "application/vnd.ms-fontobject"},
+
+        // audio
+        {"mp3", "audio/mpeg"},
+        {"m4a", "audio/mp4"},
+        {"aac", "audio/aac"},
+        {"ogg", "audio/ogg"},
+        {"oga", "audio/ogg"},
+        {"opus", "audio/opus"},
+        {"wav", "audio/wav"},
+        {"weba", "audio/webm"},
+        {"flac", "audio/flac"},
+        {"mid", "audio/midi"},
+        {"midi", "audio/midi"},
+
+        // video
+        {"mp4", "video/mp4"},
+        {"m4v", "video/mp4"},
+        {"webm", "video/webm"},
+        {"ogv", "video/ogg"},
+        {"mov", "video/quicktime"},
+        {"avi", "video/x-msvideo"},
+        {"mpeg", "video/mpeg"},
+        {"mpg", "video/mpeg"},
+        {"ts", "video/mp2t"},
+        {"3gp", "video/3gpp"},
+        {"m3u8", "application/vnd.apple.mpegurl"},
+        {"mpd", "application/dash+xml"},
+
+        // 3D models
+        {"gltf", "model/gltf+json"},
+        {"glb", "model/gltf-binary"},
+
+        // documents
+        {"pdf", "application/pdf"},
+        {"rtf", "application/rtf"},
+        {"epub", "application/epub+zip"},
+        {"doc", "application/msword"},
+        {"docx", "application/vnd.openxmlformats-officedocument.wordprocessingml.document"},
+        {"xls", "application/vnd.ms-excel"},
+        {"xlsx", "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet"},
+        {"ppt", "application/vnd.ms-powerpoint"},
+        {"pptx", "application/vnd.openxmlformats-officedocument.presentationml.presentation"},
+        {"odt", "application/vnd.oasis.opendocument.text"},
+        {"ods", "application/vnd.oasis.opendocument.spreadsheet"},
+        {"odp", "application/vnd.oasis.opendocument.presentation"},
+        {"eml", "message/rfc822"},
+
+        // archives and binaries
+        {"zip", "application/zip"},
+        {"gz", "application/gzip"},
+        {"tgz", "application/gzip"},
+        {"tar", "application/x-tar"},
+        {"bz2", "application/x-bzip2"},
+        {"xz", "application/x-xz"},
+        {"7z", "application/x-7z-compressed"},
+        {"rar", "application/vnd.rar"},
+        {"jar", "application/java-archive"},
+        {"apk", "application/vnd.android.package-archive"},
+        {"deb", "application/vnd.debian.binary-package"},
+        {"rpm", "application/x-rpm"},
+        {"dmg", "application/x-apple-diskimage"},
+        {"swf", "application/x-shockwave-flash"},
+        {"torrent", "application/x-bittorrent"},
+        {"pem", "application/x-pem-file"},
+        {"crt", "application/x-x509-ca-cert"},
+        {"der", "application/x-x509-ca-cert"},
+        {"bin", "application/octet-stream"},
+        {"exe", "application/octet-stream"},
+        {"dll", "application/octet-stream"},
+        {"iso", "application/octet-stream"},
+};
+
+constexpr size_t builtin_count_{sizeof(builtin_types_) / sizeof(builtin_types_[0])};
+
+// no extension above is longer than this
+constexpr size_t max_extension_length_{16};
+
+// Big enough that a seed putting every extension in a slot of its own turns up after a few tries. If one doesn't, the
+// static_assert below says so.
+constexpr size_t table_size_{4096};
+
+constexpr size_t length_(const char *s)
+{
+    size_t length{0};
+    while (s[length] != '\0')
+    {
+        ++length;
+    }
+    return length;
+}
+
+constexpr uint32_t hash_(const char *key, size_t length, uint32_t seed)
+{
+    uint32_t hash{seed};
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash = (hash ^ static_cast<unsigned char>(key[i])) * 0x01000193u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+struct table
+{
+    uint32_t seed;
+    uint16_t slots[table_size_]; // the index of the entry in each slot, plus one; zero for none
+};
+
+constexpr table build_table_()
+{
+    table built{};
+    for (uint32_t seed = 0x811c9dc5u; seed < 0x811c9dc5u + 1000; ++seed)
+    {
+        for (auto &slot : built.slots)
+        {
+            slot = 0;
+        }
+        bool collided{false};
+        for (size_t i = 0; i < builtin_count_ && !collided; ++i)
+        {
+            auto &slot = built.slots[hash_(builtin_types_[i].extension, length_(builtin_types_[i].extension), seed) %
+                                     table_size_];
+            collided = slot != 0;
+            slot = static_cast<uint16_t>(i + 1);
+        }
+        if (!collided)
+        {
+            built.seed = seed;
+            return built;
+        }
+    }
+    built.seed = 0;
+    return built;
+}
+
+constexpr table table_{build_table_()};
+static_assert(table_.seed != 0, "No perfect hash for the built-in MIME types; make table_size_ bigger");
+
+constexpr bool short_extensions_()
+{
+    for (const auto &entry : builtin_types_)
+    {
+        if (length_(entry.extension) > max_extension_length_)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(short_extensions_(), "A built-in MIME type's extension is longer than max_extension_length_");
+
+const char *default_type_{"text/plain"};
+
+} //namespace
+
+const char *mime_registry::builtin(const char *extension, size_t length)
+{
+    if (length == 0 || length > max_extension_length_)
+    {
+        return nullptr;
+    }
+    char lower[max_extension_length_];
+    for (size_t i = 0; i < length; ++i)
+    {
+        lower[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(extension[i])));
+    }
+
+    auto slot = table_.slots[hash_(lower, length, table_.seed) % table_size_];
+    if (slot == 0)
+    {
+        return nullptr;
+    }
+    const auto &entry = builtin_types_[slot - 1];
+    return length_(entry.extension) == length && std::memcmp(entry.extension, lower, length) == 0 ? entry.type :
+           nullptr;
+}
+
+std::string mime_registry::type_for(const std::string &filename) const
+{
+    auto slash = filename.rfind('/');
+    auto dot = filename.rfind('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return default_type_;
+    }
+    auto extension = filename.c_str() + dot + 1;
+    auto length = filename.size() - dot - 1;
+
+    if (!overrides_.empty())
+    {
+        std::string lower{extension, length};
+        for (auto &c : lower)
+        {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        auto found = overrides_.find(lower);
+        if (found != overrides_.end())
+        {
+            return found->second;
+        }
+    }
+
+    auto type = builtin(extension, length);
+    return type ? type : default_type_;
+}
+
+void mime_registry::set(std::string extension, std::string type)
+{
+    extension.erase(0, extension.find_first_not_of('.'));
+    for (auto &c : extension)
+    {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    overrides_[extension] = std::move(type);
+}
+
+} //namespace luna
@@ -0,0 +1,43 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+
+namespace luna
+{
+
+// What files are served as, going by their extensions. The built-in types are in a perfect hash table worked out at
+// compile time, so that looking one up, or finding there isn't one, is one hash and one comparison. Types set here
+// take precedence over them.
+class mime_registry
+{
+public:
+    // The MIME type for filename: its extension's, or text/plain if it has none that's known
+    std::string type_for(const std::string &filename) const;
+
+    // Serve files with extension (case doesn't matter) as type. Not safe to call while files are being served.
+    void set(std::string extension, std::string type);
+
+    // The built-in type for an extension, or null if there isn't one
+    static const char *builtin(const char *extension, size_t length);
+
+private:
+    std::unordered_map<std::string, std::string> overrides_;
+};
+
+} //namespace luna
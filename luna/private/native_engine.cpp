@@ -0,0 +1,1681 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/native_engine.h"
+
+#if defined(LUNA_HAVE_IO_URING)
+
+#include "luna/private/http2_session.h"
+#include "luna/private/http_parser.h"
+#include "luna/private/safer_times.h"
+#include "luna/private/uring.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+
+#endif // LUNA_HAVE_IO_URING
+
+namespace luna
+{
+
+#if defined(LUNA_HAVE_IO_URING)
+
+std::string addr_to_str_(const struct sockaddr *addr); // shared with the libmicrohttpd transport
+
+// how many submissions each worker's ring holds
+static const unsigned int ring_entries_ = 256;
+
+// receive buffers grow at least this much at a time
+static const size_t receive_chunk_ = 16 * 1024;
+
+// one default-sized pipe's worth of file per splice
+static const size_t splice_chunk_ = 64 * 1024;
+
+static const std::string continue_response_{"HTTP/1.1 100 Continue\r\n\r\n"};
+
+static const std::string switching_protocols_response_{
+        "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n"};
+
+static const char *reason_phrase_(status_code code)
+{
+    switch (code)
+    {
+        case 100: return "Continue";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 303: return "See Other";
+        case 304: return "Not Modified";
+        case 307: return "Temporary Redirect";
+        case 308: return "Permanent Redirect";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 409: return "Conflict";
+        case 410: return "Gone";
+        case 411: return "Length Required";
+        case 413: return "Payload Too Large";
+        case 415: return "Unsupported Media Type";
+        case 422: return "Unprocessable Entity";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        default: return "Unknown";
+    }
+}
+
+static request_method method_from_(const http_slice &method)
+{
+    switch (method.length)
+    {
+        case 3:
+            if (!std::memcmp(method.data, "GET", 3)) return request_method::GET;
+            if (!std::memcmp(method.data, "PUT", 3)) return request_method::PUT;
+            break;
+        case 4:
+            if (!std::memcmp(method.data, "POST", 4)) return request_method::POST;
+            break;
+        case 5:
+            if (!std::memcmp(method.data, "PATCH", 5)) return request_method::PATCH;
+            break;
+        case 6:
+            if (!std::memcmp(method.data, "DELETE", 6)) return request_method::DELETE;
+            break;
+        case 7:
+            if (!std::memcmp(method.data, "OPTIONS", 7)) return request_method::OPTIONS;
+            break;
+        default:
+            break;
+    }
+    return request_method::UNKNOWN;
+}
+
+static int listen_socket_(uint16_t port)
+{
+    auto fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    // every worker listens on its own socket, and the kernel balances new connections between them
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        LUNA_LOG_DEBUG(std::string{"Failed to bind to port "} + std::to_string(port) + ": " + std::strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+struct connection;
+
+// A response on its way back to the worker that owns the connection, from the handler pool, or from whichever thread
+// handled an identical request that this one waited on
+struct delivery
+{
+    connection *conn;
+    uint64_t serial; // in case conn has been closed meanwhile, and its memory reused
+    uint32_t stream_id; // zero for HTTP/1.1
+    luna::request request;
+    luna::response response;
+};
+
+// Everything we know about one client connection. Each connection has at most one operation in flight at a time,
+// so a completion for it can always act on it (or free it) without coordinating with anything else. Aligned so that
+// there's room for what a completion is for in the low bits of a pointer to it.
+struct alignas(16) connection
+{
+    int fd{-1};
+    uint64_t serial{0}; // tells this connection apart from any that had its memory before it
+    std::string ip_address;
+
+    // the TLS handshake, until the connection is handed to the kernel
+    std::unique_ptr<kernel_tls::session> tls;
+
+    // bytes received but not yet consumed; the request head is parsed in place here
+    std::vector<char> in;
+    size_t in_used{0};
+    http_request_head head;
+
+    // a chunked request body, decoded as it arrives; decoded chunks are dropped from in
+    std::string chunked_body;
+
+    // a receive is in flight, and whether it was cancelled to make way for HTTP/2 responses that are ready to go
+    bool receiving{false};
+    bool interrupted{false};
+
+    // watching for the client hanging up while an HTTP/1.1 request is handled, whether it has (or has only stopped
+    // sending), and a response that's ready but waits for the watch to be called off
+    bool watching{false};
+    bool hung_up{false};
+    bool half_closed{false};
+    OPT_NS::optional<delivery> held;
+
+    std::string out;
+    size_t out_sent{0};
+    bool keep_alive{true};
+    bool continue_sent{false};
+    bool sending_continue{false};
+
+    // file responses go from file to pipe to socket, without passing through user space
+    int file_fd{-1};
+    off_t file_offset{0};
+    size_t file_remaining{0};
+    int pipe_fds[2]{-1, -1};
+    size_t piped{0};
+
+    // set once the connection has switched to HTTP/2
+    std::unique_ptr<http2_session> h2;
+
+    // requests being handled, or whose responses are still being sent, by HTTP/2 stream (zero for HTTP/1.1), to be
+    // cancelled if the connection goes before they're done
+    std::map<uint32_t, cancellation_token> responding;
+
+    // admission for the request being received
+    concurrency_limiter::permit permit;
+};
+
+// Shared with the handlers that post to it, which may outlive the worker
+struct mailbox
+{
+    std::mutex lock;
+    bool open{true};
+    int wake_fd{-1};
+    std::vector<delivery> delivered;
+
+    void post(delivery &&delivery)
+    {
+        std::lock_guard<std::mutex> guard{lock};
+        if (open)
+        {
+            delivered.emplace_back(std::move(delivery));
+            uint64_t one = 1;
+            auto written = write(wake_fd, &one, sizeof(one));
+            (void) written;
+        }
+    }
+};
+
+class native_engine::worker
+{
+public:
+    worker(native_engine &engine, int listen_fd) :
+            engine_(engine),
+            listen_fd_{listen_fd},
+            wake_fd_{eventfd(0, EFD_CLOEXEC)},
+            wake_value_{0},
+            mailbox_{std::make_shared<mailbox>()},
+            ring_{ring_entries_},
+            stopping_{false},
+            inflight_{0},
+            next_serial_{0},
+            accept_addr_length_{0},
+            date_time_{0}
+    {
+        timeout_.tv_sec = engine_.connection_timeout_;
+        timeout_.tv_nsec = 0;
+        mailbox_->wake_fd = wake_fd_;
+    }
+
+    ~worker()
+    {
+        stop();
+
+        {
+            std::lock_guard<std::mutex> guard{mailbox_->lock};
+            mailbox_->open = false;
+        }
+
+        while (!connections_.empty())
+        {
+            release_(*connections_.begin());
+        }
+        if (wake_fd_ >= 0)
+        {
+            close(wake_fd_);
+        }
+        if (listen_fd_ >= 0)
+        {
+            close(listen_fd_);
+        }
+    }
+
+    bool start()
+    {
+        if (!ring_ || wake_fd_ < 0)
+        {
+            return false;
+        }
+
+        thread_ = std::thread{&worker::run_, this};
+        return true;
+    }
+
+    void stop()
+    {
+        if (!thread_.joinable())
+        {
+            return;
+        }
+
+        stopping_ = true;
+        uint64_t one = 1;
+        auto written = write(wake_fd_, &one, sizeof(one));
+        (void) written;
+        thread_.join();
+    }
+
+private:
+    // what a completion was for, packed into the low bits of its user_data next to the connection pointer
+    enum op : uint64_t
+    {
+        ACCEPT = 1,
+        RECEIVE,
+        SEND,
+        SPLICE_IN,
+        SPLICE_OUT,
+        WAKE,
+        IGNORED, // linked timeouts and cancellations; only the operation they act on matters
+        HANDSHAKE,
+        WATCH,
+    };
+
+    static const uint64_t op_mask_ = 15;
+
+    io_uring_sqe *prepare_(connection *conn, op kind)
+    {
+        auto sqe = ring_.get_sqe();
+        if (!sqe)
+        {
+            throw std::runtime_error{std::string{"io_uring submission failed: "} + std::strerror(errno)};
+        }
+        sqe->user_data = reinterpret_cast<uint64_t>(conn) | kind;
+        if (kind != IGNORED)
+        {
+            ++inflight_;
+        }
+        return sqe;
+    }
+
+    void run_()
+    {
+        // Splicing into a socket the client has closed raises SIGPIPE, and there's no MSG_NOSIGNAL for splice. It's
+        // raised on the thread that submitted the splice (io_uring's own threads block every signal), so blocking it
+        // here keeps it from the rest of the process, whatever the application has done with SIGPIPE.
+        sigset_t pipe;
+        sigemptyset(&pipe);
+        sigaddset(&pipe, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &pipe, nullptr);
+
+        try
+        {
+            accept_();
+            wait_for_wake_();
+
+            while (!stopping_ || inflight_ > 0)
+            {
+                if (ring_.submit_and_wait(1) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                {
+                    throw std::runtime_error{std::string{"io_uring_enter failed: "} + std::strerror(errno)};
+                }
+
+                ring_.for_each_cqe([this](const io_uring_cqe &cqe)
+                                   {
+                                       complete_(cqe);
+                                   });
+            }
+        }
+        catch (const std::exception &e)
+        {
+            LUNA_LOG_FATAL(std::string{"Native transport worker stopped: "} + e.what());
+        }
+    }
+
+    void complete_(const io_uring_cqe &cqe)
+    {
+        auto kind = static_cast<op>(cqe.user_data & op_mask_);
+        auto conn = reinterpret_cast<connection *>(cqe.user_data & ~op_mask_);
+        if (kind == IGNORED)
+        {
+            return;
+        }
+        --inflight_;
+
+        if (kind == WAKE)
+        {
+            if (stopping_)
+            {
+                deliver_(); // including the 503s for requests that were waiting on identical ones
+                shut_down_();
+                return;
+            }
+            deliver_();
+            wait_for_wake_();
+            return;
+        }
+
+        // Wind everything down as its current operation finishes, apart from responses on their way out, which are
+        // closed once they're sent
+        auto finishing = (kind == SEND || kind == SPLICE_IN || kind == SPLICE_OUT || (kind == WATCH && conn->held));
+        if (stopping_ && !finishing)
+        {
+            if (kind == ACCEPT && cqe.res >= 0)
+            {
+                close(cqe.res);
+            }
+            else if (conn)
+            {
+                release_(conn);
+            }
+            return;
+        }
+
+        switch (kind)
+        {
+            case ACCEPT:
+                on_accept_(cqe.res);
+                break;
+            case RECEIVE:
+                on_receive_(conn, cqe.res);
+                break;
+            case SEND:
+                on_send_(conn, cqe.res);
+                break;
+            case SPLICE_IN:
+                on_splice_in_(conn, cqe.res);
+                break;
+            case SPLICE_OUT:
+                on_splice_out_(conn, cqe.res);
+                break;
+            case HANDSHAKE:
+                on_handshake_(conn, cqe.res);
+                break;
+            case WATCH:
+                on_watch_(conn, cqe.res);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void wait_for_wake_()
+    {
+        auto sqe = prepare_(nullptr, WAKE);
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = wake_fd_;
+        sqe->addr = reinterpret_cast<uint64_t>(&wake_value_);
+        sqe->len = sizeof(wake_value_);
+    }
+
+    void shut_down_()
+    {
+        // Wake up everything still waiting on a client. The pending accept is cancelled outright, since shutting down
+        // a listening socket doesn't reliably complete it.
+        auto sqe = prepare_(nullptr, IGNORED);
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = ACCEPT;
+
+        shutdown(listen_fd_, SHUT_RDWR);
+        for (auto conn : connections_)
+        {
+            if (!conn->held && (conn->sending_continue || conn->out_sent == conn->out.size()))
+            {
+                shutdown(conn->fd, SHUT_RDWR);
+            }
+        }
+    }
+
+    void accept_()
+    {
+        accept_addr_length_ = sizeof(accept_addr_);
+        auto sqe = prepare_(nullptr, ACCEPT);
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listen_fd_;
+        sqe->addr = reinterpret_cast<uint64_t>(&accept_addr_);
+        sqe->addr2 = reinterpret_cast<uint64_t>(&accept_addr_length_);
+        sqe->accept_flags = SOCK_CLOEXEC;
+    }
+
+    void on_accept_(int result)
+    {
+        if (result >= 0)
+        {
+            auto addr = reinterpret_cast<const sockaddr *>(&accept_addr_);
+            auto limit = engine_.connection_limit_;
+            if ((limit && engine_.connection_count_ >= limit) ||
+                !engine_.accept_policy_callback_(addr, accept_addr_length_))
+            {
+                close(result);
+            }
+            else
+            {
+                int on = 1;
+                setsockopt(result, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+                auto conn = new connection;
+                conn->fd = result;
+                conn->serial = ++next_serial_;
+                conn->ip_address = addr_to_str_(addr);
+                connections_.insert(conn);
+                ++engine_.connection_count_;
+                if (engine_.tls_)
+                {
+                    fcntl(result, F_SETFL, fcntl(result, F_GETFL) | O_NONBLOCK);
+                    conn->tls.reset(new kernel_tls::session{*engine_.tls_, result});
+                    handshake_(conn);
+                }
+                else
+                {
+                    receive_(conn);
+                }
+            }
+        }
+        else if (result != -EINTR && result != -EAGAIN)
+        {
+            LUNA_LOG_ERROR(std::string{"Failed to accept connection: "} + std::strerror(-result));
+        }
+
+        accept_();
+    }
+
+    void handshake_(connection *conn)
+    {
+        switch (conn->tls->handshake())
+        {
+            case kernel_tls::session::progress::DONE:
+                if (!conn->tls->offload(conn->in, conn->in_used))
+                {
+                    LUNA_LOG_ERROR("Could not hand TLS for " + conn->ip_address + " over to the kernel: " +
+                                   conn->tls->error());
+                    release_(conn);
+                    return;
+                }
+                conn->tls.reset();
+                if (conn->in_used)
+                {
+                    process_(conn);
+                }
+                else
+                {
+                    receive_(conn);
+                }
+                break;
+            case kernel_tls::session::progress::WANT_READ:
+                wait_for_handshake_(conn, POLLIN);
+                break;
+            case kernel_tls::session::progress::WANT_WRITE:
+                wait_for_handshake_(conn, POLLOUT);
+                break;
+            case kernel_tls::session::progress::FAILED:
+                LUNA_LOG_DEBUG("TLS handshake with " + conn->ip_address + " failed: " + conn->tls->error());
+                release_(conn);
+                break;
+        }
+    }
+
+    void wait_for_handshake_(connection *conn, uint16_t events)
+    {
+        auto sqe = prepare_(conn, HANDSHAKE);
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = conn->fd;
+        sqe->poll_events = events;
+        link_timeout_(sqe);
+    }
+
+    // Give up on an operation that waits on the client if it takes longer than connection_timeout. It completes with
+    // -ECANCELED, and the connection is closed like any other dropped connection.
+    void link_timeout_(io_uring_sqe *sqe)
+    {
+        if (timeout_.tv_sec)
+        {
+            sqe->flags |= IOSQE_IO_LINK;
+            auto timeout = prepare_(nullptr, IGNORED);
+            timeout->opcode = IORING_OP_LINK_TIMEOUT;
+            timeout->addr = reinterpret_cast<uint64_t>(&timeout_);
+            timeout->len = 1;
+        }
+    }
+
+    void on_handshake_(connection *conn, int result)
+    {
+        if (result < 0)
+        {
+            release_(conn); // timed out, or broken
+            return;
+        }
+
+        handshake_(conn);
+    }
+
+    void receive_(connection *conn)
+    {
+        if (conn->in.size() - conn->in_used < receive_chunk_)
+        {
+            conn->in.resize(conn->in_used + receive_chunk_);
+        }
+
+        auto sqe = prepare_(conn, RECEIVE);
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = conn->fd;
+        sqe->addr = reinterpret_cast<uint64_t>(conn->in.data() + conn->in_used);
+        sqe->len = static_cast<uint32_t>(conn->in.size() - conn->in_used);
+        link_timeout_(sqe);
+        conn->receiving = true;
+    }
+
+    void on_receive_(connection *conn, int result)
+    {
+        conn->receiving = false;
+        if (conn->interrupted)
+        {
+            conn->interrupted = false;
+            if (result == -ECANCELED)
+            {
+                process_(conn); // to send what's waiting, and then receive again
+                return;
+            }
+        }
+
+        if (result <= 0)
+        {
+            release_(conn); // closed by the client, timed out, or broken
+            return;
+        }
+
+        conn->in_used += static_cast<size_t>(result);
+        process_(conn);
+    }
+
+    // Look at what's been received so far: either handle a complete request, or go back for more
+    void process_(connection *conn)
+    {
+        if (conn->h2)
+        {
+            process_h2_(conn);
+            return;
+        }
+
+        // a client with prior knowledge of HTTP/2 support starts with the HTTP/2 preface instead of a request
+        auto &preface = http2_session::preface;
+        if (conn->in_used && !std::memcmp(conn->in.data(), preface.data(), std::min(conn->in_used, preface.size())))
+        {
+            if (conn->in_used < preface.size())
+            {
+                receive_(conn);
+                return;
+            }
+            start_h2_(conn);
+            process_h2_(conn);
+            return;
+        }
+
+        size_t head_size;
+        auto status = parse_request_head(conn->in.data(), conn->in_used, conn->head, head_size);
+        if (status == parse_status::INCOMPLETE)
+        {
+            if (conn->in_used >= engine_.max_head_size_)
+            {
+                respond_with_error_(conn, 431);
+            }
+            else
+            {
+                receive_(conn);
+            }
+            return;
+        }
+        if (status == parse_status::INVALID)
+        {
+            respond_with_error_(conn, 400);
+            return;
+        }
+
+        if (!conn->permit)
+        {
+            // Under overload, turn the request away before reading its body. The path is still escaped, which is
+            // close enough for finding the endpoint's priority.
+            auto target = conn->head.target;
+            auto query = static_cast<const char *>(std::memchr(target.data, '?', target.length));
+            std::string path{target.data, query ? static_cast<size_t>(query - target.data) : target.length};
+            conn->permit = engine_.dispatcher_.admit(method_from_(conn->head.method), path);
+            if (!conn->permit)
+            {
+                conn->keep_alive = false; // the body, if any, is still on its way
+                conn->out = engine_.shed_response_;
+                conn->out_sent = 0;
+                send_(conn);
+                return;
+            }
+        }
+
+        std::string body;
+        size_t body_size = 0;
+        auto available = conn->in_used - head_size;
+        auto body_start = conn->in.data() + head_size;
+        auto max_body_size = engine_.max_body_size_;
+        if (conn->head.chunked)
+        {
+            size_t decoded;
+            status = parse_chunked_body(body_start, available, max_body_size, conn->chunked_body, decoded);
+            if (status == parse_status::COMPLETE)
+            {
+                body.swap(conn->chunked_body);
+                body_size = decoded;
+            }
+            else if (status == parse_status::INCOMPLETE)
+            {
+                // decode each chunk only once, however many pieces the body arrives in
+                if (decoded)
+                {
+                    std::memmove(body_start, body_start + decoded, available - decoded);
+                    conn->in_used -= decoded;
+                    available -= decoded;
+                }
+                // what's left is at most one chunk, and can't be much bigger than the body may be
+                if (available > max_body_size - conn->chunked_body.size() + engine_.max_head_size_)
+                {
+                    status = parse_status::TOO_LARGE;
+                }
+            }
+        }
+        else if (conn->head.content_length > max_body_size)
+        {
+            status = parse_status::TOO_LARGE;
+        }
+        else if (available >= conn->head.content_length)
+        {
+            body_size = conn->head.content_length;
+            body.assign(body_start, body_size);
+            status = parse_status::COMPLETE;
+        }
+        else
+        {
+            status = parse_status::INCOMPLETE;
+        }
+
+        if (status == parse_status::INVALID)
+        {
+            respond_with_error_(conn, 400);
+            return;
+        }
+        if (status == parse_status::TOO_LARGE)
+        {
+            respond_with_error_(conn, 413);
+            return;
+        }
+        if (status == parse_status::INCOMPLETE)
+        {
+            if (conn->head.expect_continue && !conn->continue_sent)
+            {
+                conn->continue_sent = true;
+                conn->sending_continue = true;
+                conn->out = continue_response_;
+                conn->out_sent = 0;
+                send_(conn);
+            }
+            else
+            {
+                receive_(conn);
+            }
+            return;
+        }
+
+        handle_request_(conn, head_size + body_size, std::move(body));
+    }
+
+    void handle_request_(connection *conn, size_t request_size, std::string &&body)
+    {
+        const auto &head = conn->head;
+
+        request_headers headers;
+        for (const auto &header : head.headers)
+        {
+            headers[header.name.str()] = header.value.str();
+        }
+
+        conn->keep_alive = head.keep_alive;
+        conn->continue_sent = false;
+
+        // done with this request's bytes; anything after them is the next pipelined request
+        std::string method{head.method.str()};
+        std::string target{head.target.str()};
+        std::string version{head.version.str()};
+        auto remaining = conn->in_used - request_size;
+        if (remaining)
+        {
+            std::memmove(conn->in.data(), conn->in.data() + request_size, remaining);
+        }
+        conn->in_used = remaining;
+
+        if (upgrade_to_h2_(conn, method, target, headers, body))
+        {
+            conn->permit.release();
+            return;
+        }
+
+        auto request = build_request_(conn, method, target, std::move(version), std::move(headers), std::move(body));
+        conn->responding[0] = request.cancellation;
+
+        dispatch_(conn, 0, std::move(request), std::move(conn->permit));
+        watch_(conn);
+    }
+
+    // The connection has nothing else to do until the response is posted back, so meanwhile, watch for the client
+    // going away, which cancels the request while its handler is still running. POLLHUP and POLLERR are always
+    // reported; POLLRDHUP is only asked for until the client has been seen to stop sending.
+    void watch_(connection *conn)
+    {
+        conn->watching = true;
+        auto sqe = prepare_(conn, WATCH);
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = conn->fd;
+        sqe->poll_events = conn->half_closed ? 0 : POLLRDHUP;
+    }
+
+    void on_watch_(connection *conn, int result)
+    {
+        conn->watching = false;
+        auto aborted = (result < 0 && result != -ECANCELED) || (result > 0 && (result & (POLLHUP | POLLERR)));
+        if (!aborted && conn->held)
+        {
+            // called off, as the response is ready
+            auto delivery = std::move(*conn->held);
+            conn->held = OPT_NS::nullopt;
+            respond_(conn, std::move(delivery.request), std::move(delivery.response));
+            return;
+        }
+        if (result > 0 && !aborted)
+        {
+            // The client has only shut down its sending half, which HTTP/1.1 allows, so it still gets the response
+            // (and any it pipelined before that), but there's nothing more to read from it. Keep watching for it going
+            // away altogether.
+            conn->half_closed = true;
+            if (!conn->in_used)
+            {
+                conn->keep_alive = false;
+            }
+            watch_(conn);
+            return;
+        }
+
+        if (conn->held)
+        {
+            release_(conn); // too late to tell the handler
+            return;
+        }
+        conn->hung_up = true;
+        conn->responding[0].cancel();
+    }
+
+    // Run the request's handler on the handler pool, and post the response back here, to deliver_()
+    void dispatch_(connection *conn, uint32_t stream_id, luna::request &&request, concurrency_limiter::permit &&permit)
+    {
+        auto mailbox = mailbox_;
+        auto &dispatcher = engine_.dispatcher_;
+        auto serial = conn->serial;
+        auto pending = std::make_shared<luna::request>(std::move(request));
+        auto held = std::make_shared<concurrency_limiter::permit>(std::move(permit));
+        engine_.handlers_->post([mailbox, &dispatcher, conn, serial, stream_id, pending, held]
+                                {
+                                    // a request that waits for an identical one (see router::coalesce) is posted
+                                    // back from whichever thread handled that one, and no thread waits meanwhile
+                                    auto post = [mailbox, conn, serial, stream_id, pending](luna::response response)
+                                    {
+                                        mailbox->post({conn, serial, stream_id, std::move(*pending),
+                                                       std::move(response)});
+                                    };
+
+                                    OPT_NS::optional<luna::response> response;
+                                    try
+                                    {
+                                        response = dispatcher.dispatch(*pending, post);
+                                    }
+                                    catch (const std::exception &e)
+                                    {
+                                        LUNA_LOG_ERROR(std::string{"Request handler threw an exception: "} + e.what());
+                                        response = luna::response{500, "text/plain", "Internal error"};
+                                    }
+                                    catch (...)
+                                    {
+                                        LUNA_LOG_ERROR("Unknown internal error");
+                                        response = luna::response{500, "text/plain", "Internal error"};
+                                    }
+
+                                    // waiting on another request isn't counted against the limit either
+                                    held->release();
+                                    if (response)
+                                    {
+                                        post(std::move(*response));
+                                    }
+                                });
+    }
+
+    void respond_(connection *conn, luna::request &&request, luna::response &&response)
+    {
+        engine_.dispatcher_.renderer().finalize(request, response);
+        write_response_(conn, response);
+
+        request.end = std::chrono::system_clock::now();
+        access_log(std::move(request), std::move(response)); // we're done with these, so the logger can take them
+
+        send_(conn);
+    }
+
+    // Send the responses the handlers have posted back
+    void deliver_()
+    {
+        std::vector<delivery> delivered;
+        {
+            std::lock_guard<std::mutex> guard{mailbox_->lock};
+            delivered.swap(mailbox_->delivered);
+        }
+
+        for (auto &delivery : delivered)
+        {
+            auto conn = delivery.conn;
+            if (!connections_.count(conn) || conn->serial != delivery.serial)
+            {
+                continue; // an HTTP/2 client that went away while its request was being handled
+            }
+
+            if (delivery.stream_id)
+            {
+                conn->responding.erase(delivery.stream_id);
+                respond_h2_(conn, delivery.stream_id, std::move(delivery.request), std::move(delivery.response));
+            }
+            else if (conn->watching)
+            {
+                // the watch has to finish before the response can go out
+                conn->held = std::move(delivery);
+                auto sqe = prepare_(nullptr, IGNORED);
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->addr = reinterpret_cast<uint64_t>(conn) | WATCH;
+            }
+            else if (conn->hung_up)
+            {
+                release_(conn);
+            }
+            else
+            {
+                respond_(conn, std::move(delivery.request), std::move(delivery.response));
+            }
+        }
+    }
+
+    luna::request build_request_(connection *conn,
+                                 const std::string &method,
+                                 const std::string &target,
+                                 std::string &&version,
+                                 request_headers &&headers,
+                                 std::string &&body)
+    {
+        auto start = std::chrono::system_clock::now();
+
+        auto query = target.find('?');
+        auto path_length = (query == std::string::npos) ? target.size() : query;
+
+        std::string path;
+        if (engine_.unescaper_callback_)
+        {
+            path = engine_.unescaper_callback_(target.substr(0, path_length));
+        }
+        else
+        {
+            url_decode(target.data(), path_length, path, false);
+        }
+
+        query_params params;
+        if (query != std::string::npos)
+        {
+            parse_query_string(target.data() + query + 1, target.size() - query - 1, params);
+        }
+
+        // form bodies are turned into params, just as libmicrohttpd's post processor does
+        auto content_type = headers.find("Content-Type");
+        static const std::string form_type{"application/x-www-form-urlencoded"};
+        if (content_type != headers.end() &&
+            !strncasecmp(content_type->second.c_str(), form_type.c_str(), form_type.size()))
+        {
+            query_params post_params;
+            parse_query_string(body.data(), body.size(), post_params);
+            if (!post_params.empty())
+            {
+                std::swap(params, post_params);
+                body.clear();
+            }
+        }
+
+        LUNA_LOG_DEBUG(std::string{"Received request for "} + method + " " + path);
+
+        luna::request request{};
+        request.start = start;
+        request.end = start;
+        request.ip_address = conn->ip_address;
+        request.method = method_from_(http_slice{method.data(), method.size()});
+        request.path = std::move(path);
+        request.http_version = std::move(version);
+        request.params = std::move(params);
+        request.headers = std::move(headers);
+        request.body = std::move(body);
+        return request;
+    }
+
+    // An HTTP/1.1 request can ask to carry on in HTTP/2 (RFC 7540 §3.2). We only take it up on that when there's no
+    // request body to read first, which is how clients ask in practice.
+    bool upgrade_to_h2_(connection *conn,
+                        const std::string &method,
+                        const std::string &target,
+                        request_headers &headers,
+                        std::string &body)
+    {
+        auto upgrade = headers.find("Upgrade");
+        auto settings = headers.find("HTTP2-Settings");
+        if (upgrade == headers.end() || settings == headers.end() || !body.empty() ||
+            upgrade->second.find("h2c") == std::string::npos)
+        {
+            return false;
+        }
+
+        auto http2_settings = settings->second;
+        start_h2_(conn);
+        if (!conn->h2->start_upgraded(http2_settings, http2_request{method, target, headers, {}}))
+        {
+            conn->h2.reset();
+            return false; // settings we can't make sense of, so carry on in HTTP/1.1
+        }
+
+        conn->out = switching_protocols_response_;
+        conn->out.append(conn->h2->output());
+        conn->out_sent = 0;
+        conn->h2->output().clear();
+        conn->keep_alive = true;
+        send_(conn);
+        return true;
+    }
+
+    void start_h2_(connection *conn)
+    {
+        conn->h2.reset(new http2_session{[this, conn](uint32_t stream_id, http2_request &&request)
+                                         {
+                                             return handle_h2_(conn, stream_id, std::move(request));
+                                         }, engine_.max_head_size_, engine_.max_body_size_});
+        conn->h2->on_reset([conn](uint32_t stream_id)
+                           {
+                               auto found = conn->responding.find(stream_id);
+                               if (found != conn->responding.end())
+                               {
+                                   found->second.cancel();
+                                   conn->responding.erase(found);
+                               }
+                           });
+    }
+
+    void process_h2_(connection *conn)
+    {
+        auto consumed = conn->h2->receive(conn->in.data(), conn->in_used);
+        auto remaining = conn->in_used - consumed;
+        if (remaining && consumed)
+        {
+            std::memmove(conn->in.data(), conn->in.data() + consumed, remaining);
+        }
+        conn->in_used = remaining;
+
+        conn->h2->flush(); // the next of any files' frames, now what came before has been sent
+        conn->keep_alive = !conn->h2->wants_close();
+        auto &output = conn->h2->output();
+        if (!output.empty())
+        {
+            conn->out.swap(output);
+            output.clear();
+            conn->out_sent = 0;
+            send_(conn);
+        }
+        else if (!conn->keep_alive)
+        {
+            release_(conn);
+        }
+        else
+        {
+            receive_(conn);
+        }
+    }
+
+    OPT_NS::optional<http2_response> handle_h2_(connection *conn, uint32_t stream_id, http2_request &&h2_request)
+    {
+        auto request = build_request_(conn, h2_request.method, h2_request.target, "HTTP/2",
+                                      std::move(h2_request.headers), std::move(h2_request.body));
+
+        auto permit = engine_.dispatcher_.admit(request.method, request.path);
+        if (!permit)
+        {
+            const auto &shed = engine_.dispatcher_.shed_response();
+            http2_response h2_response{shed.status_code, {{"content-type", shed.content_type}}, shed.content};
+            for (const auto &header : shed.headers)
+            {
+                h2_response.headers.emplace_back(header.first, header.second);
+            }
+            return h2_response;
+        }
+        conn->responding[stream_id] = request.cancellation;
+
+        // the connection carries on with its other streams meanwhile
+        dispatch_(conn, stream_id, std::move(request), std::move(permit));
+        return OPT_NS::nullopt;
+    }
+
+    void respond_h2_(connection *conn, uint32_t stream_id, luna::request &&request, luna::response &&response)
+    {
+        engine_.dispatcher_.renderer().finalize(request, response);
+
+        // HTTP/2 responses are framed in user space, so files are read a frame at a time by the session rather than
+        // spliced
+        auto code = response.status_code;
+        auto has_body = (code >= 200 && code != 204 && code != 304);
+        size_t file_size = 0;
+        auto fd = has_body ? open_file_(response, file_size) : -1;
+
+        http2_response h2_response{response.status_code, {}, {}};
+        if (fd >= 0)
+        {
+            h2_response.file = fd;
+            h2_response.file_size = file_size;
+        }
+        else if (has_body)
+        {
+            h2_response.body = response.content;
+        }
+
+        h2_response.headers.reserve(response.headers.size() + 2);
+        for (const auto &header : response.headers)
+        {
+            h2_response.headers.emplace_back(header.first, header.second);
+        }
+        h2_response.headers.emplace_back("date", http_date_());
+        if (has_body)
+        {
+            h2_response.headers.emplace_back("content-type", response.content_type);
+        }
+
+        request.end = std::chrono::system_clock::now();
+        access_log(std::move(request), std::move(response));
+
+        conn->h2->respond(stream_id, std::move(h2_response));
+        if (!conn->h2->output().empty() && conn->receiving && !conn->interrupted)
+        {
+            // Waiting on the client could take a while, so stop, and send this first. If a send is in flight
+            // instead, this goes out once that's done.
+            conn->interrupted = true;
+            auto sqe = prepare_(nullptr, IGNORED);
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = reinterpret_cast<uint64_t>(conn) | RECEIVE;
+        }
+    }
+
+    void respond_with_error_(connection *conn, status_code code)
+    {
+        conn->keep_alive = false;
+
+        luna::request request{};
+        std::string message{std::to_string(code) + " " + reason_phrase_(code)};
+        luna::response response{code, "text/html; charset=utf-8", "<html><h1>" + message + "</h1></html>"};
+        engine_.dispatcher_.renderer().finalize(request, response);
+        write_response_(conn, response);
+        send_(conn);
+    }
+
+    // Open the file a response is to be sent from, and find how big it is. If it can't be, the response becomes a 500
+    // and -1 is returned.
+    int open_file_(luna::response &response, size_t &size)
+    {
+        if (response.file.empty())
+        {
+            return -1;
+        }
+
+        auto fd = open(response.file.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0)
+        {
+            size = static_cast<size_t>(st.st_size);
+            return fd;
+        }
+
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        LUNA_LOG_ERROR("Could not open " + response.file);
+        luna::request request{};
+        response = luna::response{500, "text/html; charset=utf-8", "<html><h1>500 Internal Server Error</h1></html>"};
+        engine_.dispatcher_.renderer().finalize(request, response);
+        return -1;
+    }
+
+    void write_response_(connection *conn, luna::response &response)
+    {
+        size_t file_size = 0;
+        auto fd = open_file_(response, file_size);
+        if (fd >= 0)
+        {
+            conn->file_fd = fd;
+            conn->file_offset = 0;
+            conn->file_remaining = file_size;
+        }
+
+        auto code = response.status_code;
+        auto has_body = (code >= 200 && code != 204 && code != 304);
+        auto content_length = (conn->file_fd >= 0) ? conn->file_remaining : response.content.size();
+
+        auto &out = conn->out;
+        out.clear();
+        conn->out_sent = 0;
+
+        out.append("HTTP/1.1 ");
+        out.append(std::to_string(code));
+        out.push_back(' ');
+        out.append(reason_phrase_(code));
+        out.append("\r\n");
+        for (const auto &header : response.headers)
+        {
+            // framing is ours to decide
+            if (!strcasecmp(header.first.c_str(), "Content-Length") ||
+                !strcasecmp(header.first.c_str(), "Transfer-Encoding") ||
+                !strcasecmp(header.first.c_str(), "Connection"))
+            {
+                continue;
+            }
+            out.append(header.first);
+            out.append(": ");
+            out.append(header.second);
+            out.append("\r\n");
+        }
+        out.append("Date: ");
+        out.append(http_date_());
+        out.append("\r\n");
+        if (has_body)
+        {
+            out.append("Content-Type: ");
+            out.append(response.content_type);
+            out.append("\r\nContent-Length: ");
+            out.append(std::to_string(content_length));
+            out.append("\r\n");
+        }
+        if (!conn->keep_alive)
+        {
+            out.append("Connection: close\r\n");
+        }
+        out.append("\r\n");
+
+        if (has_body && conn->file_fd < 0)
+        {
+            out.append(response.content);
+        }
+    }
+
+    void send_(connection *conn)
+    {
+        auto sqe = prepare_(conn, SEND);
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = conn->fd;
+        sqe->addr = reinterpret_cast<uint64_t>(conn->out.data() + conn->out_sent);
+        sqe->len = static_cast<uint32_t>(conn->out.size() - conn->out_sent);
+        sqe->msg_flags = MSG_NOSIGNAL;
+        link_timeout_(sqe); // a client that stops reading mustn't hold on to the connection forever
+    }
+
+    void on_send_(connection *conn, int result)
+    {
+        if (result < 0)
+        {
+            release_(conn);
+            return;
+        }
+
+        conn->out_sent += static_cast<size_t>(result);
+        if (conn->out_sent < conn->out.size())
+        {
+            send_(conn);
+            return;
+        }
+
+        if (conn->sending_continue)
+        {
+            conn->sending_continue = false;
+            process_(conn);
+            return;
+        }
+
+        if (conn->file_fd >= 0)
+        {
+            if (conn->pipe_fds[0] < 0 && pipe2(conn->pipe_fds, O_CLOEXEC) != 0)
+            {
+                LUNA_LOG_ERROR(std::string{"Could not create a pipe: "} + std::strerror(errno));
+                release_(conn);
+                return;
+            }
+            splice_in_(conn);
+            return;
+        }
+
+        finish_response_(conn);
+    }
+
+    void splice_in_(connection *conn)
+    {
+        if (conn->file_remaining == 0)
+        {
+            close(conn->file_fd);
+            conn->file_fd = -1;
+            finish_response_(conn);
+            return;
+        }
+
+        auto sqe = prepare_(conn, SPLICE_IN);
+        sqe->opcode = IORING_OP_SPLICE;
+        sqe->fd = conn->pipe_fds[1];
+        sqe->off = static_cast<uint64_t>(-1);
+        sqe->splice_fd_in = conn->file_fd;
+        sqe->splice_off_in = static_cast<uint64_t>(conn->file_offset);
+        sqe->len = static_cast<uint32_t>(std::min(conn->file_remaining, splice_chunk_));
+        sqe->splice_flags = SPLICE_F_MOVE;
+    }
+
+    void on_splice_in_(connection *conn, int result)
+    {
+        if (result <= 0)
+        {
+            release_(conn); // the file got shorter underneath us; there's no way to fix up the response now
+            return;
+        }
+
+        conn->file_offset += result;
+        conn->file_remaining -= static_cast<size_t>(result);
+        conn->piped = static_cast<size_t>(result);
+        splice_out_(conn);
+    }
+
+    void splice_out_(connection *conn)
+    {
+        auto sqe = prepare_(conn, SPLICE_OUT);
+        sqe->opcode = IORING_OP_SPLICE;
+        sqe->fd = conn->fd;
+        sqe->off = static_cast<uint64_t>(-1);
+        sqe->splice_fd_in = conn->pipe_fds[0];
+        sqe->splice_off_in = static_cast<uint64_t>(-1);
+        sqe->len = static_cast<uint32_t>(conn->piped);
+        sqe->splice_flags = SPLICE_F_MOVE;
+        link_timeout_(sqe);
+    }
+
+    void on_splice_out_(connection *conn, int result)
+    {
+        if (result <= 0)
+        {
+            release_(conn);
+            return;
+        }
+
+        conn->piped -= static_cast<size_t>(result);
+        if (conn->piped)
+        {
+            splice_out_(conn);
+        }
+        else
+        {
+            splice_in_(conn);
+        }
+    }
+
+    void finish_response_(connection *conn)
+    {
+        conn->responding.erase(0); // HTTP/2 streams are done with as their responses are handed to the session
+
+        if (!conn->keep_alive || stopping_)
+        {
+            release_(conn);
+            return;
+        }
+
+        process_(conn); // there may be another request waiting already
+    }
+
+    void release_(connection *conn)
+    {
+        for (auto &responding : conn->responding)
+        {
+            responding.second.cancel();
+        }
+
+        close(conn->fd);
+        if (conn->file_fd >= 0)
+        {
+            close(conn->file_fd);
+        }
+        if (conn->pipe_fds[0] >= 0)
+        {
+            close(conn->pipe_fds[0]);
+            close(conn->pipe_fds[1]);
+        }
+        connections_.erase(conn);
+        --engine_.connection_count_;
+        delete conn;
+    }
+
+    const std::string &http_date_()
+    {
+        auto now = std::time(nullptr);
+        if (now != date_time_)
+        {
+            date_time_ = now;
+            auto tm = luna::gmtime(now);
+            date_ = put_time(&tm, "%a, %d %b %Y %H:%M:%S GMT");
+        }
+        return date_;
+    }
+
+    native_engine &engine_;
+
+    int listen_fd_;
+    int wake_fd_;
+    uint64_t wake_value_;
+    std::shared_ptr<mailbox> mailbox_;
+
+    uring ring_;
+    std::thread thread_;
+    std::atomic<bool> stopping_;
+    size_t inflight_;
+
+    std::unordered_set<connection *> connections_;
+    uint64_t next_serial_;
+
+    sockaddr_storage accept_addr_;
+    socklen_t accept_addr_length_;
+
+    __kernel_timespec timeout_;
+
+    std::time_t date_time_;
+    std::string date_;
+};
+
+#else
+
+// without io_uring there are no workers, but the engine still has to be destructible
+class native_engine::worker
+{
+};
+
+#endif // LUNA_HAVE_IO_URING
+
+native_engine::native_engine(dispatcher &dispatcher) :
+        transport_engine{dispatcher},
+        running_{false},
+        thread_count_{0},
+        handler_count_{0},
+        max_body_size_{16 * 1024 * 1024},
+        accept_policy_callback_{[](const struct sockaddr *, socklen_t) -> bool
+                                { return true; }},
+        connection_limit_{0},
+        connection_timeout_{0},
+        max_head_size_{64 * 1024},
+        connection_count_{0}
+{}
+
+native_engine::~native_engine()
+{
+    stop();
+}
+
+bool native_engine::start(uint16_t port)
+{
+#if defined(LUNA_HAVE_IO_URING)
+    if (!https_key_.empty() || !https_cert_.empty() || !https_certificates_.empty())
+    {
+        if (https_key_.empty() != https_cert_.empty())
+        {
+            LUNA_LOG_ERROR("Please provide both server::https_mem_key AND server::https_mem_cert");
+            return false;
+        }
+        std::string error;
+        if (!kernel_tls::available(error))
+        {
+            LUNA_LOG_ERROR("The native transport serves HTTPS with kernel TLS, but " + error);
+            return false;
+        }
+        tls_.reset(new kernel_tls);
+        if (!tls_->configure(certificates_(https_certificates_), https_priorities_, error))
+        {
+            LUNA_LOG_ERROR("Could not set up TLS: " + error);
+            tls_.reset();
+            return false;
+        }
+        if (!tls_->enable_resumption(tls_resumption_.cache_size, tls_resumption_.tickets, tls_resumption_.lifetime,
+                                     error))
+        {
+            LUNA_LOG_ERROR("Could not set up TLS session resumption: " + error);
+            tls_.reset();
+            return false;
+        }
+    }
+
+    const auto &shed = dispatcher_.shed_response();
+    shed_response_ = "HTTP/1.1 " + std::to_string(shed.status_code) + " " + reason_phrase_(shed.status_code) + "\r\n";
+    for (const auto &header : shed.headers)
+    {
+        shed_response_ += header.first + ": " + header.second + "\r\n";
+    }
+    shed_response_ += "Content-Type: " + shed.content_type + "\r\nContent-Length: " +
+                      std::to_string(shed.content.size()) + "\r\nConnection: close\r\n\r\n" + shed.content;
+
+    auto cores = std::max(1U, std::thread::hardware_concurrency());
+    handlers_.reset(new handler_pool{handler_count_ ? handler_count_ : 4 * cores});
+
+    auto threads = thread_count_ ? thread_count_ : cores;
+    for (unsigned int i = 0; i < threads; ++i)
+    {
+        auto fd = listen_socket_(port);
+        if (fd < 0)
+        {
+            workers_.clear();
+            return false;
+        }
+
+        if (port == 0)
+        {
+            // the kernel picked a port for the first socket; the rest have to share it
+            sockaddr_in addr;
+            socklen_t length = sizeof(addr);
+            getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &length);
+            port = ntohs(addr.sin_port);
+        }
+
+        workers_.emplace_back(new worker{*this, fd});
+        if (!workers_.back()->start())
+        {
+            LUNA_LOG_ERROR("Could not set up io_uring; is it disabled on this system?");
+            workers_.clear();
+            return false;
+        }
+    }
+
+    running_ = true;
+    return true;
+#else
+    LUNA_LOG_ERROR("The native transport needs io_uring, which this build of Luna doesn't have");
+    return false;
+#endif
+}
+
+void native_engine::stop()
+{
+    // workers finish their in-flight operations and close their sockets as they're destroyed, cancelling whatever is
+    // still being handled, so there's nothing left to post the handlers' responses back to
+    workers_.clear();
+    handlers_.reset();
+    running_ = false;
+}
+
+bool native_engine::is_running()
+{
+    return running_;
+}
+
+
+//////// option setters
+
+void native_engine::set_option(server::thread_pool_size value)
+{
+    thread_count_ = value;
+}
+
+void native_engine::set_option(server::handler_pool_size value)
+{
+    handler_count_ = value;
+}
+
+void native_engine::set_option(server::max_request_body_size value)
+{
+    max_body_size_ = value;
+}
+
+void native_engine::set_option(server::accept_policy_cb value)
+{
+    accept_policy_callback_ = value;
+}
+
+void native_engine::set_option(server::connection_limit value)
+{
+    connection_limit_ = value;
+}
+
+void native_engine::set_option(server::connection_timeout value)
+{
+    connection_timeout_ = value;
+}
+
+void native_engine::set_option(server::connection_memory_limit value)
+{
+    max_head_size_ = value;
+}
+
+void native_engine::set_option(server::unescaper_cb value)
+{
+    unescaper_callback_ = value;
+}
+
+void native_engine::set_option(const server::https_mem_key &value)
+{
+    https_key_ = value.get();
+}
+
+void native_engine::set_option(const server::https_mem_cert &value)
+{
+    https_cert_ = value.get();
+}
+
+void native_engine::set_option(const server::https_key_password &value)
+{
+    https_key_password_ = value.get();
+}
+
+void native_engine::set_option(const server::https_priorities &value)
+{
+    https_priorities_ = value.get();
+}
+
+void native_engine::set_option(const server::https_certificates &value)
+{
+    https_certificates_ = value;
+}
+
+void native_engine::set_option(const server::tls_session_resumption &value)
+{
+    tls_resumption_ = value;
+}
+
+bool native_engine::reload_certificates(const server::https_certificates &certificates)
+{
+    if (tls_)
+    {
+        std::string error;
+        if (!tls_->reload(certificates_(certificates), error))
+        {
+            LUNA_LOG_ERROR("Could not reload the HTTPS certificates: " + error);
+            return false;
+        }
+    }
+    https_certificates_ = certificates;
+    return true;
+}
+
+// https_mem_cert and https_mem_key, if they're given, come first, for clients whose server name matches nothing else
+server::https_certificates native_engine::certificates_(const server::https_certificates &certificates) const
+{
+    server::https_certificates all;
+    if (!https_cert_.empty())
+    {
+        all.push_back({https_cert_, https_key_, https_key_password_});
+    }
+    all.insert(all.end(), certificates.begin(), certificates.end());
+    return all;
+}
+
+server::tls_handshake_counts native_engine::tls_handshakes() const
+{
+    if (!tls_)
+    {
+        return {0, 0};
+    }
+    return {tls_->full_handshakes(), tls_->resumed_handshakes()};
+}
+
+} //namespace luna
@@ -0,0 +1,124 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include "luna/private/handler_pool.h"
+#include "luna/private/kernel_tls.h"
+#include "luna/private/transport_engine.h"
+#include "luna/server.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace luna
+{
+
+// Luna's own HTTP/1.1 transport. Each worker thread (one per core, unless thread_pool_size says otherwise) owns an
+// io_uring and its own SO_REUSEPORT listening socket, so the kernel spreads connections across workers and a
+// connection never changes threads. Accepts, receives, sends, and file transfers (spliced straight from the file into
+// the socket) are all submitted to the ring, and requests are parsed in place in the connection's receive buffer.
+// Connections that open with the HTTP/2 preface, or upgrade to h2c, are handed over to an http2_session.
+//
+// Workers never run request handlers themselves, since anything a handler waits on (a bulkhead's queue, a shared
+// cache, a slow database) would hold up every other connection on the same ring. Handlers run on a handler_pool, and
+// their responses are posted back to the worker that owns the connection.
+//
+// Given a certificate and key, or several to choose between by server name, it serves HTTPS instead, handing each
+// connection to the kernel once the TLS handshake is done (see kernel_tls), so that nothing past the handshake is any
+// different.
+//
+// Only available on Linux, and only when Luna was built against kernel headers with io_uring; otherwise start() fails.
+class native_engine : public transport_engine
+{
+public:
+    explicit native_engine(dispatcher &dispatcher);
+
+    ~native_engine() override;
+
+    bool start(uint16_t port) override;
+
+    void stop() override;
+
+    bool is_running() override;
+
+    // option setters. Options that only make sense for libmicrohttpd are ignored.
+    void set_option(server::thread_pool_size value);
+
+    void set_option(server::handler_pool_size value);
+
+    void set_option(server::max_request_body_size value);
+
+    void set_option(server::accept_policy_cb value);
+
+    void set_option(server::connection_limit value);
+
+    void set_option(server::connection_timeout value);
+
+    void set_option(server::connection_memory_limit value);
+
+    void set_option(server::unescaper_cb value);
+
+    void set_option(const server::https_mem_key &value);
+
+    void set_option(const server::https_mem_cert &value);
+
+    void set_option(const server::https_key_password &value);
+
+    void set_option(const server::https_priorities &value);
+
+    void set_option(const server::https_certificates &value);
+
+    void set_option(const server::tls_session_resumption &value);
+
+    // replace https_certificates, while serving or for the next start()
+    bool reload_certificates(const server::https_certificates &certificates);
+
+    // zero until HTTPS is being served
+    server::tls_handshake_counts tls_handshakes() const;
+
+private:
+    class worker;
+
+    server::https_certificates certificates_(const server::https_certificates &certificates) const;
+
+    std::vector<std::unique_ptr<worker>> workers_;
+    std::atomic<bool> running_;
+
+    unsigned int thread_count_;
+    unsigned int handler_count_;
+    size_t max_body_size_;
+    server::accept_policy_cb accept_policy_callback_;
+    server::unescaper_cb unescaper_callback_;
+    unsigned int connection_limit_;
+    unsigned int connection_timeout_;
+    size_t max_head_size_;
+
+    std::string https_key_;
+    std::string https_cert_;
+    std::string https_key_password_;
+    std::string https_priorities_;
+    server::https_certificates https_certificates_;
+    server::tls_session_resumption tls_resumption_;
+    std::unique_ptr<kernel_tls> tls_; // set while serving HTTPS
+
+    std::atomic<unsigned int> connection_count_;
+
+    std::unique_ptr<handler_pool> handlers_; // set while running
+
+    // the whole of the response for requests that are turned away under load, prepared when the engine starts
+    std::string shed_response_;
+};
+
+} //namespace luna
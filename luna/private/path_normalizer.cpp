@@ -0,0 +1,143 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/path_normalizer.h"
+#include <cstring>
+
+namespace luna
+{
+
+static int hex_value_(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Whether a segment is only safe as it stands: not "." or ".." spelled with percent-encoding, and without an encoded
+// separator or NUL
+static bool safe_segment_(const char *segment, size_t length)
+{
+    if (std::memchr(segment, '%', length) == nullptr)
+    {
+        return true;
+    }
+
+    size_t dots{0};
+    bool only_dots{true};
+    for (size_t i = 0; i < length; ++i)
+    {
+        auto c = segment[i];
+        if (c == '%' && i + 2 < length && hex_value_(segment[i + 1]) >= 0 && hex_value_(segment[i + 2]) >= 0)
+        {
+            c = static_cast<char>(hex_value_(segment[i + 1]) * 16 + hex_value_(segment[i + 2]));
+            if (c == '/' || c == '\\' || c == '\0')
+            {
+                return false;
+            }
+            i += 2;
+        }
+        if (c == '.')
+        {
+            ++dots;
+        }
+        else
+        {
+            only_dots = false;
+        }
+    }
+    return !(only_dots && dots <= 2);
+}
+
+bool normalize_path(char *path, size_t &length)
+{
+    if (std::memchr(path, '\0', length) != nullptr)
+    {
+        return false;
+    }
+
+    // segments are copied down over what's been dropped; what's written never gets ahead of what's been read
+    size_t written{0};
+    size_t start{0};
+    while (start < length)
+    {
+        auto slash = static_cast<const char *>(std::memchr(path + start, '/', length - start));
+        size_t end = slash ? static_cast<size_t>(slash - path) : length;
+        auto segment_length = end - start;
+
+        if (segment_length == 0 || (segment_length == 1 && path[start] == '.'))
+        {
+            // nothing to keep
+        }
+        else if (segment_length == 2 && path[start] == '.' && path[start + 1] == '.')
+        {
+            if (written == 0)
+            {
+                return false; // above the root
+            }
+            while (written > 0 && path[written - 1] != '/')
+            {
+                --written;
+            }
+            if (written > 0)
+            {
+                --written; // and the slash before it
+            }
+        }
+        else
+        {
+            if (!safe_segment_(path + start, segment_length))
+            {
+                return false;
+            }
+            if (written > 0)
+            {
+                path[written++] = '/';
+            }
+            std::memmove(path + written, path + start, segment_length);
+            written += segment_length;
+        }
+        start = end + 1;
+    }
+
+    length = written;
+    return true;
+}
+
+bool normalize_path(std::string &path)
+{
+    if (path.empty())
+    {
+        return true;
+    }
+    auto length = path.size();
+    if (!normalize_path(&path[0], length))
+    {
+        return false;
+    }
+    path.resize(length); // only ever shorter, so this doesn't allocate
+    return true;
+}
+
+} //namespace luna
@@ -0,0 +1,34 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace luna
+{
+
+// Turn a path requested under a static mount into the path of the file to serve relative to the mount's root, in place
+// and in one pass, without allocating: empty and "." segments are dropped (so there are no leading, trailing or double
+// slashes left), and ".." takes off the segment before it.
+//
+// Returns false, leaving path in no particular state, for a path that climbs out of the root, that has a NUL in it, or
+// that has a segment that's a "." or ".." once percent-decoded, or a percent-encoded slash, backslash or NUL. Paths
+// arrive already decoded, so these can only be attempts to get past a check somewhere that decodes them again.
+bool normalize_path(char *path, size_t &length);
+
+bool normalize_path(std::string &path);
+
+} //namespace luna
@@ -0,0 +1,575 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/persistent_store.h"
+#include "luna/private/credential_cache.h"
+#include "luna/config.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace luna
+{
+
+static const std::string magic_{"LUNALOG\x01"};
+
+// checksum, key length, value length, expiry
+static const size_t record_header_{8 + 4 + 4 + 8};
+
+// more than this many writes waiting, and new ones are dropped; it's only a cache
+static const size_t max_pending_writes_{1024};
+
+// how often expired records are looked for, when nothing else is happening
+static const std::chrono::seconds sweep_interval_{60};
+
+// how much of the log compaction copies at a time
+static const size_t compaction_buffer_{1024 * 1024};
+
+static void put_u32_(std::string &out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+static void put_u64_(std::string &out, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+static uint32_t get_u32_(const char *in)
+{
+    uint32_t value{0};
+    for (int i = 0; i < 4; ++i)
+    {
+        value |= static_cast<uint32_t>(static_cast<uint8_t>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+static uint64_t get_u64_(const char *in)
+{
+    uint64_t value{0};
+    for (int i = 0; i < 8; ++i)
+    {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+// of everything in a record after the checksum itself
+static uint64_t checksum_(const char *data, size_t length)
+{
+    return siphash_2_4(0x6c756e612d6c6f67ULL, 0x2d636865636b7331ULL, data, length);
+}
+
+static uint64_t to_ms_(persistent_store::clock::time_point time)
+{
+    return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count());
+}
+
+static bool write_all_(int fd, const std::string &data, size_t offset)
+{
+    size_t written{0};
+    while (written < data.size())
+    {
+        auto result = pwrite(fd, data.data() + written, data.size() - written, static_cast<off_t>(offset + written));
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        written += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+persistent_store::persistent_store(std::string path, size_t max_size) :
+        path_{std::move(path)},
+        max_size_{max_size},
+        fd_{-1},
+        map_{MAP_FAILED},
+        end_{0},
+        live_{0},
+        loaded_{false},
+        writing_{false},
+        stopping_{false}
+{}
+
+persistent_store::~persistent_store()
+{
+    {
+        std::lock_guard<std::mutex> guard{writes_lock_};
+        stopping_ = true;
+    }
+    writes_changed_.notify_one();
+    if (writer_.joinable())
+    {
+        writer_.join();
+    }
+
+    if (map_ != MAP_FAILED)
+    {
+        munmap(map_, max_size_);
+    }
+    if (fd_ >= 0)
+    {
+        close(fd_); // and with it, the lock on the file
+    }
+}
+
+void persistent_store::load()
+{
+    std::lock_guard<std::mutex> guard{writes_lock_};
+    if (writer_.joinable() || stopping_)
+    {
+        return;
+    }
+    writer_ = std::thread{&persistent_store::run_, this};
+}
+
+std::shared_ptr<std::string> persistent_store::read(const std::string &key) const
+{
+    auto now = to_ms_(clock::now());
+
+    std::lock_guard<std::mutex> guard{lock_};
+    auto found = index_.find(key);
+    if (found == index_.end() || found->second.expires <= now)
+    {
+        return nullptr;
+    }
+
+    auto value = static_cast<const char *>(map_) + found->second.offset + record_header_ + key.size();
+    return std::make_shared<std::string>(value, found->second.length - record_header_ - key.size());
+}
+
+void persistent_store::write(const std::string &key, std::shared_ptr<std::string> value, clock::time_point expires)
+{
+    if (!value || value->empty())
+    {
+        // gone from reads straight away; the record saying so is only for the next time the log is loaded
+        std::lock_guard<std::mutex> guard{lock_};
+        auto found = index_.find(key);
+        if (found != index_.end())
+        {
+            live_ -= found->second.length;
+            index_.erase(found);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard{writes_lock_};
+        if (stopping_)
+        {
+            return;
+        }
+        if (writes_.size() >= max_pending_writes_)
+        {
+            LUNA_LOG_DEBUG("Persistent response cache is falling behind; not storing " + key);
+            return;
+        }
+        writes_.emplace_back(pending{key, std::move(value), expires});
+    }
+    writes_changed_.notify_one();
+}
+
+void persistent_store::flush()
+{
+    std::unique_lock<std::mutex> lock{writes_lock_};
+    if (!writer_.joinable())
+    {
+        return; // nothing will ever write them
+    }
+    writes_done_.wait(lock, [this]
+    { return stopping_ || (writes_.empty() && !writing_); });
+}
+
+void persistent_store::compact()
+{
+    std::lock_guard<std::mutex> guard{file_lock_};
+    if (loaded_)
+    {
+        compact_();
+    }
+}
+
+size_t persistent_store::size() const
+{
+    std::lock_guard<std::mutex> guard{lock_};
+    return end_;
+}
+
+bool persistent_store::open_()
+{
+    auto fd = open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        LUNA_LOG_ERROR("Couldn't open persistent response cache " + path_ + ": " + std::strerror(errno));
+        return false;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        LUNA_LOG_WARNING("Persistent response cache " + path_ + " is in use by another process; carrying on without it");
+        close(fd);
+        return false;
+    }
+
+    struct stat st;
+    auto map = fstat(fd, &st) == 0 ? mmap(nullptr, max_size_, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (map == MAP_FAILED)
+    {
+        LUNA_LOG_ERROR("Couldn't map persistent response cache " + path_ + ": " + std::strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    auto size = static_cast<size_t>(st.st_size);
+    if (size < magic_.size() || std::memcmp(map, magic_.data(), magic_.size()) != 0)
+    {
+        if (size > 0)
+        {
+            LUNA_LOG_WARNING("Persistent response cache " + path_ + " wasn't written by this version of " + LUNA_NAME +
+                             "; starting it afresh");
+        }
+        if (ftruncate(fd, 0) != 0 || !write_all_(fd, magic_, 0))
+        {
+            LUNA_LOG_ERROR("Couldn't write persistent response cache " + path_ + ": " + std::strerror(errno));
+            munmap(map, max_size_);
+            close(fd);
+            return false;
+        }
+        size = magic_.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        fd_ = fd;
+        map_ = map;
+    }
+    index_log_(size);
+    return true;
+}
+
+void persistent_store::index_log_(size_t size)
+{
+    auto now = to_ms_(clock::now());
+    auto log = static_cast<const char *>(map_);
+    auto readable = std::min(size, max_size_);
+
+    std::unordered_map<std::string, location> index;
+    size_t live{0};
+    size_t position{magic_.size()};
+    while (readable - position >= record_header_)
+    {
+        auto record = log + position;
+        auto key_length = get_u32_(record + 8);
+        auto value_length = get_u32_(record + 12);
+        auto expires = get_u64_(record + 16);
+        auto length = record_header_ + key_length + value_length;
+        if (length > readable - position || get_u64_(record) != checksum_(record + 8, length - 8))
+        {
+            break; // cut short as it was written, most likely
+        }
+
+        std::string key{record + record_header_, key_length};
+        auto found = index.find(key);
+        if (found != index.end())
+        {
+            live -= found->second.length;
+            index.erase(found);
+        }
+        if (value_length > 0 && expires > now)
+        {
+            index.emplace(std::move(key), location{position, length, expires});
+            live += length;
+        }
+        position += length;
+    }
+
+    if (position < size)
+    {
+        LUNA_LOG_WARNING("Dropping the last " + std::to_string(size - position) + " bytes of persistent response cache " +
+                         path_ + ", which can't be read");
+        if (ftruncate(fd_, static_cast<off_t>(position)) != 0)
+        {
+            LUNA_LOG_WARNING("Couldn't truncate persistent response cache " + path_ + ": " + std::strerror(errno));
+        }
+    }
+
+    LUNA_LOG_INFO("Loaded " + std::to_string(index.size()) + " responses from persistent response cache " + path_);
+
+    std::lock_guard<std::mutex> guard{lock_};
+    index_ = std::move(index);
+    end_ = position;
+    live_ = live;
+}
+
+void persistent_store::run_()
+{
+    bool opened;
+    {
+        std::lock_guard<std::mutex> guard{file_lock_};
+        opened = open_();
+    }
+    if (!opened)
+    {
+        {
+            std::lock_guard<std::mutex> guard{writes_lock_};
+            stopping_ = true;
+            writes_.clear();
+        }
+        writes_done_.notify_all();
+        return;
+    }
+    loaded_ = true;
+
+    auto next_sweep = clock::now() + sweep_interval_;
+    for (;;)
+    {
+        std::deque<pending> writes;
+        {
+            std::unique_lock<std::mutex> lock{writes_lock_};
+            writes_changed_.wait_for(lock, sweep_interval_, [this]
+            { return stopping_ || !writes_.empty(); });
+            if (stopping_ && writes_.empty())
+            {
+                return; // once everything's written, so that a restart finds it
+            }
+            writes.swap(writes_);
+            writing_ = true;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard{file_lock_};
+            append_(writes);
+            if (clock::now() >= next_sweep)
+            {
+                forget_expired_();
+                next_sweep = clock::now() + sweep_interval_;
+            }
+            if (compaction_due_())
+            {
+                compact_();
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> guard{writes_lock_};
+            writing_ = false;
+        }
+        writes_done_.notify_all();
+    }
+}
+
+void persistent_store::append_(std::deque<pending> &writes)
+{
+    std::string records;
+    std::vector<std::pair<std::string, location>> locations;
+    for (auto &write : writes)
+    {
+        auto value_length = write.value ? write.value->size() : 0;
+        auto length = record_header_ + write.key.size() + value_length;
+        if (end_ + records.size() + length > max_size_)
+        {
+            append_records_(records, locations);
+            records.clear();
+            locations.clear();
+            compact_();
+            if (end_ + length > max_size_)
+            {
+                LUNA_LOG_DEBUG("Persistent response cache is full; not storing " + write.key);
+                continue;
+            }
+        }
+
+        auto expires = to_ms_(write.expires);
+        locations.emplace_back(write.key, location{end_ + records.size(), length, expires});
+
+        auto start = records.size();
+        put_u64_(records, 0); // the checksum, once the rest is there
+        put_u32_(records, static_cast<uint32_t>(write.key.size()));
+        put_u32_(records, static_cast<uint32_t>(value_length));
+        put_u64_(records, expires);
+        records.append(write.key);
+        if (write.value)
+        {
+            records.append(*write.value);
+        }
+        std::string checksum;
+        put_u64_(checksum, checksum_(records.data() + start + 8, length - 8));
+        records.replace(start, 8, checksum);
+    }
+    append_records_(records, locations);
+}
+
+bool persistent_store::append_records_(const std::string &records,
+                                       std::vector<std::pair<std::string, location>> &locations)
+{
+    if (records.empty())
+    {
+        return true;
+    }
+    if (!write_all_(fd_, records, end_))
+    {
+        LUNA_LOG_WARNING("Writing to persistent response cache " + path_ + " failed: " + std::strerror(errno));
+        return false; // and the next write goes over whatever part of this made it
+    }
+
+    std::lock_guard<std::mutex> guard{lock_};
+    end_ += records.size();
+    for (auto &written : locations)
+    {
+        auto found = index_.find(written.first);
+        if (found != index_.end())
+        {
+            live_ -= found->second.length;
+            index_.erase(found);
+        }
+        if (written.second.length > record_header_ + written.first.size()) // not a removal
+        {
+            live_ += written.second.length;
+            index_.emplace(std::move(written.first), written.second);
+        }
+    }
+    return true;
+}
+
+void persistent_store::compact_()
+{
+    forget_expired_();
+
+    auto compacted_path = path_ + ".compacting";
+    auto fd = open(compacted_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0 || flock(fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        LUNA_LOG_WARNING("Couldn't compact persistent response cache " + path_ + ": " + std::strerror(errno));
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return;
+    }
+
+    // Nothing else is appended to the log meanwhile, but keys may still be removed from the index
+    std::vector<std::pair<std::string, location>> records;
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        records.assign(index_.begin(), index_.end());
+    }
+
+    auto log = static_cast<const char *>(map_);
+    std::unordered_map<std::string, location> index;
+    index.reserve(records.size());
+    std::string buffer{magic_};
+    size_t written{0};
+    bool ok{true};
+    for (const auto &entry : records)
+    {
+        index.emplace(entry.first, location{written + buffer.size(), entry.second.length, entry.second.expires});
+        buffer.append(log + entry.second.offset, entry.second.length);
+        if (buffer.size() >= compaction_buffer_)
+        {
+            ok = ok && write_all_(fd, buffer, written);
+            written += buffer.size();
+            buffer.clear();
+        }
+    }
+    ok = ok && write_all_(fd, buffer, written);
+    written += buffer.size();
+
+    // the new log must be whole before it replaces the old one
+    auto map = ok && fsync(fd) == 0 ? mmap(nullptr, max_size_, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (map == MAP_FAILED || rename(compacted_path.c_str(), path_.c_str()) != 0)
+    {
+        LUNA_LOG_WARNING("Couldn't compact persistent response cache " + path_ + ": " + std::strerror(errno));
+        if (map != MAP_FAILED)
+        {
+            munmap(map, max_size_);
+        }
+        close(fd);
+        unlink(compacted_path.c_str());
+        return;
+    }
+
+    auto before = end_;
+    auto old_fd = fd;
+    auto old_map = map;
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        std::swap(fd_, old_fd);
+        std::swap(map_, old_map);
+        live_ = 0;
+        for (auto position = index.begin(); position != index.end();)
+        {
+            if (index_.count(position->first))
+            {
+                live_ += position->second.length;
+                ++position;
+            }
+            else
+            {
+                position = index.erase(position); // removed while the log was being rewritten
+            }
+        }
+        index_ = std::move(index);
+        end_ = written;
+    }
+    munmap(old_map, max_size_);
+    close(old_fd);
+
+    LUNA_LOG_DEBUG("Compacted persistent response cache " + path_ + " from " + std::to_string(before) + " to " +
+                   std::to_string(written) + " bytes");
+}
+
+void persistent_store::forget_expired_()
+{
+    auto now = to_ms_(clock::now());
+
+    std::lock_guard<std::mutex> guard{lock_};
+    for (auto position = index_.begin(); position != index_.end();)
+    {
+        if (position->second.expires <= now)
+        {
+            live_ -= position->second.length;
+            position = index_.erase(position);
+        }
+        else
+        {
+            ++position;
+        }
+    }
+}
+
+bool persistent_store::compaction_due_() const
+{
+    // once more than half the log is dead, and it's big enough to be worth the trouble
+    std::lock_guard<std::mutex> guard{lock_};
+    auto dead = end_ - magic_.size() - live_;
+    return dead > live_ && end_ > max_size_ / 4;
+}
+
+} //namespace luna
@@ -0,0 +1,134 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace luna
+{
+
+// A key-value store in a file that outlives the process, so that a server restarted with the same file starts with a
+// warm response cache.
+//
+// The file is an append-only log of records, each carrying its key, its value, when it expires, and a checksum. It's
+// memory-mapped for reading, and an index of where each key's latest record is kept in memory. Writes are queued and
+// appended by a background thread, which also opens and indexes the log when load() is called; records that have
+// expired, been removed, or were cut short by a crash are skipped as it goes. Once most of the log is records nobody
+// will read again, it's rewritten with only the live ones.
+//
+// Only one process may use a file at a time; any others carry on without it.
+class persistent_store
+{
+public:
+    using clock = std::chrono::system_clock;
+
+    persistent_store(std::string path, size_t max_size);
+
+    // writes whatever is still queued before returning
+    ~persistent_store();
+
+    persistent_store(const persistent_store &) = delete;
+    persistent_store &operator=(const persistent_store &) = delete;
+
+    // Open and index the log, in the background. Reads find nothing until that's done.
+    void load();
+
+    bool loaded() const
+    { return loaded_; }
+
+    // null if key isn't there, or has expired
+    std::shared_ptr<std::string> read(const std::string &key) const;
+
+    // An empty value removes the key
+    void write(const std::string &key, std::shared_ptr<std::string> value, clock::time_point expires);
+
+    // wait until everything written so far is in the log
+    void flush();
+
+    // rewrite the log with only the records that are still live
+    void compact();
+
+    // how large the log is now
+    size_t size() const;
+
+private:
+    struct location
+    {
+        size_t offset; // of the record
+        size_t length; // of the whole record
+        uint64_t expires; // ms since the epoch
+    };
+
+    struct pending
+    {
+        std::string key;
+        std::shared_ptr<std::string> value;
+        clock::time_point expires;
+    };
+
+    bool open_();
+
+    void index_log_(size_t size);
+
+    void run_();
+
+    // append to the log, compacting first if they won't fit
+    void append_(std::deque<pending> &writes);
+
+    bool append_records_(const std::string &records, std::vector<std::pair<std::string, location>> &locations);
+
+    void compact_();
+
+    // move expired records from the live count to the dead
+    void forget_expired_();
+
+    bool compaction_due_() const;
+
+    std::string path_;
+    size_t max_size_;
+
+    // held by whatever is changing the file: the background thread, or compact()
+    std::mutex file_lock_;
+
+    // guards what readers look at
+    mutable std::mutex lock_;
+    int fd_;
+    void *map_; // max_size_ long, whatever the size of the file; only what's been written is read
+    size_t end_; // where the next record goes
+    size_t live_; // bytes in records that are in the index
+    std::unordered_map<std::string, location> index_;
+    std::atomic<bool> loaded_;
+
+    std::thread writer_;
+    std::mutex writes_lock_;
+    std::condition_variable writes_changed_;
+    std::condition_variable writes_done_;
+    std::deque<pending> writes_;
+    bool writing_; // a batch has been taken from writes_, but isn't in the log yet
+    bool stopping_;
+};
+
+} //namespace luna
@@ -13,8 +13,11 @@
 //
 
 #include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
 #include <fstream>
-#include <mime/mime.h>
+#include <unistd.h>
 #include "response_renderer.h"
 #include "luna/private/file_helpers.h"
 
@@ -33,18 +36,13 @@ status_code default_success_code_(request_method method)
     return 200;
 }
 
-std::string get_mime_type_(const std::string &file)
+static int64_t modified_ns_(const struct stat &st)
 {
-    std::string retval;
-    try
-    {
-        retval = mime::content_type(mime::get_extension_from_path(file));
-    }
-    catch(std::out_of_range &e)
-    {
-        retval = "text/plain";
-    }
-    return retval;
+#if defined(__APPLE__)
+    return static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -56,7 +54,11 @@ std::mutex response_renderer::fd_mutex_;
 response_renderer::response_renderer() :
         server_identifier_{std::string{LUNA_NAME} + "/" + LUNA_VERSION},
         use_fd_cache_{false},
-        cache_keep_alive_{std::chrono::minutes{30}}
+        cache_keep_alive_{std::chrono::minutes{30}},
+        small_file_cache_size_{16 * 1024 * 1024},
+        small_file_max_size_{64 * 1024},
+        small_files_held_{0},
+        mime_types_{std::make_shared<mime_registry>()}
 {}
 
 std::shared_ptr<cacheable_response>
@@ -90,86 +92,76 @@ response_renderer::render(const request &request, response &response)
     // Add headers to response object, but only if it needs it
     if (!response_mhd->cached)
     {
-        for (const auto &header : response.headers)
-        {
-            MHD_add_response_header(response_mhd->mhd_response, header.first.c_str(), header.second.c_str());
-        }
-
         // Add default content type, if missing
         // TODO IS THIS NECESSARY?
         if(response.content_type.empty())
         {
             response.content_type = "text/html; charset=utf-8";
         }
-        MHD_add_response_header(response_mhd->mhd_response,
-                                MHD_HTTP_HEADER_CONTENT_TYPE,
-                                response.content_type.c_str());
-        MHD_add_response_header(response_mhd->mhd_response, MHD_HTTP_HEADER_SERVER, server_identifier_.c_str());
+        add_headers_(response_mhd->mhd_response, response);
     }
 
     // TODO can we cache this response?
     return response_mhd;
 }
 
-std::shared_ptr<cacheable_response>
-response_renderer::from_file_(const request &request, response &response)
+void response_renderer::add_headers_(struct MHD_Response *mhd_response, const response &response) const
 {
-    std::shared_ptr<cacheable_response> response_mhd;
+    for (const auto &header : response.headers)
+    {
+        MHD_add_response_header(mhd_response, header.first.c_str(), header.second.c_str());
+    }
+    MHD_add_response_header(mhd_response, MHD_HTTP_HEADER_CONTENT_TYPE, response.content_type.c_str());
+    MHD_add_response_header(mhd_response, MHD_HTTP_HEADER_SERVER, server_identifier_.c_str());
+}
 
-    if (!response_mhd) // TODO always false! What was this here for?
+void response_renderer::finalize(const request &request, response &response)
+{
+    if (0 == response.status_code)
     {
-        // look for the file in our local fd cache
-        if (use_fd_cache_ && fd_cache_.count(response.file))
-        {
-            SHARED_LOCK<SHARED_MUTEX> lock{response_renderer::fd_cache_mutex_};
+        response.status_code = default_success_code_(request.method);
+    }
 
-            response_mhd = fd_cache_[response.file];
-            // has the cache expired?
-            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::system_clock::now() - response_mhd->time_cached);
-            if (duration.count() <= cache_keep_alive_.count())
+    if (!response.file.empty())
+    {
+        std::string filename;
+        struct stat st;
+        if (resolve_file_(request, response, filename, st))
+        {
+            if (response.content_type.empty())
             {
-                response_mhd->cached = true;
-                error_log(log_level::DEBUG, "File cache: HIT");
-#ifdef LUNA_TESTING
-                auto header = MHD_get_response_header(response_mhd->mhd_response, "X-LUNA-CACHE");
-                if (header == nullptr)
-                {
-                    MHD_add_response_header(response_mhd->mhd_response, "X-LUNA-CACHE", "HIT");
-                }
-                else if (header[0] == 'M')
-                {
-                    MHD_del_response_header(response_mhd->mhd_response, "X-LUNA-CACHE", "MISS");
-                    MHD_add_response_header(response_mhd->mhd_response, "X-LUNA-CACHE", "HIT");
-                }
-#endif
-                return response_mhd; // we can jump out early.
+                response.content_type = mime_type_for(filename);
             }
-
-            // else lets invalidate the cache
-            fd_cache_.erase(response.file);
-            response_mhd = nullptr; //delete our copy too
+            response.status_code = default_success_code_(request.method);
+            response.file = filename;
         }
     }
 
+    if (response.content_type.empty())
+    {
+        response.content_type = "text/html; charset=utf-8";
+    }
+    response.headers[MHD_HTTP_HEADER_SERVER] = server_identifier_;
+}
 
-    // cache miss, look for the file on disk
-
+bool response_renderer::resolve_file_(const request &request,
+                                      response &response,
+                                      std::string &filename,
+                                      struct stat &st)
+{
     // TODO replace with new c++17 std::filesystem implementation. Later.
     // first we see if this is a folder or a file. If it is a folder, we look for some index.* files to use instead.
-    struct stat st;
-    auto filename = response.file;
+    filename = response.file;
 
     auto stat_ret = stat(filename.c_str(), &st);
 
-
-    if (S_ISDIR(st.st_mode))
+    if (stat_ret == 0 && S_ISDIR(st.st_mode))
     {
         if (filename[filename.size() - 1] != '/')
         {
             filename += "/";
         }
-        for (const auto name : index_filenames)
+        for (const auto &name : index_filenames)
         {
             std::string induced_filename{filename + name};
             {
@@ -186,34 +178,147 @@ response_renderer::from_file_(const request &request, response &response)
     if (stat_ret != 0)
     {
         // The file doesn't exist, 404
-        response = luna::response{404, "text/html; charset=utf-8", "<html><h1>404 Not Found</h1></html>"};
-        if(not_found_handler_)
+        not_found(request, response);
+        return false;
+    }
+
+    return true;
+}
+
+void response_renderer::not_found(const request &request, response &response) const
+{
+    response = luna::response{404, "text/html; charset=utf-8", "<html><h1>404 Not Found</h1></html>"};
+    if(not_found_handler_)
+    {
+        not_found_handler_(request, response);
+    }
+}
+
+std::string response_renderer::mime_type_for(const std::string &filename) const
+{
+    return mime_types_->type_for(filename);
+}
+
+void response_renderer::watch_files(const std::string &root)
+{
+    std::unique_lock<SHARED_MUTEX> cache_lock{response_renderer::fd_cache_mutex_};
+    watched_roots_.emplace_back(root);
+}
+
+void response_renderer::file_changed(const std::string &path)
+{
+    {
+        // small files are checked against the disk each time anyway; this just frees the memory sooner
+        std::lock_guard<std::mutex> lock{small_files_mutex_};
+        auto held = small_files_.find(path);
+        if (held != small_files_.end())
+        {
+            small_files_held_ -= held->second.size;
+            small_files_used_.erase(held->second.used);
+            small_files_.erase(held);
+        }
+    }
+
+    std::unique_lock<SHARED_MUTEX> cache_lock{response_renderer::fd_cache_mutex_};
+    auto root = std::find(watched_roots_.begin(), watched_roots_.end(), path);
+    if (root == watched_roots_.end())
+    {
+        fd_cache_.erase(path);
+        return;
+    }
+
+    watched_roots_.erase(root);
+    auto prefix = path + "/";
+    for (auto entry = fd_cache_.begin(); entry != fd_cache_.end();)
+    {
+        if (entry->first.compare(0, prefix.size(), prefix) == 0)
         {
-            not_found_handler_(request, response);
+            entry = fd_cache_.erase(entry);
         }
+        else
+        {
+            ++entry;
+        }
+    }
+}
 
+std::shared_ptr<cacheable_response>
+response_renderer::from_file_(const request &request, response &response)
+{
+    std::shared_ptr<cacheable_response> response_mhd;
+
+    if (!response_mhd) // TODO always false! What was this here for?
+    {
+        // look for the file in our local fd cache
+        SHARED_LOCK<SHARED_MUTEX> lock{response_renderer::fd_cache_mutex_};
+        auto cached = use_fd_cache_ ? fd_cache_.find(response.file) : fd_cache_.end();
+        if (cached != fd_cache_.end())
+        {
+            response_mhd = cached->second;
+            // has the cache expired? Watched files don't; they're dropped when they change
+            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now() - response_mhd->time_cached);
+            if (response_mhd->watched || duration.count() <= cache_keep_alive_.count())
+            {
+                response_mhd->cached = true;
+                LUNA_LOG_DEBUG("File cache: HIT");
+#ifdef LUNA_TESTING
+                auto header = MHD_get_response_header(response_mhd->mhd_response, "X-LUNA-CACHE");
+                if (header == nullptr)
+                {
+                    MHD_add_response_header(response_mhd->mhd_response, "X-LUNA-CACHE", "HIT");
+                }
+                else if (header[0] == 'M')
+                {
+                    MHD_del_response_header(response_mhd->mhd_response, "X-LUNA-CACHE", "MISS");
+                    MHD_add_response_header(response_mhd->mhd_response, "X-LUNA-CACHE", "HIT");
+                }
+#endif
+                return response_mhd; // we can jump out early.
+            }
+
+            // else lets invalidate the cache
+            lock.unlock();
+            std::unique_lock<SHARED_MUTEX> cache_lock{response_renderer::fd_cache_mutex_};
+            fd_cache_.erase(response.file);
+            response_mhd = nullptr; //delete our copy too
+        }
+    }
+
+
+    // cache miss, look for the file on disk
+    struct stat st;
+    std::string filename;
+    if (!resolve_file_(request, response, filename, st))
+    {
         response_mhd = std::make_shared<cacheable_response>(MHD_create_response_from_buffer(response.content.length(),
                                                                                             (void *) response.content.c_str(),
                                                                                             MHD_RESPMEM_MUST_COPY),
                                                             response.status_code);
 
         return response_mhd; // done!
-
     }
 
 
     // Made it this far, we have a file of some kind we need to load from the disk, wooo.
 
-    std::unique_lock<std::mutex> fd_lock{
-            response_renderer::fd_mutex_};
     // determine mime type
     if (response.content_type.empty())
     {
-        response.content_type = get_mime_type_(filename);
+        response.content_type = mime_type_for(filename);
     }
 
     response.status_code = default_success_code_(request.method);
 
+    // small files are served from memory instead
+    response_mhd = from_memory_(response, filename, st);
+    if (response_mhd)
+    {
+        return response_mhd;
+    }
+
+    std::unique_lock<std::mutex> fd_lock{
+            response_renderer::fd_mutex_};
     auto file = fopen(filename.c_str(), "r");
 
     // because we already checked with stat(), this is guaranteed to work
@@ -231,7 +336,15 @@ response_renderer::from_file_(const request &request, response &response)
         // TODO put a cap on how big the cache can be!
         std::unique_lock<SHARED_MUTEX> cache_lock{response_renderer::fd_cache_mutex_};
         response_mhd->time_cached = std::chrono::system_clock::now();
-        error_log(log_level::DEBUG, "File cache: MISS");
+        for (const auto &root : watched_roots_)
+        {
+            if (response.file.compare(0, root.size() + 1, root + "/") == 0)
+            {
+                response_mhd->watched = true;
+                break;
+            }
+        }
+        LUNA_LOG_DEBUG("File cache: MISS");
 #ifdef LUNA_TESTING
         MHD_add_response_header(response_mhd->mhd_response, "X-LUNA-CACHE", "MISS");
 #endif
@@ -241,6 +354,109 @@ response_renderer::from_file_(const request &request, response &response)
     return response_mhd;
 };
 
+std::shared_ptr<cacheable_response>
+response_renderer::from_memory_(const response &response, const std::string &filename, const struct stat &st)
+{
+    auto size = static_cast<size_t>(st.st_size);
+    if (small_file_cache_size_ == 0 || !S_ISREG(st.st_mode) || size > small_file_max_size_ ||
+        size > small_file_cache_size_)
+    {
+        return nullptr;
+    }
+
+    // the response is shared, headers and all, so it has to have been made for a response just like this one
+    std::string variant{std::to_string(response.status_code) + "\n" + response.content_type + "\n"};
+    for (const auto &header : response.headers)
+    {
+        variant += header.first + ": " + header.second + "\n";
+    }
+    auto same_file = [&st](const small_file &held)
+    {
+        return held.size == static_cast<uint64_t>(st.st_size) && held.modified == modified_ns_(st) &&
+               held.inode == static_cast<uint64_t>(st.st_ino) && held.device == static_cast<uint64_t>(st.st_dev);
+    };
+
+    {
+        std::lock_guard<std::mutex> lock{small_files_mutex_};
+        auto held = small_files_.find(filename);
+        if (held != small_files_.end() && same_file(held->second) && held->second.variant == variant)
+        {
+            small_files_used_.splice(small_files_used_.begin(), small_files_used_, held->second.used);
+            return held->second.response;
+        }
+    }
+
+    // read it in, making sure it's still the file that was asked about
+    auto fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    std::string contents(size, '\0');
+    size_t read_so_far{0};
+    while (read_so_far < size)
+    {
+        auto got = read(fd, &contents[read_so_far], size - read_so_far);
+        if (got <= 0)
+        {
+            if (got < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        read_so_far += static_cast<size_t>(got);
+    }
+    struct stat after;
+    auto unchanged = read_so_far == size && fstat(fd, &after) == 0 && after.st_size == st.st_size &&
+                     modified_ns_(after) == modified_ns_(st) && after.st_ino == st.st_ino;
+    close(fd);
+    if (!unchanged)
+    {
+        return nullptr; // it's changing under us; let it be served from disk this time
+    }
+
+    auto content = std::make_shared<const std::string>(std::move(contents));
+    auto response_mhd = std::make_shared<cacheable_response>(
+            MHD_create_response_from_buffer(content->size(),
+                                            const_cast<char *>(content->data()),
+                                            MHD_RESPMEM_PERSISTENT),
+            response.status_code);
+    response_mhd->content = content;
+    add_headers_(response_mhd->mhd_response, response);
+    response_mhd->cached = true; // finished: nobody may add to it once it's shared
+
+    std::lock_guard<std::mutex> lock{small_files_mutex_};
+    auto held = small_files_.find(filename);
+    if (held != small_files_.end())
+    {
+        small_files_held_ -= held->second.size;
+        small_files_used_.erase(held->second.used);
+        small_files_.erase(held);
+    }
+    small_files_used_.emplace_front(filename);
+    small_files_.emplace(filename, small_file{static_cast<uint64_t>(st.st_size),
+                                              modified_ns_(st),
+                                              static_cast<uint64_t>(st.st_ino),
+                                              static_cast<uint64_t>(st.st_dev),
+                                              std::move(variant),
+                                              response_mhd,
+                                              small_files_used_.begin()});
+    small_files_held_ += size;
+
+    // make room, least recently used first
+    while (small_files_held_ > small_file_cache_size_)
+    {
+        auto evicted = small_files_.find(small_files_used_.back());
+        small_files_held_ -= evicted->second.size;
+        small_files_.erase(evicted);
+        small_files_used_.pop_back();
+    }
+    LUNA_LOG_DEBUG("Small file cache: MISS " + filename);
+
+    return response_mhd;
+}
+
 
 ///// Option setters
 
@@ -269,6 +485,24 @@ void response_renderer::set_option(server::internal_file_cache_keep_alive value)
     cache_keep_alive_ = value;
 }
 
+void response_renderer::set_option(server::small_file_cache_size value)
+{
+    small_file_cache_size_ = value.get();
+}
+
+void response_renderer::set_option(server::small_file_max_size value)
+{
+    small_file_max_size_ = value.get();
+}
+
+void response_renderer::set_option(const server::mime_types &value)
+{
+    for (const auto &type : value)
+    {
+        mime_types_->set(type.first, type.second);
+    }
+}
+
 void response_renderer::set_option(server::not_found_handler_cb value)
 {
     not_found_handler_ = value;
@@ -16,11 +16,15 @@
 
 #include <luna/luna.h>
 #include "luna/private/cacheable_response.h"
+#include "luna/private/mime_registry.h"
+#include <sys/stat.h>
+#include <list>
 #include <unordered_map>
 #include <shared_mutex>
 #include <mutex>
 #include <thread>
 #include <chrono>
+#include <vector>
 
 
 // NOTE: Apple prior to macOS 12 doesn't support shared mutexes :(
@@ -51,17 +55,56 @@ public:
 
     std::shared_ptr<cacheable_response> render(const luna::request &request, luna::response &response);
 
+    // Fill in everything render() would, but leave the result as a luna::response, for transports that write responses
+    // out themselves. File responses are resolved to the file that will actually be served (or turned into a 404), but
+    // the file is not opened.
+    void finalize(const luna::request &request, luna::response &response);
+
+    // Turn response into a 404, as the server's not found handler would have it
+    void not_found(const luna::request &request, luna::response &response) const;
+
+    // What files are served as, going by their extension
+    std::string mime_type_for(const std::string &filename) const;
+
+    // The same, for a static_file_index to type its files with
+    std::shared_ptr<const mime_registry> mime_types() const
+    { return mime_types_; }
+
+    // Files under root are watched for changes (see static_file_index), and file_changed() is called when one does. The
+    // fd cache keeps them until then, rather than for internal_file_cache_keep_alive.
+    void watch_files(const std::string &root);
+
+    // Drop a file from the fd and small file caches. Called with a watched root, every file under it is dropped, and
+    // it's no longer watched.
+    void file_changed(const std::string &path);
+
     // option setters
     void set_option(const server::server_identifier &value);
     void set_option(const server::server_identifier_and_version &value);
     void set_option(const server::append_to_server_identifier &value); //TODO I am not fond of having this here.
     void set_option(server::enable_internal_file_cache value);
     void set_option(server::internal_file_cache_keep_alive value);
+    void set_option(server::small_file_cache_size value);
+    void set_option(server::small_file_max_size value);
+    void set_option(const server::mime_types &value);
     void set_option(server::not_found_handler_cb value);
 
 private:
     std::shared_ptr<cacheable_response> from_file_(const luna::request &request, luna::response &response);
 
+    // Find the file to serve for response.file, looking for an index file if it is a directory. On success, fills in
+    // filename and st; otherwise rewrites response as a 404.
+    bool resolve_file_(const luna::request &request, luna::response &response, std::string &filename, struct stat &st);
+
+    // The shared, in-memory response for filename, read from disk if it isn't already held or has changed since. Null
+    // if the file is too big to be held, or couldn't be read.
+    std::shared_ptr<cacheable_response> from_memory_(const luna::response &response,
+                                                     const std::string &filename,
+                                                     const struct stat &st);
+
+    // The headers every response is sent with
+    void add_headers_(struct MHD_Response *mhd_response, const luna::response &response) const;
+
     std::string server_identifier_;
 
     // fd cache
@@ -70,6 +113,29 @@ private:
     static SHARED_MUTEX fd_cache_mutex_;
     std::unordered_map<std::string, std::shared_ptr<cacheable_response> > fd_cache_;
     std::chrono::milliseconds cache_keep_alive_;
+    std::vector<std::string> watched_roots_; // guarded by fd_cache_mutex_
+
+    // small file cache
+    struct small_file
+    {
+        // which version of the file this is
+        uint64_t size;
+        int64_t modified; // ns since the epoch
+        uint64_t inode;
+        uint64_t device;
+
+        std::string variant; // the status, content type and headers the response was made with
+        std::shared_ptr<cacheable_response> response;
+        std::list<std::string>::iterator used; // its place in small_files_used_
+    };
+    size_t small_file_cache_size_;
+    size_t small_file_max_size_;
+    std::mutex small_files_mutex_;
+    std::unordered_map<std::string, small_file> small_files_;
+    std::list<std::string> small_files_used_; // most recently used first
+    size_t small_files_held_; // bytes
+
+    std::shared_ptr<mime_registry> mime_types_;
 
     // custom user-supplied 404 renderer
     server::not_found_handler_cb not_found_handler_;
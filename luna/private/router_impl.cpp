@@ -14,9 +14,15 @@
 
 #include "router_impl.h"
 #include "luna/config.h"
+#include "luna/private/path_normalizer.h"
+#include "luna/private/safer_times.h"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <strings.h>
+#include <sys/stat.h>
 #include <mutex>
 #include <vector>
-#include <stack>
 #include <algorithm>
 
 
@@ -34,6 +40,21 @@ router::router_impl::router_impl(std::string route_base) :
     }
 }
 
+response router::router_impl::not_found_(const request &req)
+{
+    response not_found{404, "text/html; charset=utf-8", "<html><h1>404 Not Found</h1></html>"};
+    std::shared_ptr<response_renderer> renderer;
+    {
+        std::lock_guard<std::mutex> lock{lock_};
+        renderer = renderer_;
+    }
+    if (renderer)
+    {
+        renderer->not_found(req, not_found);
+    }
+    return not_found;
+}
+
 void router::router_impl::set_mime_type(std::string mime_type)
 {
     mime_type_ = mime_type;
@@ -42,14 +63,26 @@ void router::router_impl::set_mime_type(std::string mime_type)
 void router::router_impl::handle_request(request_method method,
                             std::regex route,
                             router::endpoint_handler_cb callback,
-                            parameter::validators validations)
+                            parameter::validators validations,
+                            endpoint_options options)
 {
+    std::unique_ptr<bulkhead_gate> bulkhead;
+    if (options.bulkhead)
+    {
+        bulkhead = std::make_unique<bulkhead_gate>(*options.bulkhead);
+    }
+    if (options.coalesce)
+    {
+        coalescing_ = true;
+    }
+    auto ep = std::make_shared<endpoint>(endpoint{std::move(route),
+                                                  std::move(callback),
+                                                  compile_validators_(std::move(validations)),
+                                                  std::move(options),
+                                                  std::move(bulkhead)});
+
     std::lock_guard<std::mutex> guard{lock_};
-    request_handlers_[method].insert(std::end(request_handlers_[method]),
-                                            std::make_tuple(
-                                                    route,
-                                                    callback,
-                                                    validations));
+    request_handlers_[method].emplace_back(std::move(ep));
 }
 
 void router::router_impl::handle_request(request_method method,
@@ -57,100 +90,447 @@ void router::router_impl::handle_request(request_method method,
                             router::endpoint_handler_cb callback,
                             parameter::validators validations)
 {
-    std::lock_guard<std::mutex> guard{lock_};
-    request_handlers_[method].insert(std::end(request_handlers_[method]),
-                                            std::make_tuple(
-                                                    std::regex{route},
-                                                    callback,
-                                                    validations));
+    handle_request(method, std::regex{route}, std::move(callback), std::move(validations));
 }
 
-std::string sanitize_path_(std::string path_to_files)
+std::vector<router::router_impl::compiled_validator>
+router::router_impl::compile_validators_(parameter::validators &&validations)
+{
+    std::vector<compiled_validator> compiled;
+    compiled.reserve(validations.size());
+    for (auto &validator : validations)
+    {
+        compiled_validator v{};
+        v.key = std::move(validator.key);
+        v.required = validator.required;
+        if (validator.typed_validation_func)
+        {
+            v.typed_validation_func = std::move(validator.typed_validation_func);
+        }
+        else if (validator.validation_func)
+        {
+            v.validation_func = std::move(validator.validation_func);
+        }
+        // else there is nothing to check beyond presence
+        compiled.emplace_back(std::move(v));
+    }
+    return compiled;
+}
+
+bool router::router_impl::validate_params_(const endpoint &endpoint, request &request, std::string &error)
 {
-    std::vector<std::string> url_comps;
-    std::string delimeter = "/";
-    std::string final_path = "";
-    std::string working_path = path_to_files;
-    size_t pos = 0;
-    int num_front_slash = 0, num_back_slash = 0;
+    for (const auto &validator : endpoint.validators)
+    {
+        auto param = request.params.find(validator.key);
+        if (param == request.params.end())
+        {
+            if (validator.required) //not present, but required
+            {
+                error = "is missing required parameter \"" + validator.key + "\"";
+                return false;
+            }
+            continue;
+        }
+
+        //run the validator
+        bool valid{true};
+        if (validator.typed_validation_func)
+        {
+            parameter::value parsed;
+            valid = validator.typed_validation_func(param->second, parsed);
+            if (valid)
+            {
+                request.parsed_params[validator.key] = parsed;
+            }
+        }
+        else if (validator.validation_func)
+        {
+            valid = validator.validation_func(param->second);
+        }
+
+        if (!valid)
+        {
+            error = "is missing required parameter \"" + validator.key + "\"";
+            return false;
+        }
+    }
+
+    return true;
+}
 
+std::string sanitize_path_(std::string path_to_files)
+{
     // path can contain many / as prefix or suffix
     // we want to preserve that in the final path
-    while (pos < path_to_files.size() and path_to_files[pos++] == '/') {
-        ++num_front_slash;
+    auto first = path_to_files.find_first_not_of('/');
+    if (first == std::string::npos)
+    {
+        // nothing to sanitize
+        return path_to_files;
     }
+    auto trailing = path_to_files.size() - path_to_files.find_last_not_of('/') - 1;
 
-    pos = path_to_files.size() - 1;
-    while (int(pos) - 1 >= 0 and path_to_files[pos--] == '/') {
-        ++num_back_slash;
+    auto length = path_to_files.size() - first - trailing;
+    if (!normalize_path(&path_to_files[first], length))
+    {
+        // trying to access a file outside cwd
+        // Return empty string which would result in 404
+        return "";
     }
+    path_to_files.resize(first + length);
+    if (path_to_files.empty())
+    {
+        path_to_files = "."; // a relative path that went nowhere
+    }
+    path_to_files.append(trailing, '/');
 
-    // Now, split by '/' to get URL components
-    while ((pos = working_path.find(delimeter)) != std::string::npos) {
-        std::string comp =  working_path.substr(0, pos);
-        if (not comp.empty()) {
-            url_comps.push_back(comp);
+    return path_to_files;
+}
+
+// Caching headers for a file served by serve_files, and a 304 instead if the client has the file already
+static response cache_file_(const request &req,
+                            response found,
+                            uint64_t size,
+                            int64_t modified,
+                            bool immutable,
+                            std::chrono::seconds max_age)
+{
+    char etag[48];
+    std::snprintf(etag, sizeof(etag), "\"%llx-%llx\"", static_cast<unsigned long long>(modified),
+                  static_cast<unsigned long long>(size));
+    auto modified_s = static_cast<time_t>(modified / 1000000000);
+    auto modified_tm = luna::gmtime(modified_s);
+    found.headers["ETag"] = etag;
+    found.headers["Last-Modified"] = put_time(&modified_tm, "%a, %d %b %Y %H:%M:%S GMT");
+    if (immutable)
+    {
+        found.headers["Cache-Control"] = "public, max-age=31536000, immutable";
+    }
+    else if (max_age.count() > 0)
+    {
+        found.headers["Cache-Control"] = "public, max-age=" + std::to_string(max_age.count());
+    }
+    else
+    {
+        found.headers["Cache-Control"] = "no-cache";
+    }
+
+    // If-None-Match, when there is one, decides it
+    bool unchanged{false};
+    auto if_none_match = req.headers.find("If-None-Match");
+    auto if_modified_since = req.headers.find("If-Modified-Since");
+    if (if_none_match != req.headers.end())
+    {
+        unchanged = if_none_match->second == "*" || if_none_match->second.find(etag) != std::string::npos;
+    }
+    else if (if_modified_since != req.headers.end())
+    {
+        struct tm since{};
+        if (strptime(if_modified_since->second.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &since))
+        {
+            unchanged = timegm(&since) >= modified_s;
         }
-        working_path.erase(0, pos + delimeter.length());
     }
+    if (unchanged)
+    {
+        found.file.clear();
+        found.status_code = 304;
+    }
+    return found;
+}
 
-    std::string last_comp = working_path.substr(0, pos);
-    if (not last_comp.empty()) {
-        url_comps.push_back(last_comp);
+void router::router_impl::serve_files(std::string mount_point, std::string path_to_files, router::file_options options)
+{
+    auto sanitized = sanitize_path_(path_to_files);
+    if (sanitized.empty())
+    {
+        LUNA_LOG_ERROR("Not serving files from " + path_to_files + ", which climbs out of the working directory");
+        return;
     }
+    path_to_files = sanitized;
+    std::regex route{mount_point + "(.*)"};
+    std::string local_path{path_to_files + "/"};
 
-    if (url_comps.empty()) {
-        // nothing to sanitize
-        return path_to_files;
+    auto root = path_to_files;
+    while (root.size() > 1 && root.back() == '/')
+    {
+        root.pop_back();
     }
 
-    std::stack<std::string> stk;
-    for (auto& comp : url_comps) {
-        if (comp == ".." and stk.empty()) {
-            // trying to access a file outside cwd
-            // Return empty string which would result in 404
-            return "";
-        } else if (comp == "..") {
-            stk.pop();
-        } else {
-            stk.push(comp);
+    // Which files are fingerprinted, if any are
+    std::shared_ptr<asset_fingerprints> fingerprints;
+    if (!options.asset_manifest.empty() || options.fingerprint_assets)
+    {
+        auto manifest = options.asset_manifest;
+        if (!manifest.empty() && manifest.front() != '/')
+        {
+            manifest = root + "/" + manifest;
         }
+        fingerprints = std::make_shared<asset_fingerprints>(root, manifest);
+        std::lock_guard<std::mutex> lock{lock_};
+        fingerprinted_mounts_.emplace_back(mount_point, fingerprints);
     }
 
-    // Build final path from stack
-    while (not stk.empty()) {
-        final_path = stk.top() + delimeter + final_path;
-        stk.pop();
+    // Keep what's there in memory, if it can be kept current, and tell the server's fd cache when it changes
+    std::shared_ptr<const mime_registry> mime_types;
+    {
+        std::lock_guard<std::mutex> lock{lock_};
+        mime_types = renderer_ ? renderer_->mime_types() : std::make_shared<const mime_registry>();
+    }
+    std::unique_ptr<static_file_index> index{new static_file_index{root, [this, root, fingerprints](const std::string &path)
+    {
+        std::shared_ptr<response_renderer> renderer;
+        {
+            std::lock_guard<std::mutex> lock{lock_};
+            renderer = renderer_;
+        }
+        if (renderer)
+        {
+            renderer->file_changed(path);
+        }
+        if (fingerprints && !fingerprints->manifest().empty() && (path == fingerprints->manifest() || path == root))
+        {
+            fingerprints->reload();
+        }
+    }, mime_types}};
+    static_file_index *files{nullptr}; // lives as long as this router does
+    if (*index)
+    {
+        files = index.get();
+        std::lock_guard<std::mutex> lock{lock_};
+        if (renderer_)
+        {
+            renderer_->watch_files(root);
+        }
+        file_indexes_.emplace_back(std::move(index));
     }
 
-    // remove trailing '/' added by previous stmt
-    final_path.pop_back();
+    auto max_age = options.asset_max_age;
+    handle_request(request_method::GET, route, [=](const request &req) -> response
+    {
+        std::string path = req.matches[1];
+        if (!normalize_path(path))
+        {
+            LUNA_LOG_DEBUG("Refusing to serve " + req.path);
+            return not_found_(req);
+        }
 
-    // add back the /s in
-    while (num_front_slash--) {
-        final_path = "/" + final_path;
-    }
+        // fingerprinted files never change, so they can be kept forever
+        bool immutable{false};
+        if (fingerprints)
+        {
+            auto file = fingerprints->resolve(path);
+            if (file)
+            {
+                path = *file;
+                immutable = true;
+            }
+        }
+
+        if (files && *files)
+        {
+            auto file = files->find_normalized(path);
+            if (!file)
+            {
+                return not_found_(req);
+            }
+
+            auto found = response::from_file(file->path);
+            found.content_type = file->mime_type;
+            return cache_file_(req, std::move(found), file->size, file->modified, immutable, max_age);
+        }
+
+        path = local_path + path;
+
+        LUNA_LOG_DEBUG(std::string{"File requested:  "} + req.matches[1]);
+        LUNA_LOG_DEBUG(std::string{"Serve from    :  "} + path);
 
-    while (num_back_slash--) {
-        final_path += "/";
+        // directories, and files that aren't there, are left to the renderer
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+        {
+#if defined(__APPLE__)
+            auto modified = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+            auto modified = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+            return cache_file_(req, response::from_file(path), static_cast<uint64_t>(st.st_size), modified, immutable,
+                               max_age);
+        }
+        return response::from_file(path);
+    });
+}
+
+std::string router::router_impl::asset_path(const std::string &path)
+{
+    std::vector<std::pair<std::string, std::shared_ptr<asset_fingerprints>>> mounts;
+    {
+        std::lock_guard<std::mutex> lock{lock_};
+        mounts = fingerprinted_mounts_;
     }
+    for (const auto &mount : mounts)
+    {
+        auto prefix = route_base_ + mount.first;
+        if (path.compare(0, prefix.size(), prefix) != 0)
+        {
+            continue;
+        }
+        auto start = path.find_first_not_of('/', prefix.size());
+        if (start == std::string::npos)
+        {
+            continue;
+        }
+        auto fingerprinted = mount.second->fingerprinted(path.substr(start));
+        if (!fingerprinted.empty())
+        {
+            return path.substr(0, start) + fingerprinted;
+        }
+    }
+    return path;
+}
 
-    return final_path;
+// Whether an Accept-Encoding header allows coding. Any q-value but zero will do.
+static bool accepts_encoding_(const std::string &accept_encoding, const std::string &coding)
+{
+    size_t start{0};
+    while (start < accept_encoding.size())
+    {
+        auto end = accept_encoding.find(',', start);
+        if (end == std::string::npos)
+        {
+            end = accept_encoding.size();
+        }
+        auto item = accept_encoding.substr(start, end - start);
+        start = end + 1;
+
+        auto name_start = item.find_first_not_of(" \t");
+        if (name_start == std::string::npos)
+        {
+            continue;
+        }
+        auto name_end = item.find_first_of(" \t;", name_start);
+        auto name = item.substr(name_start, name_end == std::string::npos ? std::string::npos : name_end - name_start);
+        if (name != "*" && (name.size() != coding.size() || strncasecmp(name.c_str(), coding.c_str(), name.size()) != 0))
+        {
+            continue;
+        }
+        auto q = item.find("q=", name_end == std::string::npos ? item.size() : name_end);
+        return q == std::string::npos || std::strtod(item.c_str() + q + 2, nullptr) > 0;
+    }
+    return false;
 }
 
-void router::router_impl::serve_files(std::string mount_point, std::string path_to_files)
+void router::router_impl::serve_embedded(std::string mount_point, const embedded_assets &assets)
 {
-    path_to_files = sanitize_path_(path_to_files);
     std::regex route{mount_point + "(.*)"};
-    std::string local_path{path_to_files + "/"};
+    const auto *embedded = &assets;
+
     handle_request(request_method::GET, route, [=](const request &req) -> response
     {
-        std::string path = local_path + req.matches[1];
+        std::string path = req.matches[1];
+        auto first = path.find_first_not_of('/');
+        path.erase(0, first == std::string::npos ? path.size() : first);
+        if (!path.empty() && path.back() == '/')
+        {
+            path.pop_back();
+        }
 
-        error_log(log_level::DEBUG, std::string{"File requested:  "} + req.matches[1]);
-        error_log(log_level::DEBUG, std::string{"Serve from    :  "} + path);
+        auto asset = embedded->find(path);
+        if (!asset)
+        {
+            return not_found_(req);
+        }
 
-        return response::from_file(path);
+        // the smallest representation the client will take
+        auto data = asset->data;
+        auto size = asset->size;
+        std::string encoding;
+        auto accept_encoding = req.headers.find("Accept-Encoding");
+        if (accept_encoding != req.headers.end())
+        {
+            if (asset->brotli && accepts_encoding_(accept_encoding->second, "br"))
+            {
+                data = asset->brotli;
+                size = asset->brotli_size;
+                encoding = "br";
+            }
+            else if (asset->gzip && accepts_encoding_(accept_encoding->second, "gzip"))
+            {
+                data = asset->gzip;
+                size = asset->gzip_size;
+                encoding = "gzip";
+            }
+        }
+
+        // each representation has an ETag of its own
+        std::string etag{asset->etag};
+        if (!encoding.empty())
+        {
+            etag.insert(etag.size() - 1, "-" + encoding);
+        }
+
+        response found{200, asset->mime_type, ""};
+        found.headers["ETag"] = etag;
+        if (asset->gzip || asset->brotli)
+        {
+            found.headers["Vary"] = "Accept-Encoding";
+        }
+
+        auto if_none_match = req.headers.find("If-None-Match");
+        if (if_none_match != req.headers.end() &&
+            (if_none_match->second == "*" || if_none_match->second.find(etag) != std::string::npos))
+        {
+            found.status_code = 304;
+            return found;
+        }
+
+        if (!encoding.empty())
+        {
+            found.headers["Content-Encoding"] = encoding;
+        }
+        found.content.assign(reinterpret_cast<const char *>(data), size);
+        return found;
+    });
+}
+
+void router::router_impl::serve_cache_admin(std::string mount_point)
+{
+    handle_request(request_method::POST, mount_point, [this](const request &req) -> response
+    {
+        std::shared_ptr<tiered_response_cache> cache;
+        {
+            std::lock_guard<std::mutex> guard{lock_};
+            cache = response_cache_;
+        }
+        if (!cache)
+        {
+            return {404, "text/plain", "There is no response cache to purge"};
+        }
+
+        auto tag = req.params.find("tag");
+        auto path = req.params.find("path");
+        auto prefix = req.params.find("prefix");
+        if ((tag != req.params.end()) + (path != req.params.end()) + (prefix != req.params.end()) != 1)
+        {
+            return {400, "text/plain", "Give one of tag, path or prefix"};
+        }
+
+        size_t purged;
+        if (tag != req.params.end())
+        {
+            purged = cache->purge_tag(tag->second);
+        }
+        else if (path != req.params.end())
+        {
+            purged = cache->purge_prefix(tiered_response_cache::path_prefix(path->second));
+        }
+        else
+        {
+            purged = cache->purge_prefix(prefix->second);
+        }
+        LUNA_LOG_INFO("Purged " + std::to_string(purged) + " responses from the response cache");
+
+        return {200, "application/json", "{\"purged\": " + std::to_string(purged) + "}"};
     });
 }
 
@@ -159,6 +539,119 @@ void router::router_impl::add_header(std::string &&key, std::string &&value)
     headers_[key] = std::move(value);
 }
 
+void router::router_impl::set_bulkhead(bulkhead bulkhead)
+{
+    auto gate = std::make_shared<bulkhead_gate>(bulkhead);
+    std::lock_guard<std::mutex> guard{lock_};
+    bulkhead_ = std::move(gate);
+}
+
+void router::router_impl::require_basic_authorization(std::string realm,
+                                                      basic_authorization_cb verifier,
+                                                      std::chrono::milliseconds cache_ttl,
+                                                      size_t cache_size)
+{
+    std::shared_ptr<const authorization> required{new authorization{authorization_kind::BASIC,
+                                                                    std::move(realm),
+                                                                    std::move(verifier),
+                                                                    nullptr,
+                                                                    std::make_unique<credential_cache>(cache_ttl, cache_size)}};
+    std::lock_guard<std::mutex> guard{lock_};
+    authorization_ = std::move(required);
+}
+
+void router::router_impl::require_bearer_authorization(std::string realm,
+                                                       bearer_authorization_cb verifier,
+                                                       std::chrono::milliseconds cache_ttl,
+                                                       size_t cache_size)
+{
+    std::shared_ptr<const authorization> required{new authorization{authorization_kind::BEARER,
+                                                                    std::move(realm),
+                                                                    nullptr,
+                                                                    std::move(verifier),
+                                                                    std::make_unique<credential_cache>(cache_ttl, cache_size)}};
+    std::lock_guard<std::mutex> guard{lock_};
+    authorization_ = std::move(required);
+}
+
+bool router::router_impl::authorize_(const authorization &authorization, const request &request)
+{
+    auto header = request.headers.find("Authorization");
+    if (header == request.headers.end())
+    {
+        return false;
+    }
+
+    // seen and verified recently? Then we can skip the (presumably expensive) verifier
+    if (authorization.cache->contains(header->second))
+    {
+        return true;
+    }
+
+    bool verified{false};
+    if (authorization.kind == authorization_kind::BASIC)
+    {
+        auto auth = get_basic_authorization(request.headers);
+        verified = auth && authorization.basic_verifier(auth.username, auth.password);
+    }
+    else
+    {
+        auto auth = get_bearer_authorization(request.headers);
+        verified = auth && authorization.bearer_verifier(auth.token);
+    }
+
+    if (verified)
+    {
+        authorization.cache->insert(header->second);
+    }
+
+    return verified;
+}
+
+luna::response router::router_impl::run_handler_(const endpoint &endpoint,
+                                                  bulkhead_gate *router_bulkhead,
+                                                  request &request)
+{
+    if (!endpoint.bulkhead && !router_bulkhead)
+    {
+        return endpoint.callback(request);
+    }
+
+    // the endpoint's own bulkhead first, so that requests queueing for it don't hold a place in the router's
+    std::vector<bulkhead_gate::permit> permits;
+    bulkhead_gate *pool{nullptr};
+    for (auto gate : {endpoint.bulkhead.get(), router_bulkhead})
+    {
+        if (!gate)
+        {
+            continue;
+        }
+        auto permit = gate->enter(request.cancellation.deadline());
+        if (!permit)
+        {
+            LUNA_LOG_WARNING("Request for \"" + request.path + "\" was turned away by a full bulkhead");
+            return gate->rejection();
+        }
+        permits.emplace_back(std::move(permit));
+        if (!pool && gate->has_threads())
+        {
+            pool = gate;
+        }
+    }
+
+    if (!pool)
+    {
+        return endpoint.callback(request);
+    }
+
+    auto response = pool->run(endpoint.callback, request, std::move(permits));
+    if (!response)
+    {
+        LUNA_LOG_WARNING("Request for \"" + request.path + "\" passed its deadline while its handler was running");
+        return {503, "text/plain", "Request deadline exceeded"};
+    }
+    return std::move(*response);
+}
 
 // Helper function to tack on headers
 luna::response make_response_(luna::response &&response, luna::headers &headers_)
@@ -174,6 +667,185 @@ luna::response make_response_(luna::response &&response, luna::headers &headers_
     return response;
 }
 
+luna::response router::router_impl::respond_(const endpoint &endpoint,
+                                             bulkhead_gate *router_bulkhead,
+                                             request &request,
+                                             luna::headers &headers,
+                                             const std::string &mime_type)
+{
+    auto response = make_response_(run_handler_(endpoint, router_bulkhead, request), headers);
+
+    // add mime type if needed. Don't add a mimetype for file responses
+    if (response.file.empty() && response.content_type.empty()) //no content type assigned, use the default
+    {
+        response.content_type = mime_type;
+    }
+
+    return response;
+}
+
+tiered_response_cache::lifetime router::router_impl::cache_lifetime_(const endpoint &endpoint)
+{
+    tiered_response_cache::lifetime lifetime{*endpoint.options.cache_for};
+    lifetime.stale_while_revalidate = endpoint.options.stale_while_revalidate.value_or(std::chrono::milliseconds{0});
+    lifetime.stale_if_error = endpoint.options.stale_if_error.value_or(std::chrono::milliseconds{0});
+    return lifetime;
+}
+
+void router::router_impl::revalidate_(tiered_response_cache &cache,
+                                      const std::string &key,
+                                      std::shared_ptr<const endpoint> endpoint,
+                                      std::shared_ptr<bulkhead_gate> router_bulkhead,
+                                      const request &request,
+                                      luna::headers headers,
+                                      std::string mime_type,
+                                      bool shared)
+{
+    // the request being answered now can't be allowed to cancel this one, but it gets the same time to run
+    luna::request refresh{request};
+    refresh.start = std::chrono::system_clock::now();
+    refresh.cancellation = cancellation_token{};
+    auto deadline = request.cancellation.deadline();
+    if (deadline != cancellation_token::clock::time_point::max())
+    {
+        refresh.cancellation.set_deadline(
+                cancellation_token::to_clock(refresh.start) + (deadline - cancellation_token::to_clock(request.start)));
+    }
+
+    cache.revalidate(key, cache_lifetime_(*endpoint), shared,
+                     [endpoint, router_bulkhead, refresh, headers, mime_type]() mutable -> OPT_NS::optional<luna::response>
+                     {
+                         return respond_(*endpoint, router_bulkhead.get(), refresh, headers, mime_type);
+                     });
+}
+
+OPT_NS::optional<router::priority_level> router::router_impl::priority_for(request_method method,
+                                                                            const std::string &path)
+{
+    std::lock_guard<std::mutex> guard{lock_};
+
+    if (path.compare(0, route_base_.size(), route_base_) != 0)
+    {
+        return OPT_NS::nullopt;
+    }
+    auto endpoint_path = path.substr(route_base_.size());
+
+    for (const auto &handler : request_handlers_[method])
+    {
+        if (std::regex_match(endpoint_path, handler->route))
+        {
+            return handler->options.priority ? *handler->options.priority : priority_level::NORMAL;
+        }
+    }
+    return OPT_NS::nullopt;
+}
+
+// length-prefixed, so that no two different sets of values can run together into the same key
+static void append_key_part_(std::string &key, const std::string &part)
+{
+    key.append(std::to_string(part.size()));
+    key.push_back(':');
+    key.append(part);
+}
+
+template<typename M>
+static void append_key_value_(std::string &key, const M &values, const std::string &name)
+{
+    auto value = values.find(name);
+    if (value == values.end())
+    {
+        key.push_back('-'); // absent, which is different from present and empty
+        return;
+    }
+    append_key_part_(key, value->second);
+}
+
+OPT_NS::optional<std::string> router::router_impl::coalesce_key_for(const request &request)
+{
+    // nothing here coalesces, so there's no need to find the endpoint
+    if (!coalescing_ || request.method != request_method::GET)
+    {
+        return OPT_NS::nullopt;
+    }
+
+    std::unique_lock<std::mutex> ulock{lock_};
+
+    if (request.path.compare(0, route_base_.size(), route_base_) != 0)
+    {
+        return OPT_NS::nullopt;
+    }
+    auto endpoint_path = request.path.substr(route_base_.size());
+
+    for (const auto &handler : request_handlers_[request.method])
+    {
+        if (!std::regex_match(endpoint_path, handler->route))
+        {
+            continue;
+        }
+
+        if (!handler->options.coalesce)
+        {
+            return std::string{};
+        }
+        auto matched = handler;
+        auto authorizing = static_cast<bool>(authorization_);
+        ulock.unlock();
+
+        std::string key;
+        append_key_part_(key, request.path);
+        // requests that might fail validation differently can't share an answer
+        for (const auto &validator : matched->validators)
+        {
+            append_key_value_(key, request.params, validator.key);
+        }
+        for (const auto &param : matched->options.coalesce->params)
+        {
+            append_key_value_(key, request.params, param);
+        }
+        for (const auto &header : matched->options.coalesce->headers)
+        {
+            append_key_value_(key, request.headers, header);
+        }
+        // nor can requests with different credentials, or one without any could be let in on another's
+        if (authorizing)
+        {
+            append_key_value_(key, request.headers, "Authorization");
+        }
+        return key;
+    }
+    return OPT_NS::nullopt;
+}
+
+void router::router_impl::set_response_cache(std::shared_ptr<tiered_response_cache> cache)
+{
+    std::lock_guard<std::mutex> lock{lock_};
+    response_cache_ = std::move(cache);
+}
+
+void router::router_impl::set_renderer(std::shared_ptr<response_renderer> renderer)
+{
+    std::lock_guard<std::mutex> lock{lock_};
+    renderer_ = std::move(renderer);
+    for (const auto &index : file_indexes_)
+    {
+        if (renderer_ && *index)
+        {
+            renderer_->watch_files(index->root());
+        }
+    }
+}
+
+std::string router::router_impl::cache_key_(const request &request, bool authorizing)
+{
+    // a response for one set of credentials is no good for another, or for none
+    std::string credentials;
+    if (authorizing)
+    {
+        append_key_value_(credentials, request.headers, "Authorization");
+    }
+    return tiered_response_cache::key(request.path, request.params, credentials);
+}
+
 OPT_NS::optional<luna::response> router::router_impl::process_request(request &request)
 {
     // TODO this is here to prevent writing to the list of endpoints while we're using it. Not sure we actually need this,
@@ -192,69 +864,113 @@ OPT_NS::optional<luna::response> router::router_impl::process_request(request &r
 
     OPT_NS::optional<luna::response> response;
 
-    for (const auto &handler_tuple : request_handlers_[request.method])
+    for (const auto &handler : request_handlers_[request.method])
     {
         std::smatch pieces_match;
-        auto path_regex = std::get<std::regex>(handler_tuple);
 
-        if (std::regex_match(path, pieces_match, path_regex))
+        if (std::regex_match(path, pieces_match, handler->route))
         {
+            auto matched = handler; // hold on to the endpoint, we are about to let go of the lock
+            auto router_bulkhead = bulkhead_;
+            auto authorization = authorization_;
+            auto cache = (matched->options.cache_for && matched->options.cache_for->count() > 0 &&
+                          request.method == request_method::GET) ? response_cache_ : nullptr;
             ulock.unlock(); // found a match, can unlock as we won't continue down the list of endpoints.
 
             std::vector<std::string> matches;
-            error_log(luna::log_level::DEBUG, std::string{"    match: "} + path);
+            LUNA_LOG_DEBUG(std::string{"    match: "} + path);
             for (size_t i = 0; i < pieces_match.size(); ++i)
             {
-                std::ssub_match sub_match = pieces_match[i];
-                std::string piece = sub_match.str();
-                error_log(luna::log_level::DEBUG, std::string{"      submatch "} + std::to_string(i) + ": " + piece);
+                const std::ssub_match &sub_match = pieces_match[i];
+                LUNA_LOG_DEBUG(std::string{"      submatch "} + std::to_string(i) + ": " + sub_match.str());
                 matches.emplace_back(sub_match.str());
             }
 
-            request.matches = matches;
+            request.matches = std::move(matches);
+
+            if (matched->options.deadline)
+            {
+                auto deadline = *matched->options.deadline;
+                request.cancellation.set_deadline(
+                        deadline.count() > 0 ? cancellation_token::to_clock(request.start) + deadline
+                                             : cancellation_token::clock::time_point::max());
+            }
 
-            auto callback = std::get<endpoint_handler_cb>(handler_tuple);
             try
             {
                 // Validate the parameters passed in
-                // TODO this can probably be optimized
-                // TODO refactor this out!
-                bool valid_params{true};
-                auto validators = std::get<parameter::validators>(handler_tuple);
-                for (const auto &validator : validators)
+                std::string error;
+                if (authorization && !authorize_(*authorization, request))
+                {
+                    response = make_response_(unauthorized_response{authorization->realm, authorization->kind},
+                                              headers_);
+                }
+                else if (!validate_params_(*matched, request, error))
+                {
+                    error = "Request handler for \"" + path + "\" " + error;
+                    LUNA_LOG_ERROR(error);
+                    response = make_response_({400, "text/plain", error}, headers_);
+                }
+                else if (request.cancellation.is_cancelled())
                 {
-                    bool present = (request.params.count(validator.key) == 0) ? false : true;
-                    if (present)
+                    // nobody is waiting for the answer any more, so don't spend anything working it out
+                    LUNA_LOG_WARNING("Request for \"" + path + "\" was cancelled before its handler ran");
+                    response = make_response_({503, "text/plain", "Request deadline exceeded"}, headers_);
+                }
+                else
+                {
+                    std::string cache_key;
+                    OPT_NS::optional<tiered_response_cache::hit> cached;
+                    if (cache)
+                    {
+                        cache_key = cache_key_(request, static_cast<bool>(authorization));
+                        cached = cache->get(cache_key);
+                    }
+                    // keep responses to credentialed requests out of the store other servers share
+                    auto shared = !authorization;
+
+                    if (cached && cached->freshness != tiered_response_cache::freshness::IF_ERROR)
                     {
-                        //run the validator
-                        if (!validator.validation_func(request.params[validator.key]))
+                        if (cached->freshness == tiered_response_cache::freshness::REVALIDATE)
                         {
-                            std::string error{"Request handler for \"" + path + "\" is missing required parameter \"" + validator.key + "\""};
-                            error_log(luna::log_level::ERROR, error);
-                            response = make_response_({400, "text/plain", error}, headers_);
-                            valid_params = false;
-                            break; //stop examining params
+                            revalidate_(*cache, cache_key, matched, router_bulkhead, request, headers_, mime_type_, shared);
                         }
+                        response = std::move(cached->response);
                     }
-                    else if (validator.required) //not present, but required
+                    else
                     {
-                        std::string error{"Request handler for \"" + path + "\" is missing required parameter \"" + validator.key + "\""};
-                        error_log(luna::log_level::ERROR, error);
-                        response = make_response_({400, "text/plain", error}, headers_);
-                        valid_params = false;
-                        break; //stop examining params
-                    }
-                }
-
-                if (valid_params)
-                {
-                    //made it this far! try the callback
-                    response = make_response_(callback(request), headers_);
+                        //made it this far! try the callback
+                        try
+                        {
+                            response = respond_(*matched, router_bulkhead.get(), request, headers_, mime_type_);
+                        }
+                        catch (const std::exception &e)
+                        {
+                            if (!cached)
+                            {
+                                throw;
+                            }
+                            LUNA_LOG_ERROR(std::string{"Request handler for \"" + path + "\" threw an exception: "} + e.what());
+                        }
+                        catch (...)
+                        {
+                            if (!cached)
+                            {
+                                throw;
+                            }
+                            LUNA_LOG_ERROR("Unknown internal error");
+                        }
 
-                    // add mime type if needed. Don't add a mimetype for file responses
-                    if (response->file.empty() && response->content_type.empty()) //no content type assigned, use the default
-                    {
-                        response->content_type = mime_type_;
+                        if (cached && (!response || response->status_code >= 500))
+                        {
+                            // it failed, or missed its deadline, but there's something to fall back on
+                            LUNA_LOG_WARNING("Answering the request for \"" + path + "\" with a stale response");
+                            response = std::move(cached->response);
+                        }
+                        else if (cache && tiered_response_cache::cacheable(*response))
+                        {
+                            cache->put(cache_key, *response, cache_lifetime_(*matched), shared);
+                        }
                     }
                 }
             }
@@ -262,13 +978,13 @@ OPT_NS::optional<luna::response> router::router_impl::process_request(request &r
                 // TODO there is surely a more robust way to do this;
             catch (const std::exception &e)
             {
-                error_log(luna::log_level::ERROR, std::string{"Request handler for \"" + path + "\" threw an exception: "} + e.what());
+                LUNA_LOG_ERROR(std::string{"Request handler for \"" + path + "\" threw an exception: "} + e.what());
                 response = make_response_({500, "text/plain", "Internal error"}, headers_);
                 //TODO render the stack trace, etc.
             }
             catch (...)
             {
-                error_log(luna::log_level::ERROR, "Unknown internal error");
+                LUNA_LOG_ERROR("Unknown internal error");
                 //TODO use the same error message as above, and just log things differently and test for that.
                 response = make_response_({500, "text/plain", "Unknown internal error"}, headers_);
                 //TODO render the stack trace, etc.
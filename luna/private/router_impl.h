@@ -15,9 +15,16 @@
 #pragma once
 
 #include <luna/router.h>
+#include "luna/private/asset_fingerprints.h"
+#include "luna/private/bulkhead_gate.h"
+#include "luna/private/credential_cache.h"
+#include "luna/private/response_renderer.h"
+#include "luna/private/static_file_index.h"
+#include "luna/private/tiered_response_cache.h"
+#include <atomic>
 #include <map>
 #include <vector>
-#include <tuple>
+#include <memory>
 #include <mutex>
 
 namespace luna
@@ -37,27 +44,130 @@ public:
     void handle_request(request_method method,
                         std::regex route,
                         endpoint_handler_cb callback,
-                        parameter::validators validations = {});
+                        parameter::validators validations = {},
+                        endpoint_options options = {});
 
     void handle_request(request_method method,
                         std::string route,
                         endpoint_handler_cb callback,
                         parameter::validators validations = {});
 
-    void serve_files(std::string mount_point, std::string path_to_files);
+    void serve_files(std::string mount_point, std::string path_to_files, router::file_options options = {});
+
+    std::string asset_path(const std::string &path);
+
+    void serve_embedded(std::string mount_point, const embedded_assets &assets);
+
+    void serve_cache_admin(std::string mount_point);
 
     void add_header(std::string &&key, std::string &&value);
 
+    void set_bulkhead(bulkhead bulkhead);
+
+    void require_basic_authorization(std::string realm,
+                                     basic_authorization_cb verifier,
+                                     std::chrono::milliseconds cache_ttl,
+                                     size_t cache_size);
+
+    void require_bearer_authorization(std::string realm,
+                                      bearer_authorization_cb verifier,
+                                      std::chrono::milliseconds cache_ttl,
+                                      size_t cache_size);
+
     OPT_NS::optional<luna::response> process_request(request &request);
 
+    OPT_NS::optional<priority_level> priority_for(request_method method, const std::string &path);
+
+    OPT_NS::optional<std::string> coalesce_key_for(const request &request);
+
+    void set_response_cache(std::shared_ptr<tiered_response_cache> cache);
+
+    void set_renderer(std::shared_ptr<response_renderer> renderer);
+
 private:
 
+    // A 404, as the server's not found handler would have it
+    response not_found_(const request &req);
+
+    // A parameter validator, boiled down at handle_request time to exactly what needs to run for each request
+    struct compiled_validator
+    {
+        std::string key;
+        bool required;
+        parameter::validation_function validation_func;
+        parameter::typed_validation_function typed_validation_func; // takes precedence when set
+    };
+
+    struct endpoint
+    {
+        std::regex route;
+        endpoint_handler_cb callback;
+        std::vector<compiled_validator> validators;
+        endpoint_options options;
+        std::unique_ptr<bulkhead_gate> bulkhead; // from options.bulkhead
+    };
+
+    static std::vector<compiled_validator> compile_validators_(parameter::validators &&validations);
+
+    bool validate_params_(const endpoint &endpoint, request &request, std::string &error);
+
+    struct authorization
+    {
+        authorization_kind kind;
+        std::string realm;
+        basic_authorization_cb basic_verifier;
+        bearer_authorization_cb bearer_verifier;
+        std::unique_ptr<credential_cache> cache;
+    };
+
+    static bool authorize_(const authorization &authorization, const request &request);
+
+    // What identifies a response in the response cache: the path and every query parameter, and the credentials
+    static std::string cache_key_(const request &request, bool authorizing);
+
+    // Run the endpoint's handler, once the request is inside whichever bulkheads apply
+    static luna::response run_handler_(const endpoint &endpoint, bulkhead_gate *router_bulkhead, request &request);
+
+    // Run the handler, and finish its response off with the router's headers and default MIME type
+    static luna::response respond_(const endpoint &endpoint,
+                                   bulkhead_gate *router_bulkhead,
+                                   request &request,
+                                   luna::headers &headers,
+                                   const std::string &mime_type);
+
+    static tiered_response_cache::lifetime cache_lifetime_(const endpoint &endpoint);
+
+    // Have the response cache replace a stale response in the background, by running the handler again for a copy of
+    // this request
+    static void revalidate_(tiered_response_cache &cache,
+                            const std::string &key,
+                            std::shared_ptr<const endpoint> endpoint,
+                            std::shared_ptr<bulkhead_gate> router_bulkhead,
+                            const request &request,
+                            luna::headers headers,
+                            std::string mime_type,
+                            bool shared);
+
     std::string route_base_;
     std::mutex lock_;
-    using request_handlers = std::vector<std::tuple<std::regex, endpoint_handler_cb, parameter::validators>>;
+    // endpoints are shared so that a request can keep using its endpoint after the lock is released
+    using request_handlers = std::vector<std::shared_ptr<const endpoint>>;
     std::map<request_method, request_handlers> request_handlers_;
     luna::headers headers_;
     std::string mime_type_;
+    // shared for the same reason as the bulkhead below
+    std::shared_ptr<const authorization> authorization_;
+    // shared so that a request can keep using it after the lock is released, even if it's replaced
+    std::shared_ptr<bulkhead_gate> bulkhead_;
+    std::atomic<bool> coalescing_{false}; // whether any endpoint here coalesces requests
+    std::shared_ptr<tiered_response_cache> response_cache_; // from the server, if it has one
+    std::shared_ptr<response_renderer> renderer_; // the server's, for 404s and for telling it when files change
+
+    // serve_files mount points with fingerprinted files, for asset_path()
+    std::vector<std::pair<std::string, std::shared_ptr<asset_fingerprints>>> fingerprinted_mounts_;
+
+    // One for each serve_files, last so that they stop watching before anything they call back into is gone
+    std::vector<std::unique_ptr<static_file_index>> file_indexes_;
 };
 
 } //namespace luna
@@ -15,11 +15,11 @@
 #pragma once
 
 #include "luna/router.h"
-#include "luna/private/safer_times.h"
-#include "luna/private/response_renderer.h"
+#include "luna/private/dispatcher.h"
+#include "luna/private/loopback_engine.h"
+#include "luna/private/microhttpd_engine.h"
+#include "luna/private/native_engine.h"
 #include "luna/server.h"
-#include <microhttpd.h>
-#include <cstring>
 #include <chrono>
 #include <mutex>
 #include <thread>
@@ -51,6 +51,20 @@ public:
 
     explicit operator bool();
 
+    response inject(request request);
+
+    size_t purge_cached_tag(const std::string &tag);
+
+    size_t purge_cached_path(const std::string &path);
+
+    size_t purge_cached_request(const std::string &path, const query_params &params);
+
+    size_t purge_cached_prefix(const std::string &prefix);
+
+    tls_handshake_counts tls_handshakes();
+
+    bool reload_https_certificates(const https_certificates &certificates);
+
 protected:
     friend class server;
 
@@ -109,6 +123,10 @@ protected:
 
     void set_option_(const https_key_password &value);
 
+    void set_option_(const https_certificates &value);
+
+    void set_option_(const tls_session_resumption &value);
+
 //    void set_option_(notify_connection value); //TODO later
 
     void set_option_(const server_identifier &value);
@@ -121,107 +139,47 @@ protected:
 
     void set_option_(internal_file_cache_keep_alive value);
 
-    void set_option_(not_found_handler_cb value);
-
-private:
-
-    std::mutex lock_;
-
-    bool debug_output_;
-
-    bool ssl_mem_key_set_;
-    bool ssl_mem_cert_set_;
+    void set_option_(small_file_cache_size value);
 
-    bool use_thread_per_connection_;
+    void set_option_(small_file_max_size value);
 
-    bool use_epoll_if_available_;
+    void set_option_(const mime_types &value);
 
-    uint16_t port_;
-
-    // string copies of options
-    std::vector<std::string> https_mem_key_;
-    std::vector<std::string> https_mem_cert_;
-    std::vector<std::string> https_priorities_;
-    std::vector<std::string> https_mem_trust_;
-    std::vector<std::string> https_mem_dhparams_;
-    std::vector<std::string> https_key_password_;
-
-    //options
-    std::vector<MHD_OptionItem> options_;
-
-    struct MHD_Daemon *daemon_;
-
-    std::condition_variable running_cv_;
-
-    ///// internal use-only callbacks
-
-    int access_handler_callback_(struct MHD_Connection *connection,
-                                 const char *url,
-                                 const char *method,
-                                 const char *version,
-                                 const char *upload_data,
-                                 size_t *upload_data_size,
-                                 void **con_cls);
-
-
-    ////// external-use callbacks that can be set with options
-    accept_policy_cb accept_policy_callback_; //has a default value
+    void set_option_(not_found_handler_cb value);
 
-    unescaper_cb unescaper_callback_;
+    void set_option_(transport value);
 
-    ///// callback shims
+    void set_option_(handler_pool_size value);
 
-    static int access_policy_callback_shim_(void *cls,
-                                            const struct sockaddr *addr,
-                                            socklen_t addrlen);
+    void set_option_(max_request_body_size value);
 
-    static int access_handler_callback_shim_(void *cls,
-                                             struct MHD_Connection *connection,
-                                             const char *url,
-                                             const char *method,
-                                             const char *version,
-                                             const char *upload_data,
-                                             size_t *upload_data_size,
-                                             void **con_cls);
+    void set_option_(request_deadline value);
 
-    static void request_completed_callback_shim_(void *cls,
-                                                 struct MHD_Connection *connection,
-                                                 void **con_cls,
-                                                 enum MHD_RequestTerminationCode toe);
+    void set_option_(const request_deadline_header &value);
 
-    static void *uri_logger_callback_shim_(void *cls, const char *uri, struct MHD_Connection *con);
+    void set_option_(const adaptive_concurrency_limit &value);
 
-    static void logger_callback_shim_(void *cls, const char *fm, va_list ap);
+    void set_option_(const response_cache &value);
 
-    static size_t unescaper_callback_shim_(void *cls, struct MHD_Connection *c, char *s);
+private:
+    transport_engine &engine_();
 
-    static int iterate_postdata_shim_(void *cls,
-                                      enum MHD_ValueKind kind,
-                                      const char *key,
-                                      const char *filename,
-                                      const char *content_type,
-                                      const char *transfer_encoding,
-                                      const char *data,
-                                      uint64_t off,
-                                      size_t size);
+    std::mutex lock_;
 
-    //TODO MHD_OPTION_HTTPS_CERT_CALLBACK callback_shim_
+    uint16_t port_;
 
-    //TODO I don't know what to do with this one yet.
-//    static void notify_connection_callback_shim_(void *cls,
-//                                                 struct MHD_Connection *connection,
-//                                                 void **socket_context,
-//                                                 enum MHD_ConnectionNotificationCode toe);
+    // request handling and response generation, shared by every transport
+    dispatcher dispatcher_;
 
+    transport_kind transport_kind_;
+    microhttpd_engine microhttpd_engine_;
+    native_engine native_engine_;
+    loopback_engine loopback_engine_;
 
-    // request handling and response generation
-    std::vector<std::shared_ptr<router>> routers_;
-    response_renderer response_renderer_;
+    bool running_;
+    std::condition_variable running_cv_;
 
     std::string server_name_;
-
-    // custom 404 renderer
-    not_found_handler_cb not_found_handler_;
 };
 
 } //namespace luna
@@ -0,0 +1,535 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/shared_memory_store.h"
+#include "luna/private/credential_cache.h"
+#include "luna/config.h"
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace luna
+{
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "atomics in shared memory must be lock-free to work across processes");
+
+static const uint64_t magic_{0x314d4853414e554cULL}; // "LUNASHM1"
+static const uint32_t version_{1};
+
+static const size_t chunk_sizes_[] = {512, 2 * 1024, 8 * 1024, 32 * 1024, 128 * 1024, 512 * 1024};
+
+// how far along the table a key may be from where it hashes to
+static const unsigned int max_probe_{16};
+
+// how long to keep trying for a slot that's being written, before deciding its writer has died
+static const unsigned int max_attempts_{1000};
+
+static const size_t alignment_{64};
+
+static size_t align_(size_t offset)
+{
+    return (offset + alignment_ - 1) & ~(alignment_ - 1);
+}
+
+enum slot_state : uint32_t
+{
+    EMPTY = 0, // never used, which ends a search
+    FULL,
+    DELETED, // used once, which doesn't
+};
+
+struct shared_memory_store::header
+{
+    std::atomic<uint64_t> magic; // set last, by whichever process creates the file
+    uint64_t size;
+    uint32_t version;
+    std::atomic<uint32_t> hand; // where the next eviction starts looking
+    // the free chunks in each size class, as lock-free stacks: chunk + 1 (0 when empty) in the low half, and a count
+    // of changes in the high half so that a stale compare-and-swap can't succeed
+    std::atomic<uint64_t> free[slab_classes];
+    std::atomic<uint32_t> carved[slab_classes]; // chunks handed out at least once; the rest have never been touched
+};
+
+struct shared_memory_store::slot
+{
+    std::atomic<uint32_t> sequence; // odd while a writer holds the slot
+    std::atomic<uint32_t> state;
+    std::atomic<uint64_t> hash;
+    std::atomic<uint32_t> slab;
+    std::atomic<uint32_t> chunk;
+    std::atomic<uint32_t> key_length;
+    std::atomic<uint32_t> value_length;
+};
+
+shared_memory_store::layout shared_memory_store::layout_for_(size_t size)
+{
+    layout layout{};
+    layout.slots_offset = align_(sizeof(header));
+
+    // size the slabs as if there were no table, then size the table for twice as many entries as there are chunks, and
+    // the slabs again for what's left
+    auto slab_space = [&layout, size](size_t table_size) -> size_t
+    {
+        auto used = layout.slots_offset + table_size + alignment_ * slab_classes;
+        return size > used ? (size - used) / slab_classes : 0;
+    };
+
+    size_t chunks{0};
+    for (auto chunk_size : chunk_sizes_)
+    {
+        chunks += slab_space(0) / chunk_size;
+    }
+    layout.slot_count = 64;
+    while (layout.slot_count < chunks * 2 && layout.slot_count < (1U << 30))
+    {
+        layout.slot_count <<= 1;
+    }
+
+    auto offset = layout.slots_offset + layout.slot_count * sizeof(slot);
+    auto space = slab_space(layout.slot_count * sizeof(slot));
+    for (unsigned int i = 0; i < slab_classes; ++i)
+    {
+        offset = align_(offset);
+        layout.slab_offsets[i] = offset;
+        layout.chunk_counts[i] = static_cast<uint32_t>(space / chunk_sizes_[i]);
+        offset += layout.chunk_counts[i] * chunk_sizes_[i];
+    }
+    return layout;
+}
+
+shared_memory_store::shared_memory_store(const std::string &path, size_t size) :
+        fd_{-1},
+        map_{MAP_FAILED},
+        size_{size},
+        header_{nullptr},
+        layout_(layout_for_(size))
+{
+    if (layout_.slab_offsets[slab_classes - 1] + layout_.chunk_counts[slab_classes - 1] * chunk_sizes_[slab_classes - 1] >
+        size || layout_.chunk_counts[0] == 0)
+    {
+        LUNA_LOG_ERROR("Shared memory cache " + path + " is too small to be useful");
+        return;
+    }
+
+    bool creating{true};
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd_ < 0 && errno == EEXIST)
+    {
+        creating = false;
+        fd_ = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    }
+    if (fd_ < 0)
+    {
+        LUNA_LOG_ERROR("Couldn't open shared memory cache " + path + ": " + std::strerror(errno));
+        return;
+    }
+
+    if (creating)
+    {
+#if defined(__linux__)
+        // claim the memory now, rather than finding out there isn't any when a page is first touched
+        if (posix_fallocate(fd_, 0, static_cast<off_t>(size)) != 0)
+#else
+        if (ftruncate(fd_, static_cast<off_t>(size)) != 0)
+#endif
+        {
+            LUNA_LOG_ERROR("Couldn't size shared memory cache " + path);
+            unlink(path.c_str());
+            return;
+        }
+    }
+    else
+    {
+        // another process is creating it; give it a moment to get the size right
+        struct stat st;
+        for (unsigned int i = 0; fstat(fd_, &st) == 0 && static_cast<size_t>(st.st_size) < size && i < 100; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+        if (fstat(fd_, &st) != 0 || static_cast<size_t>(st.st_size) != size)
+        {
+            LUNA_LOG_ERROR("Shared memory cache " + path + " is a different size; remove it, or use another path");
+            return;
+        }
+    }
+
+    map_ = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (map_ == MAP_FAILED)
+    {
+        LUNA_LOG_ERROR("Couldn't map shared memory cache " + path + ": " + std::strerror(errno));
+        return;
+    }
+    auto header = static_cast<shared_memory_store::header *>(map_);
+
+    if (creating)
+    {
+        // everything else starts out zero, which is empty
+        header->size = size;
+        header->version = version_;
+        header->magic.store(magic_, std::memory_order_release);
+    }
+    else
+    {
+        for (unsigned int i = 0; header->magic.load(std::memory_order_acquire) != magic_ && i < 100; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+        if (header->magic.load(std::memory_order_acquire) != magic_ || header->size != size ||
+            header->version != version_)
+        {
+            LUNA_LOG_ERROR("Shared memory cache " + path + " wasn't made by this version of " + LUNA_NAME +
+                           "; remove it, or use another path");
+            return;
+        }
+    }
+
+    header_ = header;
+}
+
+shared_memory_store::~shared_memory_store()
+{
+    if (map_ != MAP_FAILED)
+    {
+        munmap(map_, size_);
+    }
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+}
+
+size_t shared_memory_store::max_entry_size() const
+{
+    return chunk_sizes_[slab_classes - 1];
+}
+
+std::shared_ptr<std::string> shared_memory_store::read(const std::string &key) const
+{
+    if (!header_)
+    {
+        return nullptr;
+    }
+
+    auto hash = hash_(key);
+    for (unsigned int probe = 0; probe < max_probe_; ++probe)
+    {
+        auto &slot = slot_at_(hash, probe);
+        for (unsigned int attempt = 0;; ++attempt)
+        {
+            if (attempt == max_attempts_)
+            {
+                return nullptr; // it's taking too long to get a consistent look at it
+            }
+
+            auto before = slot.sequence.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            auto state = slot.state.load(std::memory_order_relaxed);
+            std::shared_ptr<std::string> value;
+            const char *data;
+            uint32_t length;
+            if (state == FULL && locate_(slot, hash, key, data, length))
+            {
+                value = std::make_shared<std::string>(data, length);
+            }
+
+            // if it changed while we were looking, none of that counts
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != before)
+            {
+                continue;
+            }
+
+            if (state == EMPTY)
+            {
+                return nullptr;
+            }
+            if (value)
+            {
+                return value;
+            }
+            break; // on to the next slot
+        }
+    }
+    return nullptr;
+}
+
+void shared_memory_store::write(const std::string &key, const std::string &value)
+{
+    if (!header_)
+    {
+        return;
+    }
+
+    auto hash = hash_(key);
+    auto size = key.size() + value.size();
+
+    // find a chunk, and fill it in, before touching the table
+    uint32_t slab{slab_classes}, chunk{0};
+    if (!value.empty())
+    {
+        for (uint32_t i = 0; i < slab_classes; ++i)
+        {
+            if (size <= chunk_sizes_[i] && layout_.chunk_counts[i] > 0)
+            {
+                slab = i;
+                break;
+            }
+        }
+        if (slab < slab_classes && !allocate_(slab, chunk) && !(evict_(slab) && allocate_(slab, chunk)))
+        {
+            slab = slab_classes;
+        }
+        if (slab < slab_classes)
+        {
+            auto data = chunk_(slab, chunk);
+            std::memcpy(data, key.data(), key.size());
+            std::memcpy(data + key.size(), value.data(), value.size());
+        }
+    }
+    // otherwise this only removes the key
+
+    auto fill = [&](shared_memory_store::slot &slot)
+    {
+        if (slab < slab_classes)
+        {
+            slot.hash.store(hash, std::memory_order_relaxed);
+            slot.slab.store(slab, std::memory_order_relaxed);
+            slot.chunk.store(chunk, std::memory_order_relaxed);
+            slot.key_length.store(static_cast<uint32_t>(key.size()), std::memory_order_relaxed);
+            slot.value_length.store(static_cast<uint32_t>(value.size()), std::memory_order_relaxed);
+            slot.state.store(FULL, std::memory_order_relaxed);
+        }
+        else
+        {
+            slot.state.store(DELETED, std::memory_order_relaxed);
+        }
+    };
+
+    // replace the key where it is, if it's here
+    int candidate{-1};
+    for (unsigned int probe = 0; probe < max_probe_; ++probe)
+    {
+        auto &slot = slot_at_(hash, probe);
+        uint32_t sequence;
+        if (!lock_(slot, sequence))
+        {
+            continue;
+        }
+
+        auto state = slot.state.load(std::memory_order_relaxed);
+        const char *data;
+        uint32_t length;
+        if (state == FULL && locate_(slot, hash, key, data, length))
+        {
+            auto old_slab = slot.slab.load(std::memory_order_relaxed);
+            auto old_chunk = slot.chunk.load(std::memory_order_relaxed);
+            fill(slot);
+            unlock_(slot, sequence);
+            free_(old_slab, old_chunk);
+            return;
+        }
+        unlock_(slot, sequence);
+
+        if (state != FULL && candidate < 0)
+        {
+            candidate = probe;
+        }
+        if (state == EMPTY)
+        {
+            break; // it can't be any further along
+        }
+    }
+
+    if (slab == slab_classes)
+    {
+        return; // nothing to add
+    }
+
+    // or put it in the first free slot, or failing that, in place of a neighbour
+    if (candidate < 0)
+    {
+        candidate = header_->hand.fetch_add(1, std::memory_order_relaxed) % max_probe_;
+    }
+    auto &slot = slot_at_(hash, static_cast<unsigned int>(candidate));
+    uint32_t sequence;
+    if (!lock_(slot, sequence))
+    {
+        free_(slab, chunk);
+        return;
+    }
+    auto evicted = slot.state.load(std::memory_order_relaxed) == FULL;
+    auto old_slab = slot.slab.load(std::memory_order_relaxed);
+    auto old_chunk = slot.chunk.load(std::memory_order_relaxed);
+    fill(slot);
+    unlock_(slot, sequence);
+    if (evicted)
+    {
+        free_(old_slab, old_chunk);
+    }
+}
+
+uint64_t shared_memory_store::hash_(const std::string &key)
+{
+    // fixed keys, so that every process agrees
+    return siphash_2_4(0x6c756e612d73686dULL, 0x2d73746f72652d31ULL, key.data(), key.size());
+}
+
+shared_memory_store::slot &shared_memory_store::slot_at_(uint64_t hash, unsigned int probe) const
+{
+    auto slots = reinterpret_cast<slot *>(static_cast<char *>(map_) + layout_.slots_offset);
+    return slots[(hash + probe) & (layout_.slot_count - 1)];
+}
+
+char *shared_memory_store::chunk_(uint32_t slab, uint32_t chunk) const
+{
+    return static_cast<char *>(map_) + layout_.slab_offsets[slab] + chunk * chunk_sizes_[slab];
+}
+
+bool shared_memory_store::lock_(slot &slot, uint32_t &sequence)
+{
+    for (unsigned int attempt = 0; attempt < max_attempts_; ++attempt)
+    {
+        sequence = slot.sequence.load(std::memory_order_relaxed);
+        if (!(sequence & 1) &&
+            slot.sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire,
+                                                std::memory_order_relaxed))
+        {
+            // readers that see anything written from here on will also see the odd sequence number
+            std::atomic_thread_fence(std::memory_order_release);
+            return true;
+        }
+        std::this_thread::yield();
+    }
+    return false;
+}
+
+void shared_memory_store::unlock_(slot &slot, uint32_t sequence)
+{
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool shared_memory_store::locate_(const slot &slot,
+                                  uint64_t hash,
+                                  const std::string &key,
+                                  const char *&value,
+                                  uint32_t &value_length) const
+{
+    if (slot.hash.load(std::memory_order_relaxed) != hash ||
+        slot.key_length.load(std::memory_order_relaxed) != key.size())
+    {
+        return false;
+    }
+
+    // Readers may be looking at a slot that's halfway through changing, so each field is read once, and checked to be
+    // in bounds before it's followed. If it was changing, the sequence number will say so afterwards.
+    auto slab = slot.slab.load(std::memory_order_relaxed);
+    auto chunk = slot.chunk.load(std::memory_order_relaxed);
+    value_length = slot.value_length.load(std::memory_order_relaxed);
+    if (slab >= slab_classes || chunk >= layout_.chunk_counts[slab] ||
+        key.size() + value_length > chunk_sizes_[slab])
+    {
+        return false;
+    }
+
+    auto data = chunk_(slab, chunk);
+    value = data + key.size();
+    return std::memcmp(data, key.data(), key.size()) == 0;
+}
+
+bool shared_memory_store::allocate_(uint32_t slab, uint32_t &chunk)
+{
+    auto &top = header_->free[slab];
+    auto head = top.load(std::memory_order_acquire);
+    while (head & 0xffffffff)
+    {
+        auto index = static_cast<uint32_t>(head & 0xffffffff) - 1;
+        // if someone else takes this chunk first, this may read garbage, but the compare-and-swap will then fail
+        auto next = reinterpret_cast<std::atomic<uint32_t> *>(chunk_(slab, index))->load(std::memory_order_relaxed);
+        auto replacement = (((head >> 32) + 1) << 32) | next;
+        if (top.compare_exchange_weak(head, replacement, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            chunk = index;
+            return true;
+        }
+    }
+
+    // nothing has been freed, so use one that never has been used
+    auto &carved = header_->carved[slab];
+    auto count = carved.load(std::memory_order_relaxed);
+    while (count < layout_.chunk_counts[slab])
+    {
+        if (carved.compare_exchange_weak(count, count + 1, std::memory_order_relaxed))
+        {
+            chunk = count;
+            return true;
+        }
+    }
+    return false;
+}
+
+void shared_memory_store::free_(uint32_t slab, uint32_t chunk)
+{
+    auto &top = header_->free[slab];
+    auto next = reinterpret_cast<std::atomic<uint32_t> *>(chunk_(slab, chunk));
+    auto head = top.load(std::memory_order_relaxed);
+    uint64_t replacement;
+    do
+    {
+        next->store(static_cast<uint32_t>(head & 0xffffffff), std::memory_order_relaxed);
+        replacement = (((head >> 32) + 1) << 32) | (chunk + 1);
+    }
+    while (!top.compare_exchange_weak(head, replacement, std::memory_order_release, std::memory_order_relaxed));
+}
+
+bool shared_memory_store::evict_(uint32_t slab)
+{
+    auto slots = reinterpret_cast<slot *>(static_cast<char *>(map_) + layout_.slots_offset);
+    for (uint32_t looked = 0; looked < layout_.slot_count; ++looked)
+    {
+        auto &slot = slots[header_->hand.fetch_add(1, std::memory_order_relaxed) & (layout_.slot_count - 1)];
+        if (slot.state.load(std::memory_order_relaxed) != FULL || slot.slab.load(std::memory_order_relaxed) != slab)
+        {
+            continue;
+        }
+
+        uint32_t sequence;
+        if (!lock_(slot, sequence))
+        {
+            continue;
+        }
+        if (slot.state.load(std::memory_order_relaxed) != FULL || slot.slab.load(std::memory_order_relaxed) != slab)
+        {
+            unlock_(slot, sequence);
+            continue;
+        }
+        auto chunk = slot.chunk.load(std::memory_order_relaxed);
+        slot.state.store(DELETED, std::memory_order_relaxed);
+        unlock_(slot, sequence);
+        free_(slab, chunk);
+        return true;
+    }
+    return false;
+}
+
+} //namespace luna
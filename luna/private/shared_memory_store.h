@@ -0,0 +1,108 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace luna
+{
+
+// A key-value store in a memory-mapped file, shared by every process on the host that maps the same file (put it on a
+// tmpfs such as /dev/shm to keep it off the disk). Used as the shared store behind the response cache, so that
+// processes serving the same routes get each other's hits.
+//
+// The file holds a fixed-size open-addressing hash table, and slabs of fixed-size chunks in a handful of size classes
+// for the keys and values. Each slot in the table is guarded by a sequence lock: writers take it by making its sequence
+// number odd, and readers never wait or write, they just copy the value out and try again if the sequence number moved
+// underneath them. Free chunks are kept on lock-free stacks. A process that dies mid-write leaves one slot unusable,
+// rather than the whole table locked.
+//
+// When a size class runs out of chunks, or a key's neighbourhood in the table is full, something is evicted to make
+// room: it's a cache, so anything can go.
+class shared_memory_store
+{
+public:
+    shared_memory_store(const std::string &path, size_t size);
+
+    ~shared_memory_store();
+
+    shared_memory_store(const shared_memory_store &) = delete;
+    shared_memory_store &operator=(const shared_memory_store &) = delete;
+
+    // false if the file couldn't be created or mapped, or was made by something else
+    explicit operator bool() const
+    { return header_ != nullptr; }
+
+    // null if key isn't there
+    std::shared_ptr<std::string> read(const std::string &key) const;
+
+    // An empty value removes the key. Values too large for the largest chunk aren't stored (and remove the key, so that
+    // an older value isn't left behind).
+    void write(const std::string &key, const std::string &value);
+
+    // the largest key and value, together, that can be stored
+    size_t max_entry_size() const;
+
+private:
+    struct header;
+    struct slot;
+
+    static const unsigned int slab_classes = 6;
+
+    // the geometry of a file of a given size, the same in every process
+    struct layout
+    {
+        uint32_t slot_count; // a power of two
+        uint32_t chunk_counts[slab_classes];
+        size_t slots_offset;
+        size_t slab_offsets[slab_classes];
+    };
+
+    static layout layout_for_(size_t size);
+
+    static uint64_t hash_(const std::string &key);
+
+    slot &slot_at_(uint64_t hash, unsigned int probe) const;
+
+    char *chunk_(uint32_t slab, uint32_t chunk) const;
+
+    // take the slot's lock, or give up after a while (its holder might have died)
+    static bool lock_(slot &slot, uint32_t &sequence);
+
+    static void unlock_(slot &slot, uint32_t sequence);
+
+    // whether the slot holds key, and if so, where its value is
+    bool locate_(const slot &slot, uint64_t hash, const std::string &key, const char *&value,
+                 uint32_t &value_length) const;
+
+    bool allocate_(uint32_t slab, uint32_t &chunk);
+
+    void free_(uint32_t slab, uint32_t chunk);
+
+    // free a chunk of this size class by evicting whatever is using one
+    bool evict_(uint32_t slab);
+
+    int fd_;
+    void *map_;
+    size_t size_;
+    header *header_;
+    layout layout_;
+};
+
+} //namespace luna
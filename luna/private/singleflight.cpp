@@ -0,0 +1,161 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/singleflight.h"
+#include <algorithm>
+
+namespace luna
+{
+
+singleflight::singleflight() : closed_{false}, next_deadline_{clock::time_point::max()}, stopping_{false}
+{}
+
+singleflight::~singleflight()
+{
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        stopping_ = true;
+    }
+    deadlines_changed_.notify_one();
+    if (watchdog_.joinable())
+    {
+        watchdog_.join();
+    }
+}
+
+bool singleflight::join(const std::string &key, clock::time_point deadline, ready_cb on_ready)
+{
+    std::lock_guard<std::mutex> guard{lock_};
+    if (closed_)
+    {
+        return true;
+    }
+
+    auto flight = flights_.find(key);
+    if (flight == flights_.end())
+    {
+        flights_.emplace(key, std::vector<follower>{});
+        return true;
+    }
+
+    flight->second.push_back({std::move(on_ready), deadline});
+    if (deadline < next_deadline_)
+    {
+        next_deadline_ = deadline;
+        if (!watchdog_.joinable())
+        {
+            watchdog_ = std::thread{&singleflight::expire_, this};
+        }
+        deadlines_changed_.notify_one();
+    }
+    return false;
+}
+
+void singleflight::land(const std::string &key, const response &response)
+{
+    std::vector<follower> followers;
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        auto flight = flights_.find(key);
+        if (flight == flights_.end())
+        {
+            return;
+        }
+        followers = std::move(flight->second);
+        flights_.erase(flight);
+    }
+
+    // anyone arriving from here on leads a flight of their own, and sees whatever has changed since
+    for (auto &follower : followers)
+    {
+        follower.on_ready(response);
+    }
+}
+
+void singleflight::close(const response &response)
+{
+    decltype(flights_) flights;
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        closed_ = true;
+        flights.swap(flights_);
+    }
+
+    // the leaders will find nothing to land
+    for (auto &flight : flights)
+    {
+        for (auto &follower : flight.second)
+        {
+            follower.on_ready(response);
+        }
+    }
+}
+
+void singleflight::open()
+{
+    std::lock_guard<std::mutex> guard{lock_};
+    closed_ = false;
+}
+
+void singleflight::expire_()
+{
+    static const response expired{503, "text/plain", "Request deadline exceeded"};
+
+    std::unique_lock<std::mutex> lock{lock_};
+    while (!stopping_)
+    {
+        auto now = clock::now();
+        std::vector<ready_cb> due;
+        next_deadline_ = clock::time_point::max();
+        for (auto &flight : flights_)
+        {
+            auto &followers = flight.second;
+            for (auto follower = followers.begin(); follower != followers.end();)
+            {
+                if (follower->deadline <= now)
+                {
+                    due.emplace_back(std::move(follower->on_ready));
+                    follower = followers.erase(follower);
+                }
+                else
+                {
+                    next_deadline_ = std::min(next_deadline_, follower->deadline);
+                    ++follower;
+                }
+            }
+        }
+
+        if (!due.empty())
+        {
+            lock.unlock();
+            for (auto &on_ready : due)
+            {
+                on_ready(expired);
+            }
+            lock.lock();
+            continue;
+        }
+
+        if (next_deadline_ == clock::time_point::max())
+        {
+            deadlines_changed_.wait(lock);
+        }
+        else
+        {
+            deadlines_changed_.wait_until(lock, next_deadline_);
+        }
+    }
+}
+
+} //namespace luna
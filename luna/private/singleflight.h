@@ -0,0 +1,73 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include <luna/types.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace luna
+{
+
+// Lets concurrent identical requests share one run of their handler. The first request with a given key is the
+// leader: it runs, and hands its response to every request that joined while it was running.
+class singleflight
+{
+public:
+    using ready_cb = std::function<void(const response &response)>;
+    using clock = cancellation_token::clock;
+
+    singleflight();
+
+    ~singleflight();
+
+    // true means there was nobody to wait for: the caller leads, and must land() when it has its response. Otherwise
+    // on_ready will be called once: with the leader's response, on the leader's thread, or if deadline passes first,
+    // with a 503, on a thread of our own.
+    bool join(const std::string &key, clock::time_point deadline, ready_cb on_ready);
+
+    void land(const std::string &key, const response &response);
+
+    // Answer everyone waiting with response instead of their leader's, and until open(), let every request lead
+    void close(const response &response);
+
+    void open();
+
+private:
+    struct follower
+    {
+        ready_cb on_ready;
+        clock::time_point deadline;
+    };
+
+    void expire_();
+
+    std::mutex lock_;
+    std::unordered_map<std::string, std::vector<follower>> flights_; // the followers waiting on each leader
+    bool closed_;
+
+    // answers followers whose deadlines pass, from the first time one joins with a deadline
+    std::thread watchdog_;
+    std::condition_variable deadlines_changed_;
+    clock::time_point next_deadline_;
+    bool stopping_;
+};
+
+} //namespace luna
@@ -0,0 +1,342 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/static_file_index.h"
+#include "luna/private/file_helpers.h"
+#include "luna/private/path_normalizer.h"
+#include "luna/config.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <unordered_set>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#endif
+
+namespace luna
+{
+
+// once a change is seen, wait until there's been none for this long before reading the tree again
+static const int settle_ms_{50};
+
+// but no longer than this in all, in case the changes never stop
+static const std::chrono::milliseconds max_settle_{1000};
+
+// symbolic links can make a tree as deep as you like
+static const unsigned int max_depth_{32};
+
+static_file_index::static_file_index(std::string root,
+                                     change_cb on_change,
+                                     std::shared_ptr<const mime_registry> mime_types) :
+        root_{std::move(root)},
+        on_change_{std::move(on_change)},
+        mime_types_{std::move(mime_types)},
+        watching_{false},
+        inotify_{-1},
+        stop_{-1, -1}
+{
+#if defined(__linux__)
+    inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_ < 0 || pipe2(stop_, O_CLOEXEC) != 0)
+    {
+        LUNA_LOG_WARNING("Can't watch " + root_ + " for changes (" + std::strerror(errno) +
+                         "); looking on disk for every file instead");
+        return;
+    }
+
+    auto files = std::make_shared<tree>();
+    if (!read_tree_(*files))
+    {
+        LUNA_LOG_WARNING("Looking on disk for every file under " + root_ + " instead");
+        return;
+    }
+    LUNA_LOG_DEBUG("Indexed " + std::to_string(files->size()) + " paths under " + root_);
+    files_ = std::move(files);
+    watching_ = true;
+    watcher_ = std::thread{&static_file_index::watch_, this};
+#else
+    LUNA_LOG_DEBUG("Not indexing " + root_ + "; keeping an index current needs inotify");
+#endif
+}
+
+static_file_index::~static_file_index()
+{
+    if (stop_[1] >= 0)
+    {
+        close(stop_[1]);
+    }
+    if (watcher_.joinable())
+    {
+        watcher_.join();
+    }
+    if (stop_[0] >= 0)
+    {
+        close(stop_[0]);
+    }
+    if (inotify_ >= 0)
+    {
+        close(inotify_);
+    }
+}
+
+std::shared_ptr<const static_file_index::file> static_file_index::find(const std::string &path) const
+{
+    // the same key as the tree was read into: no empty or "." segments, and ".." taken off what came before it
+    auto key = path;
+    if (!normalize_path(key))
+    {
+        return nullptr;
+    }
+    return find_normalized(key);
+}
+
+std::shared_ptr<const static_file_index::file> static_file_index::find_normalized(const std::string &key) const
+{
+    std::shared_ptr<const tree> files;
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        files = files_;
+    }
+    if (!files)
+    {
+        return nullptr;
+    }
+    auto found = files->find(key);
+    return found == files->end() ? nullptr : found->second;
+}
+
+#if defined(__linux__)
+
+static const uint32_t watch_mask_{IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM |
+                                  IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF};
+
+bool static_file_index::read_tree_(tree &files)
+{
+    struct stat st;
+    if (stat(root_.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        LUNA_LOG_WARNING("Can't index " + root_ + ", which isn't a directory");
+        return false;
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> visited{{st.st_dev, st.st_ino}};
+    return read_directory_(root_, "", files, visited, 0);
+}
+
+bool static_file_index::read_directory_(const std::string &directory,
+                                        const std::string &relative,
+                                        tree &files,
+                                        std::vector<std::pair<uint64_t, uint64_t>> &visited,
+                                        unsigned int depth)
+{
+    // watch first, so that nothing that changes while the directory's being read goes unnoticed
+    if (inotify_add_watch(inotify_, directory.c_str(), watch_mask_) < 0)
+    {
+        LUNA_LOG_WARNING("Can't watch " + directory + " for changes: " + std::strerror(errno));
+        return false;
+    }
+
+    auto dir = opendir(directory.c_str());
+    if (dir == nullptr)
+    {
+        LUNA_LOG_WARNING("Can't read " + directory + ": " + std::strerror(errno));
+        return false;
+    }
+    std::vector<std::string> names;
+    while (auto entry = readdir(dir))
+    {
+        std::string name{entry->d_name};
+        if (name != "." && name != "..")
+        {
+            names.emplace_back(std::move(name));
+        }
+    }
+    closedir(dir);
+
+    for (const auto &name : names)
+    {
+        auto path = directory + "/" + name;
+        auto key = relative.empty() ? name : relative + "/" + name;
+
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+        {
+            continue; // a dangling link, or gone already
+        }
+
+        if (S_ISDIR(st.st_mode))
+        {
+            std::pair<uint64_t, uint64_t> id{st.st_dev, st.st_ino};
+            if (depth + 1 >= max_depth_ || std::find(visited.begin(), visited.end(), id) != visited.end())
+            {
+                continue; // a link back up the tree
+            }
+            visited.emplace_back(id);
+            auto read = read_directory_(path, key, files, visited, depth + 1);
+            visited.pop_back();
+            if (!read)
+            {
+                return false;
+            }
+        }
+        else if (S_ISREG(st.st_mode))
+        {
+            auto modified = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+            files[key] = std::make_shared<const file>(file{path,
+                                                           static_cast<uint64_t>(st.st_size),
+                                                           modified,
+                                                           static_cast<uint64_t>(st.st_ino),
+                                                           mime_types_->type_for(path)});
+        }
+    }
+
+    // a directory is served as its index file, if it has one
+    for (const auto &name : index_filenames)
+    {
+        auto index = files.find(relative.empty() ? name : relative + "/" + name);
+        if (index != files.end())
+        {
+            files[relative] = index->second;
+            break;
+        }
+    }
+
+    return true;
+}
+
+void static_file_index::watch_()
+{
+    // the events themselves don't matter, as the whole tree is read again; just that there were some
+    auto drain = [this]
+    {
+        alignas(struct inotify_event) char events[4096];
+        while (read(inotify_, events, sizeof(events)) > 0)
+        {}
+    };
+
+    pollfd fds[2]{{inotify_, POLLIN, 0},
+                  {stop_[0], POLLIN, 0}};
+    for (;;)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            LUNA_LOG_ERROR("Watching " + root_ + " failed: " + std::strerror(errno));
+            stop_watching_();
+            return;
+        }
+        if (fds[1].revents)
+        {
+            return;
+        }
+        drain();
+
+        // let a burst of changes (a deploy, say) finish first
+        auto deadline = std::chrono::steady_clock::now() + max_settle_;
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            auto ready = poll(fds, 2, settle_ms_);
+            if (ready == 0 || (ready < 0 && errno != EINTR))
+            {
+                break;
+            }
+            if (fds[1].revents)
+            {
+                return;
+            }
+            drain();
+        }
+
+        reread_();
+        if (!watching_)
+        {
+            return;
+        }
+    }
+}
+
+#else
+
+bool static_file_index::read_tree_(tree &files)
+{
+    return false;
+}
+
+bool static_file_index::read_directory_(const std::string &directory,
+                                        const std::string &relative,
+                                        tree &files,
+                                        std::vector<std::pair<uint64_t, uint64_t>> &visited,
+                                        unsigned int depth)
+{
+    return false;
+}
+
+void static_file_index::watch_()
+{}
+
+#endif // __linux__
+
+void static_file_index::reread_()
+{
+    auto files = std::make_shared<tree>();
+    if (!read_tree_(*files))
+    {
+        stop_watching_();
+        return;
+    }
+
+    std::shared_ptr<const tree> old;
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        old = std::move(files_);
+        files_ = files;
+    }
+    LUNA_LOG_DEBUG("Indexed " + std::to_string(files->size()) + " paths under " + root_ + " again, after a change");
+
+    // tell whoever is keeping files open which of them aren't what they were
+    std::unordered_set<std::string> changed;
+    for (const auto &entry : *old)
+    {
+        const auto &was = *entry.second;
+        auto now = files->find(entry.first);
+        if (now == files->end() || now->second->path != was.path || now->second->size != was.size ||
+            now->second->modified != was.modified || now->second->inode != was.inode)
+        {
+            changed.emplace(was.path);
+        }
+    }
+    for (const auto &path : changed)
+    {
+        on_change_(path);
+    }
+}
+
+void static_file_index::stop_watching_()
+{
+    watching_ = false;
+    LUNA_LOG_WARNING("Stopped watching " + root_ + " for changes; looking on disk for every file under it instead");
+    on_change_(root_);
+}
+
+} //namespace luna
@@ -0,0 +1,108 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include "luna/private/mime_registry.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace luna
+{
+
+// What's in a directory tree served by router::serve_files, kept in memory so that finding the file for a request, or
+// finding that there isn't one, takes no system calls. The tree is read when the index is made, and read again
+// whenever inotify reports a change anywhere in it; static trees change rarely, and usually all at once, so the whole
+// tree is re-read once the changes settle down rather than patched event by event.
+//
+// inotify is Linux only. Elsewhere, or if the tree can't be watched (too many directories for the inotify limits, say),
+// the index converts to false, and whoever is using it should look on disk instead.
+class static_file_index
+{
+public:
+    struct file
+    {
+        std::string path; // what to serve: for a directory, its index file
+        uint64_t size;
+        int64_t modified; // ns since the epoch
+        uint64_t inode; // with the size and modification time, tells one version of the file from the next
+        std::string mime_type;
+    };
+
+    // Called from the index's own thread with the path of each file that has changed or gone away, or with the root
+    // itself if the tree has stopped being watched, and so might change without notice
+    using change_cb = std::function<void(const std::string &path)>;
+
+    // Files are typed by mime_types when they're indexed
+    static_file_index(std::string root,
+                      change_cb on_change,
+                      std::shared_ptr<const mime_registry> mime_types = std::make_shared<const mime_registry>());
+
+    ~static_file_index();
+
+    static_file_index(const static_file_index &) = delete;
+    static_file_index &operator=(const static_file_index &) = delete;
+
+    explicit operator bool() const
+    { return watching_; }
+
+    const std::string &root() const
+    { return root_; }
+
+    // path is relative to the root; null if there's nothing to serve for it
+    std::shared_ptr<const file> find(const std::string &path) const;
+
+    // the same, for a path that normalize_path() has already been through
+    std::shared_ptr<const file> find_normalized(const std::string &key) const;
+
+private:
+    using tree = std::unordered_map<std::string, std::shared_ptr<const file>>;
+
+    // read the whole tree, watching every directory in it
+    bool read_tree_(tree &files);
+
+    bool read_directory_(const std::string &directory,
+                         const std::string &relative,
+                         tree &files,
+                         std::vector<std::pair<uint64_t, uint64_t>> &visited,
+                         unsigned int depth);
+
+    void watch_();
+
+    void reread_();
+
+    // stop trusting the index
+    void stop_watching_();
+
+    std::string root_;
+    change_cb on_change_;
+    std::shared_ptr<const mime_registry> mime_types_;
+
+    mutable std::mutex lock_;
+    std::shared_ptr<const tree> files_;
+
+    std::atomic<bool> watching_;
+    int inotify_;
+    int stop_[2]; // a pipe; closing the write end stops the watcher
+    std::thread watcher_;
+};
+
+} //namespace luna
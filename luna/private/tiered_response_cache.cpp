@@ -0,0 +1,683 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/tiered_response_cache.h"
+#include "luna/private/credential_cache.h"
+#include "luna/config.h"
+#include <strings.h>
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+namespace luna
+{
+
+// more than this many writes waiting for the shared store, or stale responses waiting to be replaced, and new ones are
+// dropped; it's only a cache
+static const size_t max_pending_writes_ = 1024;
+
+// what an entry costs beyond its contents, roughly
+static const size_t entry_overhead_ = 128;
+
+static const std::string magic_{"LUNA\x01"};
+
+const char *const tiered_response_cache::tag_header{"Surrogate-Key"};
+
+static void put_u32_(std::string &out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+static void put_u64_(std::string &out, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+static void put_string_(std::string &out, const std::string &value)
+{
+    put_u32_(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
+}
+
+// reads from an encoded value, failing (rather than reading past the end) on anything truncated
+class reader_
+{
+public:
+    reader_(const std::string &in, size_t position) : in_{in}, position_{position}
+    {}
+
+    bool u32(uint32_t &value)
+    {
+        if (in_.size() - position_ < 4)
+        {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            value |= static_cast<uint32_t>(static_cast<uint8_t>(in_[position_++])) << (8 * i);
+        }
+        return true;
+    }
+
+    bool u64(uint64_t &value)
+    {
+        if (in_.size() - position_ < 8)
+        {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            value |= static_cast<uint64_t>(static_cast<uint8_t>(in_[position_++])) << (8 * i);
+        }
+        return true;
+    }
+
+    bool string(std::string &value)
+    {
+        uint32_t length;
+        if (!u32(length) || in_.size() - position_ < length)
+        {
+            return false;
+        }
+        value.assign(in_, position_, length);
+        position_ += length;
+        return true;
+    }
+
+    bool done() const
+    { return position_ == in_.size(); }
+
+private:
+    const std::string &in_;
+    size_t position_;
+};
+
+static uint64_t to_ms_(tiered_response_cache::clock::time_point time)
+{
+    return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count());
+}
+
+static tiered_response_cache::clock::time_point from_ms_(uint64_t ms)
+{
+    return tiered_response_cache::clock::time_point{std::chrono::milliseconds{ms}};
+}
+
+static size_t size_of_(const std::string &key, const response &response)
+{
+    auto size = entry_overhead_ + key.size() + response.content_type.size() + response.content.size();
+    for (const auto &header : response.headers)
+    {
+        size += header.first.size() + header.second.size();
+    }
+    return size;
+}
+
+tiered_response_cache::tiered_response_cache(size_t max_size,
+                                             cache::read read,
+                                             cache::write write,
+                                             std::unique_ptr<persistent_store> persistent) :
+        max_size_{max_size},
+        read_{std::move(read)},
+        write_{std::move(write)},
+        persistent_{std::move(persistent)},
+        size_{0},
+        stopping_{false}
+{
+    if (write_)
+    {
+        writer_ = std::thread{&tiered_response_cache::write_behind_, this};
+    }
+}
+
+tiered_response_cache::~tiered_response_cache()
+{
+    {
+        std::lock_guard<std::mutex> guard{writes_lock_};
+        stopping_ = true;
+    }
+    writes_changed_.notify_one();
+    refills_changed_.notify_one();
+    if (writer_.joinable())
+    {
+        writer_.join();
+    }
+    if (refiller_.joinable())
+    {
+        refiller_.join();
+    }
+}
+
+void tiered_response_cache::load()
+{
+    if (persistent_)
+    {
+        persistent_->load();
+    }
+}
+
+OPT_NS::optional<tiered_response_cache::hit> tiered_response_cache::get(const std::string &key)
+{
+    auto now = clock::now();
+
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        auto found = index_.find(key);
+        if (found != index_.end())
+        {
+            auto position = found->second;
+            auto freshness = freshness_at_(position->expires, now);
+            if (freshness)
+            {
+                entries_.splice(entries_.begin(), entries_, position);
+                return hit{*position->value, *freshness};
+            }
+            erase_(position);
+        }
+    }
+
+    if (persistent_)
+    {
+        auto found = adopt_(key, persistent_->read(shared_key(key)), now);
+        if (found)
+        {
+            return found;
+        }
+    }
+
+    if (!read_)
+    {
+        return OPT_NS::nullopt;
+    }
+
+    std::shared_ptr<std::string> encoded;
+    try
+    {
+        encoded = read_(shared_key(key));
+    }
+    catch (const std::exception &e)
+    {
+        LUNA_LOG_WARNING(std::string{"Reading from the shared response cache failed: "} + e.what());
+        return OPT_NS::nullopt;
+    }
+    return adopt_(key, encoded, now);
+}
+
+void tiered_response_cache::put(const std::string &key,
+                                const response &response,
+                                const lifetime &lifetime,
+                                bool shared)
+{
+    auto now = clock::now();
+    auto fresh_until = now + lifetime.ttl;
+    expiry expires{fresh_until, fresh_until + lifetime.stale_while_revalidate, fresh_until + lifetime.stale_if_error};
+    auto value = std::make_shared<const luna::response>(response);
+
+    shared = shared && (write_ || persistent_);
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        insert_(key, value, expires, shared);
+    }
+
+    if (shared)
+    {
+        queue_write_(key, std::make_shared<std::string>(encode(key, response, expires)),
+                     std::max(expires.revalidate_until, expires.error_until));
+    }
+}
+
+size_t tiered_response_cache::purge_tag(const std::string &tag)
+{
+    std::vector<std::string> tombstones;
+    size_t purged{0};
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        auto tagged = tags_.find(tag);
+        if (tagged == tags_.end())
+        {
+            return 0;
+        }
+        auto keys = std::move(tagged->second); // purging them will change the index we're reading
+        for (const auto &key : keys)
+        {
+            purge_(index_.at(key), tombstones);
+        }
+        purged = keys.size();
+    }
+
+    for (const auto &key : tombstones)
+    {
+        queue_write_(key, std::make_shared<std::string>(), clock::time_point{});
+    }
+    return purged;
+}
+
+size_t tiered_response_cache::purge_prefix(const std::string &prefix)
+{
+    std::vector<std::string> tombstones;
+    size_t purged{0};
+    {
+        std::lock_guard<std::mutex> guard{lock_};
+        auto position = index_.lower_bound(prefix);
+        while (position != index_.end() && position->first.compare(0, prefix.size(), prefix) == 0)
+        {
+            auto entry = (position++)->second;
+            purge_(entry, tombstones);
+            ++purged;
+        }
+    }
+
+    for (const auto &key : tombstones)
+    {
+        queue_write_(key, std::make_shared<std::string>(), clock::time_point{});
+    }
+    return purged;
+}
+
+void tiered_response_cache::revalidate(const std::string &key, const lifetime &lifetime, bool shared, refill_cb refill)
+{
+    {
+        std::lock_guard<std::mutex> guard{writes_lock_};
+        if (stopping_ || refilling_.count(key))
+        {
+            return;
+        }
+        if (refills_.size() >= max_pending_writes_)
+        {
+            LUNA_LOG_DEBUG("Response cache is falling behind; not revalidating " + key);
+            return;
+        }
+        refilling_.emplace(key);
+        refills_.emplace_back(tiered_response_cache::refill{key, lifetime, shared, std::move(refill)});
+        if (!refiller_.joinable())
+        {
+            refiller_ = std::thread{&tiered_response_cache::refill_, this};
+        }
+    }
+    refills_changed_.notify_one();
+}
+
+bool tiered_response_cache::cacheable(const response &response)
+{
+    switch (response.status_code)
+    {
+        // cacheable by default (RFC 7231 §6.1)
+        case 0: // not set by the handler, so 200 for the GET requests that are cached
+        case 200:
+        case 203:
+        case 204:
+        case 300:
+        case 301:
+        case 404:
+        case 410:
+            break;
+        default:
+            return false;
+    }
+
+    if (!response.file.empty())
+    {
+        return false;
+    }
+
+    for (const auto &header : response.headers)
+    {
+        // the key doesn't include the request headers a Vary names, so one client's version could go to another
+        if (!strcasecmp(header.first.c_str(), "Set-Cookie") || !strcasecmp(header.first.c_str(), "Vary"))
+        {
+            return false;
+        }
+        if (!strcasecmp(header.first.c_str(), "Cache-Control") &&
+            (header.second.find("no-store") != std::string::npos ||
+             header.second.find("private") != std::string::npos))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::string tiered_response_cache::encode(const std::string &key, const response &response, const expiry &expires)
+{
+    std::string out;
+    out.reserve(size_of_(key, response));
+
+    out.append(magic_);
+    put_string_(out, key);
+    put_u64_(out, to_ms_(expires.fresh_until));
+    put_u64_(out, to_ms_(expires.revalidate_until));
+    put_u64_(out, to_ms_(expires.error_until));
+    put_u32_(out, response.status_code);
+    put_string_(out, response.content_type);
+    put_u32_(out, static_cast<uint32_t>(response.headers.size()));
+    for (const auto &header : response.headers)
+    {
+        put_string_(out, header.first);
+        put_string_(out, header.second);
+    }
+    put_string_(out, response.content);
+
+    return out;
+}
+
+bool tiered_response_cache::decode(const std::string &encoded,
+                                   const std::string &key,
+                                   response &response,
+                                   expiry &expires)
+{
+    if (encoded.compare(0, magic_.size(), magic_) != 0)
+    {
+        return false;
+    }
+
+    reader_ reader{encoded, magic_.size()};
+    std::string stored_key;
+    uint64_t fresh_ms, revalidate_ms, error_ms;
+    uint32_t status, header_count;
+    if (!reader.string(stored_key) || stored_key != key || // a collision in the shared key, or not ours at all
+        !reader.u64(fresh_ms) ||
+        !reader.u64(revalidate_ms) ||
+        !reader.u64(error_ms) ||
+        !reader.u32(status) ||
+        !reader.string(response.content_type) ||
+        !reader.u32(header_count))
+    {
+        return false;
+    }
+
+    response.status_code = static_cast<luna::status_code>(status);
+    response.headers.clear();
+    for (uint32_t i = 0; i < header_count; ++i)
+    {
+        std::string name, value;
+        if (!reader.string(name) || !reader.string(value))
+        {
+            return false;
+        }
+        response.headers[name] = std::move(value);
+    }
+
+    if (!reader.string(response.content) || !reader.done())
+    {
+        return false;
+    }
+
+    response.file.clear();
+    expires = expiry{from_ms_(fresh_ms), from_ms_(revalidate_ms), from_ms_(error_ms)};
+    return true;
+}
+
+std::string tiered_response_cache::key(const std::string &path,
+                                       const query_params &params,
+                                       const std::string &credentials)
+{
+    auto key = request_prefix(path, params);
+    key.append(credentials);
+    return key;
+}
+
+std::string tiered_response_cache::path_prefix(const std::string &path)
+{
+    // paths never contain NUL, so this can't be mistaken for the beginning of a longer path
+    std::string prefix{path};
+    prefix.push_back('\0');
+    return prefix;
+}
+
+std::string tiered_response_cache::request_prefix(const std::string &path, const query_params &params)
+{
+    auto prefix = path_prefix(path);
+    for (const auto &param : params)
+    {
+        for (const auto *part : {&param.first, &param.second})
+        {
+            prefix.append(std::to_string(part->size()));
+            prefix.push_back(':');
+            prefix.append(*part);
+        }
+    }
+    // nor can a length, so this can't be mistaken for the beginning of a longer list of parameters
+    prefix.push_back('\0');
+    return prefix;
+}
+
+std::string tiered_response_cache::shared_key(const std::string &key)
+{
+    // fixed hash keys, so that every server agrees
+    auto high = siphash_2_4(0x6c756e612d63616cULL, 0x68652d6b65792d31ULL, key.data(), key.size());
+    auto low = siphash_2_4(0x6c756e612d63616cULL, 0x68652d6b65792d32ULL, key.data(), key.size());
+
+    char hex[33];
+    std::snprintf(hex, sizeof(hex), "%016llx%016llx", static_cast<unsigned long long>(high),
+                  static_cast<unsigned long long>(low));
+    return std::string{"luna:"} + hex;
+}
+
+OPT_NS::optional<tiered_response_cache::freshness> tiered_response_cache::freshness_at_(const expiry &expires,
+                                                                                         clock::time_point now)
+{
+    if (now < expires.fresh_until)
+    {
+        return freshness::FRESH;
+    }
+    if (now < expires.revalidate_until)
+    {
+        return freshness::REVALIDATE;
+    }
+    if (now < expires.error_until)
+    {
+        return freshness::IF_ERROR;
+    }
+    return OPT_NS::nullopt;
+}
+
+OPT_NS::optional<tiered_response_cache::hit> tiered_response_cache::adopt_(const std::string &key,
+                                                                          std::shared_ptr<std::string> encoded,
+                                                                          clock::time_point now)
+{
+    if (!encoded)
+    {
+        return OPT_NS::nullopt;
+    }
+
+    auto found = std::make_shared<response>();
+    expiry expires;
+    if (!decode(*encoded, key, *found, expires))
+    {
+        return OPT_NS::nullopt;
+    }
+    auto freshness = freshness_at_(expires, now);
+    if (!freshness)
+    {
+        return OPT_NS::nullopt;
+    }
+
+    std::lock_guard<std::mutex> guard{lock_};
+    insert_(key, found, expires, write_ || persistent_);
+    return hit{*found, *freshness};
+}
+
+void tiered_response_cache::insert_(const std::string &key,
+                                    std::shared_ptr<const response> value,
+                                    const expiry &expires,
+                                    bool shared)
+{
+    auto found = index_.find(key);
+    if (found != index_.end())
+    {
+        erase_(found->second);
+    }
+
+    auto size = size_of_(key, *value);
+    if (size > max_size_)
+    {
+        return; // would push everything else out, and still not fit
+    }
+
+    while (size_ + size > max_size_ && !entries_.empty())
+    {
+        erase_(std::prev(entries_.end()));
+    }
+
+    std::vector<std::string> tags;
+    auto tag_header_value = value->headers.find(tag_header);
+    if (tag_header_value != value->headers.end())
+    {
+        std::istringstream tag_stream{tag_header_value->second};
+        std::string tag;
+        while (tag_stream >> tag)
+        {
+            tags_[tag].emplace(key);
+            tags.emplace_back(std::move(tag));
+        }
+    }
+
+    entries_.push_front(entry{key, std::move(value), expires, size, std::move(tags), shared});
+    index_[key] = entries_.begin();
+    size_ += size;
+}
+
+void tiered_response_cache::erase_(std::list<entry>::iterator position)
+{
+    for (const auto &tag : position->tags)
+    {
+        auto tagged = tags_.find(tag);
+        if (tagged != tags_.end())
+        {
+            tagged->second.erase(position->key);
+            if (tagged->second.empty())
+            {
+                tags_.erase(tagged);
+            }
+        }
+    }
+    size_ -= position->size;
+    index_.erase(position->key);
+    entries_.erase(position);
+}
+
+void tiered_response_cache::purge_(std::list<entry>::iterator position, std::vector<std::string> &tombstones)
+{
+    if (position->shared)
+    {
+        tombstones.emplace_back(position->key);
+    }
+    erase_(position);
+}
+
+void tiered_response_cache::queue_write_(const std::string &key,
+                                         std::shared_ptr<std::string> value,
+                                         clock::time_point expires)
+{
+    if (persistent_)
+    {
+        persistent_->write(shared_key(key), value, expires);
+    }
+
+    if (!write_)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard{writes_lock_};
+        if (writes_.size() >= max_pending_writes_)
+        {
+            LUNA_LOG_DEBUG("Shared response cache is falling behind; not storing " + key);
+            return;
+        }
+        writes_.emplace_back(shared_key(key), std::move(value));
+    }
+    writes_changed_.notify_one();
+}
+
+void tiered_response_cache::write_behind_()
+{
+    for (;;)
+    {
+        std::pair<std::string, std::shared_ptr<std::string>> write;
+        {
+            std::unique_lock<std::mutex> lock{writes_lock_};
+            writes_changed_.wait(lock, [this]
+            { return stopping_ || !writes_.empty(); });
+            if (stopping_)
+            {
+                return; // whatever's left is only a cache fill; not worth holding up shutdown for
+            }
+            write = std::move(writes_.front());
+            writes_.pop_front();
+        }
+
+        try
+        {
+            write_(write.first, write.second);
+        }
+        catch (const std::exception &e)
+        {
+            LUNA_LOG_WARNING(std::string{"Writing to the shared response cache failed: "} + e.what());
+        }
+    }
+}
+
+void tiered_response_cache::refill_()
+{
+    for (;;)
+    {
+        tiered_response_cache::refill refill;
+        {
+            std::unique_lock<std::mutex> lock{writes_lock_};
+            refills_changed_.wait(lock, [this]
+            { return stopping_ || !refills_.empty(); });
+            if (stopping_)
+            {
+                return; // the stale responses will do until they run out
+            }
+            refill = std::move(refills_.front());
+            refills_.pop_front();
+        }
+
+        OPT_NS::optional<response> fresh;
+        try
+        {
+            fresh = refill.callback();
+        }
+        catch (const std::exception &e)
+        {
+            LUNA_LOG_ERROR("Revalidating " + refill.key + " failed: " + e.what());
+        }
+        catch (...)
+        {
+            LUNA_LOG_ERROR("Revalidating " + refill.key + " failed");
+        }
+
+        if (fresh && cacheable(*fresh))
+        {
+            put(refill.key, *fresh, refill.lifetime, refill.shared);
+        }
+
+        std::lock_guard<std::mutex> guard{writes_lock_};
+        refilling_.erase(refill.key);
+    }
+}
+
+} //namespace luna
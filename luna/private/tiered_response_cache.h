@@ -0,0 +1,198 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include <luna/types.h>
+#include <luna/optional.hpp>
+#include "luna/private/persistent_store.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace luna
+{
+
+// Responses from endpoints with router::cache_for, kept in memory (L1) in front of an optional store shared with other
+// servers (L2) that's reached through a luna::cache::read and luna::cache::write pair. A miss in memory falls through
+// to the shared store; what's found there is kept in memory too. New responses go into memory straight away, and into
+// the shared store from a background thread, so requests never wait on the store to write.
+//
+// Between the two there may be a persistent_store on local disk, which outlives the process: responses that would be
+// shared are written there too, and a restarted server finds them there once load() has been called.
+class tiered_response_cache
+{
+public:
+    // Expiry times travel between servers through the shared store, so they're kept on the wall clock
+    using clock = std::chrono::system_clock;
+
+    // How long a response is good for, and how long after that it may still be used while it's replaced, or if
+    // replacing it fails
+    struct lifetime
+    {
+        std::chrono::milliseconds ttl;
+        std::chrono::milliseconds stale_while_revalidate{0};
+        std::chrono::milliseconds stale_if_error{0};
+    };
+
+    // The same, as moments in time
+    struct expiry
+    {
+        clock::time_point fresh_until;
+        clock::time_point revalidate_until;
+        clock::time_point error_until;
+    };
+
+    enum class freshness
+    {
+        FRESH,
+        REVALIDATE, // stale, but may be used while it's replaced
+        IF_ERROR, // stale, and only to be used if a fresh response can't be had
+    };
+
+    struct hit
+    {
+        luna::response response;
+        tiered_response_cache::freshness freshness;
+    };
+
+    using refill_cb = std::function<OPT_NS::optional<luna::response>()>;
+
+    tiered_response_cache(size_t max_size,
+                          cache::read read,
+                          cache::write write,
+                          std::unique_ptr<persistent_store> persistent = nullptr);
+
+    ~tiered_response_cache();
+
+    // Start reading back what the persistent store kept from an earlier run, if there is one
+    void load();
+
+    OPT_NS::optional<hit> get(const std::string &key);
+
+    // Keep response for as long as its lifetime allows. Responses that mustn't leave this process (because their key
+    // includes credentials, say) aren't shared.
+    void put(const std::string &key, const response &response, const lifetime &lifetime, bool shared = true);
+
+    // Drop every response tagged with tag (see Surrogate-Key below), or whose key begins with prefix (see key()
+    // below). Copies in the shared and persistent stores that this server knows about are overwritten, so that it
+    // doesn't read them back; other servers' memory is their own business. Each returns how many responses were dropped.
+    size_t purge_tag(const std::string &tag);
+
+    size_t purge_prefix(const std::string &prefix);
+
+    // Replace a stale response in the background, with whatever refill returns (if it's cacheable). Only one refill
+    // runs for a key at a time; more requests to revalidate it meanwhile are ignored.
+    void revalidate(const std::string &key, const lifetime &lifetime, bool shared, refill_cb refill);
+
+    // Whether a response can be cached at all: a status that's cacheable by default, no file to stream, nothing
+    // particular to one client (Set-Cookie, or Vary), and no Cache-Control forbidding it
+    static bool cacheable(const response &response);
+
+    // How responses are kept in the shared store. Binary safe, and carries its own key and expiry, so a value
+    // that's been tampered with, truncated, or written by something else is rejected rather than served.
+    static std::string encode(const std::string &key, const response &response, const expiry &expires);
+
+    static bool decode(const std::string &encoded, const std::string &key, response &response, expiry &expires);
+
+    // Keys in the shared store are a fixed-length hash of ours, safe for memcached and the like
+    static std::string shared_key(const std::string &key);
+
+    // What a request's response is kept under. Keys begin with the path, and then the query parameters, so that every
+    // response for a path, or for a path and exact set of parameters, is found by purging the prefix from
+    // path_prefix() or request_prefix().
+    static std::string key(const std::string &path, const query_params &params, const std::string &credentials);
+
+    static std::string path_prefix(const std::string &path);
+
+    static std::string request_prefix(const std::string &path, const query_params &params);
+
+    // Responses are tagged by the space-separated surrogate keys in this header, as with many CDNs. It's passed on to
+    // the client as is, so that a CDN in front can purge by the same tags.
+    static const char *const tag_header;
+
+private:
+    struct entry
+    {
+        std::string key;
+        std::shared_ptr<const luna::response> value;
+        tiered_response_cache::expiry expires;
+        size_t size;
+        std::vector<std::string> tags;
+        bool shared; // whether there may be a copy in the shared or persistent store
+    };
+
+    static OPT_NS::optional<freshness> freshness_at_(const expiry &expires, clock::time_point now);
+
+    // keep an encoded response found in one of the stores, if it's still any use
+    OPT_NS::optional<hit> adopt_(const std::string &key, std::shared_ptr<std::string> encoded, clock::time_point now);
+
+    void insert_(const std::string &key, std::shared_ptr<const response> response, const expiry &expires, bool shared);
+
+    void erase_(std::list<entry>::iterator position);
+
+    // erase, noting the shared copy to overwrite once the lock is released
+    void purge_(std::list<entry>::iterator position, std::vector<std::string> &tombstones);
+
+    // to the shared and persistent stores; an empty value removes key from them
+    void queue_write_(const std::string &key, std::shared_ptr<std::string> value, clock::time_point expires);
+
+    void write_behind_();
+
+    void refill_();
+
+    size_t max_size_;
+    cache::read read_;
+    cache::write write_;
+    std::unique_ptr<persistent_store> persistent_;
+
+    std::mutex lock_;
+    std::list<entry> entries_; // most recently used first
+    // ordered, so that purging a prefix only visits what it purges
+    std::map<std::string, std::list<entry>::iterator> index_;
+    std::unordered_map<std::string, std::unordered_set<std::string>> tags_; // the keys with each tag
+    size_t size_;
+
+    // writes on their way to the shared store
+    std::thread writer_;
+    std::mutex writes_lock_;
+    std::condition_variable writes_changed_;
+    std::deque<std::pair<std::string, std::shared_ptr<std::string>>> writes_;
+    bool stopping_;
+
+    // stale responses being replaced, one at a time, on a thread started the first time one's needed
+    struct refill
+    {
+        std::string key;
+        tiered_response_cache::lifetime lifetime;
+        bool shared;
+        refill_cb callback;
+    };
+    std::thread refiller_;
+    std::condition_variable refills_changed_;
+    std::deque<refill> refills_; // guarded by writes_lock_, as is everything about the background threads
+    std::unordered_set<std::string> refilling_; // the keys in refills_, or being refilled now
+};
+
+} //namespace luna
@@ -0,0 +1,103 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/tls_session_cache.h"
+#include <functional>
+
+namespace luna
+{
+
+tls_session_cache::tls_session_cache(size_t capacity, std::chrono::seconds lifetime) :
+        shard_capacity_{(capacity + shard_count_ - 1) / shard_count_},
+        lifetime_{lifetime}
+{}
+
+tls_session_cache::shard &tls_session_cache::shard_for_(const std::string &id)
+{
+    return shards_[std::hash<std::string>{}(id) % shard_count_];
+}
+
+void tls_session_cache::store(const std::string &id, std::string session)
+{
+    if (shard_capacity_ == 0)
+    {
+        return;
+    }
+
+    auto &shard = shard_for_(id);
+    std::lock_guard<std::mutex> guard{shard.lock};
+    auto expires = std::chrono::steady_clock::now() + lifetime_;
+    auto found = shard.entries.find(id);
+    if (found != shard.entries.end())
+    {
+        found->second.session = std::move(session);
+        found->second.expires = expires;
+        shard.used.splice(shard.used.begin(), shard.used, found->second.used);
+        return;
+    }
+
+    if (shard.entries.size() >= shard_capacity_)
+    {
+        shard.entries.erase(shard.used.back());
+        shard.used.pop_back();
+    }
+    shard.used.push_front(id);
+    shard.entries.emplace(id, entry{std::move(session), expires, shard.used.begin()});
+}
+
+OPT_NS::optional<std::string> tls_session_cache::fetch(const std::string &id)
+{
+    auto &shard = shard_for_(id);
+    std::lock_guard<std::mutex> guard{shard.lock};
+    auto found = shard.entries.find(id);
+    if (found == shard.entries.end())
+    {
+        return OPT_NS::nullopt;
+    }
+    if (found->second.expires <= std::chrono::steady_clock::now())
+    {
+        shard.used.erase(found->second.used);
+        shard.entries.erase(found);
+        return OPT_NS::nullopt;
+    }
+    shard.used.splice(shard.used.begin(), shard.used, found->second.used);
+    return found->second.session;
+}
+
+bool tls_session_cache::remove(const std::string &id)
+{
+    auto &shard = shard_for_(id);
+    std::lock_guard<std::mutex> guard{shard.lock};
+    auto found = shard.entries.find(id);
+    if (found == shard.entries.end())
+    {
+        return false;
+    }
+    shard.used.erase(found->second.used);
+    shard.entries.erase(found);
+    return true;
+}
+
+size_t tls_session_cache::size()
+{
+    size_t size{0};
+    for (auto &shard : shards_)
+    {
+        std::lock_guard<std::mutex> guard{shard.lock};
+        size += shard.entries.size();
+    }
+    return size;
+}
+
+} //namespace luna
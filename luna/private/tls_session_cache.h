@@ -0,0 +1,69 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include <luna/optional.hpp>
+#include <array>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace luna
+{
+
+// TLS sessions held in memory so that clients can resume them by session ID, rather than doing a full handshake every
+// time they reconnect. Split into shards, each with its own lock, so that handshakes on different threads rarely wait
+// on each other; each shard holds its share of capacity sessions, and makes room by dropping the least recently used.
+// Sessions are dropped after lifetime, too.
+class tls_session_cache
+{
+public:
+    tls_session_cache(size_t capacity, std::chrono::seconds lifetime);
+
+    void store(const std::string &id, std::string session);
+
+    OPT_NS::optional<std::string> fetch(const std::string &id);
+
+    bool remove(const std::string &id);
+
+    size_t size();
+
+private:
+    static const size_t shard_count_{16};
+
+    struct entry
+    {
+        std::string session;
+        std::chrono::steady_clock::time_point expires;
+        std::list<std::string>::iterator used; // its place in its shard's used list
+    };
+
+    struct shard
+    {
+        std::mutex lock;
+        std::unordered_map<std::string, entry> entries;
+        std::list<std::string> used; // most recently used first
+    };
+
+    shard &shard_for_(const std::string &id);
+
+    size_t shard_capacity_;
+    std::chrono::seconds lifetime_;
+    std::array<shard, shard_count_> shards_;
+};
+
+} //namespace luna
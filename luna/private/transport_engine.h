@@ -0,0 +1,43 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#include "luna/private/dispatcher.h"
+#include <cstdint>
+
+namespace luna
+{
+
+// A network engine: something that accepts requests from somewhere, hands them to a dispatcher, and delivers the
+// responses back. The server owns one engine of each kind and starts whichever one it was configured to use.
+class transport_engine
+{
+public:
+    explicit transport_engine(dispatcher &dispatcher) : dispatcher_(dispatcher)
+    {}
+
+    virtual ~transport_engine() = default;
+
+    virtual bool start(uint16_t port) = 0;
+
+    virtual void stop() = 0;
+
+    virtual bool is_running() = 0;
+
+protected:
+    dispatcher &dispatcher_;
+};
+
+} //namespace luna
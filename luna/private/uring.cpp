@@ -0,0 +1,168 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include "luna/private/uring.h"
+
+#if defined(LUNA_HAVE_IO_URING)
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace luna
+{
+
+uring::uring(unsigned int entries) :
+        fd_{-1},
+        sq_ring_{MAP_FAILED},
+        sq_ring_size_{0},
+        cq_ring_{MAP_FAILED},
+        cq_ring_size_{0},
+        sqes_{static_cast<io_uring_sqe *>(MAP_FAILED)},
+        sqes_size_{0},
+        sq_local_tail_{0},
+        sq_submitted_tail_{0}
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    // completions can pile up faster than submissions when many connections finish at once
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+
+    auto fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0)
+    {
+        return;
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        sq_ring_size_ = cq_ring_size_ = (sq_ring_size_ > cq_ring_size_) ? sq_ring_size_ : cq_ring_size_;
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED)
+    {
+        close(fd);
+        return;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        cq_ring_ = sq_ring_;
+    }
+    else
+    {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                        IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED)
+        {
+            munmap(sq_ring_, sq_ring_size_);
+            sq_ring_ = MAP_FAILED;
+            close(fd);
+            return;
+        }
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                             fd, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED)
+    {
+        if (cq_ring_ != sq_ring_)
+        {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = cq_ring_ = MAP_FAILED;
+        close(fd);
+        return;
+    }
+
+    auto sq = static_cast<char *>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned int *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned int *>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned int *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned int *>(sq + params.sq_off.array);
+    sq_entries_ = params.sq_entries;
+
+    auto cq = static_cast<char *>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned int *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned int *>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned int *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    // we always fill the sqes in ring order, so the indirection array never needs to change
+    for (unsigned int i = 0; i < sq_entries_; ++i)
+    {
+        sq_array_[i] = i;
+    }
+
+    sq_local_tail_ = sq_submitted_tail_ = *sq_tail_;
+    fd_ = fd;
+}
+
+uring::~uring()
+{
+    if (fd_ < 0)
+    {
+        return;
+    }
+
+    munmap(sqes_, sqes_size_);
+    if (cq_ring_ != sq_ring_)
+    {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    munmap(sq_ring_, sq_ring_size_);
+    close(fd_);
+}
+
+io_uring_sqe *uring::get_sqe()
+{
+    while (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_)
+    {
+        if (submit_and_wait(0) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            return nullptr;
+        }
+    }
+
+    auto sqe = &sqes_[sq_local_tail_ & *sq_mask_];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ++sq_local_tail_;
+    return sqe;
+}
+
+int uring::submit_and_wait(unsigned int wait_for)
+{
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+
+    auto to_submit = sq_local_tail_ - sq_submitted_tail_;
+    auto flags = wait_for ? IORING_ENTER_GETEVENTS : 0U;
+    auto ret = static_cast<int>(syscall(__NR_io_uring_enter, fd_, to_submit, wait_for, flags, nullptr, 0));
+    if (ret > 0)
+    {
+        sq_submitted_tail_ += ret;
+    }
+    return ret;
+}
+
+} //namespace luna
+
+#endif // LUNA_HAVE_IO_URING
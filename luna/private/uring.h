@@ -0,0 +1,89 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#pragma once
+
+#if defined(LUNA_HAVE_IO_URING)
+
+#include <linux/io_uring.h>
+#include <cstdint>
+#include <cstddef>
+
+namespace luna
+{
+
+// A minimal io_uring submission/completion ring, talking to the kernel directly so we don't need liburing. Not
+// thread-safe: each ring belongs to exactly one thread.
+class uring
+{
+public:
+    explicit uring(unsigned int entries);
+
+    ~uring();
+
+    uring(const uring &) = delete;
+    uring &operator=(const uring &) = delete;
+
+    // false if the kernel refused to give us a ring (too old, or io_uring disabled by policy)
+    explicit operator bool() const
+    { return fd_ >= 0; }
+
+    // A zeroed submission queue entry. If the queue is full, what's queued is submitted first to make room.
+    io_uring_sqe *get_sqe();
+
+    // Submit everything queued, and wait for at least wait_for completions
+    int submit_and_wait(unsigned int wait_for);
+
+    // Hand each available completion to f, then release them back to the kernel. Returns how many were seen.
+    template<typename F>
+    unsigned int for_each_cqe(F &&f)
+    {
+        auto head = *cq_head_;
+        auto tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        unsigned int count = 0;
+        for (; head != tail; ++head, ++count)
+        {
+            f(cqes_[head & *cq_mask_]);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+private:
+    int fd_;
+
+    void *sq_ring_;
+    size_t sq_ring_size_;
+    void *cq_ring_;
+    size_t cq_ring_size_;
+    io_uring_sqe *sqes_;
+    size_t sqes_size_;
+
+    unsigned int *sq_head_;
+    unsigned int *sq_tail_;
+    unsigned int *sq_mask_;
+    unsigned int *sq_array_;
+    unsigned int sq_entries_;
+    unsigned int sq_local_tail_;
+    unsigned int sq_submitted_tail_;
+
+    unsigned int *cq_head_;
+    unsigned int *cq_tail_;
+    unsigned int *cq_mask_;
+    io_uring_cqe *cqes_;
+};
+
+} //namespace luna
+
+#endif // LUNA_HAVE_IO_URING
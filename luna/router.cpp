@@ -50,19 +50,139 @@ void router::handle_request(request_method method,
     impl_->handle_request(method, route, callback, validations);
 }
 
+void router::handle_request_(request_method method,
+                             std::regex route,
+                             router::endpoint_handler_cb callback,
+                             parameter::validators validations,
+                             endpoint_options options)
+{
+    impl_->handle_request(method, std::move(route), std::move(callback), std::move(validations), std::move(options));
+}
+
+void router::set_endpoint_option_(endpoint_options &options, deadline value)
+{
+    options.deadline = value.get();
+}
+
+void router::set_endpoint_option_(endpoint_options &options, priority value)
+{
+    options.priority = value.get();
+}
+
+void router::set_endpoint_option_(endpoint_options &options, const bulkhead &value)
+{
+    options.bulkhead = value;
+}
+
+void router::set_endpoint_option_(endpoint_options &options, const coalesce &value)
+{
+    options.coalesce = value;
+}
+
+void router::set_endpoint_option_(endpoint_options &options, cache_for value)
+{
+    options.cache_for = value.get();
+}
+
+void router::set_endpoint_option_(endpoint_options &options, stale_while_revalidate value)
+{
+    options.stale_while_revalidate = value.get();
+}
+
+void router::set_endpoint_option_(endpoint_options &options, stale_if_error value)
+{
+    options.stale_if_error = value.get();
+}
+
 void router::serve_files(std::string mount_point, std::string path_to_files)
 {
     impl_->serve_files(mount_point, path_to_files);
 }
 
+void router::serve_files_(std::string mount_point, std::string path_to_files, file_options options)
+{
+    impl_->serve_files(std::move(mount_point), std::move(path_to_files), std::move(options));
+}
+
+void router::set_file_option_(file_options &options, const asset_manifest &value)
+{
+    options.asset_manifest = value.get();
+}
+
+void router::set_file_option_(file_options &options, fingerprint_assets value)
+{
+    options.fingerprint_assets = value.get();
+}
+
+void router::set_file_option_(file_options &options, asset_max_age value)
+{
+    options.asset_max_age = value.get();
+}
+
+std::string router::asset_path(const std::string &path) const
+{
+    return impl_->asset_path(path);
+}
+
+void router::serve_embedded(std::string mount_point, const embedded_assets &assets)
+{
+    impl_->serve_embedded(std::move(mount_point), assets);
+}
+
+void router::serve_cache_admin(std::string mount_point)
+{
+    impl_->serve_cache_admin(std::move(mount_point));
+}
+
 void router::add_header(std::string &&key, std::string &&value)
 {
     impl_->add_header(std::move(key), std::move(value));
 }
 
+void router::set_bulkhead(bulkhead bulkhead)
+{
+    impl_->set_bulkhead(std::move(bulkhead));
+}
+
+void router::require_basic_authorization(std::string realm,
+                                         basic_authorization_cb verifier,
+                                         std::chrono::milliseconds cache_ttl,
+                                         size_t cache_size)
+{
+    impl_->require_basic_authorization(std::move(realm), std::move(verifier), cache_ttl, cache_size);
+}
+
+void router::require_bearer_authorization(std::string realm,
+                                          bearer_authorization_cb verifier,
+                                          std::chrono::milliseconds cache_ttl,
+                                          size_t cache_size)
+{
+    impl_->require_bearer_authorization(std::move(realm), std::move(verifier), cache_ttl, cache_size);
+}
+
 OPT_NS::optional<luna::response> router::process_request(request &request)
 {
     return impl_->process_request(request);
 }
 
+OPT_NS::optional<router::priority_level> router::priority_for(request_method method, const std::string &path)
+{
+    return impl_->priority_for(method, path);
+}
+
+OPT_NS::optional<std::string> router::coalesce_key_for(const request &request)
+{
+    return impl_->coalesce_key_for(request);
+}
+
+void router::set_response_cache_(std::shared_ptr<tiered_response_cache> cache)
+{
+    impl_->set_response_cache(std::move(cache));
+}
+
+void router::set_renderer_(std::shared_ptr<response_renderer> renderer)
+{
+    impl_->set_renderer(std::move(renderer));
+}
+
 } //namespace luna
@@ -16,15 +16,21 @@
 
 #include <luna/types.h>
 #include <luna/config.h>
+#include <luna/embedded_assets.h>
 #include <luna/optional.hpp>
 #include <regex>
 #include <functional>
+#include <chrono>
+#include <vector>
 
 namespace luna
 {
 
-// Forward declaration for friendship
+// Forward declarations for friendship
 class server;
+class dispatcher;
+class tiered_response_cache;
+class response_renderer;
 
 class router
 {
@@ -39,6 +45,76 @@ public:
 
     using endpoint_handler_cb = std::function<response (const request &req)>;
 
+    // Per-endpoint options, passed to handle_request after the validators
+
+    // How long requests to this endpoint may take before their cancellation token trips, in place of
+    // server::request_deadline. Zero means no deadline.
+    MAKE_LIKE(std::chrono::milliseconds, deadline);
+
+    // When the server is shedding load (see server::adaptive_concurrency_limit), LOW priority requests are turned away
+    // first and HIGH priority ones last. CRITICAL requests, such as health checks, are never turned away.
+    enum class priority_level
+    {
+        LOW,
+        NORMAL,
+        HIGH,
+        CRITICAL,
+    };
+
+    MAKE_LIKE(priority_level, priority);
+
+    // Caps how many requests may be inside at once, for one endpoint (passed to handle_request) or for a whole router
+    // (set_bulkhead), so that one slow endpoint can't tie up every thread the server has. Requests over the cap wait
+    // in a queue of their own, up to max_queued of them for up to max_wait each (and never past their deadline), and
+    // are then turned away with a 503. With own_threads, handlers run on max_concurrent threads belonging to the
+    // bulkhead instead of the server's, and a request whose handler overruns its deadline is answered with a 503
+    // while the handler carries on without it. Either way, a request waiting to get in, or for an own_threads handler
+    // to finish, blocks the thread handling it (a server thread with libmicrohttpd, a handler pool thread with the
+    // native transport), so a bulkhead can occupy as many as max_concurrent + max_queued of those at once.
+    struct bulkhead
+    {
+        unsigned int max_concurrent{1};
+        unsigned int max_queued{0};
+        std::chrono::milliseconds max_wait{0};
+        bool own_threads{false};
+        std::chrono::seconds retry_after{1};
+    };
+
+    // Keep responses to GET requests to this endpoint for this long in the server's response cache (see
+    // server::response_cache), and answer identical requests from there meanwhile. Requests are identical when they
+    // have the same path and query parameters, and on routers that require authorization, the same credentials.
+    MAKE_LIKE(std::chrono::milliseconds, cache_for);
+
+    // With cache_for: once a cached response has expired, go on answering with it for this much longer, while the
+    // handler runs again in the background to replace it, so that no request has to wait for the new one.
+    MAKE_LIKE(std::chrono::milliseconds, stale_while_revalidate);
+
+    // With cache_for: once a cached response has expired, keep it for this much longer to fall back on if the handler
+    // throws, answers with a 5xx, or misses its deadline.
+    MAKE_LIKE(std::chrono::milliseconds, stale_if_error);
+
+    // Concurrent identical GET requests to this endpoint share one run of its handler: while it runs, later requests
+    // wait for its response rather than running it again. Requests are identical when they have the same path and the
+    // same values for the query parameters and headers listed here (plus any parameters with validators, and the
+    // credentials if the router requires authorization); anything else about them is ignored.
+    struct coalesce
+    {
+        std::vector<std::string> params;
+        std::vector<std::string> headers;
+    };
+
+    // everything the options above can set
+    struct endpoint_options
+    {
+        OPT_NS::optional<std::chrono::milliseconds> deadline;
+        OPT_NS::optional<priority_level> priority;
+        OPT_NS::optional<router::bulkhead> bulkhead;
+        OPT_NS::optional<router::coalesce> coalesce;
+        OPT_NS::optional<std::chrono::milliseconds> cache_for;
+        OPT_NS::optional<std::chrono::milliseconds> stale_while_revalidate;
+        OPT_NS::optional<std::chrono::milliseconds> stale_if_error;
+    };
+
     void handle_request(request_method method,
                         std::regex route,
                         endpoint_handler_cb callback,
@@ -49,12 +125,104 @@ public:
                         endpoint_handler_cb callback,
                         parameter::validators validations = {});
 
+    template<typename O, typename ...Os>
+    void handle_request(request_method method,
+                        std::regex route,
+                        endpoint_handler_cb callback,
+                        parameter::validators validations,
+                        O &&option,
+                        Os &&...options)
+    {
+        endpoint_options endpoint_options;
+        set_endpoint_options_(endpoint_options, LUNA_FWD(option), LUNA_FWD(options)...);
+        handle_request_(method, std::move(route), std::move(callback), std::move(validations),
+                        std::move(endpoint_options));
+    }
+
+    template<typename O, typename ...Os>
+    void handle_request(request_method method,
+                        std::string route,
+                        endpoint_handler_cb callback,
+                        parameter::validators validations,
+                        O &&option,
+                        Os &&...options)
+    {
+        handle_request(method, std::regex{route}, std::move(callback), std::move(validations), LUNA_FWD(option),
+                       LUNA_FWD(options)...);
+    }
+
     void serve_files(std::string mount_point, std::string path_to_files);
 
+    // Options for serve_files, after the path to the files
+
+    // A manifest mapping asset names to fingerprinted file names, as webpack's manifest.json does:
+    // {"app.js": "app.3b8e1f0c.js"}. The files it names never change, so they're served to be cached for a year. On
+    // Linux, the manifest is read again whenever it changes.
+    MAKE_LIKE(std::string, asset_manifest);
+
+    // For trees without a manifest: fingerprint files by hashing their contents, and serve app.js as app.<hash>.js too,
+    // to be cached for a year. asset_path() gives the fingerprinted path to link to.
+    MAKE_LIKE(bool, fingerprint_assets);
+
+    // How long browsers may go on using a file that isn't fingerprinted before asking whether it has changed, with the
+    // ETag and Last-Modified it was served with. By default, they ask every time.
+    MAKE_LIKE(std::chrono::seconds, asset_max_age);
+
+    // everything the options above can set
+    struct file_options
+    {
+        std::string asset_manifest;
+        bool fingerprint_assets{false};
+        std::chrono::seconds asset_max_age{0};
+    };
+
+    template<typename O, typename ...Os>
+    void serve_files(std::string mount_point, std::string path_to_files, O &&option, Os &&...options)
+    {
+        file_options file_options;
+        set_file_options_(file_options, LUNA_FWD(option), LUNA_FWD(options)...);
+        serve_files_(std::move(mount_point), std::move(path_to_files), std::move(file_options));
+    }
+
+    // The path to link to for a file served by serve_files, given the path it's served at: with its fingerprint, if it
+    // has one, so that it can be cached for as long as it doesn't change. Other paths are given back as they are.
+    std::string asset_path(const std::string &path) const;
+
+    // Serve assets compiled into the binary by the luna_embed_assets() CMake function, straight from memory. Responses
+    // carry an ETag, answering If-None-Match with a 304, and are sent precompressed to clients that accept it where
+    // there is a precompressed variant. assets must outlive the router; the ones luna_embed_assets() makes always do.
+    void serve_embedded(std::string mount_point, const embedded_assets &assets);
+
+    // Mount a POST endpoint at mount_point for purging the server's response cache, taking one of a tag, path or
+    // prefix parameter (see server::purge_cached_tag() and friends), and answering with how many responses were
+    // dropped, as {"purged": 3}. Put it on a router of its own that requires authorization.
+    void serve_cache_admin(std::string mount_point);
+
     void add_header(std::string &&key, std::string &&value);
 
+    // A bulkhead shared by every endpoint on this router. Requests to an endpoint with a bulkhead of its own must get
+    // into that one first.
+    void set_bulkhead(bulkhead bulkhead);
+
+    // Require credentials for every endpoint on this router. Requests without valid credentials get a 401. Credentials
+    // that pass the verifier are remembered for cache_ttl, so an expensive check runs once per client rather than on
+    // every request; set cache_size to 0 to verify every request.
+    using basic_authorization_cb = std::function<bool(const std::string &username, const std::string &password)>;
+    using bearer_authorization_cb = std::function<bool(const std::string &token)>;
+
+    void require_basic_authorization(std::string realm,
+                                     basic_authorization_cb verifier,
+                                     std::chrono::milliseconds cache_ttl = std::chrono::minutes{5},
+                                     size_t cache_size = 1024);
+
+    void require_bearer_authorization(std::string realm,
+                                      bearer_authorization_cb verifier,
+                                      std::chrono::milliseconds cache_ttl = std::chrono::minutes{5},
+                                      size_t cache_size = 1024);
+
 protected:
     friend luna::server;
+    friend luna::dispatcher;
 
     // protected constructor means the only way to ger a router is through server::create_router
     router(std::string route_base = "/");
@@ -62,10 +230,75 @@ protected:
     // for use by the server object
     OPT_NS::optional<luna::response> process_request(request &request);
 
+    // The priority of the endpoint that would handle this request, without handling it
+    OPT_NS::optional<priority_level> priority_for(request_method method, const std::string &path);
+
+    // What identifies requests that can share a response with this one, if its endpoint coalesces requests: nullopt
+    // if no endpoint on this router would handle it, and empty if the one that would doesn't coalesce
+    OPT_NS::optional<std::string> coalesce_key_for(const request &request);
+
+    void set_response_cache_(std::shared_ptr<tiered_response_cache> cache);
+
+    void set_renderer_(std::shared_ptr<response_renderer> renderer);
+
 private:
 
     class router_impl;
     std::unique_ptr<router_impl> impl_;
+
+    void handle_request_(request_method method,
+                         std::regex route,
+                         endpoint_handler_cb callback,
+                         parameter::validators validations,
+                         endpoint_options options);
+
+    template<typename T>
+    static void set_endpoint_options_(endpoint_options &options, T &&t)
+    {
+        set_endpoint_option_(options, LUNA_FWD(t));
+    }
+
+    template<typename T, typename... Ts>
+    static void set_endpoint_options_(endpoint_options &options, T &&t, Ts &&... ts)
+    {
+        set_endpoint_options_(options, LUNA_FWD(t));
+        set_endpoint_options_(options, LUNA_FWD(ts)...);
+    }
+
+    static void set_endpoint_option_(endpoint_options &options, deadline value);
+
+    static void set_endpoint_option_(endpoint_options &options, priority value);
+
+    static void set_endpoint_option_(endpoint_options &options, const bulkhead &value);
+
+    static void set_endpoint_option_(endpoint_options &options, const coalesce &value);
+
+    static void set_endpoint_option_(endpoint_options &options, cache_for value);
+
+    static void set_endpoint_option_(endpoint_options &options, stale_while_revalidate value);
+
+    static void set_endpoint_option_(endpoint_options &options, stale_if_error value);
+
+    void serve_files_(std::string mount_point, std::string path_to_files, file_options options);
+
+    template<typename T>
+    static void set_file_options_(file_options &options, T &&t)
+    {
+        set_file_option_(options, LUNA_FWD(t));
+    }
+
+    template<typename T, typename... Ts>
+    static void set_file_options_(file_options &options, T &&t, Ts &&... ts)
+    {
+        set_file_options_(options, LUNA_FWD(t));
+        set_file_options_(options, LUNA_FWD(ts)...);
+    }
+
+    static void set_file_option_(file_options &options, const asset_manifest &value);
+
+    static void set_file_option_(file_options &options, fingerprint_assets value);
+
+    static void set_file_option_(file_options &options, asset_max_age value);
 };
 
 
@@ -39,7 +39,7 @@ void server::server_impl_deleter::operator()(server::server_impl *ptr) const
 
 server::operator bool()
 {
-    return (impl_->daemon_ != nullptr);
+    return impl_->is_running();
 }
 
 void server::initialize_()
@@ -84,6 +84,41 @@ void server::stop()
     impl_->stop();
 }
 
+response server::inject(request request)
+{
+    return impl_->inject(std::move(request));
+}
+
+size_t server::purge_cached_tag(const std::string &tag)
+{
+    return impl_->purge_cached_tag(tag);
+}
+
+size_t server::purge_cached_path(const std::string &path)
+{
+    return impl_->purge_cached_path(path);
+}
+
+size_t server::purge_cached_request(const std::string &path, const query_params &params)
+{
+    return impl_->purge_cached_request(path, params);
+}
+
+size_t server::purge_cached_prefix(const std::string &prefix)
+{
+    return impl_->purge_cached_prefix(prefix);
+}
+
+server::tls_handshake_counts server::tls_handshakes()
+{
+    return impl_->tls_handshakes();
+}
+
+bool server::reload_https_certificates(const https_certificates &certificates)
+{
+    return impl_->reload_https_certificates(certificates);
+}
+
 void server::await()
 {
     impl_->await();
@@ -244,6 +279,16 @@ void server::set_option_(const server::https_key_password &value)
     impl_->set_option_(value);
 }
 
+void server::set_option_(const server::https_certificates &value)
+{
+    impl_->set_option_(value);
+}
+
+void server::set_option_(const server::tls_session_resumption &value)
+{
+    impl_->set_option_(value);
+}
+
 //void server::set_option_(notify_connection value)
 //{
 //    //TODO
@@ -275,10 +320,60 @@ void server::set_option_(internal_file_cache_keep_alive value)
     impl_->set_option_(value);
 }
 
+void server::set_option_(small_file_cache_size value)
+{
+    impl_->set_option_(value);
+}
+
+void server::set_option_(small_file_max_size value)
+{
+    impl_->set_option_(value);
+}
+
+void server::set_option_(const mime_types &value)
+{
+    impl_->set_option_(value);
+}
+
 void server::set_option_(not_found_handler_cb value)
 {
     impl_->set_option_(value);
 }
 
+void server::set_option_(transport value)
+{
+    impl_->set_option_(value);
+}
+
+void server::set_option_(handler_pool_size value)
+{
+    impl_->set_option_(value);
+}
+
+void server::set_option_(max_request_body_size value)
+{
+    impl_->set_option_(value);
+}
+
+void server::set_option_(request_deadline value)
+{
+    impl_->set_option_(value);
+}
+
+void server::set_option_(const request_deadline_header &value)
+{
+    impl_->set_option_(value);
+}
+
+void server::set_option_(const adaptive_concurrency_limit &value)
+{
+    impl_->set_option_(value);
+}
+
+void server::set_option_(const response_cache &value)
+{
+    impl_->set_option_(value);
+}
+
 
 } // namespace luna
@@ -21,6 +21,8 @@
 #include <microhttpd.h>
 #include <memory>
 #include <chrono>
+#include <map>
+#include <vector>
 
 namespace luna
 {
@@ -86,6 +88,31 @@ public:
 
     MAKE_LIKE(std::string, https_key_password);
 
+    // Serve HTTPS for many hostnames from one server, with the certificate for whichever name each client asks for
+    // (SNI). Each is a PEM certificate chain and its key; the names it's for are read from the certificate itself, and
+    // may be wildcards (*.example.com). Clients that ask for no name, or one that nothing matches, get https_mem_cert
+    // and https_mem_key if they were given, or else the first of these. Native transport only; see
+    // reload_https_certificates() for replacing them while serving.
+    struct https_certificate
+    {
+        std::string cert;
+        std::string key;
+        std::string key_password;
+    };
+
+    using https_certificates = std::vector<https_certificate>;
+
+    // Let HTTPS clients that reconnect resume their earlier session, which spares both sides the full handshake: by
+    // session ID, from an in-memory cache of up to cache_size sessions (zero for none), and with session tickets, whose
+    // keys are rotated every lifetime. A session can be resumed for up to lifetime after it began. Native transport
+    // only; resumption is on, with these defaults, unless this says otherwise.
+    struct tls_session_resumption
+    {
+        size_t cache_size{20480};
+        bool tickets{true};
+        std::chrono::seconds lifetime{std::chrono::hours{1}};
+    };
+
     MAKE_LIKE(std::string, server_identifier);
 
     using server_identifier_and_version = std::pair<std::string, std::string>;
@@ -96,8 +123,85 @@ public:
 
     using internal_file_cache_keep_alive = std::chrono::milliseconds;
 
+    // Files no bigger than small_file_max_size are read into memory the first time they're served, and the same
+    // response is shared by every request for them after that, for as long as the file doesn't change.
+    // small_file_cache_size is how much memory all of them together may take; zero turns this off.
+    MAKE_LIKE(size_t, small_file_cache_size);
+
+    MAKE_LIKE(size_t, small_file_max_size);
+
+    // Serve files with these extensions as these MIME types, as well as or instead of the built-in ones: say,
+    // mime_types{{"wgsl", "text/wgsl"}, {"log", "text/plain; charset=iso-8859-1"}}
+    using mime_types = std::map<std::string, std::string>;
+
     using not_found_handler_cb = std::function<void(const request &req, response &res)>;
 
+    // How long a request may take before its cancellation token trips, counted from when it arrived. Endpoints can
+    // override it with router::deadline. Zero (the default) means no deadline.
+    MAKE_LIKE(std::chrono::milliseconds, request_deadline);
+
+    // A request header through which clients may ask for a shorter deadline, in milliseconds. Never lengthens it.
+    MAKE_LIKE(std::string, request_deadline_header);
+
+    // Load shedding. Once more requests are in flight than the server is keeping up with, turn the rest away at once
+    // with a 503 and a Retry-After header, before their bodies are read or they're routed. The limit starts at
+    // initial_limit and adapts to how long handlers are taking, between min_limit and max_limit. Endpoints can set
+    // their priority with router::priority.
+    struct adaptive_concurrency_limit
+    {
+        unsigned int initial_limit{20};
+        unsigned int min_limit{4};
+        unsigned int max_limit{1000};
+        std::chrono::seconds retry_after{1};
+    };
+
+    // An in-process cache of the responses from endpoints that ask for it with router::cache_for, holding up to
+    // max_size bytes of them. Given a luna::cache::read and luna::cache::write pair (see luna::cache::build), it also
+    // shares responses with other servers through a store such as memcached or redis: misses in memory are looked for
+    // there, and new responses are written there in the background.
+    struct response_cache
+    {
+        response_cache() = default;
+
+        response_cache(std::pair<cache::read, cache::write> store) :
+                read{std::move(store.first)}, write{std::move(store.second)}
+        {}
+
+        size_t max_size{64 * 1024 * 1024};
+        cache::read read;
+        cache::write write;
+
+        // Instead of read and write: share responses with the other processes on this host that name the same file,
+        // which is memory-mapped, and shared_memory_size bytes long. Put it on a tmpfs such as /dev/shm.
+        std::string shared_memory_path;
+        size_t shared_memory_size{256 * 1024 * 1024};
+
+        // Also keep responses in a log file at persistent_path, of up to persistent_size bytes, so that they survive a
+        // restart: a server started with the same file reads back whatever hasn't expired, in the background, once
+        // it's started. Responses that aren't shared (because they depend on credentials) aren't kept there.
+        std::string persistent_path;
+        size_t persistent_size{1024 * 1024 * 1024};
+    };
+
+    // Which engine carries requests to and from the routers. NATIVE is Luna's own io_uring-based HTTP/1.1 server
+    // (Linux only). LOOPBACK opens no sockets at all; requests are handed to inject() and come straight back as
+    // responses.
+    enum class transport_kind
+    {
+        MICROHTTPD,
+        LOOPBACK,
+        NATIVE,
+    };
+
+    MAKE_LIKE(transport_kind, transport);
+
+    // The native transport runs request handlers on a pool of threads of their own, so that a slow handler doesn't hold
+    // up the other connections its worker is looking after. Zero (the default) means four per core.
+    MAKE_LIKE(unsigned int, handler_pool_size);
+
+    // The largest request body the native transport will take, in bytes; anything bigger is answered with 413 Payload
+    // Too Large before it has all arrived. 16MB by default.
+    MAKE_LIKE(size_t, max_request_body_size);
 
     server()
     {
@@ -133,6 +237,36 @@ public:
 
     explicit operator bool();
 
+    // Run a request through the routers in-process, without touching the network, and return the response that would
+    // have been sent. Works whichever transport is in use; file responses come back with the file contents as content.
+    response inject(request request);
+
+    // Drop responses from the response cache: those tagged with tag (by their Surrogate-Key header, a space-separated
+    // list of tags), every response for path whatever its query parameters, the response for path with exactly these
+    // parameters, or every response for a path beginning with prefix. Each returns how many responses were dropped.
+    // Purging only reaches this server's memory and the copies it wrote to a shared store.
+    size_t purge_cached_tag(const std::string &tag);
+
+    size_t purge_cached_path(const std::string &path);
+
+    size_t purge_cached_request(const std::string &path, const query_params &params);
+
+    size_t purge_cached_prefix(const std::string &prefix);
+
+    // How many HTTPS handshakes the native transport has finished since it started: full ones, and ones that resumed an
+    // earlier session (see tls_session_resumption)
+    struct tls_handshake_counts
+    {
+        uint64_t full;
+        uint64_t resumed;
+    };
+
+    tls_handshake_counts tls_handshakes();
+
+    // Swap in a new set of https_certificates, say once some have been renewed, without restarting: handshakes already
+    // under way finish with the old ones. False, leaving the old ones in place, if any of them won't load.
+    bool reload_https_certificates(const https_certificates &certificates);
+
 private:
     class server_impl;
 
@@ -215,6 +349,10 @@ private:
 
     void set_option_(const https_key_password &value);
 
+    void set_option_(const https_certificates &value);
+
+    void set_option_(const tls_session_resumption &value);
+
 //    void set_option_(notify_connection value); //TODO later
 
     void set_option_(const server_identifier &value);
@@ -227,8 +365,29 @@ private:
 
     void set_option_(internal_file_cache_keep_alive value);
 
+    void set_option_(small_file_cache_size value);
+
+    void set_option_(small_file_max_size value);
+
+    void set_option_(const mime_types &value);
+
     // Allow custom 404 handlers
     void set_option_(not_found_handler_cb value);
+
+    void set_option_(transport value);
+
+    void set_option_(handler_pool_size value);
+
+    void set_option_(max_request_body_size value);
+
+    // request deadlines
+    void set_option_(request_deadline value);
+
+    void set_option_(const request_deadline_header &value);
+
+    void set_option_(const adaptive_concurrency_limit &value);
+
+    void set_option_(const response_cache &value);
 };
 
 } //namespace luna
@@ -13,8 +13,13 @@
 //
 
 #include "types.h"
-#include <regex>
+#include <cctype>
+#include <cstring>
+#include <strings.h>
 #include <base64/base64.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 
 namespace luna
 {
@@ -27,6 +32,8 @@ std::string to_string(const authorization_kind kind)
     {
         case authorization_kind::BASIC:
             return "Basic";
+        case authorization_kind::BEARER:
+            return "Bearer";
         default:
             return "";
     }
@@ -60,37 +67,317 @@ bool case_insensitive_comp_::operator()(const std::string &a, const std::string
     return strcasecmp(a.c_str(), b.c_str()) < 0;
 }
 
+// Checks that an Authorization header value is of the form "<scheme> <credentials>", and returns the offset of the
+// credentials, or std::string::npos if it isn't. Schemes are case-insensitive, per RFC 7235
+static size_t credentials_offset_(const std::string &header, const char *scheme)
+{
+    auto scheme_length = strlen(scheme);
+    if (header.length() <= scheme_length || strncasecmp(header.c_str(), scheme, scheme_length) != 0)
+    {
+        return std::string::npos;
+    }
+
+    auto pos = scheme_length;
+    if (header[pos] != ' ')
+    {
+        return std::string::npos;
+    }
+    while (pos < header.length() && header[pos] == ' ')
+    {
+        ++pos;
+    }
+
+    return (pos < header.length()) ? pos : std::string::npos;
+}
+
 basic_authorization get_basic_authorization(const request_headers &headers)
 {
     // First, find the headers
-    if (0 == headers.count("Authorization"))
+    auto header = headers.find("Authorization");
+    if (header == headers.end())
     {
         return {false};
     }
 
     // Ensure that the header is of the form "Basic abc", and extract the encoded bit
-    std::regex basic_regex(R"(Basic ([a-zA-Z0-9\+\/=]+))"); // We should look into also accepting RFC 4648
-    std::smatch basic_match;
-    if (!std::regex_match(headers.at("Authorization"), basic_match, basic_regex) || (basic_match.size() != 2))
+    auto offset = credentials_offset_(header->second, "Basic");
+    if (offset == std::string::npos)
     {
         return {false};
     }
 
-    // The first sub_match is the whole string; the next
-    // sub_match is the first parenthesized expression.
-    std::string userpass = base64_decode(basic_match[1].str());
+    // We should look into also accepting RFC 4648
+    const auto &value = header->second;
+    for (auto i = offset; i < value.length(); ++i)
+    {
+        auto c = value[i];
+        if (!(isalnum(static_cast<unsigned char>(c)) || c == '+' || c == '/' || c == '='))
+        {
+            return {false};
+        }
+    }
+
+    std::string userpass = base64_decode(value.substr(offset));
 
     // We have a string of the form, probably, of username:password. Let's extract the username and password
-    std::regex userpass_regex("(.*?):(.*)");
-    std::smatch userpass_match;
-    if (!std::regex_match(userpass, userpass_match, userpass_regex) || (userpass_match.size() != 3))
+    auto colon = userpass.find(':');
+    if (colon == std::string::npos)
     {
         return {false};
     }
 
-    // extract username and password
+    return {true, userpass.substr(0, colon), userpass.substr(colon + 1)};
+}
+
+bearer_authorization get_bearer_authorization(const request_headers &headers)
+{
+    auto header = headers.find("Authorization");
+    if (header == headers.end())
+    {
+        return {false};
+    }
 
-    return {true, userpass_match[1].str(), userpass_match[2].str()};
+    auto offset = credentials_offset_(header->second, "Bearer");
+    if (offset == std::string::npos)
+    {
+        return {false};
+    }
+
+    // RFC 6750 b64token: ALPHA / DIGIT / "-" / "." / "_" / "~" / "+" / "/", followed by any number of "="
+    const auto &value = header->second;
+    auto i = offset;
+    while (i < value.length())
+    {
+        auto c = value[i];
+        if (!(isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '.' || c == '_' || c == '~' || c == '+' ||
+              c == '/'))
+        {
+            break;
+        }
+        ++i;
+    }
+    if (i == offset)
+    {
+        return {false};
+    }
+    while (i < value.length() && value[i] == '=')
+    {
+        ++i;
+    }
+    if (i != value.length())
+    {
+        return {false};
+    }
+
+    return {true, value.substr(offset)};
 }
 
+struct cancellation_token::state
+{
+    std::atomic<bool> cancelled{false};
+    std::atomic<clock::rep> deadline{clock::time_point::max().time_since_epoch().count()};
+    std::atomic<clock::rep> limit{clock::time_point::max().time_since_epoch().count()};
+
+    std::mutex lock;
+    std::vector<std::function<void()>> callbacks;
+};
+
+cancellation_token::cancellation_token() : state_{std::make_shared<state>()}
+{}
+
+void cancellation_token::cancel()
+{
+    std::vector<std::function<void()>> callbacks;
+    {
+        std::lock_guard<std::mutex> guard{state_->lock};
+        if (state_->cancelled.exchange(true))
+        {
+            return;
+        }
+        std::swap(callbacks, state_->callbacks);
+    }
+
+    for (const auto &callback : callbacks)
+    {
+        callback();
+    }
+}
+
+bool cancellation_token::is_cancelled() const
+{
+    return state_->cancelled || clock::now() >= deadline();
+}
+
+cancellation_token::clock::time_point cancellation_token::deadline() const
+{
+    return clock::time_point{clock::duration{std::min(state_->deadline.load(), state_->limit.load())}};
+}
+
+std::chrono::milliseconds cancellation_token::remaining() const
+{
+    auto now = clock::now();
+    auto until = deadline();
+    if (until <= now)
+    {
+        return std::chrono::milliseconds{0};
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(until - now);
+}
+
+void cancellation_token::set_deadline(clock::time_point deadline)
+{
+    state_->deadline = deadline.time_since_epoch().count();
+}
+
+void cancellation_token::limit_deadline(clock::time_point limit)
+{
+    state_->limit = std::min(state_->limit.load(), limit.time_since_epoch().count());
+}
+
+void cancellation_token::on_cancel(std::function<void()> f)
+{
+    {
+        std::lock_guard<std::mutex> guard{state_->lock};
+        if (!state_->cancelled)
+        {
+            state_->callbacks.emplace_back(std::move(f));
+            return;
+        }
+    }
+    f();
+}
+
+cancellation_token::clock::time_point cancellation_token::to_clock(std::chrono::system_clock::time_point time)
+{
+    return clock::now() - std::chrono::duration_cast<clock::duration>(std::chrono::system_clock::now() - time);
+}
+
+namespace parameter
+{
+
+typed_validation_function integer(int64_t min, int64_t max)
+{
+    return [min, max](const std::string &a, value &parsed) -> bool
+    {
+        auto c = a.c_str();
+        auto end = c + a.length();
+
+        bool negative{false};
+        if (c != end && (*c == '-' || *c == '+'))
+        {
+            negative = (*c == '-');
+            ++c;
+        }
+        if (c == end)
+        {
+            return false;
+        }
+
+        // accumulate as a negative number, which has room for INT64_MIN
+        int64_t result{0};
+        for (; c != end; ++c)
+        {
+            if (*c < '0' || *c > '9')
+            {
+                return false;
+            }
+            int64_t digit = *c - '0';
+            if (result < (INT64_MIN + digit) / 10)
+            {
+                return false; // overflow
+            }
+            result = result * 10 - digit;
+        }
+        if (!negative)
+        {
+            if (result == INT64_MIN)
+            {
+                return false;
+            }
+            result = -result;
+        }
+
+        if (result < min || result > max)
+        {
+            return false;
+        }
+
+        parsed.integer = result;
+        return true;
+    };
+}
+
+typed_validation_function one_of(std::vector<std::string> options)
+{
+    return [options](const std::string &a, value &parsed) -> bool
+    {
+        for (size_t i = 0; i < options.size(); ++i)
+        {
+            if (options[i] == a)
+            {
+                parsed.index = i;
+                return true;
+            }
+        }
+        return false;
+    };
+}
+
+static int hex_digit_(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+typed_validation_function uuid()
+{
+    return [](const std::string &a, value &parsed) -> bool
+    {
+        // xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx
+        if (a.length() != 36)
+        {
+            return false;
+        }
+
+        std::array<uint8_t, 16> bytes;
+        size_t byte{0};
+        for (size_t i = 0; i < a.length();)
+        {
+            if (i == 8 || i == 13 || i == 18 || i == 23)
+            {
+                if (a[i] != '-')
+                {
+                    return false;
+                }
+                ++i;
+                continue;
+            }
+
+            auto high = hex_digit_(a[i]);
+            auto low = hex_digit_(a[i + 1]);
+            if (high < 0 || low < 0)
+            {
+                return false;
+            }
+            bytes[byte++] = static_cast<uint8_t>((high << 4) | low);
+            i += 2;
+        }
+
+        parsed.uuid = bytes;
+        return true;
+    };
+}
+
+validation_function length(size_t min, size_t max)
+{
+    return [min, max](const std::string &a) -> bool
+    {
+        return (a.length() >= min) && (a.length() <= max);
+    };
+}
+
+} //namespace parameter
+
 } //namespace luna
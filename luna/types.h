@@ -17,8 +17,11 @@
 #include <string>
 #include <regex>
 #include <map>
+#include <array>
+#include <vector>
 #include <chrono>
 #include <functional>
+#include <memory>
 #include <stdint.h>
 
 
@@ -60,13 +63,25 @@ struct basic_authorization
     std::string password;
     explicit operator bool() {return present_;}
     basic_authorization(bool present) : present_{present} {}
-    basic_authorization(bool present, const std::string &user, const std::string &pass) : present_{present}, username{user}, password{pass} {}
+    basic_authorization(bool present, const std::string &user, const std::string &pass) : username{user}, password{pass}, present_{present} {}
 private:
     bool present_;
 };
 
 basic_authorization get_basic_authorization(const request_headers &headers);
 
+struct bearer_authorization
+{
+    std::string token;
+    explicit operator bool() {return present_;}
+    bearer_authorization(bool present) : present_{present} {}
+    bearer_authorization(bool present, const std::string &token) : token{token}, present_{present} {}
+private:
+    bool present_;
+};
+
+bearer_authorization get_bearer_authorization(const request_headers &headers);
+
 
 enum class request_method
 {
@@ -83,6 +98,62 @@ enum class request_method
 
 std::string to_string(const luna::request_method method);
 
+namespace parameter
+{
+
+// The parsed form of a query parameter that passed one of the typed validators below, so that request handlers don't
+// have to parse it all over again. Only the field that matches the validator is meaningful.
+struct value
+{
+    int64_t integer{0};              // parameter::integer
+    size_t index{0};                 // parameter::one_of, the position of the matching option
+    std::array<uint8_t, 16> uuid{}; // parameter::uuid
+};
+
+using values = std::map<std::string, value>;
+
+} //namespace parameter
+
+// Tells a request handler, and anything it hands work off to, that the work is no longer wanted: the client went
+// away, or the request ran past its deadline. Copies share their state, so async work can hold on to a copy and
+// check it (or be called back) long after the handler has returned. Cancellation is cooperative; nothing is
+// interrupted, so long-running handlers should check is_cancelled() at convenient points.
+class cancellation_token
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    cancellation_token();
+
+    void cancel();
+
+    // cancelled outright, or past the deadline
+    bool is_cancelled() const;
+
+    // clock::time_point::max() when there is no deadline
+    clock::time_point deadline() const;
+
+    // how long until the deadline, or zero once it has passed. Only meaningful when there is a deadline.
+    std::chrono::milliseconds remaining() const;
+
+    void set_deadline(clock::time_point deadline);
+
+    // Whatever set_deadline() says, the deadline will never be later than this. Used for deadlines that come from the
+    // client, which may shorten the server's own but never lengthen it.
+    void limit_deadline(clock::time_point limit);
+
+    // Call f when cancel() is called, on whichever thread calls it, or straight away if that has already happened.
+    // Passing the deadline doesn't call anything; there is no timer behind it.
+    void on_cancel(std::function<void()> f);
+
+    // The same moment as a wall-clock time point, such as request::start, on the clock deadlines are kept on
+    static clock::time_point to_clock(std::chrono::system_clock::time_point time);
+
+private:
+    struct state;
+    std::shared_ptr<state> state_;
+};
+
 struct request
 {
     std::chrono::system_clock::time_point start;
@@ -95,6 +166,8 @@ struct request
     query_params params;
     request_headers headers;
     std::string body;
+    parameter::values parsed_params;
+    cancellation_token cancellation;
 };
 
 
@@ -178,6 +251,7 @@ struct response
 enum class authorization_kind
 {
     BASIC =0,
+    BEARER,
 };
 
 std::string to_string(const authorization_kind kind);
@@ -192,29 +266,40 @@ namespace parameter
 {
 
 // default validators
-auto any = [](const std::string &a) -> bool
+static const auto any = [](const std::string &a) -> bool
 {
     return true;
 };
 
-auto match = [](const std::string &a, const std::string &b) -> bool
+static const auto match = [](const std::string &a, const std::string &b) -> bool
 {
     return a == b;
 };
 
-auto number = [](const std::string &a) -> bool
+static const auto number = [](const std::string &a) -> bool
 {
-    return std::regex_match(a, std::regex{"\\d+"});
+    if (a.empty())
+    {
+        return false;
+    }
+    for (const auto c : a)
+    {
+        if (c < '0' || c > '9')
+        {
+            return false;
+        }
+    }
+    return true;
 };
 
-auto regex = [](const std::string &a, const std::regex &r) -> bool
+static const auto regex = [](const std::string &a, const std::regex &r) -> bool
 {
     return std::regex_search(a, r);
 };
 
-auto validate = [](auto validator, auto ...rest)
+static const auto validate = [](auto validator, auto ...rest)
 {
-    return [=](std::string to_validate) -> bool
+    return [=](const std::string &to_validate) -> bool
     {
         return validator(to_validate, rest...);
     };
@@ -223,16 +308,34 @@ auto validate = [](auto validator, auto ...rest)
 const bool optional = false;
 const bool required = true;
 
-using validation_function = std::function<bool(std::string)>;
+using validation_function = std::function<bool(const std::string &)>;
+
+// Typed validators check a parameter and parse it in one go, storing the result in request::parsed_params
+using typed_validation_function = std::function<bool(const std::string &, value &)>;
+
+// A decimal integer, optionally signed, within [min, max]
+typed_validation_function integer(int64_t min = INT64_MIN, int64_t max = INT64_MAX);
+
+// One of a fixed set of strings; value::index holds the position of the one that matched
+typed_validation_function one_of(std::vector<std::string> options);
+
+// A UUID in the canonical 8-4-4-4-12 hex form; value::uuid holds its bytes
+typed_validation_function uuid();
+
+// A string between min and max bytes long, inclusive. There's nothing to parse, so this one is a plain validator.
+validation_function length(size_t min, size_t max);
 
 struct validator
 {
     std::string key;
     bool required;
     validation_function validation_func;
+    typed_validation_function typed_validation_func;
 
     validator(std::string &&key, bool required, validation_function validation_func=any) : key{std::move(key)}, required{required}, validation_func{validation_func} {};
     validator(const std::string &key, bool required, validation_function validation_func=any) : key{key}, required{required}, validation_func{validation_func} {};
+    validator(std::string &&key, bool required, typed_validation_function typed_validation_func) : key{std::move(key)}, required{required}, typed_validation_func{typed_validation_func} {};
+    validator(const std::string &key, bool required, typed_validation_function typed_validation_func) : key{key}, required{required}, typed_validation_func{typed_validation_func} {};
 
 };
 
@@ -70,6 +70,45 @@ TEST(basic_auth, helper_fail_4)
     ASSERT_FALSE(static_cast<bool>(auth));
 }
 
+TEST(basic_auth, helper_fail_5)
+{
+    luna::headers header{{"Authorization", "Bearer dXNlcjpwYXNz"}};
+    auto auth = luna::get_basic_authorization(header);
+    ASSERT_FALSE(static_cast<bool>(auth));
+}
+
+TEST(basic_auth, helper_scheme_is_case_insensitive)
+{
+    luna::headers header{{"Authorization", "basic dXNlcjpwYXNz"}};
+    auto auth = luna::get_basic_authorization(header);
+    ASSERT_TRUE(static_cast<bool>(auth));
+    ASSERT_EQ("user", auth.username);
+    ASSERT_EQ("pass", auth.password);
+}
+
+TEST(bearer_auth, helper_just_work)
+{
+    luna::headers header{{"Authorization", "Bearer mF_9.B5f-4.1JqM"}};
+    auto auth = luna::get_bearer_authorization(header);
+    ASSERT_TRUE(static_cast<bool>(auth));
+    ASSERT_EQ("mF_9.B5f-4.1JqM", auth.token);
+}
+
+TEST(bearer_auth, helper_fail)
+{
+    luna::headers header_1{{"Authorization", "Bearer "}};
+    ASSERT_FALSE(static_cast<bool>(luna::get_bearer_authorization(header_1)));
+
+    luna::headers header_2{{"Authorization", "Bearer abc def"}};
+    ASSERT_FALSE(static_cast<bool>(luna::get_bearer_authorization(header_2)));
+
+    luna::headers header_3{{"Authorization", "Basic dXNlcjpwYXNz"}};
+    ASSERT_FALSE(static_cast<bool>(luna::get_bearer_authorization(header_3)));
+
+    luna::headers header_4{{"Authorization", "Bearer ab=c"}};
+    ASSERT_FALSE(static_cast<bool>(luna::get_bearer_authorization(header_4)));
+}
+
 TEST(basic_auth, work_with_auth)
 {
     std::string username{"foo"}, password{"bar"};
@@ -175,3 +214,68 @@ TEST(basic_auth, fail_with_401_badpass)
     ASSERT_EQ(401, res.status_code);
     ASSERT_EQ("Basic realm=\"password\"", res.header["WWW-Authenticate"]);
 }
+
+TEST(basic_auth, router_requires_auth)
+{
+    std::string username{"foo"}, password{"bar"};
+    int verifications{0};
+
+    luna::server server;
+    auto router = server.create_router("/");
+    router->require_basic_authorization("realm", [&](const std::string &user, const std::string &pass) -> bool
+    {
+        ++verifications;
+        return user == username && pass == password;
+    });
+    router->handle_request(luna::request_method::GET,
+                           "/test",
+                           [=](auto req) -> luna::response
+                           {
+                               return {"hello"};
+                           });
+
+    server.start_async();
+
+    auto res = cpr::Get(cpr::Url{"http://localhost:8080/test"});
+    ASSERT_EQ(401, res.status_code);
+    ASSERT_EQ("Basic realm=\"realm\"", res.header["WWW-Authenticate"]);
+
+    res = cpr::Get(cpr::Url{"http://localhost:8080/test"}, cpr::Authentication{username, "NOPE"});
+    ASSERT_EQ(401, res.status_code);
+    ASSERT_EQ(1, verifications);
+
+    res = cpr::Get(cpr::Url{"http://localhost:8080/test"}, cpr::Authentication{username, password});
+    ASSERT_EQ(200, res.status_code);
+    ASSERT_EQ("hello", res.text);
+    ASSERT_EQ(2, verifications);
+
+    // verified credentials are cached
+    res = cpr::Get(cpr::Url{"http://localhost:8080/test"}, cpr::Authentication{username, password});
+    ASSERT_EQ(200, res.status_code);
+    ASSERT_EQ(2, verifications);
+}
+
+TEST(bearer_auth, router_requires_auth)
+{
+    luna::server server;
+    auto router = server.create_router("/");
+    router->require_bearer_authorization("realm", [](const std::string &token) -> bool
+    {
+        return token == "s3cr3t";
+    });
+    router->handle_request(luna::request_method::GET,
+                           "/test",
+                           [=](auto req) -> luna::response
+                           {
+                               return {"hello"};
+                           });
+
+    server.start_async();
+
+    auto res = cpr::Get(cpr::Url{"http://localhost:8080/test"}, cpr::Header{{"Authorization", "Bearer nope"}});
+    ASSERT_EQ(401, res.status_code);
+    ASSERT_EQ("Bearer realm=\"realm\"", res.header["WWW-Authenticate"]);
+
+    res = cpr::Get(cpr::Url{"http://localhost:8080/test"}, cpr::Header{{"Authorization", "Bearer s3cr3t"}});
+    ASSERT_EQ(200, res.status_code);
+}
@@ -0,0 +1,216 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "test_helpers.h"
+#include <atomic>
+#include <thread>
+
+TEST(bulkhead, rejects_over_the_cap)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+
+    gate gate;
+    luna::router::bulkhead bulkhead;
+    bulkhead.max_concurrent = 1;
+    bulkhead.retry_after = std::chrono::seconds{3};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/report", [&gate](const luna::request &req) -> luna::response
+    {
+        gate.wait();
+        return {"report"};
+    }, {}, bulkhead);
+    router->handle_request(luna::request_method::GET, "/lookup", [](const luna::request &req) -> luna::response
+    {
+        return {"lookup"};
+    });
+    server.start_async();
+
+    std::thread client{[&server]
+                       {
+                           ASSERT_EQ("report", server.inject(make_request_("/report")).content);
+                       }};
+    gate.wait_for_waiters(1);
+
+    auto res = server.inject(make_request_("/report"));
+    ASSERT_EQ(503, res.status_code);
+    ASSERT_EQ("3", res.headers["Retry-After"]);
+
+    // other endpoints aren't affected
+    ASSERT_EQ("lookup", server.inject(make_request_("/lookup")).content);
+
+    gate.open();
+    client.join();
+    ASSERT_EQ("report", server.inject(make_request_("/report")).content);
+}
+
+TEST(bulkhead, queues_for_a_bounded_time)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+
+    gate gate;
+    luna::router::bulkhead bulkhead;
+    bulkhead.max_concurrent = 1;
+    bulkhead.max_queued = 1;
+    bulkhead.max_wait = std::chrono::seconds{10};
+    std::atomic<int> calls{0};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/report",
+                           [&gate, &calls](const luna::request &req) -> luna::response
+                           {
+                               if (calls++ == 0)
+                               {
+                                   gate.wait();
+                               }
+                               return {"report"};
+                           }, {}, bulkhead);
+    server.start_async();
+
+    std::thread first{[&server]
+                      {
+                          ASSERT_EQ("report", server.inject(make_request_("/report")).content);
+                      }};
+    gate.wait_for_waiters(1);
+
+    // the second waits its turn, and the third finds the queue full
+    std::thread second{[&server]
+                       {
+                           ASSERT_EQ("report", server.inject(make_request_("/report")).content);
+                       }};
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    ASSERT_EQ(503, server.inject(make_request_("/report")).status_code);
+
+    gate.open();
+    first.join();
+    second.join();
+    ASSERT_EQ(2, calls);
+
+    // and a request that can't get in before max_wait gives up
+    bulkhead.max_wait = std::chrono::milliseconds{20};
+    luna::server other{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+    ::gate closed;
+    auto other_router = other.create_router("/");
+    other_router->handle_request(luna::request_method::GET, "/impatient",
+                                 [&closed](const luna::request &req) -> luna::response
+                                 {
+                                     closed.wait();
+                                     return {"impatient"};
+                                 }, {}, bulkhead);
+    other.start_async();
+    std::thread holder{[&other]
+                       {
+                           ASSERT_EQ("impatient", other.inject(make_request_("/impatient")).content);
+                       }};
+    closed.wait_for_waiters(1);
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(503, other.inject(make_request_("/impatient")).status_code);
+    ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds{20});
+    closed.open();
+    holder.join();
+}
+
+TEST(bulkhead, per_router)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+
+    gate gate;
+    luna::router::bulkhead bulkhead;
+    bulkhead.max_concurrent = 2;
+    auto reports = server.create_router("/reports");
+    reports->set_bulkhead(bulkhead);
+    reports->handle_request(luna::request_method::GET, "/slow", [&gate](const luna::request &req) -> luna::response
+    {
+        gate.wait();
+        return {"slow"};
+    });
+    reports->handle_request(luna::request_method::GET, "/fast", [](const luna::request &req) -> luna::response
+    {
+        return {"fast"};
+    });
+    auto api = server.create_router("/api");
+    api->handle_request(luna::request_method::GET, "/lookup", [](const luna::request &req) -> luna::response
+    {
+        return {"lookup"};
+    });
+    server.start_async();
+
+    std::vector<std::thread> clients;
+    for (int i = 0; i < 2; ++i)
+    {
+        clients.emplace_back([&server]
+                             {
+                                 ASSERT_EQ("slow", server.inject(make_request_("/reports/slow")).content);
+                             });
+    }
+    gate.wait_for_waiters(2);
+
+    // the whole router is full, but only that router
+    ASSERT_EQ(503, server.inject(make_request_("/reports/fast")).status_code);
+    ASSERT_EQ("lookup", server.inject(make_request_("/api/lookup")).content);
+
+    gate.open();
+    for (auto &client : clients)
+    {
+        client.join();
+    }
+    ASSERT_EQ("fast", server.inject(make_request_("/reports/fast")).content);
+}
+
+TEST(bulkhead, own_threads)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+
+    gate gate;
+    std::atomic<bool> saw_cancellation{false};
+    std::atomic<bool> finished{false};
+    luna::router::bulkhead bulkhead;
+    bulkhead.max_concurrent = 1;
+    bulkhead.own_threads = true;
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/thread", [](const luna::request &req) -> luna::response
+    {
+        return {"thread"};
+    }, {}, bulkhead);
+    router->handle_request(luna::request_method::GET, "/stuck",
+                           [&](const luna::request &req) -> luna::response
+                           {
+                               gate.wait();
+                               saw_cancellation = req.cancellation.is_cancelled();
+                               finished = true;
+                               return {"stuck"};
+                           }, {}, bulkhead, luna::router::deadline{std::chrono::milliseconds{20}});
+    router->handle_request(luna::request_method::GET, "/throws", [](const luna::request &req) -> luna::response
+    {
+        throw std::runtime_error{"oops"};
+    }, {}, bulkhead);
+    server.start_async();
+
+    ASSERT_EQ("thread", server.inject(make_request_("/thread")).content);
+    ASSERT_EQ(500, server.inject(make_request_("/throws")).status_code);
+
+    // a handler that overruns its deadline doesn't hold up the thread that's waiting for it...
+    auto res = server.inject(make_request_("/stuck"));
+    ASSERT_EQ(503, res.status_code);
+
+    // ...but it still holds its place in the bulkhead
+    ASSERT_EQ(503, server.inject(make_request_("/stuck")).status_code);
+
+    gate.open();
+    while (!finished)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    ASSERT_TRUE(saw_cancellation);
+}
@@ -0,0 +1,160 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "test_helpers.h"
+#include <thread>
+
+// reports what the handler could see of its own deadline
+static luna::response report_deadline_(const luna::request &req)
+{
+    if (req.cancellation.deadline() == luna::cancellation_token::clock::time_point::max())
+    {
+        return {"none"};
+    }
+    return {std::to_string(req.cancellation.remaining().count())};
+}
+
+TEST(cancellation, token)
+{
+    luna::cancellation_token token;
+    ASSERT_FALSE(token.is_cancelled());
+    ASSERT_EQ(luna::cancellation_token::clock::time_point::max(), token.deadline());
+
+    int called = 0;
+    token.on_cancel([&called]
+                    { ++called; });
+
+    auto copy = token;
+    copy.cancel();
+    ASSERT_TRUE(token.is_cancelled());
+    ASSERT_EQ(1, called);
+
+    copy.cancel(); // only once
+    ASSERT_EQ(1, called);
+
+    token.on_cancel([&called]
+                    { ++called; }); // already cancelled, so straight away
+    ASSERT_EQ(2, called);
+}
+
+TEST(cancellation, token_deadline)
+{
+    luna::cancellation_token token;
+    auto now = luna::cancellation_token::clock::now();
+
+    token.set_deadline(now + std::chrono::hours{1});
+    ASSERT_FALSE(token.is_cancelled());
+    ASSERT_GT(token.remaining(), std::chrono::minutes{59});
+
+    // a limit only ever shortens the deadline, even if it's set again afterwards
+    token.limit_deadline(now + std::chrono::minutes{1});
+    token.set_deadline(now + std::chrono::hours{2});
+    ASSERT_LE(token.remaining(), std::chrono::minutes{1});
+    token.limit_deadline(now + std::chrono::hours{3});
+    ASSERT_LE(token.remaining(), std::chrono::minutes{1});
+
+    token.set_deadline(now - std::chrono::milliseconds{1});
+    ASSERT_TRUE(token.is_cancelled());
+    ASSERT_EQ(0, token.remaining().count());
+}
+
+TEST(cancellation, server_default_deadline)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        luna::server::request_deadline{std::chrono::milliseconds{5000}}};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/default", report_deadline_);
+    router->handle_request(luna::request_method::GET, "/longer", report_deadline_, {},
+                           luna::router::deadline{std::chrono::milliseconds{60000}});
+    router->handle_request(luna::request_method::GET, "/none", report_deadline_, {},
+                           luna::router::deadline{std::chrono::milliseconds{0}});
+    server.start_async();
+
+    auto res = server.inject(make_request_("/default"));
+    ASSERT_EQ(200, res.status_code);
+    auto remaining = std::stol(res.content);
+    ASSERT_GT(remaining, 4000);
+    ASSERT_LE(remaining, 5000);
+
+    res = server.inject(make_request_("/longer"));
+    ASSERT_GT(std::stol(res.content), 50000);
+
+    res = server.inject(make_request_("/none"));
+    ASSERT_EQ("none", res.content);
+}
+
+TEST(cancellation, deadline_header)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        luna::server::request_deadline{std::chrono::milliseconds{5000}},
+                        luna::server::request_deadline_header{"X-Request-Timeout"}};
+    auto router = server.create_router("/");
+    bool ran = false;
+    router->handle_request(luna::request_method::GET, "/test", [&ran](const luna::request &req)
+    {
+        ran = true;
+        return report_deadline_(req);
+    });
+    server.start_async();
+
+    // a request's token is shared by its copies, so each of these needs a fresh request
+    auto req = make_request_("/test");
+    req.headers["X-Request-Timeout"] = "1000";
+    auto res = server.inject(req);
+    ASSERT_LE(std::stol(res.content), 1000);
+
+    // clients can't ask for more time than the server allows
+    req = make_request_("/test");
+    req.headers["X-Request-Timeout"] = "100000";
+    res = server.inject(req);
+    ASSERT_LE(std::stol(res.content), 5000);
+
+    req = make_request_("/test");
+    req.headers["X-Request-Timeout"] = "soon";
+    res = server.inject(req);
+    ASSERT_GT(std::stol(res.content), 1000);
+
+    // already out of time, so the handler isn't run at all
+    ran = false;
+    req = make_request_("/test");
+    req.headers["X-Request-Timeout"] = "0";
+    res = server.inject(req);
+    ASSERT_EQ(503, res.status_code);
+    ASSERT_FALSE(ran);
+}
+
+TEST(cancellation, cooperative_handler)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/slow", [](const luna::request &req) -> luna::response
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            if (req.cancellation.is_cancelled())
+            {
+                return {503, "gave up after " + std::to_string(i)};
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+        return {"finished"};
+    }, {}, luna::router::deadline{std::chrono::milliseconds{50}});
+    server.start_async();
+
+    auto res = server.inject(make_request_("/slow"));
+    ASSERT_EQ(503, res.status_code);
+    ASSERT_NE("finished", res.content);
+}
@@ -0,0 +1,238 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "test_helpers.h"
+#include <cpr/cpr.h>
+#include <atomic>
+#include <thread>
+
+TEST(coalescing, identical_requests_share_a_response)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+
+    gate gate;
+    std::atomic<int> calls{0};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/popular",
+                           [&gate, &calls](const luna::request &req) -> luna::response
+                           {
+                               auto call = ++calls;
+                               gate.wait();
+                               return {"call " + std::to_string(call)};
+                           }, {}, luna::router::coalesce{});
+    server.start_async();
+
+    std::vector<std::thread> clients;
+    for (int i = 0; i < 8; ++i)
+    {
+        clients.emplace_back([&server]
+                             {
+                                 auto res = server.inject(make_request_("/popular", {{"ignored", "x"}}));
+                                 ASSERT_EQ(200, res.status_code);
+                                 ASSERT_EQ("call 1", res.content);
+                             });
+    }
+    gate.wait_for_waiters(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds{100}); // long enough for everyone to join
+    gate.open();
+    for (auto &client : clients)
+    {
+        client.join();
+    }
+    ASSERT_EQ(1, calls);
+
+    // once it has landed, the next request runs the handler again
+    ASSERT_EQ("call 2", server.inject(make_request_("/popular")).content);
+}
+
+TEST(coalescing, waits_end_at_the_deadline)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        luna::server::request_deadline{std::chrono::milliseconds{200}}};
+
+    gate gate;
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/popular",
+                           [&gate](const luna::request &req) -> luna::response
+                           {
+                               gate.wait();
+                               return {"done"};
+                           }, {}, luna::router::coalesce{});
+    server.start_async();
+
+    auto inject = [&server]
+    {
+        auto req = make_request_("/popular");
+        req.start = std::chrono::system_clock::now();
+        return server.inject(req);
+    };
+    std::thread leader{[&inject]
+                       {
+                           ASSERT_EQ("done", inject().content);
+                       }};
+    gate.wait_for_waiters(1);
+
+    // the leader is still going when the follower's time is up
+    auto res = inject();
+    ASSERT_EQ(503, res.status_code);
+    ASSERT_EQ("Request deadline exceeded", res.content);
+
+    gate.open();
+    leader.join();
+}
+
+TEST(coalescing, waits_end_when_the_server_stops)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+
+    gate gate;
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/popular",
+                           [&gate](const luna::request &req) -> luna::response
+                           {
+                               gate.wait();
+                               return {"done"};
+                           }, {}, luna::router::coalesce{});
+    server.start_async();
+
+    std::thread leader{[&server]
+                       {
+                           ASSERT_EQ("done", server.inject(make_request_("/popular")).content);
+                       }};
+    gate.wait_for_waiters(1);
+    std::thread follower{[&server]
+                         {
+                             ASSERT_EQ(503, server.inject(make_request_("/popular")).status_code);
+                         }};
+    std::this_thread::sleep_for(std::chrono::milliseconds{100}); // long enough to join
+
+    server.stop();
+    follower.join(); // without waiting for the leader
+    gate.open();
+    leader.join();
+}
+
+TEST(coalescing, key)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+
+    gate gate;
+    std::atomic<int> calls{0};
+    luna::router::coalesce coalesce;
+    coalesce.params = {"id"};
+    coalesce.headers = {"Accept-Language"};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/item",
+                           [&gate, &calls](const luna::request &req) -> luna::response
+                           {
+                               ++calls;
+                               gate.wait();
+                               return {req.params.at("id")};
+                           }, {}, coalesce);
+    server.start_async();
+
+    std::vector<std::thread> clients;
+    for (auto id : {"1", "2"})
+    {
+        for (auto language : {"en", "fr"})
+        {
+            clients.emplace_back([&server, id, language]
+                                 {
+                                     auto res = server.inject(make_request_("/item", {{"id", id}},
+                                                                            {{"Accept-Language", language}}));
+                                     ASSERT_EQ(id, res.content);
+                                 });
+        }
+    }
+    gate.wait_for_waiters(4);
+    gate.open();
+    for (auto &client : clients)
+    {
+        client.join();
+    }
+    ASSERT_EQ(4, calls);
+}
+
+TEST(coalescing, credentials_are_part_of_the_key)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+
+    gate gate;
+    auto router = server.create_router("/");
+    router->require_bearer_authorization("test", [](const std::string &token)
+    {
+        return token == "secret";
+    });
+    router->handle_request(luna::request_method::GET, "/private", [&gate](const luna::request &req) -> luna::response
+    {
+        gate.wait();
+        return {"private"};
+    }, {}, luna::router::coalesce{});
+    server.start_async();
+
+    std::thread client{[&server]
+                       {
+                           auto res = server.inject(make_request_("/private", {},
+                                                                  {{"Authorization", "Bearer secret"}}));
+                           ASSERT_EQ("private", res.content);
+                       }};
+    gate.wait_for_waiters(1);
+
+    // a request without credentials doesn't get to wait for an answer meant for one with them
+    ASSERT_EQ(401, server.inject(make_request_("/private")).status_code);
+
+    gate.open();
+    client.join();
+}
+
+TEST(coalescing, native_transport)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::NATIVE},
+                        luna::server::thread_pool_size{4}};
+
+    gate gate;
+    std::atomic<int> calls{0};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/popular",
+                           [&gate, &calls](const luna::request &req) -> luna::response
+                           {
+                               ++calls;
+                               gate.wait();
+                               return {"popular"};
+                           }, {}, luna::router::coalesce{});
+    ASSERT_TRUE(server.start_async());
+
+    // Connections are spread across the workers by the kernel. Requests on other workers than the first one's wait
+    // for its response without holding their worker up.
+    std::vector<std::thread> clients;
+    for (int i = 0; i < 8; ++i)
+    {
+        clients.emplace_back([]
+                             {
+                                 auto res = cpr::Get(cpr::Url{"http://localhost:8080/popular"});
+                                 ASSERT_EQ(200, res.status_code);
+                                 ASSERT_EQ("popular", res.text);
+                             });
+    }
+    gate.wait_for_waiters(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds{200});
+    gate.open();
+    for (auto &client : clients)
+    {
+        client.join();
+    }
+    ASSERT_LT(calls, 8);
+}
@@ -0,0 +1,89 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "test_helpers.h"
+#include "test_public.h" // tests/public, embedded by tests/CMakeLists.txt
+
+static std::string contents_(const unsigned char *data, size_t size)
+{
+    return {reinterpret_cast<const char *>(data), size};
+}
+
+TEST(embedded_assets, finds_assets)
+{
+    const auto &assets = luna::embedded::test_public;
+
+    auto text = assets.find("test.txt");
+    ASSERT_TRUE(text);
+    ASSERT_EQ("hello\n", contents_(text->data, text->size));
+    ASSERT_EQ("text/plain", std::string{text->mime_type}.substr(0, 10));
+    ASSERT_FALSE(text->gzip);
+
+    auto css = assets.find("test.css");
+    ASSERT_TRUE(css);
+    ASSERT_EQ("text/css", std::string{css->mime_type}.substr(0, 8));
+    ASSERT_TRUE(css->gzip); // from test.css.gz
+    ASSERT_FALSE(css->brotli);
+    ASSERT_FALSE(assets.find("test.css.gz"));
+    ASSERT_NE(std::string{css->etag}, std::string{text->etag});
+
+    // directories are there as their index files
+    auto index = assets.find("test");
+    ASSERT_TRUE(index);
+    ASSERT_EQ(assets.find("test/index.html")->data, index->data);
+    ASSERT_FALSE(assets.find("empty"));
+    ASSERT_TRUE(assets.find("empty/.keep"));
+
+    ASSERT_FALSE(assets.find(""));
+    ASSERT_FALSE(assets.find("missing.txt"));
+    ASSERT_FALSE(assets.find("/test.txt"));
+}
+
+TEST(embedded_assets, serve_embedded)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+    server.create_router("/")->serve_embedded("/assets", luna::embedded::test_public);
+    server.start_async();
+
+    auto response = server.inject(make_request_("/assets/test.txt"));
+    ASSERT_EQ(200, response.status_code);
+    ASSERT_EQ("hello\n", response.content);
+    ASSERT_EQ("text/plain", response.content_type.substr(0, 10));
+    auto etag = response.headers["ETag"];
+    ASSERT_FALSE(etag.empty());
+    ASSERT_EQ(0U, response.headers.count("Vary"));
+
+    ASSERT_EQ(200, server.inject(make_request_("/assets/test/")).status_code);
+    ASSERT_EQ(404, server.inject(make_request_("/assets/missing.txt")).status_code);
+
+    // unchanged
+    response = server.inject(make_request_("/assets/test.txt", {}, {{"If-None-Match", etag}}));
+    ASSERT_EQ(304, response.status_code);
+    ASSERT_TRUE(response.content.empty());
+
+    // compressed, for clients that will have it
+    auto css = luna::embedded::test_public.find("test.css");
+    response = server.inject(make_request_("/assets/test.css", {}, {{"Accept-Encoding", "deflate, gzip"}}));
+    ASSERT_EQ(200, response.status_code);
+    ASSERT_EQ("gzip", response.headers["Content-Encoding"]);
+    ASSERT_EQ("Accept-Encoding", response.headers["Vary"]);
+    ASSERT_EQ(contents_(css->gzip, css->gzip_size), response.content);
+    ASSERT_NE(std::string{css->etag}, response.headers["ETag"]);
+
+    response = server.inject(make_request_("/assets/test.css", {}, {{"Accept-Encoding", "gzip;q=0"}}));
+    ASSERT_EQ(0U, response.headers.count("Content-Encoding"));
+    ASSERT_EQ(contents_(css->data, css->size), response.content);
+}
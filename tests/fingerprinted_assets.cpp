@@ -0,0 +1,123 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "test_helpers.h"
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+// a directory of its own for each test, gone afterwards
+class asset_tree
+{
+public:
+    asset_tree()
+    {
+        char path[] = "/tmp/luna_assets_test_XXXXXX";
+        path_ = mkdtemp(path);
+    }
+
+    ~asset_tree()
+    {
+        std::system(("rm -rf " + path_).c_str());
+    }
+
+    const std::string &path() const
+    { return path_; }
+
+    void write(const std::string &name, const std::string &contents) const
+    {
+        std::ofstream out{path_ + "/" + name};
+        out << contents;
+    }
+
+private:
+    std::string path_;
+};
+
+static const std::string immutable_{"public, max-age=31536000, immutable"};
+
+TEST(fingerprinted_assets, from_a_manifest)
+{
+    asset_tree tree;
+    tree.write("app.3b8e1f0c.js", "app");
+    tree.write("style.css", "style");
+    tree.write("manifest.json", R"({"app.js": "/static/app.3b8e1f0c.js", "entrypoints": {"main": ["app.js"]}})");
+
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+    auto router = server.create_router("/");
+    router->serve_files("/static", tree.path(), luna::router::asset_manifest{"manifest.json"});
+    server.start_async();
+
+    ASSERT_EQ("/static/app.3b8e1f0c.js", router->asset_path("/static/app.js"));
+    ASSERT_EQ("/static/style.css", router->asset_path("/static/style.css"));
+    ASSERT_EQ("/elsewhere/app.js", router->asset_path("/elsewhere/app.js"));
+
+    auto response = server.inject(make_request_("/static/app.3b8e1f0c.js"));
+    ASSERT_EQ(200, response.status_code);
+    ASSERT_EQ(immutable_, response.headers["Cache-Control"]);
+
+    // everything else is checked on every use
+    response = server.inject(make_request_("/static/style.css"));
+    ASSERT_EQ(200, response.status_code);
+    ASSERT_EQ("no-cache", response.headers["Cache-Control"]);
+    auto etag = response.headers["ETag"];
+    auto last_modified = response.headers["Last-Modified"];
+    ASSERT_FALSE(etag.empty());
+    ASSERT_FALSE(last_modified.empty());
+
+    response = server.inject(make_request_("/static/style.css", {}, {{"If-None-Match", etag}}));
+    ASSERT_EQ(304, response.status_code);
+    ASSERT_TRUE(response.file.empty());
+    ASSERT_EQ(304, server.inject(make_request_("/static/style.css", {}, {{"If-Modified-Since", last_modified}})).status_code);
+    ASSERT_EQ(200, server.inject(make_request_("/static/style.css", {}, {{"If-None-Match", "\"other\""}})).status_code);
+    ASSERT_EQ(200, server.inject(make_request_("/static/style.css", {},
+                                               {{"If-Modified-Since", "Thu, 01 Jan 1970 00:00:00 GMT"}})).status_code);
+}
+
+TEST(fingerprinted_assets, by_content)
+{
+    asset_tree tree;
+    tree.write("app.js", "app");
+    tree.write("README", "read me");
+
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+    auto router = server.create_router("/");
+    router->serve_files("/static", tree.path(), luna::router::fingerprint_assets{true},
+                        luna::router::asset_max_age{std::chrono::minutes{1}});
+    server.start_async();
+
+    auto path = router->asset_path("/static/app.js");
+    ASSERT_EQ(31U, path.size()); // /static/app.<16 hex digits>.js
+    ASSERT_EQ("/static/app.", path.substr(0, 12));
+    ASSERT_EQ(".js", path.substr(28));
+    ASSERT_EQ(8U, router->asset_path("/static/README").find("README."));
+
+    auto response = server.inject(make_request_(path));
+    ASSERT_EQ(200, response.status_code);
+    ASSERT_EQ(tree.path() + "/app.js", response.file);
+    ASSERT_EQ(immutable_, response.headers["Cache-Control"]);
+
+    response = server.inject(make_request_("/static/app.js"));
+    ASSERT_EQ(200, response.status_code);
+    ASSERT_EQ("public, max-age=60", response.headers["Cache-Control"]);
+
+    // once the file changes, so does its fingerprint, and the old one is gone
+    tree.write("app.js", "app, changed");
+    ASSERT_NE(path, router->asset_path("/static/app.js"));
+    ASSERT_EQ(404, server.inject(make_request_(path)).status_code);
+    ASSERT_EQ(404, server.inject(make_request_("/static/app.0123456789abcdef.js")).status_code);
+}
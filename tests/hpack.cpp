@@ -0,0 +1,213 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "luna/private/hpack.h"
+
+static std::string from_hex_(const std::string &hex)
+{
+    std::string out;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2)
+    {
+        out.push_back(static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+    }
+    return out;
+}
+
+static bool decode_(luna::hpack_decoder &decoder, const std::string &hex, std::vector<luna::hpack_field> &fields)
+{
+    auto block = from_hex_(hex);
+    fields.clear();
+    return decoder.decode(reinterpret_cast<const uint8_t *>(block.data()), block.size(), fields);
+}
+
+TEST(hpack, huffman)
+{
+    std::string encoded;
+    luna::huffman_encode("www.example.com", encoded);
+    ASSERT_EQ(from_hex_("f1e3c2e5f23a6ba0ab90f4ff"), encoded);
+    ASSERT_EQ(encoded.size(), luna::huffman_encoded_length("www.example.com"));
+
+    std::string decoded;
+    ASSERT_TRUE(luna::huffman_decode(reinterpret_cast<const uint8_t *>(encoded.data()), encoded.size(), decoded));
+    ASSERT_EQ("www.example.com", decoded);
+
+    // every byte value survives the round trip
+    std::string all;
+    for (int c = 0; c < 256; ++c)
+    {
+        all.push_back(static_cast<char>(c));
+    }
+    encoded.clear();
+    decoded.clear();
+    luna::huffman_encode(all, encoded);
+    ASSERT_TRUE(luna::huffman_decode(reinterpret_cast<const uint8_t *>(encoded.data()), encoded.size(), decoded));
+    ASSERT_EQ(all, decoded);
+
+    // padding that isn't all ones, or is a whole byte long, is an error
+    auto bad = from_hex_("f1e3c2e5f23a6ba0ab90f4fe");
+    ASSERT_FALSE(luna::huffman_decode(reinterpret_cast<const uint8_t *>(bad.data()), bad.size(), decoded));
+    bad = from_hex_("f1e3c2e5f23a6ba0ab90f4ffff");
+    ASSERT_FALSE(luna::huffman_decode(reinterpret_cast<const uint8_t *>(bad.data()), bad.size(), decoded));
+}
+
+// RFC 7541 C.3
+TEST(hpack, decode_without_huffman)
+{
+    luna::hpack_decoder decoder;
+    std::vector<luna::hpack_field> fields;
+
+    ASSERT_TRUE(decode_(decoder, "828684410f7777772e6578616d706c652e636f6d", fields));
+    ASSERT_EQ(4, fields.size());
+    ASSERT_EQ(":method", fields[0].name);
+    ASSERT_EQ("GET", fields[0].value);
+    ASSERT_EQ(":authority", fields[3].name);
+    ASSERT_EQ("www.example.com", fields[3].value);
+
+    ASSERT_TRUE(decode_(decoder, "828684be58086e6f2d6361636865", fields));
+    ASSERT_EQ(5, fields.size());
+    ASSERT_EQ("www.example.com", fields[3].value);
+    ASSERT_EQ("cache-control", fields[4].name);
+    ASSERT_EQ("no-cache", fields[4].value);
+
+    ASSERT_TRUE(decode_(decoder, "828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565", fields));
+    ASSERT_EQ(5, fields.size());
+    ASSERT_EQ("https", fields[1].value);
+    ASSERT_EQ("/index.html", fields[2].value);
+    ASSERT_EQ("custom-key", fields[4].name);
+    ASSERT_EQ("custom-value", fields[4].value);
+}
+
+// RFC 7541 C.4
+TEST(hpack, decode_with_huffman)
+{
+    luna::hpack_decoder decoder;
+    std::vector<luna::hpack_field> fields;
+
+    ASSERT_TRUE(decode_(decoder, "828684418cf1e3c2e5f23a6ba0ab90f4ff", fields));
+    ASSERT_EQ(4, fields.size());
+    ASSERT_EQ("www.example.com", fields[3].value);
+
+    ASSERT_TRUE(decode_(decoder, "828684be5886a8eb10649cbf", fields));
+    ASSERT_EQ(5, fields.size());
+    ASSERT_EQ("no-cache", fields[4].value);
+
+    ASSERT_TRUE(decode_(decoder, "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf", fields));
+    ASSERT_EQ(5, fields.size());
+    ASSERT_EQ("custom-key", fields[4].name);
+    ASSERT_EQ("custom-value", fields[4].value);
+}
+
+TEST(hpack, decode_invalid)
+{
+    luna::hpack_decoder decoder;
+    std::vector<luna::hpack_field> fields;
+
+    ASSERT_FALSE(decode_(decoder, "80", fields)); // index 0
+    ASSERT_FALSE(decode_(decoder, "be", fields)); // past the end of an empty dynamic table
+    ASSERT_FALSE(decode_(decoder, "410f7777", fields)); // string runs off the end of the block
+    ASSERT_FALSE(decode_(decoder, "3fe21f", fields)); // table size update larger than we allow
+    ASSERT_FALSE(decode_(decoder, "8220", fields)); // table size update after a field
+}
+
+TEST(hpack, decode_list_too_large)
+{
+    luna::hpack_encoder encoder;
+    luna::hpack_decoder decoder{4096, 300};
+    auto encode = [&encoder](size_t times)
+    {
+        std::string block;
+        encoder.begin(block);
+        for (size_t i = 0; i < times; ++i)
+        {
+            encoder.encode("x-big", std::string(100, 'x'), block);
+        }
+        return block;
+    };
+
+    std::vector<luna::hpack_field> fields;
+    auto block = encode(2); // 137 bytes apiece, once decoded
+    ASSERT_TRUE(decoder.decode(reinterpret_cast<const uint8_t *>(block.data()), block.size(), fields));
+    ASSERT_FALSE(decoder.too_large());
+    ASSERT_EQ(2, fields.size());
+
+    // a few bytes of indices into the table, which come to too much
+    block = encode(3);
+    ASSERT_LT(block.size(), 10);
+    fields.clear();
+    ASSERT_TRUE(decoder.decode(reinterpret_cast<const uint8_t *>(block.data()), block.size(), fields));
+    ASSERT_TRUE(decoder.too_large());
+    ASSERT_TRUE(fields.empty());
+
+    // and the table is still in step
+    block = encode(1);
+    ASSERT_TRUE(decoder.decode(reinterpret_cast<const uint8_t *>(block.data()), block.size(), fields));
+    ASSERT_FALSE(decoder.too_large());
+    ASSERT_EQ(1, fields.size());
+    ASSERT_EQ("x-big", fields[0].name);
+}
+
+TEST(hpack, encode_round_trip)
+{
+    luna::hpack_encoder encoder;
+    luna::hpack_decoder decoder;
+    std::vector<std::pair<std::string, std::string>> headers{
+            {":status", "200"},
+            {"content-type", "application/json"},
+            {"server", "luna/5"},
+            {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+            {"x-custom", std::string(200, 'x')},
+    };
+
+    size_t first_size = 0;
+    for (int round = 0; round < 2; ++round)
+    {
+        std::string block;
+        encoder.begin(block);
+        for (const auto &header : headers)
+        {
+            encoder.encode(header.first, header.second, block);
+        }
+
+        std::vector<luna::hpack_field> fields;
+        ASSERT_TRUE(decoder.decode(reinterpret_cast<const uint8_t *>(block.data()), block.size(), fields));
+        ASSERT_EQ(headers.size(), fields.size());
+        for (size_t i = 0; i < headers.size(); ++i)
+        {
+            ASSERT_EQ(headers[i].first, fields[i].name);
+            ASSERT_EQ(headers[i].second, fields[i].value);
+        }
+
+        // the second time around, the stable headers come out of the dynamic table
+        if (round == 0)
+        {
+            first_size = block.size();
+        }
+        else
+        {
+            ASSERT_LT(block.size(), first_size);
+        }
+    }
+
+    // shrinking the table is announced at the start of the next block
+    encoder.set_max_table_size(0);
+    std::string block;
+    encoder.begin(block);
+    encoder.encode("server", "luna/5", block);
+    std::vector<luna::hpack_field> fields;
+    ASSERT_TRUE(decoder.decode(reinterpret_cast<const uint8_t *>(block.data()), block.size(), fields));
+    ASSERT_EQ(1, fields.size());
+    ASSERT_EQ("luna/5", fields[0].value);
+}
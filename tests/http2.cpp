@@ -0,0 +1,421 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "luna/private/http2_session.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdlib>
+
+struct frame
+{
+    uint8_t type;
+    uint8_t flags;
+    uint32_t stream_id;
+    std::string payload;
+};
+
+static std::string frame_(uint8_t type, uint8_t flags, uint32_t stream_id, const std::string &payload)
+{
+    std::string out;
+    out.push_back(static_cast<char>(payload.size() >> 16));
+    out.push_back(static_cast<char>(payload.size() >> 8));
+    out.push_back(static_cast<char>(payload.size()));
+    out.push_back(static_cast<char>(type));
+    out.push_back(static_cast<char>(flags));
+    out.push_back(static_cast<char>(stream_id >> 24));
+    out.push_back(static_cast<char>(stream_id >> 16));
+    out.push_back(static_cast<char>(stream_id >> 8));
+    out.push_back(static_cast<char>(stream_id));
+    return out + payload;
+}
+
+static std::string headers_(luna::hpack_encoder &encoder,
+                            uint32_t stream_id,
+                            const std::string &method,
+                            const std::string &path,
+                            bool end_stream)
+{
+    std::string block;
+    encoder.begin(block);
+    encoder.encode(":method", method, block);
+    encoder.encode(":scheme", "http", block);
+    encoder.encode(":path", path, block);
+    encoder.encode(":authority", "localhost", block);
+    return frame_(0x1, end_stream ? 0x5 : 0x4, stream_id, block);
+}
+
+static std::vector<frame> frames_(luna::http2_session &session)
+{
+    std::vector<frame> frames;
+    auto &out = session.output();
+    size_t i = 0;
+    while (i + 9 <= out.size())
+    {
+        auto p = reinterpret_cast<const uint8_t *>(out.data() + i);
+        size_t length = (p[0] << 16) | (p[1] << 8) | p[2];
+        uint32_t stream_id = ((p[5] & 0x7f) << 24) | (p[6] << 16) | (p[7] << 8) | p[8];
+        frames.push_back({p[3], p[4], stream_id, out.substr(i + 9, length)});
+        i += 9 + length;
+    }
+    out.clear();
+    return frames;
+}
+
+static size_t feed_(luna::http2_session &session, const std::string &data)
+{
+    return session.receive(data.data(), data.size());
+}
+
+static luna::http2_response echo_(uint32_t stream_id, luna::http2_request &&request)
+{
+    luna::http2_response response{200, {{"Content-Type", "text/plain"}, {"X-Method", request.method},
+                                        {"X-Host", request.headers["host"]}}, {}};
+    response.body = request.target + ":" + request.body;
+    return response;
+}
+
+TEST(http2, prior_knowledge)
+{
+    luna::http2_session session{echo_, 64 * 1024, 1024};
+    luna::hpack_encoder encoder;
+    luna::hpack_decoder decoder;
+
+    auto data = luna::http2_session::preface + frame_(0x4, 0, 0, "") + headers_(encoder, 1, "GET", "/hi", true);
+    // nothing happens until the whole preface is in
+    ASSERT_EQ(0, session.receive(data.data(), 10));
+    ASSERT_EQ(data.size(), feed_(session, data));
+
+    auto frames = frames_(session);
+    ASSERT_EQ(4, frames.size());
+    ASSERT_EQ(0x4, frames[0].type); // our settings
+    ASSERT_EQ(0x4, frames[1].type); // acknowledging theirs
+    ASSERT_EQ(0x1, frames[1].flags);
+    ASSERT_EQ(0x1, frames[2].type);
+    ASSERT_EQ(1, frames[2].stream_id);
+    ASSERT_EQ(0x0, frames[3].type);
+    ASSERT_EQ(0x1, frames[3].flags); // END_STREAM
+    ASSERT_EQ("/hi:", frames[3].payload);
+
+    std::vector<luna::hpack_field> fields;
+    ASSERT_TRUE(decoder.decode(reinterpret_cast<const uint8_t *>(frames[2].payload.data()), frames[2].payload.size(),
+                               fields));
+    ASSERT_EQ(":status", fields[0].name);
+    ASSERT_EQ("200", fields[0].value);
+    std::map<std::string, std::string> response_headers;
+    for (const auto &field : fields)
+    {
+        response_headers[field.name] = field.value;
+    }
+    ASSERT_EQ("text/plain", response_headers["content-type"]);
+    ASSERT_EQ("GET", response_headers["x-method"]);
+    ASSERT_EQ("localhost", response_headers["x-host"]);
+    ASSERT_EQ("4", response_headers["content-length"]);
+    ASSERT_FALSE(session.wants_close());
+}
+
+TEST(http2, request_body)
+{
+    luna::http2_session session{echo_, 64 * 1024, 1024};
+    luna::hpack_encoder encoder;
+
+    feed_(session, luna::http2_session::preface + frame_(0x4, 0, 0, "") + headers_(encoder, 1, "POST", "/echo", false));
+    frames_(session);
+
+    // padded, and split across frames
+    feed_(session, frame_(0x0, 0x8, 1, std::string{"\x03"} + "hello" + std::string(3, '\0')));
+    auto frames = frames_(session);
+    ASSERT_EQ(2, frames.size()); // window updates for the stream and the connection
+    ASSERT_EQ(0x8, frames[0].type);
+    ASSERT_EQ(1, frames[0].stream_id);
+    ASSERT_EQ(0x8, frames[1].type);
+    ASSERT_EQ(0, frames[1].stream_id);
+
+    feed_(session, frame_(0x0, 0x1, 1, " world"));
+    frames = frames_(session);
+    ASSERT_EQ(0x0, frames.back().type);
+    ASSERT_EQ("/echo:hello world", frames.back().payload);
+}
+
+TEST(http2, request_body_limits)
+{
+    luna::http2_session session{echo_, 64 * 1024, 1024};
+    luna::hpack_encoder encoder;
+
+    auto data = luna::http2_session::preface + frame_(0x4, 0, 0, "") + headers_(encoder, 1, "POST", "/echo", false);
+    data += headers_(encoder, 3, "POST", "/echo", false);
+    feed_(session, data);
+    frames_(session);
+
+    // between them, the two streams hold as much as we'll take, so the connection's window isn't given back...
+    feed_(session, frame_(0x0, 0, 1, std::string(600, 'a')) + frame_(0x0, 0, 3, std::string(500, 'b')));
+    auto frames = frames_(session);
+    ASSERT_EQ(3, frames.size());
+    ASSERT_EQ(1, frames[0].stream_id);
+    ASSERT_EQ(0, frames[1].stream_id); // for the first frame alone
+    ASSERT_EQ(std::string("\x00\x00\x02\x58", 4), frames[1].payload);
+    ASSERT_EQ(3, frames[2].stream_id);
+
+    // ...until one of them is handed on
+    feed_(session, frame_(0x0, 0x1, 1, ""));
+    frames = frames_(session);
+    ASSERT_EQ(0x8, frames[0].type);
+    ASSERT_EQ(0, frames[0].stream_id);
+    ASSERT_EQ(std::string("\x00\x00\x01\xf4", 4), frames[0].payload);
+    ASSERT_EQ("/echo:" + std::string(600, 'a'), frames.back().payload);
+
+    // a stream's body can't be larger than the limit
+    feed_(session, frame_(0x0, 0, 3, std::string(600, 'b')));
+    frames = frames_(session);
+    ASSERT_EQ(3, frames.size());
+    ASSERT_EQ(0x8, frames[0].type); // the connection's credit
+    ASSERT_EQ(0x1, frames[1].type);
+    ASSERT_EQ(3, frames[1].stream_id);
+    luna::hpack_decoder decoder;
+    std::vector<luna::hpack_field> fields;
+    ASSERT_TRUE(decoder.decode(reinterpret_cast<const uint8_t *>(frames[1].payload.data()), frames[1].payload.size(),
+                               fields));
+    ASSERT_EQ("413", fields[0].value);
+    ASSERT_EQ(0x3, frames[2].type);
+    ASSERT_FALSE(session.wants_close());
+}
+
+TEST(http2, header_list_too_large)
+{
+    luna::http2_session session{echo_, 1024, 1024};
+    luna::hpack_encoder encoder;
+
+    feed_(session, luna::http2_session::preface + frame_(0x4, 0, 0, ""));
+    auto frames = frames_(session);
+    ASSERT_NE(std::string::npos, frames[0].payload.find(std::string{"\x00\x06\x00\x00\x04\x00", 6})); // advertised
+
+    std::string block;
+    encoder.begin(block);
+    encoder.encode(":method", "GET", block);
+    encoder.encode(":scheme", "http", block);
+    encoder.encode(":path", "/", block);
+    for (int i = 0; i < 10; ++i)
+    {
+        encoder.encode("x-big", std::string(100, 'x'), block); // small once compressed, but not once decoded
+    }
+    ASSERT_LT(block.size(), 1024);
+    feed_(session, frame_(0x1, 0x5, 1, block));
+    frames = frames_(session);
+    ASSERT_EQ(1, frames.size());
+    ASSERT_EQ(0x1, frames[0].type);
+    luna::hpack_decoder decoder;
+    std::vector<luna::hpack_field> fields;
+    ASSERT_TRUE(decoder.decode(reinterpret_cast<const uint8_t *>(frames[0].payload.data()), frames[0].payload.size(),
+                               fields));
+    ASSERT_EQ("431", fields[0].value);
+
+    // the connection carries on
+    feed_(session, headers_(encoder, 3, "GET", "/ok", true));
+    frames = frames_(session);
+    ASSERT_EQ("/ok:", frames.back().payload);
+}
+
+TEST(http2, deferred_response)
+{
+    std::vector<uint32_t> handling;
+    luna::http2_session session{[&handling](uint32_t stream_id, luna::http2_request &&)
+                                        -> OPT_NS::optional<luna::http2_response>
+                                {
+                                    handling.push_back(stream_id);
+                                    return OPT_NS::nullopt;
+                                }, 64 * 1024, 1024};
+    std::vector<uint32_t> reset;
+    session.on_reset([&reset](uint32_t stream_id)
+                     {
+                         reset.push_back(stream_id);
+                     });
+    luna::hpack_encoder encoder;
+
+    auto data = luna::http2_session::preface + frame_(0x4, 0, 0, "") + headers_(encoder, 1, "GET", "/a", true);
+    data += headers_(encoder, 3, "GET", "/b", true); // encoded in order, as they share a compression context
+    data += headers_(encoder, 5, "POST", "/c", false);
+    feed_(session, data);
+    auto frames = frames_(session);
+    ASSERT_EQ(2, frames.size()); // just the settings
+    ASSERT_EQ(2, handling.size());
+
+    // answered in any order
+    session.respond(3, {200, {}, "b"});
+    frames = frames_(session);
+    ASSERT_EQ(2, frames.size());
+    ASSERT_EQ(3, frames[0].stream_id);
+    ASSERT_EQ("b", frames[1].payload);
+
+    // the handler is only told of resets of streams it's still answering
+    feed_(session, frame_(0x3, 0, 3, std::string{"\x00\x00\x00\x08", 4}));
+    feed_(session, frame_(0x3, 0, 5, std::string{"\x00\x00\x00\x08", 4}));
+    ASSERT_TRUE(reset.empty());
+
+    // a stream the client has given up on is answered with nothing
+    feed_(session, frame_(0x3, 0, 1, std::string{"\x00\x00\x00\x08", 4}));
+    ASSERT_EQ(std::vector<uint32_t>{1}, reset);
+    session.respond(1, {200, {}, "a"});
+    ASSERT_TRUE(frames_(session).empty());
+}
+
+TEST(http2, flow_control)
+{
+    luna::http2_session session{[](uint32_t stream_id, luna::http2_request &&request) -> luna::http2_response
+                                {
+                                    return {200, {}, std::string(1000, 'x')};
+                                }, 64 * 1024, 1024};
+    luna::hpack_encoder encoder;
+
+    // SETTINGS_INITIAL_WINDOW_SIZE = 300
+    std::string settings{"\x00\x04\x00\x00\x01\x2c", 6};
+    feed_(session, luna::http2_session::preface + frame_(0x4, 0, 0, settings) + headers_(encoder, 1, "GET", "/", true));
+    auto frames = frames_(session);
+    ASSERT_EQ(0x0, frames.back().type);
+    ASSERT_EQ(300, frames.back().payload.size());
+    ASSERT_EQ(0, frames.back().flags);
+
+    feed_(session, frame_(0x8, 0, 1, std::string{"\x00\x00\x02\x00", 4})); // 512 more
+    frames = frames_(session);
+    ASSERT_EQ(1, frames.size());
+    ASSERT_EQ(512, frames[0].payload.size());
+
+    feed_(session, frame_(0x8, 0, 1, std::string{"\x00\x00\x10\x00", 4}));
+    frames = frames_(session);
+    ASSERT_EQ(1, frames.size());
+    ASSERT_EQ(188, frames[0].payload.size());
+    ASSERT_EQ(0x1, frames[0].flags);
+}
+
+TEST(http2, file_body)
+{
+    char path[] = "/tmp/luna_http2_test_XXXXXX";
+    auto fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    std::string contents;
+    for (int i = 0; i < 200000; ++i)
+    {
+        contents.push_back(static_cast<char>('a' + i % 26));
+    }
+    ASSERT_EQ(contents.size(), write(fd, contents.data(), contents.size()));
+    unlink(path);
+
+    luna::http2_session session{[fd, &contents](uint32_t stream_id, luna::http2_request &&) -> luna::http2_response
+                                {
+                                    luna::http2_response response{200, {}, {}};
+                                    response.file = fd;
+                                    response.file_size = contents.size();
+                                    return response;
+                                }, 64 * 1024, 1024};
+    luna::hpack_encoder encoder;
+
+    // windows big enough that only the output budget holds the file back
+    std::string settings{"\x00\x04\x00\x10\x00\x00", 6};
+    auto data = luna::http2_session::preface + frame_(0x4, 0, 0, settings);
+    data += frame_(0x8, 0, 0, std::string{"\x00\x10\x00\x00", 4});
+    data += headers_(encoder, 1, "GET", "/", true);
+    feed_(session, data);
+
+    std::string sent;
+    auto frames = frames_(session);
+    while (true)
+    {
+        size_t queued = 0;
+        for (auto &frame : frames)
+        {
+            if (frame.type == 0x0)
+            {
+                ASSERT_LE(frame.payload.size(), 16384); // no bigger than the client's maximum frame size
+                sent += frame.payload;
+                queued += frame.payload.size();
+            }
+        }
+        ASSERT_LE(queued, luna::http2_session::output_budget + 16384);
+        if (frames.back().type == 0x0 && (frames.back().flags & 0x1))
+        {
+            break;
+        }
+        session.flush();
+        frames = frames_(session);
+        ASSERT_FALSE(frames.empty());
+    }
+    ASSERT_EQ(contents, sent);
+    ASSERT_EQ(-1, fcntl(fd, F_GETFD)); // the session closed it once it was sent
+}
+
+TEST(http2, ping)
+{
+    luna::http2_session session{echo_, 64 * 1024, 1024};
+    feed_(session, luna::http2_session::preface + frame_(0x6, 0, 0, "12345678"));
+    auto frames = frames_(session);
+    ASSERT_EQ(0x6, frames.back().type);
+    ASSERT_EQ(0x1, frames.back().flags);
+    ASSERT_EQ("12345678", frames.back().payload);
+}
+
+TEST(http2, protocol_errors)
+{
+    {
+        luna::http2_session session{echo_, 64 * 1024, 1024};
+        feed_(session, "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+        ASSERT_EQ(0x7, frames_(session).back().type); // GOAWAY
+        ASSERT_TRUE(session.wants_close());
+    }
+    {
+        // even stream ids are the server's
+        luna::http2_session session{echo_, 64 * 1024, 1024};
+        luna::hpack_encoder encoder;
+        feed_(session, luna::http2_session::preface + headers_(encoder, 2, "GET", "/", true));
+        ASSERT_EQ(0x7, frames_(session).back().type);
+        ASSERT_TRUE(session.wants_close());
+    }
+    {
+        // a header block interrupted by another frame
+        luna::http2_session session{echo_, 64 * 1024, 1024};
+        luna::hpack_encoder encoder;
+        auto headers = headers_(encoder, 1, "GET", "/", true);
+        headers[4] = 0x1; // END_STREAM without END_HEADERS
+        feed_(session, luna::http2_session::preface + headers + frame_(0x6, 0, 0, "12345678"));
+        ASSERT_EQ(0x7, frames_(session).back().type);
+    }
+    {
+        // garbage where a header block should be
+        luna::http2_session session{echo_, 64 * 1024, 1024};
+        feed_(session, luna::http2_session::preface + frame_(0x1, 0x5, 1, "\xff\xff\xff\xff"));
+        auto frames = frames_(session);
+        ASSERT_EQ(0x7, frames.back().type);
+        ASSERT_EQ('\x09', frames.back().payload[7]); // COMPRESSION_ERROR
+    }
+}
+
+TEST(http2, upgrade)
+{
+    luna::http2_session session{echo_, 64 * 1024, 1024};
+    // SETTINGS_MAX_CONCURRENT_STREAMS = 100, SETTINGS_INITIAL_WINDOW_SIZE = 65535 (as curl sends)
+    ASSERT_TRUE(session.start_upgraded("AAMAAABkAAQAAP__", {"GET", "/upgraded", {{"host", "localhost"}}, {}}));
+    auto frames = frames_(session);
+    ASSERT_EQ(3, frames.size());
+    ASSERT_EQ(0x4, frames[0].type);
+    ASSERT_EQ(0x1, frames[1].type);
+    ASSERT_EQ(1, frames[1].stream_id);
+    ASSERT_EQ("/upgraded:", frames[2].payload);
+
+    // the client still sends its preface, and goes on from stream 3
+    luna::hpack_encoder encoder;
+    feed_(session, luna::http2_session::preface + frame_(0x4, 0, 0, "") + headers_(encoder, 3, "GET", "/next", true));
+    ASSERT_EQ("/next:", frames_(session).back().payload);
+
+    luna::http2_session bad{echo_, 64 * 1024, 1024};
+    ASSERT_FALSE(bad.start_upgraded("AAMAAABkAAQAA", {"GET", "/", {}, {}})); // not a whole number of settings
+}
@@ -0,0 +1,143 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "luna/private/http_parser.h"
+
+static luna::parse_status parse_(const std::string &text, luna::http_request_head &head, size_t &consumed)
+{
+    return luna::parse_request_head(text.data(), text.size(), head, consumed);
+}
+
+TEST(http_parser, request_head)
+{
+    std::string text{"GET /foo/bar?baz=qux HTTP/1.1\r\n"
+                     "Host: localhost:8080\r\n"
+                     "X-Long-Header-Name-To-Cross-A-Vector-Boundary:   padded value \t \r\n"
+                     "\r\n"
+                     "next request"};
+    luna::http_request_head head;
+    size_t consumed;
+    ASSERT_EQ(luna::parse_status::COMPLETE, parse_(text, head, consumed));
+    ASSERT_EQ(text.size() - 12, consumed);
+    ASSERT_EQ("GET", head.method.str());
+    ASSERT_EQ("/foo/bar?baz=qux", head.target.str());
+    ASSERT_EQ("HTTP/1.1", head.version.str());
+    ASSERT_EQ(2, head.headers.size());
+    ASSERT_EQ("Host", head.headers[0].name.str());
+    ASSERT_EQ("localhost:8080", head.headers[0].value.str());
+    ASSERT_EQ("padded value", head.headers[1].value.str());
+    ASSERT_TRUE(head.keep_alive);
+}
+
+TEST(http_parser, incomplete)
+{
+    std::string text{"POST /foo HTTP/1.1\r\nContent-Length: 5\r\n\r\n"};
+    luna::http_request_head head;
+    size_t consumed;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        ASSERT_EQ(luna::parse_status::INCOMPLETE, luna::parse_request_head(text.data(), i, head, consumed)) << i;
+    }
+    ASSERT_EQ(luna::parse_status::COMPLETE, parse_(text, head, consumed));
+    ASSERT_EQ(5, head.content_length);
+}
+
+TEST(http_parser, invalid)
+{
+    luna::http_request_head head;
+    size_t consumed;
+    ASSERT_EQ(luna::parse_status::INVALID, parse_("GET /foo\x01 HTTP/1.1\r\n\r\n", head, consumed));
+    ASSERT_EQ(luna::parse_status::INVALID, parse_("GET /foo HTTP/2.0\r\n\r\n", head, consumed));
+    ASSERT_EQ(luna::parse_status::INVALID, parse_("GET /foo HTTP/1.1\r\nHost : x\r\n\r\n", head, consumed));
+    ASSERT_EQ(luna::parse_status::INVALID, parse_("GET /foo HTTP/1.1\r\nNoColon\r\n\r\n", head, consumed));
+    ASSERT_EQ(luna::parse_status::INVALID,
+              parse_("GET /foo HTTP/1.1\r\nX-Header: this value has a \x7f in the middle of it\r\n\r\n", head,
+                     consumed));
+    ASSERT_EQ(luna::parse_status::INVALID,
+              parse_("POST /foo HTTP/1.1\r\nContent-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n", head,
+                     consumed));
+    ASSERT_EQ(luna::parse_status::INVALID,
+              parse_("POST /foo HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\n", head, consumed));
+}
+
+TEST(http_parser, connection_header)
+{
+    luna::http_request_head head;
+    size_t consumed;
+    ASSERT_EQ(luna::parse_status::COMPLETE, parse_("GET / HTTP/1.0\r\n\r\n", head, consumed));
+    ASSERT_FALSE(head.keep_alive);
+    ASSERT_EQ(luna::parse_status::COMPLETE, parse_("GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n", head, consumed));
+    ASSERT_TRUE(head.keep_alive);
+    ASSERT_EQ(luna::parse_status::COMPLETE, parse_("GET / HTTP/1.1\r\nConnection: foo, close\r\n\r\n", head, consumed));
+    ASSERT_FALSE(head.keep_alive);
+}
+
+TEST(http_parser, chunked_body)
+{
+    std::string text{"5\r\nhello\r\n7;ext=1\r\n, world\r\n0\r\nTrailer: yes\r\n\r\nGET"};
+    std::string body;
+    size_t consumed;
+    ASSERT_EQ(luna::parse_status::COMPLETE,
+              luna::parse_chunked_body(text.data(), text.size(), 1024, body, consumed));
+    ASSERT_EQ("hello, world", body);
+    ASSERT_EQ(text.size() - 3, consumed);
+
+    body.clear();
+    ASSERT_EQ(luna::parse_status::INVALID, luna::parse_chunked_body("zz\r\n", 4, 1024, body, consumed));
+}
+
+TEST(http_parser, chunked_body_resumes)
+{
+    std::string text{"5\r\nhello\r\n7;ext=1\r\n, world\r\n0\r\n\r\n"};
+    std::string body;
+    size_t consumed;
+
+    // only the first chunk is complete
+    ASSERT_EQ(luna::parse_status::INCOMPLETE, luna::parse_chunked_body(text.data(), 14, 1024, body, consumed));
+    ASSERT_EQ("hello", body);
+    ASSERT_EQ(10, consumed);
+
+    // carry on from where that left off
+    size_t more;
+    ASSERT_EQ(luna::parse_status::COMPLETE,
+              luna::parse_chunked_body(text.data() + consumed, text.size() - consumed, 1024, body, more));
+    ASSERT_EQ("hello, world", body);
+    ASSERT_EQ(text.size(), consumed + more);
+}
+
+TEST(http_parser, chunked_body_too_large)
+{
+    std::string body;
+    size_t consumed;
+    // refused on the size alone, before any of the chunk has arrived
+    ASSERT_EQ(luna::parse_status::TOO_LARGE, luna::parse_chunked_body("400\r\n", 5, 1023, body, consumed));
+
+    std::string text{"5\r\nhello\r\n5\r\nworld\r\n0\r\n\r\n"};
+    ASSERT_EQ(luna::parse_status::TOO_LARGE, luna::parse_chunked_body(text.data(), text.size(), 9, body, consumed));
+    body.clear();
+    ASSERT_EQ(luna::parse_status::COMPLETE, luna::parse_chunked_body(text.data(), text.size(), 10, body, consumed));
+}
+
+TEST(http_parser, query_string)
+{
+    luna::query_params params;
+    std::string query{"a=1&b=hello+world&c=%2Fpath%2x&&d"};
+    luna::parse_query_string(query.data(), query.size(), params);
+    ASSERT_EQ("1", params["a"]);
+    ASSERT_EQ("hello world", params["b"]);
+    ASSERT_EQ("/path%2x", params["c"]);
+    ASSERT_EQ(1, params.count("d"));
+}
@@ -0,0 +1,151 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "test_helpers.h"
+#include "luna/private/concurrency_limiter.h"
+#include <thread>
+
+TEST(load_shedding, limiter_adapts)
+{
+    luna::concurrency_limiter limiter{10, 2, 100};
+
+    // requests that are quick and consistent, at the limit: the limit grows
+    for (int round = 0; round < 20; ++round)
+    {
+        std::vector<luna::concurrency_limiter::permit> permits;
+        while (true)
+        {
+            auto permit = limiter.try_acquire(luna::router::priority_level::NORMAL);
+            if (!permit)
+            {
+                break;
+            }
+            permits.emplace_back(std::move(permit));
+        }
+        ASSERT_EQ(limiter.limit(), permits.size());
+        for (auto &permit : permits)
+        {
+            permit.release();
+        }
+    }
+    auto grown = limiter.limit();
+    ASSERT_GT(grown, 10);
+    ASSERT_EQ(0, limiter.in_flight());
+
+    // then they start to take far longer: the limit comes down
+    for (int round = 0; round < 5; ++round)
+    {
+        std::vector<luna::concurrency_limiter::permit> permits;
+        for (unsigned int i = 0; i < limiter.limit(); ++i)
+        {
+            permits.emplace_back(limiter.try_acquire(luna::router::priority_level::NORMAL));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{20});
+        for (auto &permit : permits)
+        {
+            permit.release();
+        }
+    }
+    ASSERT_LT(limiter.limit(), grown);
+    ASSERT_GE(limiter.limit(), 2);
+}
+
+TEST(load_shedding, limiter_priorities)
+{
+    luna::concurrency_limiter limiter{4, 4, 4};
+
+    std::vector<luna::concurrency_limiter::permit> permits;
+    for (int i = 0; i < 3; ++i)
+    {
+        permits.emplace_back(limiter.try_acquire(luna::router::priority_level::NORMAL));
+        ASSERT_TRUE(static_cast<bool>(permits.back()));
+    }
+    ASSERT_FALSE(static_cast<bool>(limiter.try_acquire(luna::router::priority_level::LOW)));
+    ASSERT_TRUE(limiter.priority_matters());
+
+    permits.emplace_back(limiter.try_acquire(luna::router::priority_level::NORMAL));
+    ASSERT_TRUE(static_cast<bool>(permits.back()));
+    ASSERT_FALSE(static_cast<bool>(limiter.try_acquire(luna::router::priority_level::NORMAL)));
+
+    permits.emplace_back(limiter.try_acquire(luna::router::priority_level::HIGH));
+    ASSERT_TRUE(static_cast<bool>(permits.back()));
+    ASSERT_FALSE(static_cast<bool>(limiter.try_acquire(luna::router::priority_level::HIGH)));
+
+    for (int i = 0; i < 10; ++i)
+    {
+        permits.emplace_back(limiter.try_acquire(luna::router::priority_level::CRITICAL));
+        ASSERT_TRUE(static_cast<bool>(permits.back()));
+    }
+    ASSERT_EQ(15, limiter.in_flight());
+
+    // abandoned permits give their slots back too
+    permits.clear();
+    ASSERT_EQ(0, limiter.in_flight());
+}
+
+TEST(load_shedding, shed_with_503)
+{
+    luna::server::adaptive_concurrency_limit limit;
+    limit.initial_limit = limit.min_limit = limit.max_limit = 2;
+    limit.retry_after = std::chrono::seconds{5};
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}, limit};
+
+    gate gate;
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/slow", [&gate](const luna::request &req) -> luna::response
+    {
+        gate.wait();
+        return {"slow"};
+    });
+    router->handle_request(luna::request_method::GET, "/fast", [](const luna::request &req) -> luna::response
+    {
+        return {"fast"};
+    });
+    router->handle_request(luna::request_method::GET, "/health", [](const luna::request &req) -> luna::response
+    {
+        return {"ok"};
+    }, {}, luna::router::priority{luna::router::priority_level::CRITICAL});
+    server.start_async();
+
+    ASSERT_EQ("fast", server.inject(make_request_("/fast")).content);
+
+    std::vector<std::thread> clients;
+    for (int i = 0; i < 2; ++i)
+    {
+        clients.emplace_back([&server]
+                             {
+                                 ASSERT_EQ("slow", server.inject(make_request_("/slow")).content);
+                             });
+    }
+    gate.wait_for_waiters(2);
+
+    auto res = server.inject(make_request_("/fast"));
+    ASSERT_EQ(503, res.status_code);
+    ASSERT_EQ("5", res.headers["Retry-After"]);
+
+    // health checks still get through
+    res = server.inject(make_request_("/health"));
+    ASSERT_EQ(200, res.status_code);
+    ASSERT_EQ("ok", res.content);
+
+    gate.open();
+    for (auto &client : clients)
+    {
+        client.join();
+    }
+
+    ASSERT_EQ("fast", server.inject(make_request_("/fast")).content);
+}
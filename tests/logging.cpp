@@ -16,6 +16,8 @@
 #include <gtest/gtest.h>
 #include <luna/luna.h>
 #include <cpr/cpr.h>
+#include <atomic>
+#include <thread>
 
 TEST(logging, error_logger_test)
 {
@@ -34,6 +36,142 @@ TEST(logging, error_logger_test)
     luna::reset_error_logger();
 }
 
+TEST(logging, runtime_log_level)
+{
+    std::string log_str{"NOPE"};
+    luna::set_error_logger([&](luna::log_level level, const std::string& message)
+                           {
+                               log_str = message;
+                           });
+    luna::set_log_level(luna::log_level::INFO);
+
+    luna::error_log(luna::log_level::DEBUG, "hello");
+    ASSERT_EQ("NOPE", log_str);
+    ASSERT_FALSE(luna::error_log_enabled(luna::log_level::DEBUG));
+
+    luna::error_log(luna::log_level::WARNING, "hello");
+    ASSERT_EQ("hello", log_str);
+
+    luna::set_log_level(luna::log_level::DEBUG);
+    luna::reset_error_logger();
+}
+
+TEST(logging, lazy_log_messages)
+{
+    bool evaluated{false};
+    auto message = [&]() -> std::string
+    {
+        evaluated = true;
+        return "hello";
+    };
+
+    // no logger, so the message should never be built
+    LUNA_LOG_ERROR(message());
+    ASSERT_FALSE(evaluated);
+
+    std::string log_str{"NOPE"};
+    luna::set_error_logger([&](luna::log_level level, const std::string& message)
+                           {
+                               log_str = message;
+                           });
+    luna::set_log_level(luna::log_level::WARNING);
+
+    LUNA_LOG_INFO(message());
+    ASSERT_FALSE(evaluated);
+
+    LUNA_LOG_ERROR(message());
+    ASSERT_TRUE(evaluated);
+    ASSERT_EQ("hello", log_str);
+
+    luna::set_log_level(luna::log_level::DEBUG);
+    luna::reset_error_logger();
+}
+
+TEST(logging, async_error_logger_test)
+{
+    std::string log_str{"NOPE"};
+    luna::set_error_logger([&](luna::log_level level, const std::string& message)
+                           {
+                               log_str = message;
+                           });
+    luna::enable_async_logging();
+
+    luna::error_log(luna::log_level::DEBUG, "hello");
+    luna::flush_logs();
+    ASSERT_EQ("hello", log_str);
+
+    luna::disable_async_logging();
+    luna::reset_error_logger();
+}
+
+TEST(logging, async_access_log_leaves_bodies_behind)
+{
+    std::string logged_path, logged_body, logged_content;
+    luna::set_access_logger([&](const luna::request &request, const luna::response &response)
+                            {
+                                logged_path = request.path;
+                                logged_body = request.body;
+                                logged_content = response.content;
+                            });
+    luna::enable_async_logging();
+
+    luna::request req{std::chrono::system_clock::now(), std::chrono::system_clock::now(), "", luna::request_method::POST, "/upload", "HTTP/1.1", {}, {}, {}, "a large body"};
+    luna::response res{200, "large content"};
+    luna::access_log(req, res);
+    luna::flush_logs();
+    ASSERT_EQ("/upload", logged_path);
+    ASSERT_EQ("", logged_body);
+    ASSERT_EQ("", logged_content);
+
+    // turning async logging off and on again while logging is safe
+    std::atomic<int> count{0};
+    luna::set_access_logger([&](const luna::request &request, const luna::response &response)
+                            {
+                                ++count;
+                            });
+    std::atomic<bool> done{false};
+    std::thread logging_thread{[&]
+                               {
+                                   while(!done)
+                                       luna::access_log(req, res);
+                               }};
+    for(int i = 0; i < 50; ++i)
+    {
+        luna::disable_async_logging();
+        luna::enable_async_logging();
+    }
+    done = true;
+    logging_thread.join();
+    luna::disable_async_logging();
+    ASSERT_LT(0, count);
+
+    luna::reset_access_logger();
+}
+
+TEST(logging, async_logging_drops_when_full)
+{
+    std::atomic<bool> blocked{true};
+    std::atomic<int> count{0};
+    luna::set_error_logger([&](luna::log_level level, const std::string& message)
+                           {
+                               while(blocked) std::this_thread::yield();
+                               ++count;
+                           });
+    luna::enable_async_logging(2);
+
+    for(int i = 0; i < 100; ++i)
+    {
+        luna::error_log(luna::log_level::INFO, "hello");
+    }
+    ASSERT_LT(0, luna::dropped_log_records());
+
+    blocked = false;
+    luna::disable_async_logging();
+    ASSERT_GT(100, count);
+
+    luna::reset_error_logger();
+}
+
 TEST(logging, basic_formatting_test)
 {
     std::string log_str;
@@ -0,0 +1,95 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "test_helpers.h"
+
+TEST(loopback, inject_get)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET,
+                           "/test",
+                           [](auto req) -> luna::response
+                           {
+                               return {"hello " + req.params["name"]};
+                           });
+
+    ASSERT_TRUE(server.start_async());
+    ASSERT_TRUE(static_cast<bool>(server));
+
+    auto req = make_request_(luna::request_method::GET, "/test");
+    req.params["name"] = "world";
+    auto res = server.inject(req);
+    ASSERT_EQ(200, res.status_code);
+    ASSERT_EQ("hello world", res.content);
+    ASSERT_EQ("text/html; charset=utf-8", res.content_type);
+    ASSERT_EQ(1, res.headers.count("Server"));
+
+    server.stop();
+    ASSERT_FALSE(static_cast<bool>(server));
+}
+
+TEST(loopback, inject_post_status_code)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::POST,
+                           "/test",
+                           [](auto req) -> luna::response
+                           {
+                               return {"application/json", req.body};
+                           });
+
+    server.start_async();
+
+    auto req = make_request_(luna::request_method::POST, "/test");
+    req.body = "{}";
+    auto res = server.inject(req);
+    ASSERT_EQ(201, res.status_code);
+    ASSERT_EQ("{}", res.content);
+    ASSERT_EQ("application/json", res.content_type);
+}
+
+TEST(loopback, inject_not_found)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        luna::server::not_found_handler_cb{[](const luna::request &req, luna::response &res)
+                                                           {
+                                                               res.content = "nothing at " + req.path;
+                                                           }}};
+    server.create_router("/");
+    server.start_async();
+
+    auto res = server.inject(make_request_(luna::request_method::GET, "/nope"));
+    ASSERT_EQ(404, res.status_code);
+    ASSERT_EQ("nothing at /nope", res.content);
+}
+
+TEST(loopback, inject_file)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+    auto router = server.create_router("/");
+    std::string path{STATIC_ASSET_PATH};
+    router->serve_files("/", path + "/tests/public");
+
+    server.start_async();
+
+    auto res = server.inject(make_request_(luna::request_method::GET, "/test.txt"));
+    ASSERT_EQ(200, res.status_code);
+    ASSERT_EQ("hello\n", res.content);
+    ASSERT_EQ("text/plain", res.content_type);
+}
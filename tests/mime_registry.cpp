@@ -0,0 +1,74 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "test_helpers.h"
+#include "luna/private/mime_registry.h"
+
+TEST(mime_registry, builtin_types)
+{
+    luna::mime_registry mime_types;
+    ASSERT_EQ("text/html; charset=utf-8", mime_types.type_for("/srv/www/index.html"));
+    ASSERT_EQ("text/css; charset=utf-8", mime_types.type_for("style.CSS"));
+    ASSERT_EQ("application/javascript; charset=utf-8", mime_types.type_for("app.min.js"));
+    ASSERT_EQ("image/jpeg", mime_types.type_for("photo.JpEg"));
+    ASSERT_EQ("font/woff2", mime_types.type_for("fonts/body.woff2"));
+    ASSERT_EQ("application/wasm", mime_types.type_for("module.wasm"));
+    ASSERT_EQ("text/plain", mime_types.type_for("test.txt"));
+
+    ASSERT_EQ("text/plain", mime_types.type_for("test.waaat"));
+    ASSERT_EQ("text/plain", mime_types.type_for("testnoext"));
+    ASSERT_EQ("text/plain", mime_types.type_for("trailing."));
+    ASSERT_EQ("text/plain", mime_types.type_for("some.dir/README"));
+    ASSERT_EQ("text/plain", mime_types.type_for("archive.averyveryverylongextension"));
+
+    // the extension has to match all the way
+    ASSERT_EQ(nullptr, luna::mime_registry::builtin("htmlx", 5));
+    ASSERT_EQ(nullptr, luna::mime_registry::builtin("ht", 2));
+    ASSERT_STREQ("text/html; charset=utf-8", luna::mime_registry::builtin("html", 4));
+}
+
+TEST(mime_registry, overrides)
+{
+    luna::mime_registry mime_types;
+    mime_types.set(".WGSL", "text/wgsl");
+    mime_types.set("js", "text/javascript");
+
+    ASSERT_EQ("text/wgsl", mime_types.type_for("shader.wgsl"));
+    ASSERT_EQ("text/javascript", mime_types.type_for("app.JS"));
+    ASSERT_EQ("text/css; charset=utf-8", mime_types.type_for("style.css"));
+}
+
+TEST(mime_registry, server_option)
+{
+    std::string path{STATIC_ASSET_PATH};
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        luna::server::mime_types{{"waaat", "application/x-waaat"}, {"txt", "text/x-test"}}};
+    auto router = server.create_router("/");
+    router->serve_files("/", path + "/tests/public");
+    server.start_async();
+
+    auto response = server.inject(make_request_("/test.waaat"));
+    ASSERT_EQ(200, response.status_code);
+    ASSERT_EQ("application/x-waaat", response.content_type);
+
+    response = server.inject(make_request_("/test.txt"));
+    ASSERT_EQ(200, response.status_code);
+    ASSERT_EQ("text/x-test", response.content_type);
+
+    response = server.inject(make_request_("/test.html"));
+    ASSERT_EQ(200, response.status_code);
+    ASSERT_EQ("text/html; charset=utf-8", response.content_type);
+}
@@ -0,0 +1,176 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include <cpr/cpr.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+TEST(native_transport, get)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::NATIVE},
+                        luna::server::thread_pool_size{2}};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET,
+                           "/test",
+                           [](auto req) -> luna::response
+                           {
+                               return {"hello " + req.params["key"]};
+                           });
+
+    ASSERT_TRUE(server.start_async());
+    auto res = cpr::Get(cpr::Url{"http://localhost:8080/test"}, cpr::Parameters{{"key", "world wide"}});
+    ASSERT_EQ(200, res.status_code);
+    ASSERT_EQ("hello world wide", res.text);
+    ASSERT_EQ("text/html; charset=utf-8", res.header["Content-Type"]);
+    ASSERT_EQ(1, res.header.count("Server"));
+    ASSERT_EQ(1, res.header.count("Date"));
+}
+
+TEST(native_transport, post_form)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::NATIVE}};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::POST,
+                           "/test",
+                           [](auto req) -> luna::response
+                           {
+                               return {req.params["key"]};
+                           });
+
+    server.start_async();
+    auto res = cpr::Post(cpr::Url{"http://localhost:8080/test"}, cpr::Payload{{"key", "value"}});
+    ASSERT_EQ(201, res.status_code);
+    ASSERT_EQ("value", res.text);
+}
+
+TEST(native_transport, post_body)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::NATIVE}};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::POST,
+                           "/test",
+                           [](auto req) -> luna::response
+                           {
+                               return {"application/json", req.body};
+                           });
+
+    server.start_async();
+    std::string body{"{\"key\": \"" + std::string(100000, 'x') + "\"}"};
+    auto res = cpr::Post(cpr::Url{"http://localhost:8080/test"},
+                         cpr::Header{{"Content-Type", "application/json"}},
+                         cpr::Body{body});
+    ASSERT_EQ(201, res.status_code);
+    ASSERT_EQ(body, res.text);
+    ASSERT_EQ("application/json", res.header["Content-Type"]);
+}
+
+TEST(native_transport, not_found)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::NATIVE}};
+    server.create_router("/");
+
+    server.start_async();
+    auto res = cpr::Get(cpr::Url{"http://localhost:8080/nope"});
+    ASSERT_EQ(404, res.status_code);
+}
+
+TEST(native_transport, serve_file)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::NATIVE}};
+    auto router = server.create_router("/");
+    std::string path{STATIC_ASSET_PATH};
+    router->serve_files("/", path + "/tests/public");
+
+    server.start_async();
+    auto res = cpr::Get(cpr::Url{"http://localhost:8080/test.txt"});
+    ASSERT_EQ(200, res.status_code);
+    ASSERT_EQ("text/plain", res.header["Content-Type"]);
+    ASSERT_EQ("hello\n", res.text);
+
+    res = cpr::Get(cpr::Url{"http://localhost:8080/test/"});
+    ASSERT_EQ(200, res.status_code);
+    ASSERT_EQ("text/html; charset=utf-8", res.header["Content-Type"]);
+    ASSERT_EQ("hello html\n", res.text);
+}
+
+TEST(native_transport, restart)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::NATIVE}};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET,
+                           "/test",
+                           [](auto req) -> luna::response
+                           {
+                               return {"hello"};
+                           });
+
+    ASSERT_TRUE(server.start_async());
+    ASSERT_TRUE(static_cast<bool>(server));
+    server.stop();
+    ASSERT_FALSE(static_cast<bool>(server));
+    ASSERT_TRUE(server.start_async());
+    auto res = cpr::Get(cpr::Url{"http://localhost:8080/test"});
+    ASSERT_EQ(200, res.status_code);
+}
+
+TEST(native_transport, half_close)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::NATIVE}};
+    auto router = server.create_router("/");
+    std::atomic<bool> cancelled{false};
+    router->handle_request(luna::request_method::GET,
+                           "/test",
+                           [&cancelled](auto req) -> luna::response
+                           {
+                               std::this_thread::sleep_for(std::chrono::milliseconds{200});
+                               cancelled = req.cancellation.is_cancelled();
+                               return {"hello"};
+                           });
+    ASSERT_TRUE(server.start_async());
+
+    // a client may stop sending once its request is out, and still expects the response
+    auto client = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(8080);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(0, connect(client, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)));
+    std::string request{"GET /test HTTP/1.1\r\nHost: localhost\r\n\r\n"};
+    ASSERT_EQ(request.size(), send(client, request.data(), request.size(), 0));
+    shutdown(client, SHUT_WR);
+
+    std::string response;
+    char buffer[4096];
+    ssize_t received;
+    while ((received = recv(client, buffer, sizeof(buffer), 0)) > 0)
+    {
+        response.append(buffer, received);
+    }
+    close(client);
+
+    ASSERT_EQ(0, response.find("HTTP/1.1 200"));
+    ASSERT_NE(std::string::npos, response.find("Connection: close\r\n"));
+    ASSERT_EQ("hello", response.substr(response.size() - 5));
+    ASSERT_FALSE(cancelled);
+}
@@ -0,0 +1,83 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "test_helpers.h"
+#include "luna/private/path_normalizer.h"
+
+static OPT_NS::optional<std::string> normalized_(std::string path)
+{
+    if (!luna::normalize_path(path))
+    {
+        return OPT_NS::nullopt;
+    }
+    return path;
+}
+
+TEST(path_normalizer, normalizes)
+{
+    ASSERT_EQ(std::string{""}, *normalized_(""));
+    ASSERT_EQ(std::string{""}, *normalized_("/"));
+    ASSERT_EQ(std::string{""}, *normalized_("//./"));
+    ASSERT_EQ(std::string{"test.txt"}, *normalized_("/test.txt"));
+    ASSERT_EQ(std::string{"css/site.css"}, *normalized_("//css///./site.css/"));
+    ASSERT_EQ(std::string{"b/c"}, *normalized_("a/../b/./c"));
+    ASSERT_EQ(std::string{"a"}, *normalized_("a/b/c/../.."));
+    ASSERT_EQ(std::string{""}, *normalized_("a/.."));
+
+    // names that only look like traversal
+    ASSERT_EQ(std::string{"..."}, *normalized_("/..."));
+    ASSERT_EQ(std::string{"..a/.b"}, *normalized_("/..a/.b"));
+    ASSERT_EQ(std::string{"100%/50%25"}, *normalized_("/100%/50%25"));
+}
+
+TEST(path_normalizer, rejects_escapes)
+{
+    ASSERT_FALSE(normalized_(".."));
+    ASSERT_FALSE(normalized_("/../etc/passwd"));
+    ASSERT_FALSE(normalized_("a/../../etc/passwd"));
+    ASSERT_FALSE(normalized_("a/b/../c/../../.."));
+
+    // encoded once more than they should be
+    ASSERT_FALSE(normalized_("/%2e%2e/etc/passwd"));
+    ASSERT_FALSE(normalized_("/%2E./etc/passwd"));
+    ASSERT_FALSE(normalized_("/a/.%2e"));
+    ASSERT_FALSE(normalized_("/a/%2e"));
+    ASSERT_FALSE(normalized_("/..%2fetc/passwd"));
+    ASSERT_FALSE(normalized_("/..%5Cetc/passwd"));
+    ASSERT_FALSE(normalized_("/test.txt%00.html"));
+    ASSERT_FALSE(normalized_(std::string{"/test.txt\0.html", 15}));
+}
+
+TEST(path_normalizer, serve_files)
+{
+    std::string path{STATIC_ASSET_PATH};
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}};
+    auto router = server.create_router("/");
+    router->serve_files("/", path + "/tests/public");
+    server.start_async();
+
+    auto response = server.inject(make_request_("//./test.txt"));
+    ASSERT_EQ(200, response.status_code);
+
+    response = server.inject(make_request_("/test/../test.txt"));
+    ASSERT_EQ(200, response.status_code);
+
+    response = server.inject(make_request_("/../public/test.txt"));
+    ASSERT_EQ(404, response.status_code);
+
+    response = server.inject(make_request_("/%2e%2e/public/test.txt"));
+    ASSERT_EQ(404, response.status_code);
+}
@@ -0,0 +1,263 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "test_helpers.h"
+#include "luna/private/persistent_store.h"
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// a file of its own for each test, gone afterwards
+class persistent_file
+{
+public:
+    persistent_file() : path_{"/tmp/luna_log_test_" + std::to_string(getpid()) + "_" + std::to_string(next_++)}
+    {
+        unlink(path_.c_str());
+    }
+
+    ~persistent_file()
+    {
+        unlink(path_.c_str());
+    }
+
+    const std::string &path() const
+    { return path_; }
+
+    size_t size() const
+    {
+        struct stat st;
+        return stat(path_.c_str(), &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+    }
+
+private:
+    static int next_;
+    std::string path_;
+};
+
+int persistent_file::next_{0};
+
+static const size_t size_{8 * 1024 * 1024};
+
+using clock_ = luna::persistent_store::clock;
+
+static std::shared_ptr<std::string> value_(std::string value)
+{
+    return std::make_shared<std::string>(std::move(value));
+}
+
+static void await_load_(const luna::persistent_store &store)
+{
+    for (int i = 0; i < 500 && !store.loaded(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+}
+
+TEST(persistent_cache, survives_a_restart)
+{
+    persistent_file file;
+    auto later = clock_::now() + std::chrono::minutes{1};
+    {
+        luna::persistent_store store{file.path(), size_};
+        store.load();
+        await_load_(store);
+        ASSERT_TRUE(store.loaded());
+
+        store.write("key", value_({"bin\0ary", 7}), later);
+        store.write("other", value_("other"), later);
+        store.write("other", value_("newer"), later);
+        store.write("removed", value_("removed"), later);
+        store.write("removed", value_(""), later);
+        store.flush();
+        ASSERT_EQ(std::string("bin\0ary", 7), *store.read("key"));
+        ASSERT_FALSE(store.read("removed"));
+    } // whatever is still queued is written on the way out
+
+    luna::persistent_store store{file.path(), size_};
+    ASSERT_FALSE(store.read("key")); // not until it's loaded
+    store.load();
+    await_load_(store);
+    ASSERT_EQ(std::string("bin\0ary", 7), *store.read("key"));
+    ASSERT_EQ("newer", *store.read("other"));
+    ASSERT_FALSE(store.read("removed"));
+}
+
+TEST(persistent_cache, expired_records_are_not_loaded)
+{
+    persistent_file file;
+    {
+        luna::persistent_store store{file.path(), size_};
+        store.load();
+        store.write("brief", value_("brief"), clock_::now() + std::chrono::milliseconds{50});
+        store.write("lasting", value_("lasting"), clock_::now() + std::chrono::minutes{1});
+        store.flush();
+        ASSERT_EQ("brief", *store.read("brief"));
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+        ASSERT_FALSE(store.read("brief"));
+    }
+
+    luna::persistent_store store{file.path(), size_};
+    store.load();
+    await_load_(store);
+    ASSERT_FALSE(store.read("brief"));
+    ASSERT_EQ("lasting", *store.read("lasting"));
+}
+
+TEST(persistent_cache, incomplete_records_are_dropped)
+{
+    persistent_file file;
+    auto later = clock_::now() + std::chrono::minutes{1};
+    {
+        luna::persistent_store store{file.path(), size_};
+        store.load();
+        store.write("whole", value_("whole"), later);
+        store.write("cut short", value_(std::string(1000, 'x')), later);
+        store.flush();
+    }
+    ASSERT_EQ(0, truncate(file.path().c_str(), static_cast<off_t>(file.size() - 10)));
+    auto truncated = file.size();
+
+    {
+        luna::persistent_store store{file.path(), size_};
+        store.load();
+        await_load_(store);
+        ASSERT_EQ("whole", *store.read("whole"));
+        ASSERT_FALSE(store.read("cut short"));
+        ASSERT_LT(store.size(), truncated);
+
+        // and new records go where it was
+        store.write("after", value_("after"), later);
+    }
+
+    luna::persistent_store store{file.path(), size_};
+    store.load();
+    await_load_(store);
+    ASSERT_EQ("whole", *store.read("whole"));
+    ASSERT_EQ("after", *store.read("after"));
+
+    // nor is anything taken from a file written by something else
+    persistent_file other;
+    {
+        std::ofstream out{other.path()};
+        out << "not a log at all";
+    }
+    luna::persistent_store garbage{other.path(), size_};
+    garbage.load();
+    await_load_(garbage);
+    ASSERT_TRUE(garbage.loaded());
+    ASSERT_FALSE(garbage.read("not a log at all"));
+}
+
+TEST(persistent_cache, one_process_at_a_time)
+{
+    persistent_file file;
+    luna::persistent_store first{file.path(), size_};
+    first.load();
+    await_load_(first);
+    ASSERT_TRUE(first.loaded());
+
+    luna::persistent_store second{file.path(), size_};
+    second.load();
+    second.write("key", value_("value"), clock_::now() + std::chrono::minutes{1});
+    second.flush();
+    ASSERT_FALSE(second.loaded());
+    ASSERT_FALSE(first.read("key"));
+}
+
+TEST(persistent_cache, compaction)
+{
+    persistent_file file;
+    auto later = clock_::now() + std::chrono::minutes{1};
+    luna::persistent_store store{file.path(), size_};
+    store.load();
+    await_load_(store);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        store.write("key " + std::to_string(i % 10), value_(std::string(1000, static_cast<char>('a' + i % 26))), later);
+        if (i % 100 == 99)
+        {
+            store.flush(); // don't overrun the queue
+        }
+    }
+    store.write("brief", value_("brief"), clock_::now() + std::chrono::milliseconds{10});
+    store.flush();
+    auto before = store.size();
+    ASSERT_GT(before, 1000000U);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    store.compact();
+    ASSERT_LT(store.size(), 20000U);
+    ASSERT_EQ(store.size(), file.size());
+    ASSERT_EQ(std::string(1000, static_cast<char>('a' + 999 % 26)), *store.read("key 9"));
+    ASSERT_FALSE(store.read("brief"));
+
+    // it goes on as it was
+    store.write("key 0", value_("after"), later);
+    store.flush();
+    ASSERT_EQ("after", *store.read("key 0"));
+
+    // and happens by itself once the log is mostly dead
+    for (int i = 0; i < 3000; ++i)
+    {
+        store.write("key", value_(std::string(1000, 'x')), later);
+        if (i % 100 == 99)
+        {
+            store.flush();
+        }
+    }
+    store.flush();
+    ASSERT_LT(store.size(), size_ / 2);
+    ASSERT_EQ(std::string(1000, 'x'), *store.read("key"));
+}
+
+TEST(persistent_cache, response_cache)
+{
+    persistent_file file;
+    luna::server::response_cache cache;
+    cache.persistent_path = file.path();
+    cache.persistent_size = size_;
+
+    std::atomic<int> calls{0};
+    auto handler = [&calls](const luna::request &req) -> luna::response
+    {
+        return {"call " + std::to_string(++calls)};
+    };
+
+    {
+        luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}, cache};
+        server.create_router("/")->handle_request(luna::request_method::GET, "/warm", handler, {},
+                                                  luna::router::cache_for{std::chrono::minutes{1}});
+        server.start_async();
+        ASSERT_EQ("call 1", server.inject(make_request_("/warm")).content);
+    }
+
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK}, cache};
+    server.create_router("/")->handle_request(luna::request_method::GET, "/warm", handler, {},
+                                              luna::router::cache_for{std::chrono::minutes{1}});
+    server.start_async();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds{100}); // it's loaded in the background
+    ASSERT_EQ("call 1", server.inject(make_request_("/warm")).content);
+    ASSERT_EQ(1, calls);
+
+    // purging reaches the disk too
+    server.purge_cached_path("/warm");
+    ASSERT_EQ("call 2", server.inject(make_request_("/warm")).content);
+}
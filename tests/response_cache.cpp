@@ -0,0 +1,443 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "test_helpers.h"
+#include "luna/private/tiered_response_cache.h"
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+// a stand-in for memcached and the like
+class shared_store
+{
+public:
+    std::pair<luna::cache::read, luna::cache::write> accessors()
+    {
+        return luna::cache::build([this](const std::string &key) -> std::shared_ptr<std::string>
+                                  {
+                                      std::lock_guard<std::mutex> lock{mutex_};
+                                      auto value = values_.find(key);
+                                      if (value == values_.end())
+                                      {
+                                          return nullptr;
+                                      }
+                                      return std::make_shared<std::string>(value->second);
+                                  },
+                                  [this](const std::string &key, std::shared_ptr<std::string> value)
+                                  {
+                                      std::lock_guard<std::mutex> lock{mutex_};
+                                      values_[key] = *value;
+                                      changed_.notify_all();
+                                  });
+    }
+
+    void wait_for_values(size_t count)
+    {
+        std::unique_lock<std::mutex> lock{mutex_};
+        changed_.wait_for(lock, std::chrono::seconds{5}, [this, count]
+        { return values_.size() >= count; });
+    }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return values_.size();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::map<std::string, std::string> values_;
+};
+
+TEST(response_cache, hits_skip_the_handler)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        luna::server::response_cache{}};
+
+    std::atomic<int> calls{0};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/cached", [&calls](const luna::request &req) -> luna::response
+    {
+        return {"call " + std::to_string(++calls)};
+    }, {}, luna::router::cache_for{std::chrono::minutes{1}});
+    router->handle_request(luna::request_method::GET, "/uncached", [&calls](const luna::request &req) -> luna::response
+    {
+        return {"call " + std::to_string(++calls)};
+    });
+    server.start_async();
+
+    auto res = server.inject(make_request_("/cached", {{"page", "1"}}));
+    ASSERT_EQ(200, res.status_code);
+    ASSERT_EQ("call 1", res.content);
+    ASSERT_EQ("text/html; charset=utf-8", res.content_type);
+    ASSERT_EQ("call 1", server.inject(make_request_("/cached", {{"page", "1"}})).content);
+    ASSERT_EQ(1, calls);
+
+    // different parameters make a different request
+    ASSERT_EQ("call 2", server.inject(make_request_("/cached", {{"page", "2"}})).content);
+
+    // and endpoints that don't ask for caching don't get it
+    ASSERT_EQ("call 3", server.inject(make_request_("/uncached")).content);
+    ASSERT_EQ("call 4", server.inject(make_request_("/uncached")).content);
+}
+
+TEST(response_cache, entries_expire)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        luna::server::response_cache{}};
+
+    std::atomic<int> calls{0};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/brief", [&calls](const luna::request &req) -> luna::response
+    {
+        return {"call " + std::to_string(++calls)};
+    }, {}, luna::router::cache_for{std::chrono::milliseconds{100}});
+    server.start_async();
+
+    ASSERT_EQ("call 1", server.inject(make_request_("/brief")).content);
+    ASSERT_EQ("call 1", server.inject(make_request_("/brief")).content);
+    std::this_thread::sleep_for(std::chrono::milliseconds{150});
+    ASSERT_EQ("call 2", server.inject(make_request_("/brief")).content);
+}
+
+TEST(response_cache, uncacheable_responses_are_not_kept)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        luna::server::response_cache{}};
+
+    std::atomic<int> calls{0};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/error", [&calls](const luna::request &req) -> luna::response
+    {
+        ++calls;
+        return {500, "oops"};
+    }, {}, luna::router::cache_for{std::chrono::minutes{1}});
+    router->handle_request(luna::request_method::GET, "/cookie", [&calls](const luna::request &req) -> luna::response
+    {
+        luna::response res{"hello"};
+        res.headers["Set-Cookie"] = "session=" + std::to_string(++calls);
+        return res;
+    }, {}, luna::router::cache_for{std::chrono::minutes{1}});
+    router->handle_request(luna::request_method::GET, "/varies", [](const luna::request &req) -> luna::response
+    {
+        luna::response res{req.headers.count("Accept-Language") ? req.headers.at("Accept-Language") : "en"};
+        res.headers["Vary"] = "Accept-Language";
+        return res;
+    }, {}, luna::router::cache_for{std::chrono::minutes{1}});
+    server.start_async();
+
+    // the key doesn't include the headers a response varies on
+    ASSERT_EQ("fr", server.inject(make_request_("/varies", {}, {{"Accept-Language", "fr"}})).content);
+    ASSERT_EQ("de", server.inject(make_request_("/varies", {}, {{"Accept-Language", "de"}})).content);
+
+    server.inject(make_request_("/error"));
+    server.inject(make_request_("/error"));
+    ASSERT_EQ(2, calls);
+
+    ASSERT_EQ("session=3", server.inject(make_request_("/cookie")).headers["Set-Cookie"]);
+    ASSERT_EQ("session=4", server.inject(make_request_("/cookie")).headers["Set-Cookie"]);
+}
+
+TEST(response_cache, credentials_are_part_of_the_key)
+{
+    shared_store store;
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        luna::server::response_cache{store.accessors()}};
+
+    auto router = server.create_router("/");
+    router->require_bearer_authorization("test", [](const std::string &token)
+    {
+        return token == "alice" || token == "bob";
+    });
+    router->handle_request(luna::request_method::GET, "/me", [](const luna::request &req) -> luna::response
+    {
+        return {req.headers.at("Authorization")};
+    }, {}, luna::router::cache_for{std::chrono::minutes{1}});
+    server.start_async();
+
+    ASSERT_EQ("Bearer alice", server.inject(make_request_("/me", {}, {{"Authorization", "Bearer alice"}})).content);
+    ASSERT_EQ("Bearer bob", server.inject(make_request_("/me", {}, {{"Authorization", "Bearer bob"}})).content);
+    ASSERT_EQ(401, server.inject(make_request_("/me")).status_code);
+
+    // and what's only for one user never leaves this server
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    ASSERT_EQ(0, store.size());
+}
+
+TEST(response_cache, shared_store)
+{
+    shared_store store;
+    std::atomic<int> calls{0};
+    auto handler = [&calls](const luna::request &req) -> luna::response
+    {
+        ++calls;
+        return {"application/octet-stream", std::string{"bin\0ary", 7}};
+    };
+
+    luna::server first{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                       luna::server::response_cache{store.accessors()}};
+    first.create_router("/")->handle_request(luna::request_method::GET, "/shared", handler, {},
+                                             luna::router::cache_for{std::chrono::minutes{1}});
+    first.start_async();
+
+    luna::server second{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        luna::server::response_cache{store.accessors()}};
+    second.create_router("/")->handle_request(luna::request_method::GET, "/shared", handler, {},
+                                              luna::router::cache_for{std::chrono::minutes{1}});
+    second.start_async();
+
+    ASSERT_EQ(std::string("bin\0ary", 7), first.inject(make_request_("/shared")).content);
+    store.wait_for_values(1);
+
+    // the second server finds the first one's response in the shared store
+    auto res = second.inject(make_request_("/shared"));
+    ASSERT_EQ(200, res.status_code);
+    ASSERT_EQ("application/octet-stream", res.content_type);
+    ASSERT_EQ(std::string("bin\0ary", 7), res.content);
+    ASSERT_EQ(1, calls);
+}
+
+TEST(response_cache, stale_while_revalidate)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        luna::server::response_cache{}};
+
+    std::mutex mutex;
+    std::condition_variable called;
+    int calls{0};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/popular", [&](const luna::request &req) -> luna::response
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        called.notify_all();
+        return {"call " + std::to_string(++calls)};
+    }, {}, luna::router::cache_for{std::chrono::milliseconds{100}},
+                           luna::router::stale_while_revalidate{std::chrono::minutes{1}});
+    server.start_async();
+
+    ASSERT_EQ("call 1", server.inject(make_request_("/popular")).content);
+    std::this_thread::sleep_for(std::chrono::milliseconds{150});
+
+    // expired, so it's answered with straight away, and replaced in the background
+    ASSERT_EQ("call 1", server.inject(make_request_("/popular")).content);
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        ASSERT_TRUE(called.wait_for(lock, std::chrono::seconds{5}, [&calls]
+        { return calls == 2; }));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds{20}); // for the new response to be stored
+
+    ASSERT_EQ("call 2", server.inject(make_request_("/popular")).content);
+}
+
+TEST(response_cache, stale_if_error)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        luna::server::response_cache{}};
+
+    std::atomic<bool> failing{false};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/flaky", [&failing](const luna::request &req) -> luna::response
+    {
+        if (failing)
+        {
+            throw std::runtime_error{"unavailable"};
+        }
+        return {"fine"};
+    }, {}, luna::router::cache_for{std::chrono::milliseconds{50}},
+                           luna::router::stale_if_error{std::chrono::milliseconds{200}});
+    router->handle_request(luna::request_method::GET, "/overloaded", [&failing](const luna::request &req) -> luna::response
+    {
+        if (failing)
+        {
+            return {503, "try later"};
+        }
+        return {"fine"};
+    }, {}, luna::router::cache_for{std::chrono::milliseconds{50}},
+                           luna::router::stale_if_error{std::chrono::milliseconds{200}});
+    server.start_async();
+
+    ASSERT_EQ("fine", server.inject(make_request_("/flaky")).content);
+    ASSERT_EQ("fine", server.inject(make_request_("/overloaded")).content);
+    failing = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+
+    // expired, but there's nothing better
+    auto res = server.inject(make_request_("/flaky"));
+    ASSERT_EQ(200, res.status_code);
+    ASSERT_EQ("fine", res.content);
+    ASSERT_EQ("fine", server.inject(make_request_("/overloaded")).content);
+
+    // until it's too old even for that
+    std::this_thread::sleep_for(std::chrono::milliseconds{200});
+    ASSERT_EQ(500, server.inject(make_request_("/flaky")).status_code);
+    ASSERT_EQ(503, server.inject(make_request_("/overloaded")).status_code);
+}
+
+TEST(response_cache, purging)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        luna::server::response_cache{}};
+
+    std::atomic<int> calls{0};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/products/.*", [&calls](const luna::request &req) -> luna::response
+    {
+        ++calls;
+        luna::response res{req.path};
+        res.headers["Surrogate-Key"] = "products " + req.path.substr(10);
+        return res;
+    }, {}, luna::router::cache_for{std::chrono::minutes{1}});
+    server.start_async();
+
+    auto fill = [&server]
+    {
+        for (auto path : {"/products/1", "/products/2", "/products/10"})
+        {
+            server.inject(make_request_(path));
+            server.inject(make_request_(path, {{"format", "json"}}));
+        }
+    };
+    fill();
+    ASSERT_EQ(6, calls);
+    fill();
+    ASSERT_EQ(6, calls);
+
+    ASSERT_EQ(2, server.purge_cached_tag("1"));
+    ASSERT_EQ(0, server.purge_cached_tag("1"));
+    ASSERT_EQ(0, server.purge_cached_tag("nothing"));
+    ASSERT_EQ(1, server.purge_cached_request("/products/2", {{"format", "json"}}));
+    ASSERT_EQ(1, server.purge_cached_path("/products/2"));
+    ASSERT_EQ(2, server.purge_cached_path("/products/10"));
+
+    fill();
+    ASSERT_EQ(12, calls);
+    ASSERT_EQ(6, server.purge_cached_prefix("/products/"));
+    ASSERT_EQ(0, server.purge_cached_tag("products")); // went with them
+
+    fill();
+    ASSERT_EQ(6, server.purge_cached_tag("products"));
+    ASSERT_EQ(0, server.purge_cached_prefix("/"));
+}
+
+TEST(response_cache, purging_the_shared_store)
+{
+    shared_store store;
+    std::atomic<int> calls{0};
+    auto handler = [&calls](const luna::request &req) -> luna::response
+    {
+        return {"call " + std::to_string(++calls)};
+    };
+
+    luna::server first{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                       luna::server::response_cache{store.accessors()}};
+    first.create_router("/")->handle_request(luna::request_method::GET, "/shared", handler, {},
+                                             luna::router::cache_for{std::chrono::minutes{1}});
+    first.start_async();
+
+    luna::server second{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        luna::server::response_cache{store.accessors()}};
+    second.create_router("/")->handle_request(luna::request_method::GET, "/shared", handler, {},
+                                              luna::router::cache_for{std::chrono::minutes{1}});
+    second.start_async();
+
+    ASSERT_EQ("call 1", first.inject(make_request_("/shared")).content);
+    store.wait_for_values(1);
+
+    // once the first server purges it, the second can't find it in the shared store either
+    ASSERT_EQ(1, first.purge_cached_path("/shared"));
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    ASSERT_EQ("call 2", second.inject(make_request_("/shared")).content);
+}
+
+TEST(response_cache, admin_router)
+{
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        luna::server::response_cache{}};
+
+    std::atomic<int> calls{0};
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET, "/page", [&calls](const luna::request &req) -> luna::response
+    {
+        luna::response res{"call " + std::to_string(++calls)};
+        res.headers["Surrogate-Key"] = "pages";
+        return res;
+    }, {}, luna::router::cache_for{std::chrono::minutes{1}});
+    auto admin = server.create_router("/admin");
+    admin->serve_cache_admin("/cache");
+    server.start_async();
+
+    auto purge = [&server](luna::query_params params)
+    {
+        auto req = make_request_("/admin/cache", std::move(params));
+        req.method = luna::request_method::POST;
+        return server.inject(std::move(req));
+    };
+
+    server.inject(make_request_("/page"));
+    server.inject(make_request_("/page", {{"n", "2"}}));
+
+    auto res = purge({{"tag", "pages"}});
+    ASSERT_EQ(200, res.status_code);
+    ASSERT_EQ("application/json", res.content_type);
+    ASSERT_EQ("{\"purged\": 2}", res.content);
+
+    server.inject(make_request_("/page"));
+    ASSERT_EQ("{\"purged\": 1}", purge({{"path", "/page"}}).content);
+    server.inject(make_request_("/page"));
+    ASSERT_EQ("{\"purged\": 1}", purge({{"prefix", "/pa"}}).content);
+
+    ASSERT_EQ(400, purge({}).status_code);
+    ASSERT_EQ(400, purge({{"tag", "pages"}, {"path", "/page"}}).status_code);
+}
+
+TEST(response_cache, encoding)
+{
+    luna::response res{203, "image/x-test", std::string{"\0\1\2\xff", 4}};
+    res.headers["X-Thing"] = std::string{"a\0b", 3};
+    auto now = luna::tiered_response_cache::clock::now();
+    luna::tiered_response_cache::expiry expires{now + std::chrono::minutes{1},
+                                                now + std::chrono::minutes{2},
+                                                now + std::chrono::minutes{3}};
+
+    auto encoded = luna::tiered_response_cache::encode("/key", res, expires);
+
+    luna::response decoded;
+    luna::tiered_response_cache::expiry decoded_expires;
+    ASSERT_TRUE(luna::tiered_response_cache::decode(encoded, "/key", decoded, decoded_expires));
+    ASSERT_EQ(203, decoded.status_code);
+    ASSERT_EQ("image/x-test", decoded.content_type);
+    ASSERT_EQ(res.content, decoded.content);
+    ASSERT_EQ(res.headers["X-Thing"], decoded.headers["X-Thing"]);
+    ASSERT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(expires.fresh_until -
+                                                                     decoded_expires.fresh_until).count(), 1);
+    ASSERT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(expires.revalidate_until -
+                                                                     decoded_expires.revalidate_until).count(), 1);
+    ASSERT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(expires.error_until -
+                                                                     decoded_expires.error_until).count(), 1);
+
+    // anything truncated, for another key, or not ours at all, is rejected
+    ASSERT_FALSE(luna::tiered_response_cache::decode(encoded, "/other", decoded, decoded_expires));
+    for (size_t length = 0; length < encoded.size(); ++length)
+    {
+        ASSERT_FALSE(luna::tiered_response_cache::decode(encoded.substr(0, length), "/key", decoded, decoded_expires));
+    }
+    ASSERT_FALSE(luna::tiered_response_cache::decode(encoded + "x", "/key", decoded, decoded_expires));
+    ASSERT_FALSE(luna::tiered_response_cache::decode("some other value", "/key", decoded, decoded_expires));
+}
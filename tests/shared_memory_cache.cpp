@@ -0,0 +1,231 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "test_helpers.h"
+#include "luna/private/shared_memory_store.h"
+#include <atomic>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// a file of its own for each test, gone afterwards
+class shared_memory_file
+{
+public:
+    shared_memory_file() : path_{"/tmp/luna_shm_test_" + std::to_string(getpid()) + "_" + std::to_string(next_++)}
+    {
+        unlink(path_.c_str());
+    }
+
+    ~shared_memory_file()
+    {
+        unlink(path_.c_str());
+    }
+
+    const std::string &path() const
+    { return path_; }
+
+private:
+    static int next_;
+    std::string path_;
+};
+
+int shared_memory_file::next_{0};
+
+static const size_t size_{8 * 1024 * 1024};
+
+TEST(shared_memory_cache, read_and_write)
+{
+    shared_memory_file file;
+    luna::shared_memory_store store{file.path(), size_};
+    ASSERT_TRUE(store);
+
+    ASSERT_FALSE(store.read("missing"));
+
+    store.write("key", std::string{"bin\0ary", 7});
+    auto value = store.read("key");
+    ASSERT_TRUE(value);
+    ASSERT_EQ(std::string("bin\0ary", 7), *value);
+
+    // values move between size classes as they grow
+    store.write("key", std::string(100000, 'x'));
+    ASSERT_EQ(std::string(100000, 'x'), *store.read("key"));
+    store.write("key", "small");
+    ASSERT_EQ("small", *store.read("key"));
+
+    // an empty value removes the key, as does one too large to store
+    store.write("key", "");
+    ASSERT_FALSE(store.read("key"));
+    store.write("key", "small");
+    store.write("key", std::string(store.max_entry_size() + 1, 'x'));
+    ASSERT_FALSE(store.read("key"));
+}
+
+TEST(shared_memory_cache, shared_between_mappings)
+{
+    shared_memory_file file;
+    luna::shared_memory_store first{file.path(), size_};
+    luna::shared_memory_store second{file.path(), size_};
+    ASSERT_TRUE(first);
+    ASSERT_TRUE(second);
+
+    first.write("key", "value");
+    ASSERT_EQ("value", *second.read("key"));
+
+    // but not with a file of another size
+    luna::shared_memory_store different{file.path(), size_ * 2};
+    ASSERT_FALSE(different);
+    ASSERT_FALSE(different.read("key"));
+}
+
+TEST(shared_memory_cache, shared_between_processes)
+{
+    shared_memory_file file;
+    luna::shared_memory_store parent{file.path(), size_};
+    ASSERT_TRUE(parent);
+    parent.write("from the parent", "hello");
+
+    auto child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0)
+    {
+        luna::shared_memory_store store{file.path(), size_};
+        auto value = store.read("from the parent");
+        store.write("from the child", value ? *value + " yourself" : "nothing");
+        _exit(0);
+    }
+
+    int status;
+    ASSERT_EQ(child, waitpid(child, &status, 0));
+    auto value = parent.read("from the child");
+    ASSERT_TRUE(value);
+    ASSERT_EQ("hello yourself", *value);
+}
+
+TEST(shared_memory_cache, eviction)
+{
+    shared_memory_file file;
+    luna::shared_memory_store store{file.path(), size_};
+    ASSERT_TRUE(store);
+
+    // far more than fits
+    std::string value(1000, 'x');
+    for (int i = 0; i < 20000; ++i)
+    {
+        store.write("key " + std::to_string(i), value);
+    }
+
+    // the most recent is still there, and what is there is intact
+    ASSERT_EQ(value, *store.read("key 19999"));
+    int found{0};
+    for (int i = 0; i < 20000; ++i)
+    {
+        auto read = store.read("key " + std::to_string(i));
+        if (read)
+        {
+            ASSERT_EQ(value, *read);
+            ++found;
+        }
+    }
+    ASSERT_GT(found, 100);
+    ASSERT_LT(found, 20000);
+}
+
+TEST(shared_memory_cache, concurrent_readers_see_whole_values)
+{
+    shared_memory_file file;
+    luna::shared_memory_store store{file.path(), size_};
+    ASSERT_TRUE(store);
+
+    // each value is one character repeated, so a torn read would show
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> writers;
+    for (int w = 0; w < 2; ++w)
+    {
+        writers.emplace_back([&store, &stop, w]
+                             {
+                                 for (int i = 0; !stop; ++i)
+                                 {
+                                     auto c = static_cast<char>('a' + (i + w) % 26);
+                                     store.write("key " + std::to_string(i % 8), std::string(100 + (i % 3) * 3000, c));
+                                 }
+                             });
+    }
+
+    std::atomic<int> torn{0}, seen{0};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; ++r)
+    {
+        readers.emplace_back([&store, &torn, &seen]
+                             {
+                                 for (int i = 0; i < 20000; ++i)
+                                 {
+                                     auto value = store.read("key " + std::to_string(i % 8));
+                                     if (!value)
+                                     {
+                                         continue;
+                                     }
+                                     ++seen;
+                                     if (value->find_first_not_of((*value)[0]) != std::string::npos)
+                                     {
+                                         ++torn;
+                                     }
+                                 }
+                             });
+    }
+    for (auto &reader : readers)
+    {
+        reader.join();
+    }
+    stop = true;
+    for (auto &writer : writers)
+    {
+        writer.join();
+    }
+
+    ASSERT_GT(seen, 0);
+    ASSERT_EQ(0, torn);
+}
+
+TEST(shared_memory_cache, response_cache)
+{
+    shared_memory_file file;
+    luna::server::response_cache cache;
+    cache.shared_memory_path = file.path();
+    cache.shared_memory_size = size_;
+
+    std::atomic<int> calls{0};
+    auto handler = [&calls](const luna::request &req) -> luna::response
+    {
+        return {"call " + std::to_string(++calls)};
+    };
+
+    luna::server first{luna::server::transport{luna::server::transport_kind::LOOPBACK}, cache};
+    first.create_router("/")->handle_request(luna::request_method::GET, "/shared", handler, {},
+                                             luna::router::cache_for{std::chrono::minutes{1}});
+    first.start_async();
+
+    luna::server second{luna::server::transport{luna::server::transport_kind::LOOPBACK}, cache};
+    second.create_router("/")->handle_request(luna::request_method::GET, "/shared", handler, {},
+                                              luna::router::cache_for{std::chrono::minutes{1}});
+    second.start_async();
+
+    ASSERT_EQ("call 1", first.inject(make_request_("/shared")).content);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds{100}); // it's written in the background
+    ASSERT_EQ("call 1", second.inject(make_request_("/shared")).content);
+    ASSERT_EQ(1, calls);
+}
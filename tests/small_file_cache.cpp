@@ -0,0 +1,127 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "luna/private/response_renderer.h"
+#include <fstream>
+#include <unistd.h>
+
+// files of their own for each test, gone afterwards
+class small_files
+{
+public:
+    small_files() : prefix_{"/tmp/luna_small_file_test_" + std::to_string(getpid()) + "_" + std::to_string(next_++)}
+    {}
+
+    ~small_files()
+    {
+        for (const auto &path : written_)
+        {
+            unlink(path.c_str());
+        }
+    }
+
+    std::string write(const std::string &name, const std::string &contents)
+    {
+        auto path = prefix_ + "_" + name;
+        std::ofstream out{path};
+        out << contents;
+        written_.emplace_back(path);
+        return path;
+    }
+
+private:
+    static int next_;
+    std::string prefix_;
+    std::vector<std::string> written_;
+};
+
+int small_files::next_{0};
+
+static std::shared_ptr<luna::cacheable_response> render_(luna::response_renderer &renderer,
+                                                          const std::string &path,
+                                                          luna::response_headers headers = {})
+{
+    luna::request req{};
+    req.method = luna::request_method::GET;
+    auto res = luna::response::from_file(path);
+    res.headers = std::move(headers);
+    return renderer.render(req, res);
+}
+
+TEST(small_file_cache, shared_between_requests)
+{
+    small_files files;
+    auto path = files.write("style.css", "body {}");
+    luna::response_renderer renderer;
+
+    auto first = render_(renderer, path);
+    ASSERT_EQ(200, first->status_code);
+    ASSERT_TRUE(first->content);
+    ASSERT_EQ("body {}", *first->content);
+    ASSERT_EQ(first, render_(renderer, path));
+
+    // but only with the same headers
+    auto other = render_(renderer, path, {{"Cache-Control", "no-cache"}});
+    ASSERT_NE(first, other);
+    ASSERT_EQ(other, render_(renderer, path, {{"Cache-Control", "no-cache"}}));
+}
+
+TEST(small_file_cache, follows_changes)
+{
+    small_files files;
+    auto path = files.write("data.json", "{}");
+    luna::response_renderer renderer;
+
+    auto first = render_(renderer, path);
+    files.write("data.json", "{\"changed\": true}");
+    auto second = render_(renderer, path);
+    ASSERT_NE(first, second);
+    ASSERT_EQ("{\"changed\": true}", *second->content);
+    ASSERT_EQ("{}", *first->content); // still good for whoever was sending it
+
+    renderer.file_changed(path);
+    ASSERT_NE(second, render_(renderer, path));
+}
+
+TEST(small_file_cache, only_small_files)
+{
+    small_files files;
+    auto small = files.write("small.txt", std::string(100, 'x'));
+    auto large = files.write("large.txt", std::string(1000, 'x'));
+    luna::response_renderer renderer;
+    renderer.set_option(luna::server::small_file_max_size{500});
+
+    ASSERT_TRUE(render_(renderer, small)->content);
+    ASSERT_FALSE(render_(renderer, large)->content);
+
+    luna::response_renderer off;
+    off.set_option(luna::server::small_file_cache_size{0});
+    ASSERT_FALSE(render_(off, small)->content);
+}
+
+TEST(small_file_cache, within_budget)
+{
+    small_files files;
+    auto a = files.write("a.txt", std::string(600, 'a'));
+    auto b = files.write("b.txt", std::string(600, 'b'));
+    luna::response_renderer renderer;
+    renderer.set_option(luna::server::small_file_cache_size{1000});
+
+    auto first = render_(renderer, a);
+    ASSERT_EQ(first, render_(renderer, a));
+    render_(renderer, b); // no room for both
+    ASSERT_NE(first, render_(renderer, a));
+}
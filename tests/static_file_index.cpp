@@ -0,0 +1,195 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include <luna/luna.h>
+#include "test_helpers.h"
+#include "luna/private/static_file_index.h"
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// a directory of its own for each test, gone afterwards
+class static_tree
+{
+public:
+    static_tree()
+    {
+        char path[] = "/tmp/luna_tree_test_XXXXXX";
+        path_ = mkdtemp(path);
+    }
+
+    ~static_tree()
+    {
+        std::system(("rm -rf " + path_).c_str());
+    }
+
+    const std::string &path() const
+    { return path_; }
+
+    void write(const std::string &name, const std::string &contents) const
+    {
+        std::ofstream out{path_ + "/" + name};
+        out << contents;
+    }
+
+    void make_directory(const std::string &name) const
+    {
+        mkdir((path_ + "/" + name).c_str(), 0700);
+    }
+
+private:
+    std::string path_;
+};
+
+// wait for the index to notice a change
+template<typename F>
+static bool eventually_(F &&condition)
+{
+    for (int i = 0; i < 300; ++i)
+    {
+        if (condition())
+        {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    return false;
+}
+
+#if defined(__linux__)
+
+TEST(static_file_index, finds_files)
+{
+    static_tree tree;
+    tree.write("hello.txt", "hello");
+    tree.write("style.css", "body {}");
+    tree.make_directory("docs");
+    tree.write("docs/index.html", "<html></html>");
+    tree.make_directory("empty");
+
+    luna::static_file_index index{tree.path(), [](const std::string &path)
+    {}};
+    ASSERT_TRUE(index);
+
+    auto file = index.find("hello.txt");
+    ASSERT_TRUE(file);
+    ASSERT_EQ(tree.path() + "/hello.txt", file->path);
+    ASSERT_EQ(5U, file->size);
+    ASSERT_EQ("text/plain", file->mime_type.substr(0, 10));
+    ASSERT_EQ("text/css", index.find("/style.css")->mime_type.substr(0, 8));
+
+    // directories are served as their index files, however they're asked for
+    for (auto path : {"docs", "/docs", "docs/", "/docs/", "docs/index.html", "./docs/../docs//"})
+    {
+        file = index.find(path);
+        ASSERT_TRUE(file) << path;
+        ASSERT_EQ(tree.path() + "/docs/index.html", file->path) << path;
+    }
+
+    // and nothing else is found
+    ASSERT_FALSE(index.find("missing.txt"));
+    ASSERT_FALSE(index.find("empty"));
+    ASSERT_FALSE(index.find(""));
+    ASSERT_FALSE(index.find("wp-admin/install.php"));
+    ASSERT_FALSE(index.find("../" + tree.path().substr(tree.path().rfind('/') + 1) + "/hello.txt"));
+}
+
+TEST(static_file_index, follows_changes)
+{
+    static_tree tree;
+    tree.write("hello.txt", "hello");
+    tree.write("going.txt", "going");
+
+    std::mutex lock;
+    std::set<std::string> changed;
+    luna::static_file_index index{tree.path(), [&](const std::string &path)
+    {
+        std::lock_guard<std::mutex> guard{lock};
+        changed.emplace(path);
+    }};
+    ASSERT_TRUE(index);
+    auto was_changed = [&](const std::string &name)
+    {
+        std::lock_guard<std::mutex> guard{lock};
+        return changed.count(tree.path() + "/" + name) > 0;
+    };
+
+    tree.write("new.txt", "new");
+    ASSERT_TRUE(eventually_([&]
+                            { return index.find("new.txt") != nullptr; }));
+
+    tree.write("hello.txt", "hello again");
+    ASSERT_TRUE(eventually_([&]
+                            { return index.find("hello.txt")->size == 11; }));
+    ASSERT_TRUE(eventually_([&]
+                            { return was_changed("hello.txt"); }));
+
+    unlink((tree.path() + "/going.txt").c_str());
+    ASSERT_TRUE(eventually_([&]
+                            { return index.find("going.txt") == nullptr; }));
+    ASSERT_TRUE(eventually_([&]
+                            { return was_changed("going.txt"); }));
+    ASSERT_FALSE(was_changed("new.txt"));
+
+    // including in directories that weren't there to begin with
+    tree.make_directory("later");
+    std::this_thread::sleep_for(std::chrono::milliseconds{200}); // for it to be noticed, and watched
+    tree.write("later/index.html", "later");
+    ASSERT_TRUE(eventually_([&]
+                            { return index.find("later") != nullptr; }));
+}
+
+#endif // __linux__
+
+TEST(static_file_index, missing_directory)
+{
+    luna::static_file_index index{"/no/such/luna/directory", [](const std::string &path)
+    {}};
+    ASSERT_FALSE(index);
+    ASSERT_FALSE(index.find("anything"));
+}
+
+TEST(static_file_index, serve_files)
+{
+    static_tree tree;
+    tree.write("hello.txt", "hello");
+
+    luna::server server{luna::server::transport{luna::server::transport_kind::LOOPBACK},
+                        [](const luna::request &req, luna::response &res)
+                        {
+                            res.content = "NOPE!";
+                        }};
+    server.create_router("/")->serve_files("/static", tree.path() + "/");
+    server.start_async();
+
+    auto response = server.inject(make_request_("/static/hello.txt"));
+    ASSERT_EQ(200, response.status_code);
+    ASSERT_EQ(tree.path() + "/hello.txt", response.file);
+    ASSERT_EQ("text/plain", response.content_type.substr(0, 10));
+
+    response = server.inject(make_request_("/static/wp-admin/"));
+    ASSERT_EQ(404, response.status_code);
+    ASSERT_EQ("NOPE!", response.content);
+
+    // files that appear are served as soon as they're noticed
+    tree.write("new.txt", "new");
+    ASSERT_TRUE(eventually_([&]
+                            { return server.inject(make_request_("/static/new.txt")).status_code == 200; }));
+}
@@ -0,0 +1,78 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+
+#pragma once
+
+#include <luna/luna.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <utility>
+
+// Helpers shared between the tests
+
+// a request as a transport would hand it over, for server::inject()
+inline luna::request make_request_(luna::request_method method,
+                                   std::string path,
+                                   luna::query_params params = {},
+                                   luna::request_headers headers = {})
+{
+    luna::request req{};
+    req.method = method;
+    req.path = std::move(path);
+    req.http_version = "HTTP/1.1";
+    req.params = std::move(params);
+    req.headers = std::move(headers);
+    return req;
+}
+
+inline luna::request make_request_(std::string path, luna::query_params params = {}, luna::request_headers headers = {})
+{
+    return make_request_(luna::request_method::GET, std::move(path), std::move(params), std::move(headers));
+}
+
+// keeps requests in flight until it's opened
+class gate
+{
+public:
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock{mutex_};
+        ++waiting_;
+        changed_.notify_all();
+        changed_.wait(lock, [this]
+        { return open_; });
+    }
+
+    void wait_for_waiters(int count)
+    {
+        std::unique_lock<std::mutex> lock{mutex_};
+        changed_.wait(lock, [this, count]
+        { return waiting_ >= count; });
+    }
+
+    void open()
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        open_ = true;
+        changed_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    int waiting_{0};
+    bool open_{false};
+};
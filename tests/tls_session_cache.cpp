@@ -0,0 +1,82 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+#include <gtest/gtest.h>
+#include "luna/private/tls_session_cache.h"
+#include <thread>
+
+TEST(tls_session_cache, stores_and_removes)
+{
+    luna::tls_session_cache cache{64, std::chrono::hours{1}};
+    ASSERT_FALSE(cache.fetch("one"));
+
+    cache.store("one", "first");
+    cache.store("two", "second");
+    ASSERT_EQ(std::string{"first"}, *cache.fetch("one"));
+    ASSERT_EQ(std::string{"second"}, *cache.fetch("two"));
+
+    cache.store("one", "again");
+    ASSERT_EQ(std::string{"again"}, *cache.fetch("one"));
+    ASSERT_EQ(2, cache.size());
+
+    ASSERT_TRUE(cache.remove("one"));
+    ASSERT_FALSE(cache.remove("one"));
+    ASSERT_FALSE(cache.fetch("one"));
+    ASSERT_EQ(1, cache.size());
+}
+
+TEST(tls_session_cache, bounded)
+{
+    luna::tls_session_cache cache{160, std::chrono::hours{1}};
+    for (int i = 0; i < 10000; ++i)
+    {
+        cache.store(std::to_string(i), "session");
+    }
+    ASSERT_LE(cache.size(), 160);
+
+    // the most recent ones are still there
+    ASSERT_TRUE(cache.fetch("9999"));
+
+    luna::tls_session_cache none{0, std::chrono::hours{1}};
+    none.store("one", "first");
+    ASSERT_FALSE(none.fetch("one"));
+}
+
+TEST(tls_session_cache, drops_least_recently_used)
+{
+    // two sessions to a shard
+    luna::tls_session_cache cache{32, std::chrono::hours{1}};
+    cache.store("one", "first");
+    for (int i = 0; i < 1000; ++i)
+    {
+        cache.store(std::to_string(i), "session");
+        ASSERT_TRUE(cache.fetch("one"));
+    }
+    for (int i = 1000; i < 2000; ++i)
+    {
+        cache.store(std::to_string(i), "session");
+    }
+    ASSERT_FALSE(cache.fetch("one"));
+    ASSERT_EQ(32, cache.size());
+}
+
+TEST(tls_session_cache, expires)
+{
+    luna::tls_session_cache cache{64, std::chrono::seconds{1}};
+    cache.store("one", "first");
+    ASSERT_TRUE(cache.fetch("one"));
+    std::this_thread::sleep_for(std::chrono::milliseconds{1100});
+    ASSERT_FALSE(cache.fetch("one"));
+    ASSERT_EQ(0, cache.size());
+}
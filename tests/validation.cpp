@@ -65,6 +65,68 @@ TEST(validation, regex_match)
     ASSERT_FALSE(v("value"));
 }
 
+TEST(validation, integer_match)
+{
+    luna::parameter::value parsed;
+    auto v = luna::parameter::integer();
+    ASSERT_TRUE(v("0", parsed));
+    ASSERT_EQ(0, parsed.integer);
+    ASSERT_TRUE(v("-42", parsed));
+    ASSERT_EQ(-42, parsed.integer);
+    ASSERT_TRUE(v("+42", parsed));
+    ASSERT_EQ(42, parsed.integer);
+    ASSERT_TRUE(v("9223372036854775807", parsed));
+    ASSERT_EQ(INT64_MAX, parsed.integer);
+    ASSERT_TRUE(v("-9223372036854775808", parsed));
+    ASSERT_EQ(INT64_MIN, parsed.integer);
+
+    ASSERT_FALSE(v("", parsed));
+    ASSERT_FALSE(v("-", parsed));
+    ASSERT_FALSE(v("0.4", parsed));
+    ASSERT_FALSE(v("0n", parsed));
+    ASSERT_FALSE(v("9223372036854775808", parsed));
+    ASSERT_FALSE(v("-9223372036854775809", parsed));
+
+    auto ranged = luna::parameter::integer(1, 10);
+    ASSERT_TRUE(ranged("1", parsed));
+    ASSERT_TRUE(ranged("10", parsed));
+    ASSERT_FALSE(ranged("0", parsed));
+    ASSERT_FALSE(ranged("11", parsed));
+}
+
+TEST(validation, one_of_match)
+{
+    luna::parameter::value parsed;
+    auto v = luna::parameter::one_of({"red", "green", "blue"});
+    ASSERT_TRUE(v("green", parsed));
+    ASSERT_EQ(1, parsed.index);
+    ASSERT_FALSE(v("Green", parsed));
+    ASSERT_FALSE(v("", parsed));
+}
+
+TEST(validation, uuid_match)
+{
+    luna::parameter::value parsed;
+    auto v = luna::parameter::uuid();
+    ASSERT_TRUE(v("123e4567-e89b-12d3-a456-426655440000", parsed));
+    ASSERT_EQ(0x12, parsed.uuid[0]);
+    ASSERT_EQ(0x00, parsed.uuid[15]);
+    ASSERT_TRUE(v("123E4567-E89B-12D3-A456-426655440000", parsed));
+
+    ASSERT_FALSE(v("123e4567e89b12d3a456426655440000", parsed));
+    ASSERT_FALSE(v("123e4567-e89b-12d3-a456-42665544000g", parsed));
+    ASSERT_FALSE(v("123e4567-e89b-12d3-a456-4266554400000", parsed));
+}
+
+TEST(validation, length_match)
+{
+    auto v = luna::parameter::length(2, 4);
+    ASSERT_TRUE(v("ab"));
+    ASSERT_TRUE(v("abcd"));
+    ASSERT_FALSE(v("a"));
+    ASSERT_FALSE(v("abcde"));
+}
+
 TEST(validation, basic_validation_pass)
 {
     luna::parameter::validators validators = {
@@ -280,3 +342,44 @@ TEST(validation, custom_validation_fail)
     auto res = cpr::Get(cpr::Url{"http://localhost:8080/test"}, cpr::Parameters{{"key", "01234567890"}});
     ASSERT_EQ(400, res.status_code);
 }
+
+TEST(validation, typed_validation_pass)
+{
+    luna::server server;
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET,
+                          "/test",
+                          [](auto req) -> luna::response
+                          {
+                              return {std::to_string(req.parsed_params.at("key").integer * 2)};
+                          },
+                          {
+                                  {"key", luna::parameter::required, luna::parameter::integer(0, 100)}
+                          });
+
+    server.start_async();
+
+    auto res = cpr::Get(cpr::Url{"http://localhost:8080/test"}, cpr::Parameters{{"key", "21"}});
+    ASSERT_EQ(200, res.status_code);
+    ASSERT_EQ("42", res.text);
+}
+
+TEST(validation, typed_validation_fail)
+{
+    luna::server server;
+    auto router = server.create_router("/");
+    router->handle_request(luna::request_method::GET,
+                          "/test",
+                          [](auto req) -> luna::response
+                          {
+                              return {"hello"};
+                          },
+                          {
+                                  {"key", luna::parameter::required, luna::parameter::integer(0, 100)}
+                          });
+
+    server.start_async();
+
+    auto res = cpr::Get(cpr::Url{"http://localhost:8080/test"}, cpr::Parameters{{"key", "101"}});
+    ASSERT_EQ(400, res.status_code);
+}
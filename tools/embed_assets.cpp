@@ -0,0 +1,385 @@
+//
+//      _
+//  ___/_)
+// (, /      ,_   _
+//   /   (_(_/ (_(_(_
+// CX________________
+//                   )
+//
+// Luna
+// A web application and API framework in modern C++
+//
+// Copyright © 2016–2018 D.E. Goodman-Wilson
+//
+
+// Compiles a directory into a C++ translation unit, for router::serve_embedded(). Run by the luna_embed_assets() CMake
+// function, as
+//
+//     luna_embed_assets <name> <directory> <output.cpp> <output.h>
+//
+// which defines luna::embedded::<name> in output.cpp, and declares it in output.h.
+
+#include <luna/embedded_assets.h>
+#include <luna/private/file_helpers.h>
+#include <luna/private/mime_registry.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// how hard to look for a seed that puts a bucket's paths in free slots before giving up
+static const uint32_t max_seed_{1u << 24};
+
+// symbolic links can make a tree as deep as you like
+static const unsigned int max_depth_{32};
+
+static std::string read_file_(const std::string &path)
+{
+    std::ifstream in{path, std::ios::binary};
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    if (!in)
+    {
+        throw std::runtime_error{"Can't read " + path};
+    }
+    return contents.str();
+}
+
+static void read_directory_(const std::string &directory,
+                            const std::string &relative,
+                            std::map<std::string, std::string> &files,
+                            unsigned int depth)
+{
+    if (depth >= max_depth_)
+    {
+        throw std::runtime_error{directory + " is nested too deeply"};
+    }
+
+    auto dir = opendir(directory.c_str());
+    if (dir == nullptr)
+    {
+        throw std::runtime_error{"Can't read " + directory + ": " + std::strerror(errno)};
+    }
+    std::vector<std::string> names;
+    while (auto entry = readdir(dir))
+    {
+        std::string name{entry->d_name};
+        if (name != "." && name != "..")
+        {
+            names.emplace_back(std::move(name));
+        }
+    }
+    closedir(dir);
+
+    for (const auto &name : names)
+    {
+        auto path = directory + "/" + name;
+        auto key = relative.empty() ? name : relative + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+        {
+            continue; // a dangling link
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            read_directory_(path, key, files, depth + 1);
+        }
+        else if (S_ISREG(st.st_mode))
+        {
+            files[key] = read_file_(path);
+        }
+    }
+}
+
+static std::string etag_for_(const std::string &contents)
+{
+    uint64_t hash{0xcbf29ce484222325ull};
+    for (auto c : contents)
+    {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+    }
+    char etag[32];
+    std::snprintf(etag, sizeof(etag), "\"%016llx-%zx\"", static_cast<unsigned long long>(hash), contents.size());
+    return etag;
+}
+
+static std::string quoted_(const std::string &value)
+{
+    std::string quoted{"\""};
+    for (auto c : value)
+    {
+        if (c == '"' || c == '\\')
+        {
+            quoted.push_back('\\');
+        }
+        quoted.push_back(c);
+    }
+    return quoted + "\"";
+}
+
+// Hash and displace: paths are put in buckets by one hash, and then, biggest bucket first, each bucket gets a seed for
+// a second hash that puts all of its paths in free slots. Buckets of one go straight into a free slot.
+static std::vector<int32_t> perfect_hash_(const std::vector<std::string> &keys, std::vector<size_t> &slots)
+{
+    auto count = keys.size();
+    std::vector<std::vector<size_t>> buckets(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        buckets[luna::embedded_assets_hash(keys[i].data(), keys[i].size(), 0) % count].emplace_back(i);
+    }
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&buckets](size_t a, size_t b)
+    {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    std::vector<int32_t> displacements(count, 0);
+    std::vector<bool> taken(count, false);
+    slots.assign(count, 0);
+    size_t free_slot{0};
+    for (auto bucket : order)
+    {
+        const auto &members = buckets[bucket];
+        if (members.empty())
+        {
+            break;
+        }
+        if (members.size() == 1)
+        {
+            while (taken[free_slot])
+            {
+                ++free_slot;
+            }
+            taken[free_slot] = true;
+            slots[members[0]] = free_slot;
+            displacements[bucket] = -static_cast<int32_t>(free_slot) - 1;
+            continue;
+        }
+
+        uint32_t seed{1};
+        std::vector<size_t> placed;
+        for (; seed < max_seed_; ++seed)
+        {
+            placed.clear();
+            for (auto member : members)
+            {
+                auto slot = luna::embedded_assets_hash(keys[member].data(), keys[member].size(), seed) % count;
+                if (taken[slot] || std::find(placed.begin(), placed.end(), slot) != placed.end())
+                {
+                    break;
+                }
+                placed.emplace_back(slot);
+            }
+            if (placed.size() == members.size())
+            {
+                break;
+            }
+        }
+        if (seed == max_seed_)
+        {
+            throw std::runtime_error{"Couldn't find a perfect hash for these paths"};
+        }
+        for (size_t i = 0; i < members.size(); ++i)
+        {
+            taken[placed[i]] = true;
+            slots[members[i]] = placed[i];
+        }
+        displacements[bucket] = static_cast<int32_t>(seed);
+    }
+    return displacements;
+}
+
+static void write_bytes_(std::ostream &out, const std::string &name, const std::string &contents)
+{
+    out << "constexpr unsigned char " << name << "[] = {";
+    for (size_t i = 0; i < contents.size(); ++i)
+    {
+        out << (i % 16 == 0 ? "\n        " : " ") << static_cast<unsigned int>(static_cast<unsigned char>(contents[i]))
+            << ",";
+    }
+    out << "\n};\n\n";
+}
+
+static void write_header_(const std::string &name, const std::string &path)
+{
+    std::ofstream out{path};
+    out << "// Generated by luna_embed_assets. Do not edit.\n\n"
+        << "#pragma once\n\n"
+        << "#include <luna/embedded_assets.h>\n\n"
+        << "namespace luna\n{\nnamespace embedded\n{\n\n"
+        << "extern const ::luna::embedded_assets " << name << ";\n\n"
+        << "} //namespace embedded\n} //namespace luna\n";
+    if (!out)
+    {
+        throw std::runtime_error{"Can't write " + path};
+    }
+}
+
+static void write_source_(const std::string &name,
+                          const std::string &header,
+                          const std::map<std::string, std::string> &files,
+                          const std::string &path)
+{
+    // compressed variants go with their originals, where there are originals
+    struct entry
+    {
+        std::string key;
+        std::string source; // the file it's served from
+    };
+    std::vector<entry> entries;
+    for (const auto &file : files)
+    {
+        auto is_variant = [&files](const std::string &key, const std::string &extension)
+        {
+            return key.size() > extension.size() &&
+                   key.compare(key.size() - extension.size(), extension.size(), extension) == 0 &&
+                   files.count(key.substr(0, key.size() - extension.size()));
+        };
+        if (!is_variant(file.first, ".gz") && !is_variant(file.first, ".br"))
+        {
+            entries.push_back({file.first, file.first});
+        }
+    }
+
+    // and directories are served as their index files
+    std::vector<std::string> directories{""};
+    for (const auto &file : files)
+    {
+        for (auto slash = file.first.find('/'); slash != std::string::npos; slash = file.first.find('/', slash + 1))
+        {
+            directories.emplace_back(file.first.substr(0, slash));
+        }
+    }
+    std::sort(directories.begin(), directories.end());
+    directories.erase(std::unique(directories.begin(), directories.end()), directories.end());
+    for (const auto &directory : directories)
+    {
+        for (const auto &index : luna::index_filenames)
+        {
+            auto key = directory.empty() ? index : directory + "/" + index;
+            if (files.count(key))
+            {
+                entries.push_back({directory, key});
+                break;
+            }
+        }
+    }
+
+    std::vector<std::string> keys;
+    for (const auto &entry : entries)
+    {
+        keys.emplace_back(entry.key);
+    }
+    std::vector<size_t> slots;
+    auto displacements = perfect_hash_(keys, slots);
+
+    luna::mime_registry mime_types;
+    std::ofstream out{path};
+    out << "// Generated by luna_embed_assets. Do not edit.\n\n"
+        << "#include \"" << header << "\"\n\n"
+        << "namespace\n{\n\n";
+
+    // each file's bytes, once
+    std::map<std::string, std::string> data; // path to the name of its bytes
+    for (const auto &file : files)
+    {
+        if (!file.second.empty())
+        {
+            auto bytes = "data_" + std::to_string(data.size()) + "_";
+            write_bytes_(out, bytes, file.second);
+            data[file.first] = bytes;
+        }
+    }
+    auto bytes_for = [&data](const std::string &key)
+    {
+        auto found = data.find(key);
+        return found == data.end() ? std::string{"nullptr"} : found->second;
+    };
+    auto size_for = [&files](const std::string &key)
+    {
+        auto found = files.find(key);
+        return found == files.end() ? std::string{"0"} : std::to_string(found->second.size());
+    };
+
+    std::vector<const entry *> by_slot(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        by_slot[slots[i]] = &entries[i];
+    }
+
+    out << "constexpr ::luna::embedded_asset assets_[] = {\n";
+    for (const auto entry : by_slot)
+    {
+        const auto &source = entry->source;
+        out << "        {" << quoted_(entry->key) << ", "
+            << bytes_for(source) << ", " << size_for(source) << ", "
+            << quoted_(mime_types.type_for(source)) << ", "
+            << quoted_(etag_for_(files.at(source))) << ", "
+            << bytes_for(source + ".gz") << ", " << size_for(source + ".gz") << ", "
+            << bytes_for(source + ".br") << ", " << size_for(source + ".br") << "},\n";
+    }
+    if (entries.empty())
+    {
+        out << "        {\"\", nullptr, 0, \"\", \"\", nullptr, 0, nullptr, 0},\n"; // no empty arrays
+    }
+    out << "};\n\n";
+
+    out << "constexpr int32_t displacements_[] = {";
+    for (size_t i = 0; i < displacements.size(); ++i)
+    {
+        out << (i % 16 == 0 ? "\n        " : " ") << displacements[i] << ",";
+    }
+    if (displacements.empty())
+    {
+        out << "0";
+    }
+    out << "\n};\n\n"
+        << "} //namespace\n\n"
+        << "namespace luna\n{\nnamespace embedded\n{\n\n"
+        << "constexpr ::luna::embedded_assets " << name << "{assets_, displacements_, " << entries.size() << "};\n\n"
+        << "} //namespace embedded\n} //namespace luna\n";
+    if (!out)
+    {
+        throw std::runtime_error{"Can't write " + path};
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 5)
+    {
+        std::cerr << "Usage: " << argv[0] << " <name> <directory> <output.cpp> <output.h>" << std::endl;
+        return 1;
+    }
+    std::string name{argv[1]};
+    std::string directory{argv[2]};
+    std::string source{argv[3]};
+    std::string header{argv[4]};
+
+    try
+    {
+        std::map<std::string, std::string> files;
+        read_directory_(directory, "", files, 0);
+        write_header_(name, header);
+        write_source_(name, header.substr(header.rfind('/') + 1), files, source);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}